@@ -0,0 +1,140 @@
+//file: Algorithm.h
+#ifndef ALGORITHM_H
+#define ALGORITHM_H
+
+#include<algorithm>
+#include<thread>
+#include<cstddef>
+
+namespace TKF {
+
+//smallest piece of work worth handing to another thread
+static constexpr ptrdiff_t parallel_grain = 1 << 15;
+static constexpr unsigned parallel_max_threads = 64;
+//caches move memory between cores in lines of this size, so data that
+//different threads write is kept this far apart
+static constexpr size_t cache_line_size = 64;
+
+//asks for the cache line at p ahead of a read; a no-op without the builtin
+inline void prefetch(void const* p) noexcept {
+#if defined(__GNUC__)
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
+//index of the highest set bit, x > 0
+inline unsigned floor_log2(unsigned long long x) noexcept {
+#if defined(__GNUC__)
+    return 63u - (unsigned)__builtin_clzll(x);
+#else
+    unsigned n = 0;
+    while (x >>= 1) {
+        ++n;
+    }
+    return n;
+#endif
+}
+
+//index of the lowest set bit, x > 0
+inline unsigned count_trailing_zeros(unsigned long long x) noexcept {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+inline unsigned parallel_threads() {
+    unsigned n = std::thread::hardware_concurrency();
+    if (n == 0) {
+        n = 1;
+    }
+    return n < parallel_max_threads ? n : parallel_max_threads;
+}
+
+//fork-join: runs f here and g on a new thread when fork is set
+template <typename F, typename G>
+void parallel_invoke(F const& f, G const& g, bool fork) {
+    if (!fork) {
+        f();
+        g();
+        return;
+    }
+    std::thread worker(g);
+    try {
+        f();
+    }
+    catch (...) {
+        worker.join();
+        throw;
+    }
+    worker.join();
+}
+
+//how many levels of a binary fork-join keep every core busy
+inline unsigned parallel_depth() {
+    unsigned threads = parallel_threads();
+    unsigned depth = 0;
+    while (threads > 1 && (1u << depth) < threads * 4) {
+        ++depth;
+    }
+    return depth;
+}
+
+//stable sort: equal elements keep their input order.
+//Splits into one block per core, sorts the blocks concurrently and
+//merges them pairwise, each round of merges running concurrently too.
+template <typename RANDOMITER, typename LESS>
+void parallel_sort(RANDOMITER first, RANDOMITER last, LESS less) {
+    ptrdiff_t n = last - first;
+    unsigned hw = parallel_threads();
+    unsigned parts = 1;
+    while (parts * 2 <= hw && n / (parts * 2) >= parallel_grain) {
+        parts *= 2;
+    }
+    if (parts == 1) {
+        std::stable_sort(first, last, less);
+        return;
+    }
+
+    RANDOMITER bound[parallel_max_threads + 1];
+    for (unsigned i = 0; i <= parts; ++i) {
+        bound[i] = first + n * i / parts;
+    }
+
+    std::thread workers[parallel_max_threads];
+    for (unsigned i = 0; i < parts; ++i) {
+        RANDOMITER lo = bound[i], hi = bound[i + 1];
+        workers[i] = std::thread([lo, hi, &less]() {
+            std::stable_sort(lo, hi, less);
+        });
+    }
+    for (unsigned i = 0; i < parts; ++i) {
+        workers[i].join();
+    }
+
+    for (unsigned width = 1; width < parts; width *= 2) {
+        unsigned k = 0;
+        for (unsigned i = 0; i < parts; i += 2 * width) {
+            RANDOMITER lo = bound[i], mid = bound[i + width];
+            RANDOMITER hi = bound[i + 2 * width];
+            workers[k++] = std::thread([lo, mid, hi, &less]() {
+                std::inplace_merge(lo, mid, hi, less);
+            });
+        }
+        for (unsigned i = 0; i < k; ++i) {
+            workers[i].join();
+        }
+    }
+}
+
+}
+
+#endif //!ALGORITHM_H
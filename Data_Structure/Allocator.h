@@ -7,6 +7,7 @@
 #include<cstdlib>
 #include<cstddef>
 #include<climits>
+#include<atomic>
 #include<iostream>
 #include"Type_Traits.h"
 
@@ -46,7 +47,9 @@ inline void _destroy(T* ptr) {
     ptr->~T();
 }
 
-void THROW_OUT_OF_RANGE_IF(bool judge, std::string sentence) {
+//the message stays a plain string until it is needed, so that checking
+//costs nothing on the hot paths
+inline void THROW_OUT_OF_RANGE_IF(bool judge, const char* sentence) {
     if(!judge) return;
     std::cerr << sentence;
     exit(1);
@@ -80,13 +83,356 @@ public:
         _construct(p, TKF::forward<Args>(args)...);
     }
 
-    static void deallocate(pointer p) {
+    static void deallocate(pointer p, size_type = 1) {
         _deallocate(p);
     }
 
     static void destroy(pointer p) {
         _destroy(p);
     }
+
+    //nothing is cached, so there is nothing to give back or take over
+    static void release() {}
+
+    static void absorb(allocator&, bool = false) {}
+
+    template <typename U>
+    struct rebind {
+        typedef allocator<U> other;
+    };
+};
+
+//pool_allocator: hands out single objects from fixed-size chunks.
+//Freed slots go to an intrusive freelist and are reused first; release()
+//recycles every chunk at once when the owner knows all objects are dead.
+//The chunks live in an arena shared by copies of the allocator, and
+//absorb() takes over another arena so objects can move between owners.
+//Only the reference counts are atomic: allocators sharing an arena may
+//be destroyed on different threads, but not allocate or free at once.
+template <typename T, size_t CHUNK = 65536>
+class pool_allocator {
+public:
+    typedef T           value_type;
+    typedef T*          pointer;
+    typedef const T*    const_pointer;
+    typedef T&          reference;
+    typedef const T&    const_reference;
+    typedef size_t      size_type;
+    typedef ptrdiff_t   difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef pool_allocator<U, CHUNK> other;
+    };
+
+private:
+    union _slot {
+        _slot* next;
+        alignas(T) unsigned char data[sizeof(T)];
+    };
+
+    struct _chunk {
+        _chunk* next;
+    };
+
+    struct _arena;
+
+    struct _hold {
+        _arena* arena;
+        _hold*  next;
+    };
+
+    struct _arena {
+        std::atomic<size_type> refs;
+        _slot*  free;   //freelist of returned slots
+        _slot*  cur;    //bump pointer inside the newest chunk
+        _slot*  last;   //end of the newest chunk
+        _chunk* used;   //chunks currently carved up
+        _chunk* spare;  //recycled chunks waiting for reuse
+        _hold*  held;   //shared arenas whose objects we adopted
+    };
+
+    static constexpr size_type _header = 
+        (sizeof(_chunk) + alignof(_slot) - 1) / alignof(_slot) * alignof(_slot);
+    static constexpr size_type _slots_per_chunk =
+        CHUNK > _header + sizeof(_slot) ? (CHUNK - _header) / sizeof(_slot) : 1;
+
+    _arena* _a;
+
+    template <typename U, size_t N> friend class pool_allocator;
+
+public:
+    pool_allocator() : _a(_new_arena()) {}
+
+    pool_allocator(pool_allocator const& rhs) noexcept : _a(rhs._a) {
+        if (_a != nullptr) {
+            _a->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    //a different slot size cannot share chunks
+    template <typename U>
+    pool_allocator(pool_allocator<U, CHUNK> const&) : _a(_new_arena()) {}
+
+    pool_allocator(pool_allocator&& rhs) noexcept : _a(rhs._a) {
+        rhs._a = nullptr;
+    }
+
+    pool_allocator& operator = (pool_allocator const& rhs) noexcept {
+        if (_a != rhs._a) {
+            _drop(_a);
+            _a = rhs._a;
+            if (_a != nullptr) {
+                _a->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        return *this;
+    }
+
+    pool_allocator& operator = (pool_allocator&& rhs) noexcept {
+        if (this != &rhs) {
+            _drop(_a);
+            _a = rhs._a;
+            rhs._a = nullptr;
+        }
+        return *this;
+    }
+
+    ~pool_allocator() {
+        _drop(_a);
+    }
+
+    friend bool operator == (pool_allocator const& lhs, pool_allocator const& rhs) {
+        return lhs._a == rhs._a;
+    }
+
+    friend bool operator != (pool_allocator const& lhs, pool_allocator const& rhs) {
+        return lhs._a != rhs._a;
+    }
+
+    pointer allocate(size_type N) {
+        if (N != 1) {
+            return _allocate((difference_type)N, (pointer)0);
+        }
+        if (_a == nullptr) {
+            _a = _new_arena();
+        }
+        if (_a->free != nullptr) {
+            _slot* slot = _a->free;
+            _a->free = slot->next;
+            return reinterpret_cast<pointer>(slot);
+        }
+        if (_a->cur == _a->last) {
+            _grow();
+        }
+        return reinterpret_cast<pointer>(_a->cur++);
+    }
+
+    void deallocate(pointer p, size_type N = 1) {
+        if (p == nullptr) {
+            return;
+        }
+        if (N != 1) {
+            _deallocate(p);
+            return;
+        }
+        _slot* slot = reinterpret_cast<_slot*>(p);
+        slot->next = _a->free;
+        _a->free = slot;
+    }
+
+    static void construct (pointer p) {
+        _construct(p);
+    }
+
+    static void construct(pointer p, T const& value) {
+        _construct(p, value);
+    }
+    
+    template <typename ...Args>
+    static void construct(pointer p, Args&&... args) {
+        _construct(p, TKF::forward<Args>(args)...);
+    }
+
+    static void destroy(pointer p) {
+        _destroy(p);
+    }
+
+    //every object handed out must already be dead: all chunks become
+    //spare and are carved up again from the start.
+    //A no-op while the arena is shared with another allocator.
+    void release() noexcept {
+        if (_a == nullptr || _a->refs.load(std::memory_order_acquire) != 1) {
+            return;
+        }
+        while (_a->used != nullptr) {
+            _chunk* next = _a->used->next;
+            _a->used->next = _a->spare;
+            _a->spare = _a->used;
+            _a->used = next;
+        }
+        _a->free = _a->cur = _a->last = nullptr;
+    }
+
+    //give spare chunks back to the system
+    void shrink() noexcept {
+        if (_a != nullptr) {
+            _free_chunks(_a->spare);
+            _a->spare = nullptr;
+        }
+    }
+
+    //take over everything rhs has handed out, so those objects may be
+    //deallocated through *this from now on. Unless rest says rhs still
+    //owns some of them, rhs must be done with every object it handed out:
+    //an arena nobody else uses is then spliced in, chunks, freelist and
+    //holds, and rhs starts over empty. An arena that is shared, or whose
+    //objects rhs keeps using, is only kept alive for as long as ours lives.
+    void absorb(pool_allocator& rhs, bool rest = false) {
+        if (rhs._a == nullptr || rhs._a == _a) {
+            return;
+        }
+        if (_a == nullptr) {
+            _a = _new_arena();
+        }
+        _arena* from = rhs._a;
+        if (from->refs.load(std::memory_order_acquire) == 1 && !rest) {
+            _splice(from->used, _a->used);
+            _splice(from->spare, _a->spare);
+            _hold* h = from->held;
+            while (h != nullptr) {
+                _hold* next = h->next;
+                _keep(h->arena);
+                _drop(h->arena);
+                ::operator delete(h);
+                h = next;
+            }
+            //the unused tail of from's bump chunk is simply abandoned
+            _slot* f = from->free;
+            while (f != nullptr) {
+                _slot* next = f->next;
+                f->next = _a->free;
+                _a->free = f;
+                f = next;
+            }
+            from->free = from->cur = from->last = nullptr;
+            from->used = from->spare = nullptr;
+            from->held = nullptr;
+        }
+        else {
+            _keep(from);
+        }
+    }
+
+private:
+    static _arena* _new_arena() {
+        _arena* a = new _arena;
+        a->refs.store(1, std::memory_order_relaxed);
+        a->free = a->cur = a->last = nullptr;
+        a->used = a->spare = nullptr;
+        a->held = nullptr;
+        return a;
+    }
+
+    static void _drop(_arena* a) noexcept {
+        if (a == nullptr || a->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        _free_chunks(a->used);
+        _free_chunks(a->spare);
+        _hold* h = a->held;
+        while (h != nullptr) {
+            _hold* next = h->next;
+            _drop(h->arena);
+            ::operator delete(h);
+            h = next;
+        }
+        delete a;
+    }
+
+    //makes our arena keep the chunks of a alive. Holds never form a
+    //cycle, which reference counts could not free: when a already keeps
+    //us alive, its chunks move over to us instead, and so on down the
+    //arenas a holds. Owners trading objects back and forth end up with a
+    //single hold between them.
+    void _keep(_arena* a) {
+        if (a == _a || _holds(a)) {
+            return;
+        }
+        if (_reaches(a, _a)) {
+            _splice(a->used, _a->used);
+            _splice(a->spare, _a->spare);
+            a->used = a->spare = nullptr;
+            for (_hold* h = a->held; h != nullptr; h = h->next) {
+                _keep(h->arena);
+            }
+            return;
+        }
+        _hold* h = static_cast<_hold*>(::operator new(sizeof(_hold)));
+        h->arena = a;
+        h->next = _a->held;
+        _a->held = h;
+        a->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool _holds(_arena* a) const noexcept {
+        for (_hold* h = _a->held; h != nullptr; h = h->next) {
+            if (h->arena == a) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //whether a keeps b alive through its holds
+    static bool _reaches(_arena* a, _arena* b) noexcept {
+        for (_hold* h = a->held; h != nullptr; h = h->next) {
+            if (h->arena == b || _reaches(h->arena, b)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static _slot* _slots(_chunk* chunk) noexcept {
+        return reinterpret_cast<_slot*>(
+            reinterpret_cast<unsigned char*>(chunk) + _header);
+    }
+
+    static void _splice(_chunk* from, _chunk*& to) noexcept {
+        if (from == nullptr) {
+            return;
+        }
+        _chunk* tail = from;
+        while (tail->next != nullptr) {
+            tail = tail->next;
+        }
+        tail->next = to;
+        to = from;
+    }
+
+    void _grow() {
+        _chunk* chunk = _a->spare;
+        if (chunk != nullptr) {
+            _a->spare = chunk->next;
+        }
+        else {
+            chunk = static_cast<_chunk*>(
+                ::operator new(_header + _slots_per_chunk * sizeof(_slot)));
+        }
+        chunk->next = _a->used;
+        _a->used = chunk;
+        _a->cur = _slots(chunk);
+        _a->last = _a->cur + _slots_per_chunk;
+    }
+
+    static void _free_chunks(_chunk* chunk) noexcept {
+        while (chunk != nullptr) {
+            _chunk* next = chunk->next;
+            ::operator delete(chunk);
+            chunk = next;
+        }
+    }
 };
 
 }
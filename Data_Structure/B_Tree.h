@@ -0,0 +1,1221 @@
+//file: B_Tree.h
+#ifndef B_TREE_H
+#define B_TREE_H
+
+#include<new>
+#include<cstddef>
+#include<climits>
+#include"Iterator.h"
+#include"Allocator.h"
+#include"Type_Traits.h"
+#include"Utility.h"
+#include"RB_Tree.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TKF_BTREE_SSE2 1
+#include<emmintrin.h>
+#endif
+#if defined(__SSE4_2__)
+#define TKF_BTREE_SSE42 1
+#include<nmmintrin.h>
+#endif
+
+namespace TKF {
+
+//B+ tree: values live in the leaves, which are chained for iteration;
+//internal nodes hold only separator keys and child pointers.
+//Every key of child i is not greater than keys[i], and keys[i] is not
+//greater than any key of child i + 1.
+//Inserting or erasing moves values inside their leaf, so unlike RBT
+//it invalidates iterators.
+
+//byte budgets of a node's values (leaf) and keys (internal)
+static constexpr size_t BTree_leaf_bytes = 512;
+static constexpr size_t BTree_internal_bytes = 256;
+
+constexpr size_t BTree_slots(size_t bytes, size_t size) {
+    return bytes / size < 4 ? 4 : (bytes / size > 64 ? 64 : bytes / size);
+}
+
+inline unsigned BTree_popcount(unsigned mask) {
+#if defined(__GNUC__)
+    return __builtin_popcount(mask);
+#else
+    unsigned n = 0;
+    for (; mask != 0; mask &= mask - 1) {
+        ++n;
+    }
+    return n;
+#endif
+}
+
+//SIMD lanes over a sorted key array: less() and less_equal() return a
+//bit per lane for keys[i] < key and keys[i] <= key
+template <typename KEY, size_t SIZE = sizeof(KEY)>
+struct BTree_lanes {
+    static constexpr bool value = false;
+};
+
+#ifdef TKF_BTREE_SSE2
+template <size_t SIZE, bool SIGNED>
+struct BTree_int_lanes {
+    static constexpr bool value = false;
+};
+
+template <bool SIGNED>
+struct BTree_int_lanes<4, SIGNED> {
+    static constexpr bool value = true;
+    static constexpr unsigned width = 4;
+    static constexpr unsigned full = 0xF;
+
+    static __m128i _bias(__m128i x) {
+        return SIGNED ? x : _mm_xor_si128(x, _mm_set1_epi32(INT_MIN));
+    }
+
+    template <typename KEY>
+    static __m128i _load(KEY const* keys) {
+        return _bias(_mm_loadu_si128(reinterpret_cast<__m128i const*>(keys)));
+    }
+
+    template <typename KEY>
+    static unsigned less(KEY const* keys, KEY key) {
+        __m128i k = _bias(_mm_set1_epi32(static_cast<int>(key)));
+        return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(_load(keys), k)));
+    }
+
+    template <typename KEY>
+    static unsigned less_equal(KEY const* keys, KEY key) {
+        __m128i k = _bias(_mm_set1_epi32(static_cast<int>(key)));
+        return full & ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_load(keys), k)));
+    }
+};
+
+#ifdef TKF_BTREE_SSE42
+template <bool SIGNED>
+struct BTree_int_lanes<8, SIGNED> {
+    static constexpr bool value = true;
+    static constexpr unsigned width = 2;
+    static constexpr unsigned full = 0x3;
+
+    static __m128i _bias(__m128i x) {
+        return SIGNED ? x : _mm_xor_si128(x, _mm_set1_epi64x(LLONG_MIN));
+    }
+
+    template <typename KEY>
+    static __m128i _load(KEY const* keys) {
+        return _bias(_mm_loadu_si128(reinterpret_cast<__m128i const*>(keys)));
+    }
+
+    template <typename KEY>
+    static unsigned less(KEY const* keys, KEY key) {
+        __m128i k = _bias(_mm_set1_epi64x(static_cast<long long>(key)));
+        return _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, _load(keys))));
+    }
+
+    template <typename KEY>
+    static unsigned less_equal(KEY const* keys, KEY key) {
+        __m128i k = _bias(_mm_set1_epi64x(static_cast<long long>(key)));
+        return full & ~_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(_load(keys), k)));
+    }
+};
+#endif
+
+template <size_t SIZE> struct BTree_lanes<int, SIZE> : BTree_int_lanes<SIZE, true> {};
+template <size_t SIZE> struct BTree_lanes<long, SIZE> : BTree_int_lanes<SIZE, true> {};
+template <size_t SIZE> struct BTree_lanes<long long, SIZE> : BTree_int_lanes<SIZE, true> {};
+template <size_t SIZE> struct BTree_lanes<unsigned int, SIZE> : BTree_int_lanes<SIZE, false> {};
+template <size_t SIZE> struct BTree_lanes<unsigned long, SIZE> : BTree_int_lanes<SIZE, false> {};
+template <size_t SIZE> struct BTree_lanes<unsigned long long, SIZE> : BTree_int_lanes<SIZE, false> {};
+
+template <>
+struct BTree_lanes<float, 4> {
+    static constexpr bool value = true;
+    static constexpr unsigned width = 4;
+    static constexpr unsigned full = 0xF;
+
+    static unsigned less(float const* keys, float key) {
+        return _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(keys), _mm_set1_ps(key)));
+    }
+
+    static unsigned less_equal(float const* keys, float key) {
+        return _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(keys), _mm_set1_ps(key)));
+    }
+};
+
+template <>
+struct BTree_lanes<double, 8> {
+    static constexpr bool value = true;
+    static constexpr unsigned width = 2;
+    static constexpr unsigned full = 0x3;
+
+    static unsigned less(double const* keys, double key) {
+        return _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(keys), _mm_set1_pd(key)));
+    }
+
+    static unsigned less_equal(double const* keys, double key) {
+        return _mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(keys), _mm_set1_pd(key)));
+    }
+};
+#endif
+
+//intra-node search over n sorted keys.
+//lower: first i with key <= keys[i], upper: first i with key < keys[i].
+//The general form is a binary search through COMP; arithmetic keys under
+//TKF::less scan the node with SIMD compares, stopping at the first block
+//that is not entirely below key.
+template <typename KEY, typename COMP, bool = BTree_lanes<KEY>::value>
+struct BTree_search {
+    static constexpr bool vector = false;
+
+    //get(i) gives the i-th key
+    template <typename GET>
+    static unsigned lower_by(GET const& get, unsigned n, KEY const& key, COMP const& comp) {
+        unsigned first = 0;
+        while (n > 0) {
+            unsigned half = n / 2;
+            if (!comp(key, get(first + half))) {
+                first += half + 1;
+                n -= half + 1;
+            }
+            else {
+                n = half;
+            }
+        }
+        return first;
+    }
+
+    template <typename GET>
+    static unsigned upper_by(GET const& get, unsigned n, KEY const& key, COMP const& comp) {
+        unsigned first = 0;
+        while (n > 0) {
+            unsigned half = n / 2;
+            if (comp(get(first + half), key)) {
+                first += half + 1;
+                n -= half + 1;
+            }
+            else {
+                n = half;
+            }
+        }
+        return first;
+    }
+
+    static unsigned lower(KEY const* keys, unsigned n, KEY const& key, COMP const& comp) {
+        return lower_by([keys](unsigned i) -> KEY const& { return keys[i]; }, n, key, comp);
+    }
+
+    static unsigned upper(KEY const* keys, unsigned n, KEY const& key, COMP const& comp) {
+        return upper_by([keys](unsigned i) -> KEY const& { return keys[i]; }, n, key, comp);
+    }
+};
+
+template <typename KEY>
+struct BTree_search<KEY, TKF::less<KEY>, true> {
+    typedef BTree_lanes<KEY> lanes;
+    static constexpr bool vector = true;
+
+    static unsigned lower(KEY const* keys, unsigned n, KEY key, TKF::less<KEY> const&) {
+        unsigned i = 0;
+        for (; i + lanes::width <= n; i += lanes::width) {
+            unsigned mask = lanes::less(keys + i, key);
+            if (mask != lanes::full) {
+                return i + BTree_popcount(mask);
+            }
+        }
+        while (i < n && keys[i] < key) {
+            ++i;
+        }
+        return i;
+    }
+
+    static unsigned upper(KEY const* keys, unsigned n, KEY key, TKF::less<KEY> const&) {
+        unsigned i = 0;
+        for (; i + lanes::width <= n; i += lanes::width) {
+            unsigned mask = lanes::less_equal(keys + i, key);
+            if (mask != lanes::full) {
+                return i + BTree_popcount(mask);
+            }
+        }
+        while (i < n && keys[i] <= key) {
+            ++i;
+        }
+        return i;
+    }
+};
+
+template <typename T> struct BTree_internal;
+
+template <typename T>
+struct BTree_node_base {
+    BTree_internal<T>*  parent;
+    unsigned short      pos;    //index in parent->children
+    unsigned short      count;  //values of a leaf, keys of an internal node
+    bool                leaf;
+};
+
+//leaves keep a copy of their keys next to each other when the search
+//is vectorized, so a lookup never touches the values
+template <typename KEY, size_t N, bool MIRROR>
+struct BTree_leaf_keys {};
+
+template <typename KEY, size_t N>
+struct BTree_leaf_keys<KEY, N, true> {
+    KEY keys[N];
+};
+
+//one spare slot lets a full node take the new entry before it splits
+template <typename T, bool MIRROR>
+struct BTree_leaf : public BTree_node_base<T>,
+    public BTree_leaf_keys<typename RBT_value_traits<T>::key_type,
+        BTree_slots(BTree_leaf_bytes, sizeof(T)) + 1, MIRROR> {
+    static constexpr size_t capacity = BTree_slots(BTree_leaf_bytes, sizeof(T));
+
+    BTree_leaf* prev;
+    BTree_leaf* next;
+    alignas(T) unsigned char storage[sizeof(T) * (capacity + 1)];
+
+    T* values() {
+        return reinterpret_cast<T*>(storage);
+    }
+};
+
+template <typename T>
+struct BTree_internal : public BTree_node_base<T> {
+    typedef typename RBT_value_traits<T>::key_type key_type;
+    static constexpr size_t capacity = BTree_slots(BTree_internal_bytes, sizeof(key_type));
+
+    BTree_node_base<T>* children[capacity + 2];
+    alignas(key_type) unsigned char storage[sizeof(key_type) * (capacity + 1)];
+
+    key_type* keys() {
+        return reinterpret_cast<key_type*>(storage);
+    }
+};
+
+template <typename T, bool MIRROR>
+struct BTree_iterator : public TKF::iterator<TKF::_bidirectional_iterator, T> {
+    typedef T*                          pointer;
+    typedef T&                          reference;
+    typedef BTree_leaf<T, MIRROR>*      leaf_ptr;
+    typedef BTree_iterator<T, MIRROR>   self;
+
+    leaf_ptr leaf;
+    unsigned index;
+
+    BTree_iterator() : leaf(nullptr), index(0) {}
+    BTree_iterator(leaf_ptr x, unsigned i) : leaf(x), index(i) {
+        if (index == leaf->count && leaf->next != nullptr) {
+            leaf = leaf->next;
+            index = 0;
+        }
+    }
+
+    reference operator *() const {
+        return leaf->values()[index];
+    }
+
+    pointer operator ->() const {
+        return &(operator*());
+    }
+
+    self& operator ++ () {
+        if (++index == leaf->count && leaf->next != nullptr) {
+            leaf = leaf->next;
+            index = 0;
+        }
+        return *this;
+    }
+
+    self operator ++ (int) {
+        self tmp(*this);
+        ++*this;
+        return tmp;
+    }
+
+    self& operator -- () {
+        if (index == 0) {
+            leaf = leaf->prev;
+            index = leaf->count;
+        }
+        --index;
+        return *this;
+    }
+
+    self operator -- (int) {
+        self tmp(*this);
+        --*this;
+        return tmp;
+    }
+
+    //whole leaves are skipped at once
+    void advance(ptrdiff_t n) {
+        while (n > 0) {
+            unsigned left = leaf->count - index;
+            if (static_cast<size_t>(n) < left || leaf->next == nullptr) {
+                index += static_cast<unsigned>(n);
+                return;
+            }
+            n -= left;
+            leaf = leaf->next;
+            index = 0;
+        }
+        while (n < 0) {
+            if (static_cast<size_t>(-n) <= index) {
+                index -= static_cast<unsigned>(-n);
+                return;
+            }
+            n += index + 1;
+            leaf = leaf->prev;
+            index = leaf->count - 1;
+        }
+    }
+
+    self& operator += (ptrdiff_t n) {
+        advance(n);
+        return *this;
+    }
+
+    self operator + (ptrdiff_t n) const {
+        self tmp(*this);
+        tmp.advance(n);
+        return tmp;
+    }
+
+    self& operator -= (ptrdiff_t n) {
+        advance(-n);
+        return *this;
+    }
+
+    self operator - (ptrdiff_t n) const {
+        self tmp(*this);
+        tmp.advance(-n);
+        return tmp;
+    }
+
+    bool operator == (self const& rhs) const {
+        return leaf == rhs.leaf && index == rhs.index;
+    }
+
+    bool operator != (self const& rhs) const {
+        return !(*this == rhs);
+    }
+};
+
+//counts whole leaves at once
+template <typename T, bool MIRROR>
+inline ptrdiff_t distance(BTree_iterator<T, MIRROR> first,
+    BTree_iterator<T, MIRROR> last) {
+        ptrdiff_t n = 0;
+        while (first.leaf != last.leaf) {
+            n += first.leaf->count - first.index;
+            first.leaf = first.leaf->next;
+            first.index = 0;
+        }
+        return n + static_cast<ptrdiff_t>(last.index) -
+            static_cast<ptrdiff_t>(first.index);
+}
+
+template <typename T, typename COMP, typename ALLOC = TKF::pool_allocator<T> >
+class BTree {
+public:
+    typedef RBT_value_traits<T>                     value_traits;
+    typedef typename value_traits::key_type         key_type;
+    typedef typename value_traits::value_type       value_type;
+
+    typedef COMP                                    key_compare;
+    typedef BTree_search<key_type, COMP>            search;
+    static constexpr bool mirror = search::vector;
+
+    typedef BTree_node_base<T>                      base_type;
+    typedef BTree_leaf<T, mirror>                   leaf_type;
+    typedef BTree_internal<T>                       internal_type;
+    typedef base_type*                              base_ptr;
+    typedef leaf_type*                              leaf_ptr;
+    typedef internal_type*                          internal_ptr;
+
+    typedef ALLOC                                   allocator_type;
+    typedef typename allocator_type::template
+        rebind<leaf_type>::other                    leaf_allocator;
+    typedef typename allocator_type::template
+        rebind<internal_type>::other                internal_allocator;
+
+    typedef typename allocator_type::pointer        pointer;
+    typedef typename allocator_type::const_pointer  const_pointer;
+    typedef typename allocator_type::reference      reference;
+    typedef typename allocator_type::const_reference const_reference;
+    typedef typename allocator_type::size_type      size_type;
+    typedef typename allocator_type::difference_type difference_type;
+
+    typedef BTree_iterator<T, mirror>               iterator;
+    typedef TKF::reverse_iterator<iterator>         reverse_iterator;
+
+    static constexpr unsigned leaf_capacity = leaf_type::capacity;
+    static constexpr unsigned internal_capacity = internal_type::capacity;
+
+    allocator_type get_allocator() const { return allocator_type(); }
+    key_compare key_comp() const { return _comp; }
+
+private:
+    base_ptr _root;
+    leaf_ptr _first;
+    leaf_ptr _last;
+    size_type _num;
+    key_compare _comp;
+    leaf_allocator _leaf_alloc;
+    internal_allocator _internal_alloc;
+
+public:
+    BTree() {
+        _init();
+    }
+
+    BTree(BTree const& rhs) : _comp(rhs._comp) {
+        _init();
+        _append_all(rhs);
+    }
+
+    BTree(BTree&& rhs) noexcept : _leaf_alloc(TKF::move(rhs._leaf_alloc)),
+        _internal_alloc(TKF::move(rhs._internal_alloc)) {
+        _root = rhs._root;
+        _first = rhs._first;
+        _last = rhs._last;
+        _num = rhs._num;
+        _comp = rhs._comp;
+        rhs._reset();
+    }
+
+    BTree& operator = (BTree const& rhs) {
+        if (this != &rhs) {
+            clear();
+            _comp = rhs._comp;
+            _append_all(rhs);
+        }
+        return *this;
+    }
+
+    BTree& operator = (BTree&& rhs) {
+        if (this != &rhs) {
+            _destroy_all();
+            _root = rhs._root;
+            _first = rhs._first;
+            _last = rhs._last;
+            _num = rhs._num;
+            _comp = rhs._comp;
+            _leaf_alloc = TKF::move(rhs._leaf_alloc);
+            _internal_alloc = TKF::move(rhs._internal_alloc);
+            rhs._reset();
+        }
+        return *this;
+    }
+
+    ~BTree() {
+        _destroy_all();
+    }
+
+    friend bool operator == (BTree const& lhs, BTree const& rhs) {
+        if (lhs._num != rhs._num) {
+            return false;
+        }
+        auto iter = rhs.begin();
+        for (auto i = lhs.begin(); i != lhs.end(); ++i) {
+            if (*iter != *i) {
+                return false;
+            }
+            ++iter;
+        }
+        return true;
+    }
+
+    friend bool operator < (BTree const& lhs, BTree const& rhs) {
+        auto iter = rhs.begin();
+        for (auto i = lhs.begin(); i != lhs.end(); ++i) {
+            if (iter == rhs.end()) {
+                break;
+            }
+            if (*i < *iter) {
+                return true;
+            }
+            else if (*i > *iter) {
+                return false;
+            }
+            ++iter;
+        }
+        return (iter != rhs.end());
+    }
+
+public:
+    //iterator
+    iterator begin() const noexcept {
+        return iterator(_first, 0);
+    }
+
+    iterator end() const noexcept {
+        return iterator(_last, _last->count);
+    }
+
+    reverse_iterator rbegin() const noexcept {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() const noexcept {
+        return reverse_iterator(begin());
+    }
+
+    bool empty() const noexcept {
+        return _num == 0;
+    }
+
+    size_type size() const noexcept {
+        return _num;
+    }
+
+    size_type max_size() const noexcept {
+        return static_cast<size_type>(-1);
+    }
+
+    //emplace
+    template <typename ...Args>
+    iterator multi_emplace(Args&& ...args) {
+        value_type value(TKF::forward<Args>(args)...);
+        return _multi_insert(value);
+    }
+
+    template <typename ...Args>
+    TKF::pair<iterator, bool> unique_emplace(Args&& ...args) {
+        value_type value(TKF::forward<Args>(args)...);
+        return _unique_insert(value);
+    }
+
+    template <typename ...Args>
+    iterator multi_emplace_hint(iterator hint, Args&& ...args);
+
+    template <typename ...Args>
+    iterator unique_emplace_hint(iterator hint, Args&& ...args);
+
+    //insert
+    iterator multi_insert(value_type const& value) {
+        value_type tmp(value);
+        return _multi_insert(tmp);
+    }
+
+    iterator multi_insert(value_type&& value) {
+        return _multi_insert(value);
+    }
+
+    iterator multi_insert(iterator hint, value_type const& value) {
+        return multi_emplace_hint(hint, value);
+    }
+
+    iterator multi_insert(iterator hint, value_type&& value) {
+        return multi_emplace_hint(hint, TKF::move(value));
+    }
+
+    template <typename ITER>
+    void multi_insert(ITER first, ITER last) {
+        for (; first != last; ++first) {
+            multi_emplace_hint(end(), *first);
+        }
+    }
+
+    TKF::pair<iterator, bool> unique_insert(value_type const& value) {
+        value_type tmp(value);
+        return _unique_insert(tmp);
+    }
+
+    TKF::pair<iterator, bool> unique_insert(value_type&& value) {
+        return _unique_insert(value);
+    }
+
+    iterator unique_insert(iterator hint, value_type const& value) {
+        return unique_emplace_hint(hint, value);
+    }
+
+    iterator unique_insert(iterator hint, value_type&& value) {
+        return unique_emplace_hint(hint, TKF::move(value));
+    }
+
+    //sorted input appends at the end and fills every leaf
+    template <typename ITER>
+    void unique_insert(ITER first, ITER last) {
+        for (; first != last; ++first) {
+            unique_emplace_hint(end(), *first);
+        }
+    }
+
+    //erase: returns the element after the erased one
+    iterator erase(iterator hint);
+
+    size_type multi_erase(key_type const& key);
+    size_type unique_erase(key_type const& key);
+
+    void erase(iterator first, iterator last);
+
+    void clear();
+
+    //find
+    iterator find(key_type const& key) const;
+    iterator lower_bound(key_type const& key) const;
+    iterator upper_bound(key_type const& key) const;
+
+    size_type count(key_type const& key) const {
+        return TKF::distance(lower_bound(key), upper_bound(key));
+    }
+
+    TKF::pair<iterator, iterator> equal_range(key_type const& key) const {
+        return TKF::pair<iterator, iterator>(lower_bound(key), upper_bound(key));
+    }
+
+private:
+    //helpers: untouchable and invisible for users
+    void _init() {
+        _root = _first = _last = _new_leaf();
+        _num = 0;
+    }
+
+    void _reset() {
+        _root = nullptr;
+        _first = _last = nullptr;
+        _num = 0;
+    }
+
+    static key_type const& _key(value_type const& value) {
+        return value_traits::get_key(value);
+    }
+
+    leaf_ptr _new_leaf();
+    internal_ptr _new_internal();
+    void _destroy_node(base_ptr node);
+    void _destroy_all();
+    void _append_all(BTree const& rhs);
+
+    //leaves search their key copies when there are any, else the values
+    unsigned _lower_index(leaf_ptr leaf, key_type const& key) const {
+        return _lower_index(leaf, key, TKF::int_constant<bool, mirror>());
+    }
+    unsigned _upper_index(leaf_ptr leaf, key_type const& key) const {
+        return _upper_index(leaf, key, TKF::int_constant<bool, mirror>());
+    }
+    unsigned _lower_index(leaf_ptr leaf, key_type const& key, TKF::true_type) const {
+        return search::lower(leaf->keys, leaf->count, key, _comp);
+    }
+    unsigned _upper_index(leaf_ptr leaf, key_type const& key, TKF::true_type) const {
+        return search::upper(leaf->keys, leaf->count, key, _comp);
+    }
+    unsigned _lower_index(leaf_ptr leaf, key_type const& key, TKF::false_type) const {
+        return search::lower_by([leaf](unsigned i) -> key_type const& {
+            return _key(leaf->values()[i]); }, leaf->count, key, _comp);
+    }
+    unsigned _upper_index(leaf_ptr leaf, key_type const& key, TKF::false_type) const {
+        return search::upper_by([leaf](unsigned i) -> key_type const& {
+            return _key(leaf->values()[i]); }, leaf->count, key, _comp);
+    }
+
+    static void _sync_key(leaf_ptr leaf, unsigned i) {
+        _sync_key(leaf, i, TKF::int_constant<bool, mirror>());
+    }
+    static void _sync_key(leaf_ptr leaf, unsigned i, TKF::true_type) {
+        leaf->keys[i] = _key(leaf->values()[i]);
+    }
+    static void _sync_key(leaf_ptr, unsigned, TKF::false_type) {}
+    unsigned _lower_index(internal_ptr node, key_type const& key) const;
+    unsigned _upper_index(internal_ptr node, key_type const& key) const;
+    leaf_ptr _descend(key_type const& key, bool upper) const;
+
+    bool _equal(key_type const& lhs, key_type const& rhs) const {
+        return _comp(lhs, rhs) && _comp(rhs, lhs);
+    }
+    bool _hint_fits(iterator hint) const;
+
+    iterator _multi_insert(value_type& value);
+    TKF::pair<iterator, bool> _unique_insert(value_type& value);
+    iterator _insert_at(leaf_ptr leaf, unsigned index, value_type& value);
+    void _insert_child(internal_ptr node, unsigned pos, key_type& key, base_ptr child);
+    void _adopt(internal_ptr node, unsigned from);
+
+    static void _move_values(leaf_ptr to, unsigned at, leaf_ptr from, unsigned first, unsigned last);
+    static void _move_keys(internal_ptr to, unsigned at, internal_ptr from, unsigned first, unsigned last);
+
+    void _rebalance_leaf(leaf_ptr leaf, leaf_ptr& track, unsigned& index);
+    void _rebalance_internal(internal_ptr node);
+    void _remove_child(internal_ptr node, unsigned pos);
+};
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::leaf_ptr
+BTree<T, COMP, ALLOC>::_new_leaf () {
+    leaf_ptr leaf = _leaf_alloc.allocate(1);
+    leaf->parent = nullptr;
+    leaf->pos = 0;
+    leaf->count = 0;
+    leaf->leaf = true;
+    leaf->prev = nullptr;
+    leaf->next = nullptr;
+    return leaf;
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::internal_ptr
+BTree<T, COMP, ALLOC>::_new_internal () {
+    internal_ptr node = _internal_alloc.allocate(1);
+    node->parent = nullptr;
+    node->pos = 0;
+    node->count = 0;
+    node->leaf = false;
+    return node;
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::_destroy_node (base_ptr node) {
+    if (node->leaf) {
+        leaf_ptr leaf = static_cast<leaf_ptr>(node);
+        for (unsigned i = 0; i < leaf->count; ++i) {
+            TKF::_destroy(leaf->values() + i);
+        }
+        _leaf_alloc.deallocate(leaf);
+    }
+    else {
+        internal_ptr internal = static_cast<internal_ptr>(node);
+        for (unsigned i = 0; i <= internal->count; ++i) {
+            _destroy_node(internal->children[i]);
+        }
+        for (unsigned i = 0; i < internal->count; ++i) {
+            internal->keys()[i].~key_type();
+        }
+        _internal_alloc.deallocate(internal);
+    }
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::_destroy_all () {
+    if (_root != nullptr) {
+        _destroy_node(_root);
+        _reset();
+    }
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::clear () {
+    _destroy_all();
+    _leaf_alloc.release();
+    _internal_alloc.release();
+    _init();
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::_append_all (BTree const& rhs) {
+    for (auto i = rhs.begin(); i != rhs.end(); ++i) {
+        value_type tmp(*i);
+        _insert_at(_last, _last->count, tmp);
+    }
+}
+
+template <typename T, typename COMP, typename ALLOC>
+unsigned BTree<T, COMP, ALLOC>::_lower_index (internal_ptr node, key_type const& key) const {
+    return search::lower(node->keys(), node->count, key, _comp);
+}
+
+template <typename T, typename COMP, typename ALLOC>
+unsigned BTree<T, COMP, ALLOC>::_upper_index (internal_ptr node, key_type const& key) const {
+    return search::upper(node->keys(), node->count, key, _comp);
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::leaf_ptr
+BTree<T, COMP, ALLOC>::_descend (key_type const& key, bool upper) const {
+    base_ptr node = _root;
+    while (!node->leaf) {
+        internal_ptr internal = static_cast<internal_ptr>(node);
+        unsigned i = upper ? _upper_index(internal, key) : _lower_index(internal, key);
+        node = internal->children[i];
+    }
+    return static_cast<leaf_ptr>(node);
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::iterator
+BTree<T, COMP, ALLOC>::lower_bound (key_type const& key) const {
+    leaf_ptr leaf = _descend(key, false);
+    return iterator(leaf, _lower_index(leaf, key));
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::iterator
+BTree<T, COMP, ALLOC>::upper_bound (key_type const& key) const {
+    leaf_ptr leaf = _descend(key, true);
+    return iterator(leaf, _upper_index(leaf, key));
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::iterator
+BTree<T, COMP, ALLOC>::find (key_type const& key) const {
+    iterator iter = lower_bound(key);
+    if (iter != end() && _comp(_key(*iter), key)) {
+        return iter;
+    }
+    return end();
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::iterator
+BTree<T, COMP, ALLOC>::_multi_insert (value_type& value) {
+    key_type const& key = _key(value);
+    leaf_ptr leaf = _descend(key, true);
+    return _insert_at(leaf, _upper_index(leaf, key), value);
+}
+
+template <typename T, typename COMP, typename ALLOC>
+TKF::pair<typename BTree<T, COMP, ALLOC>::iterator, bool>
+BTree<T, COMP, ALLOC>::_unique_insert (value_type& value) {
+    key_type const& key = _key(value);
+    leaf_ptr leaf = _descend(key, false);
+    unsigned index = _lower_index(leaf, key);
+    iterator bound(leaf, index);
+    if (bound != end() && _comp(_key(*bound), key)) {
+        return TKF::pair<iterator, bool>(bound, false);
+    }
+    return TKF::pair<iterator, bool>(_insert_at(leaf, index, value), true);
+}
+
+//a hint is only taken inside a leaf or at either end of the tree, where
+//no separator above can be crossed
+template <typename T, typename COMP, typename ALLOC>
+bool BTree<T, COMP, ALLOC>::_hint_fits (iterator hint) const {
+    return (hint.index != 0 || hint.leaf == _first) &&
+        (hint.index != hint.leaf->count || hint.leaf == _last);
+}
+
+template <typename T, typename COMP, typename ALLOC>
+template <typename ...Args>
+typename BTree<T, COMP, ALLOC>::iterator
+BTree<T, COMP, ALLOC>::multi_emplace_hint (iterator hint, Args&& ...args) {
+    value_type value(TKF::forward<Args>(args)...);
+    key_type const& key = _key(value);
+    if (_hint_fits(hint) &&
+        (hint == begin() || _comp(_key(hint.leaf->values()[hint.index - 1]), key)) &&
+        (hint == end() || _comp(key, _key(*hint)))) {
+        return _insert_at(hint.leaf, hint.index, value);
+    }
+    return _multi_insert(value);
+}
+
+template <typename T, typename COMP, typename ALLOC>
+template <typename ...Args>
+typename BTree<T, COMP, ALLOC>::iterator
+BTree<T, COMP, ALLOC>::unique_emplace_hint (iterator hint, Args&& ...args) {
+    value_type value(TKF::forward<Args>(args)...);
+    key_type const& key = _key(value);
+    if (_hint_fits(hint) &&
+        (hint == begin() || !_comp(key, _key(hint.leaf->values()[hint.index - 1]))) &&
+        (hint == end() || !_comp(_key(*hint), key))) {
+        return _insert_at(hint.leaf, hint.index, value);
+    }
+    return _unique_insert(value).first;
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::_move_values (leaf_ptr to, unsigned at, 
+    leaf_ptr from, unsigned first, unsigned last) {
+    //relocates [first, last) of from to at; within one leaf the ranges 
+    //may overlap, so a move to the right runs backwards
+    if (to == from && at > first) {
+        for (unsigned i = last - first; i-- > 0; ) {
+            TKF::_construct(to->values() + at + i, TKF::move(from->values()[first + i]));
+            TKF::_destroy(from->values() + first + i);
+            _sync_key(to, at + i);
+        }
+    }
+    else {
+        for (unsigned i = 0; i < last - first; ++i) {
+            TKF::_construct(to->values() + at + i, TKF::move(from->values()[first + i]));
+            TKF::_destroy(from->values() + first + i);
+            _sync_key(to, at + i);
+        }
+    }
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::_move_keys (internal_ptr to, unsigned at, 
+    internal_ptr from, unsigned first, unsigned last) {
+    if (to == from && at > first) {
+        for (unsigned i = last - first; i-- > 0; ) {
+            TKF::_construct(to->keys() + at + i, TKF::move(from->keys()[first + i]));
+            from->keys()[first + i].~key_type();
+        }
+    }
+    else {
+        for (unsigned i = 0; i < last - first; ++i) {
+            TKF::_construct(to->keys() + at + i, TKF::move(from->keys()[first + i]));
+            from->keys()[first + i].~key_type();
+        }
+    }
+}
+
+//children from index from on get their parent and position refreshed
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::_adopt (internal_ptr node, unsigned from) {
+    for (unsigned i = from; i <= node->count; ++i) {
+        node->children[i]->parent = node;
+        node->children[i]->pos = static_cast<unsigned short>(i);
+    }
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::iterator
+BTree<T, COMP, ALLOC>::_insert_at (leaf_ptr leaf, unsigned index, value_type& value) {
+    _move_values(leaf, index + 1, leaf, index, leaf->count);
+    TKF::_construct(leaf->values() + index, TKF::move(value));
+    _sync_key(leaf, index);
+    ++leaf->count;
+    ++_num;
+    if (leaf->count <= leaf_capacity) {
+        return iterator(leaf, index);
+    }
+
+    //split: appending at the very end leaves the full leaf as it is, so
+    //sorted input packs every leaf; otherwise each half takes half
+    leaf_ptr right = _new_leaf();
+    unsigned mid = (leaf == _last && index == leaf_capacity) ? 
+        leaf_capacity : leaf->count / 2;
+    _move_values(right, 0, leaf, mid, leaf->count);
+    right->count = static_cast<unsigned short>(leaf->count - mid);
+    leaf->count = static_cast<unsigned short>(mid);
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next != nullptr) {
+        leaf->next->prev = right;
+    }
+    else {
+        _last = right;
+    }
+    leaf->next = right;
+
+    key_type key = _key(right->values()[0]);
+    _insert_child(leaf->parent, leaf->pos + 1, key, right);
+    return index < mid ? iterator(leaf, index) : iterator(right, index - mid);
+}
+
+//places child at node->children[pos] with key in front of it; a null
+//node means the old root has split
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::_insert_child (internal_ptr node, unsigned pos, 
+    key_type& key, base_ptr child) {
+    if (node == nullptr) {
+        node = _new_internal();
+        node->children[0] = _root;
+        TKF::_construct(node->keys(), TKF::move(key));
+        node->children[1] = child;
+        node->count = 1;
+        _adopt(node, 0);
+        _root = node;
+        return;
+    }
+    _move_keys(node, pos, node, pos - 1, node->count);
+    for (unsigned i = node->count + 1; i > pos; --i) {
+        node->children[i] = node->children[i - 1];
+    }
+    TKF::_construct(node->keys() + pos - 1, TKF::move(key));
+    node->children[pos] = child;
+    ++node->count;
+    _adopt(node, pos);
+    if (node->count <= internal_capacity) {
+        return;
+    }
+
+    //the middle key moves up, the keys and children after it move right
+    internal_ptr right = _new_internal();
+    unsigned mid = node->count / 2;
+    _move_keys(right, 0, node, mid + 1, node->count);
+    for (unsigned i = mid + 1; i <= node->count; ++i) {
+        right->children[i - mid - 1] = node->children[i];
+    }
+    right->count = static_cast<unsigned short>(node->count - mid - 1);
+    node->count = static_cast<unsigned short>(mid);
+    _adopt(right, 0);
+    key_type up = TKF::move(node->keys()[mid]);
+    node->keys()[mid].~key_type();
+    _insert_child(node->parent, node->pos + 1, up, right);
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::iterator
+BTree<T, COMP, ALLOC>::erase (iterator hint) {
+    leaf_ptr leaf = hint.leaf;
+    unsigned index = hint.index;
+    TKF::_destroy(leaf->values() + index);
+    _move_values(leaf, index, leaf, index + 1, leaf->count);
+    --leaf->count;
+    --_num;
+    if (leaf != _root && leaf->count < leaf_capacity / 2) {
+        _rebalance_leaf(leaf, leaf, index);
+    }
+    return iterator(leaf, index);
+}
+
+//refills leaf from a sibling or merges it into one; track and index
+//follow the element they pointed at
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::_rebalance_leaf (leaf_ptr leaf, leaf_ptr& track, unsigned& index) {
+    internal_ptr parent = leaf->parent;
+    unsigned pos = leaf->pos;
+    leaf_ptr left = pos > 0 ? static_cast<leaf_ptr>(parent->children[pos - 1]) : nullptr;
+    leaf_ptr right = pos < parent->count ? 
+        static_cast<leaf_ptr>(parent->children[pos + 1]) : nullptr;
+
+    if (left != nullptr && left->count > leaf_capacity / 2) {
+        _move_values(leaf, 1, leaf, 0, leaf->count);
+        _move_values(leaf, 0, left, left->count - 1, left->count);
+        --left->count;
+        ++leaf->count;
+        parent->keys()[pos - 1] = _key(leaf->values()[0]);
+        ++index;
+        return;
+    }
+    if (right != nullptr && right->count > leaf_capacity / 2) {
+        _move_values(leaf, leaf->count, right, 0, 1);
+        _move_values(right, 0, right, 1, right->count);
+        ++leaf->count;
+        --right->count;
+        parent->keys()[pos] = _key(right->values()[0]);
+        return;
+    }
+
+    if (left == nullptr) {
+        //merge right into leaf, keeping track where it is
+        left = leaf;
+        leaf = right;
+        ++pos;
+    }
+    else {
+        index += left->count;
+        track = left;
+    }
+    _move_values(left, left->count, leaf, 0, leaf->count);
+    left->count = static_cast<unsigned short>(left->count + leaf->count);
+    leaf->count = 0;
+    left->next = leaf->next;
+    if (leaf->next != nullptr) {
+        leaf->next->prev = left;
+    }
+    else {
+        _last = left;
+    }
+    _leaf_alloc.deallocate(leaf);
+    _remove_child(parent, pos);
+}
+
+//drops node->children[pos] and the key in front of it
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::_remove_child (internal_ptr node, unsigned pos) {
+    node->keys()[pos - 1].~key_type();
+    _move_keys(node, pos - 1, node, pos, node->count);
+    for (unsigned i = pos; i < node->count; ++i) {
+        node->children[i] = node->children[i + 1];
+    }
+    --node->count;
+    _adopt(node, pos);
+    _rebalance_internal(node);
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::_rebalance_internal (internal_ptr node) {
+    if (node == _root) {
+        if (node->count == 0) {
+            _root = node->children[0];
+            _root->parent = nullptr;
+            _root->pos = 0;
+            _internal_alloc.deallocate(node);
+        }
+        return;
+    }
+    if (node->count >= internal_capacity / 2) {
+        return;
+    }
+    internal_ptr parent = node->parent;
+    unsigned pos = node->pos;
+    internal_ptr left = pos > 0 ? static_cast<internal_ptr>(parent->children[pos - 1]) : nullptr;
+    internal_ptr right = pos < parent->count ? 
+        static_cast<internal_ptr>(parent->children[pos + 1]) : nullptr;
+
+    //borrowing rotates a child through the parent's key
+    if (left != nullptr && left->count > internal_capacity / 2) {
+        _move_keys(node, 1, node, 0, node->count);
+        for (unsigned i = node->count + 1; i > 0; --i) {
+            node->children[i] = node->children[i - 1];
+        }
+        TKF::_construct(node->keys(), TKF::move(parent->keys()[pos - 1]));
+        node->children[0] = left->children[left->count];
+        parent->keys()[pos - 1] = TKF::move(left->keys()[left->count - 1]);
+        left->keys()[left->count - 1].~key_type();
+        --left->count;
+        ++node->count;
+        _adopt(node, 0);
+        return;
+    }
+    if (right != nullptr && right->count > internal_capacity / 2) {
+        TKF::_construct(node->keys() + node->count, TKF::move(parent->keys()[pos]));
+        node->children[node->count + 1] = right->children[0];
+        parent->keys()[pos] = TKF::move(right->keys()[0]);
+        right->keys()[0].~key_type();
+        _move_keys(right, 0, right, 1, right->count);
+        for (unsigned i = 0; i < right->count; ++i) {
+            right->children[i] = right->children[i + 1];
+        }
+        --right->count;
+        ++node->count;
+        _adopt(node, node->count);
+        _adopt(right, 0);
+        return;
+    }
+
+    //merging pulls the parent's key down between the two halves
+    if (left == nullptr) {
+        left = node;
+        node = right;
+        ++pos;
+    }
+    unsigned base = left->count + 1;
+    TKF::_construct(left->keys() + left->count, TKF::move(parent->keys()[pos - 1]));
+    _move_keys(left, base, node, 0, node->count);
+    for (unsigned i = 0; i <= node->count; ++i) {
+        left->children[base + i] = node->children[i];
+    }
+    left->count = static_cast<unsigned short>(base + node->count);
+    _adopt(left, base);
+    _internal_alloc.deallocate(node);
+    _remove_child(parent, pos);
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void BTree<T, COMP, ALLOC>::erase (iterator first, iterator last) {
+    if (first == begin() && last == end()) {
+        clear();
+        return;
+    }
+    for (ptrdiff_t n = TKF::distance(first, last); n > 0; --n) {
+        first = erase(first);
+    }
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::size_type
+BTree<T, COMP, ALLOC>::multi_erase (key_type const& key) {
+    iterator first = lower_bound(key);
+    size_type n = TKF::distance(first, upper_bound(key));
+    erase(first, first + n);
+    return n;
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename BTree<T, COMP, ALLOC>::size_type
+BTree<T, COMP, ALLOC>::unique_erase (key_type const& key) {
+    iterator iter = find(key);
+    if (iter == end()) {
+        return 0;
+    }
+    erase(iter);
+    return 1;
+}
+
+}
+
+#endif // !B_TREE_H
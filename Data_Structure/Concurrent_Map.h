@@ -0,0 +1,649 @@
+//file: Concurrent_Map.h
+#ifndef CONCURRENT_MAP_H
+#define CONCURRENT_MAP_H
+
+#include<new>
+#include<atomic>
+#include<thread>
+#include<vector>
+#include<cstddef>
+#include<cstdint>
+#include<exception>
+#include<functional>
+#include<algorithm>
+#include"Map.h"
+#include"Algorithm.h"
+#include"Utility.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TKF_CONCURRENT_PAUSE 1
+#include<emmintrin.h>
+#endif
+
+namespace TKF {
+
+//reader-writer spin lock in one word: a writer bit over the count of
+//readers. A waiting writer already holds the bit, so new readers back off
+//and a stream of readers cannot starve it. Not recursive.
+class rw_spin_lock {
+    static constexpr unsigned _writer = 1u << 31;
+    std::atomic<unsigned> _state;
+
+    static void _relax(unsigned& spins) {
+        if (++spins < 64) {
+#ifdef TKF_CONCURRENT_PAUSE
+            _mm_pause();
+#endif
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+
+public:
+    rw_spin_lock() noexcept : _state(0) {}
+    rw_spin_lock(rw_spin_lock const&) = delete;
+    rw_spin_lock& operator = (rw_spin_lock const&) = delete;
+
+    void lock() noexcept {
+        unsigned spins = 0;
+        unsigned state = _state.load(std::memory_order_relaxed);
+        while ((state & _writer) || !_state.compare_exchange_weak(state, state | _writer,
+            std::memory_order_acquire, std::memory_order_relaxed)) {
+            _relax(spins);
+            state = _state.load(std::memory_order_relaxed);
+        }
+        //no reader gets in any more, wait for the ones inside
+        while (_state.load(std::memory_order_acquire) != _writer) {
+            _relax(spins);
+        }
+    }
+
+    bool try_lock() noexcept {
+        unsigned state = 0;
+        return _state.compare_exchange_strong(state, _writer,
+            std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock() noexcept {
+        _state.store(0, std::memory_order_release);
+    }
+
+    void lock_shared() noexcept {
+        unsigned spins = 0;
+        unsigned state = _state.load(std::memory_order_relaxed);
+        while ((state & _writer) || !_state.compare_exchange_weak(state, state + 1,
+            std::memory_order_acquire, std::memory_order_relaxed)) {
+            _relax(spins);
+            state = _state.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool try_lock_shared() noexcept {
+        unsigned state = _state.load(std::memory_order_relaxed);
+        return !(state & _writer) && _state.compare_exchange_strong(state, state + 1,
+            std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock_shared() noexcept {
+        _state.fetch_sub(1, std::memory_order_release);
+    }
+};
+
+template <typename LOCK>
+class unique_guard {
+    LOCK& _lock;
+public:
+    explicit unique_guard(LOCK& lock) : _lock(lock) {
+        _lock.lock();
+    }
+    unique_guard(unique_guard const&) = delete;
+    unique_guard& operator = (unique_guard const&) = delete;
+    ~unique_guard() {
+        _lock.unlock();
+    }
+};
+
+template <typename LOCK>
+class shared_guard {
+    LOCK& _lock;
+public:
+    explicit shared_guard(LOCK& lock) : _lock(lock) {
+        _lock.lock_shared();
+    }
+    shared_guard(shared_guard const&) = delete;
+    shared_guard& operator = (shared_guard const&) = delete;
+    ~shared_guard() {
+        _lock.unlock_shared();
+    }
+};
+
+//a shard starts on its own cache line and fills whole lines, so locking
+//one shard never invalidates the line of its neighbour
+template <typename MAP>
+struct alignas(cache_line_size) _concurrent_shard {
+    rw_spin_lock lock;
+    MAP map;
+};
+
+//concurrent_map: keys are hash-partitioned over a power of two of
+//independent map shards, each behind its own rw_spin_lock, so threads
+//working on different shards never contend.
+//An iterator into a shard would outlive its lock, so lookups copy the
+//value out or run a visitor under the lock. Bulk insert, erase and
+//for_each fan out over the shards in parallel; ordered() and range()
+//read-lock every shard and merge them back into one key order.
+//Visitors and callbacks must not call back into the same map.
+template <typename KEY, typename T, typename HASH = std::hash<KEY>,
+    typename COMP = less<KEY>,
+    typename ALLOC = TKF::pool_allocator<TKF::pair<KEY, T> >,
+    typename POLICY = TKF::RBT_plain_node>
+class concurrent_map {
+public:
+    typedef KEY                                     key_type;
+    typedef T                                       map_type;
+    typedef TKF::pair<KEY, T>                       value_type;
+    typedef HASH                                    hasher;
+    typedef COMP                                    key_compare;
+    typedef TKF::map<KEY, T, COMP, ALLOC, POLICY>   shard_type;
+    typedef typename shard_type::size_type          size_type;
+    typedef rw_spin_lock                            lock_type;
+
+    class ordered_view;
+
+private:
+    typedef _concurrent_shard<shard_type>   _shard;
+    typedef typename shard_type::iterator   _shard_iterator;
+
+    void*       _raw;
+    _shard*     _shards;
+    size_type   _count;
+    unsigned    _shift;
+    hasher      _hash;
+    key_compare _comp;
+
+public:
+    //shards == 0 takes four per hardware thread; the count is rounded
+    //up to a power of two
+    explicit concurrent_map(size_type shards = 0, hasher const& hash = hasher());
+
+    template <typename ITER>
+    concurrent_map(ITER first, ITER last, size_type shards = 0)
+        : concurrent_map(shards) {
+        insert(first, last);
+    }
+
+    concurrent_map(concurrent_map const&) = delete;
+    concurrent_map& operator = (concurrent_map const&) = delete;
+
+    ~concurrent_map();
+
+    //API
+    key_compare key_comp() const {
+        return _comp;
+    }
+
+    hasher hash_function() const {
+        return _hash;
+    }
+
+    size_type shard_count() const noexcept {
+        return _count;
+    }
+
+    //exact only while no writer runs
+    size_type size() const;
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    void clear();
+
+    //point operations: true when a value was inserted
+    bool insert(value_type const& value) {
+        _shard& shard = _shard_of(value.first);
+        unique_guard<lock_type> guard(shard.lock);
+        return shard.map.insert(value).second;
+    }
+
+    bool insert(value_type&& value) {
+        _shard& shard = _shard_of(value.first);
+        unique_guard<lock_type> guard(shard.lock);
+        return shard.map.insert(TKF::move(value)).second;
+    }
+
+    template <typename ...Args>
+    bool emplace(Args&&... args) {
+        return insert(value_type(TKF::forward<Args>(args)...));
+    }
+
+    template <typename ...Args>
+    bool try_emplace(key_type const& key, Args&&... args) {
+        _shard& shard = _shard_of(key);
+        unique_guard<lock_type> guard(shard.lock);
+        return shard.map.try_emplace(key, TKF::forward<Args>(args)...).second;
+    }
+
+    template <typename ...Args>
+    bool try_emplace(key_type&& key, Args&&... args) {
+        _shard& shard = _shard_of(key);
+        unique_guard<lock_type> guard(shard.lock);
+        return shard.map.try_emplace(TKF::move(key), TKF::forward<Args>(args)...).second;
+    }
+
+    template <typename M>
+    bool insert_or_assign(key_type const& key, M&& obj) {
+        _shard& shard = _shard_of(key);
+        unique_guard<lock_type> guard(shard.lock);
+        return shard.map.insert_or_assign(key, TKF::forward<M>(obj)).second;
+    }
+
+    size_type erase(key_type const& key) {
+        _shard& shard = _shard_of(key);
+        unique_guard<lock_type> guard(shard.lock);
+        return shard.map.erase(key);
+    }
+
+    //copies the mapped value of key to out
+    bool find(key_type const& key, map_type& out) const {
+        _shard& shard = _shard_of(key);
+        shared_guard<lock_type> guard(shard.lock);
+        _shard_iterator iter = shard.map.find(key);
+        if (iter == shard.map.end()) {
+            return false;
+        }
+        out = iter->second;
+        return true;
+    }
+
+    bool contains(key_type const& key) const {
+        return count(key) != 0;
+    }
+
+    size_type count(key_type const& key) const {
+        _shard& shard = _shard_of(key);
+        shared_guard<lock_type> guard(shard.lock);
+        return shard.map.count(key);
+    }
+
+    //f(value_type&) under the write lock of the shard of key
+    template <typename F>
+    bool visit(key_type const& key, F f) {
+        _shard& shard = _shard_of(key);
+        unique_guard<lock_type> guard(shard.lock);
+        _shard_iterator iter = shard.map.find(key);
+        if (iter == shard.map.end()) {
+            return false;
+        }
+        f(*iter);
+        return true;
+    }
+
+    //f(value_type const&) under the read lock of the shard of key
+    template <typename F>
+    bool cvisit(key_type const& key, F f) const {
+        _shard& shard = _shard_of(key);
+        shared_guard<lock_type> guard(shard.lock);
+        _shard_iterator iter = shard.map.find(key);
+        if (iter == shard.map.end()) {
+            return false;
+        }
+        f(static_cast<value_type const&>(*iter));
+        return true;
+    }
+
+    //bulk operations: the input is split by shard, then every shard
+    //takes its part under one lock, all shards in parallel.
+    //Inserts the values of [first, last); returns how many were new.
+    template <typename ITER>
+    size_type insert(ITER first, ITER last);
+
+    //erases every key of [first, last); returns how many were present
+    template <typename ITER>
+    size_type erase(ITER first, ITER last);
+
+    //f(value_type const&) on every value, from several threads at once
+    //and in no particular order
+    template <typename F>
+    void for_each(F const& f) const;
+
+    //all values, or those with lo <= key < hi, in key order
+    ordered_view ordered() const {
+        return ordered_view(*this, nullptr, nullptr);
+    }
+
+    ordered_view range(key_type const& lo, key_type const& hi) const {
+        return ordered_view(*this, &lo, &hi);
+    }
+
+private:
+    size_type _index(key_type const& key) const {
+        if (_count == 1) {
+            return 0;
+        }
+        //fibonacci hashing: std::hash of an integer is the integer itself,
+        //and the high bits of the product mix in every bit of it
+        return static_cast<size_type>((static_cast<uint64_t>(_hash(key)) *
+            0x9E3779B97F4A7C15ull) >> _shift);
+    }
+
+    _shard& _shard_of(key_type const& key) const {
+        return _shards[_index(key)];
+    }
+
+    //runs f(i) for every shard i, spread over the hardware threads
+    template <typename F>
+    void _fan_out(F const& f) const;
+
+public:
+    //read-locks every shard while it lives; its iterator keeps one cursor
+    //per non-empty shard in a heap ordered by key and always yields the
+    //smallest, so a step costs O(log shard_count())
+    class ordered_view {
+        friend class concurrent_map;
+
+        struct _cursor {
+            _shard_iterator cur;
+            _shard_iterator last;
+        };
+
+        struct _later {
+            key_compare comp;
+            bool operator () (_cursor const& lhs, _cursor const& rhs) const {
+                return !comp(lhs.cur->first, rhs.cur->first);
+            }
+        };
+
+        concurrent_map const*   _owner;
+        std::vector<_cursor>    _heap;
+
+        ordered_view(concurrent_map const& owner, key_type const* lo, key_type const* hi);
+
+    public:
+        class iterator : public TKF::iterator<_forward_iterator, value_type,
+            ptrdiff_t, value_type const*, value_type const&> {
+            friend class ordered_view;
+            std::vector<_cursor> _heap;
+            _later _cmp;
+
+            iterator(std::vector<_cursor> const& heap, key_compare const& comp)
+                : _heap(heap), _cmp{comp} {}
+
+        public:
+            iterator() : _heap(), _cmp() {}
+
+            value_type const& operator * () const {
+                return *_heap.front().cur;
+            }
+
+            value_type const* operator -> () const {
+                return &*_heap.front().cur;
+            }
+
+            iterator& operator ++ () {
+                std::pop_heap(_heap.begin(), _heap.end(), _cmp);
+                _cursor& top = _heap.back();
+                if (++top.cur == top.last) {
+                    _heap.pop_back();
+                }
+                else {
+                    std::push_heap(_heap.begin(), _heap.end(), _cmp);
+                }
+                return *this;
+            }
+
+            iterator operator ++ (int) {
+                iterator tmp = *this;
+                ++*this;
+                return tmp;
+            }
+
+            friend bool operator == (iterator const& lhs, iterator const& rhs) {
+                if (lhs._heap.empty() || rhs._heap.empty()) {
+                    return lhs._heap.empty() && rhs._heap.empty();
+                }
+                return lhs._heap.front().cur == rhs._heap.front().cur;
+            }
+
+            friend bool operator != (iterator const& lhs, iterator const& rhs) {
+                return !(lhs == rhs);
+            }
+        };
+
+        ordered_view(ordered_view&& rhs)
+            : _owner(rhs._owner), _heap(TKF::move(rhs._heap)) {
+            rhs._owner = nullptr;
+        }
+
+        ordered_view(ordered_view const&) = delete;
+        ordered_view& operator = (ordered_view const&) = delete;
+
+        ~ordered_view() {
+            if (_owner != nullptr) {
+                for (size_type i = 0; i < _owner->_count; ++i) {
+                    _owner->_shards[i].lock.unlock_shared();
+                }
+            }
+        }
+
+        iterator begin() const {
+            return iterator(_heap, _owner->_comp);
+        }
+
+        iterator end() const {
+            return iterator();
+        }
+    };
+};
+
+template <typename KEY, typename T, typename HASH, typename COMP,
+    typename ALLOC, typename POLICY>
+concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::concurrent_map (size_type shards,
+    hasher const& hash)
+    : _raw(nullptr), _shards(nullptr), _count(1), _shift(64), _hash(hash), _comp() {
+    if (shards == 0) {
+        shards = 4 * TKF::parallel_threads();
+    }
+    while (_count < shards) {
+        _count <<= 1;
+        --_shift;
+    }
+    //operator new only promises alignof(max_align_t), so round up by hand
+    _raw = ::operator new(sizeof(_shard) * _count + cache_line_size);
+    _shards = reinterpret_cast<_shard*>((reinterpret_cast<uintptr_t>(_raw) +
+        cache_line_size - 1) & ~static_cast<uintptr_t>(cache_line_size - 1));
+    size_type i = 0;
+    try {
+        for (; i < _count; ++i) {
+            ::new (static_cast<void*>(_shards + i)) _shard();
+        }
+    }
+    catch (...) {
+        while (i-- > 0) {
+            _shards[i].~_shard();
+        }
+        ::operator delete(_raw);
+        throw;
+    }
+}
+
+template <typename KEY, typename T, typename HASH, typename COMP,
+    typename ALLOC, typename POLICY>
+concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::~concurrent_map () {
+    for (size_type i = 0; i < _count; ++i) {
+        _shards[i].~_shard();
+    }
+    ::operator delete(_raw);
+}
+
+template <typename KEY, typename T, typename HASH, typename COMP,
+    typename ALLOC, typename POLICY>
+typename concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::size_type
+concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::size () const {
+    size_type n = 0;
+    for (size_type i = 0; i < _count; ++i) {
+        shared_guard<lock_type> guard(_shards[i].lock);
+        n += _shards[i].map.size();
+    }
+    return n;
+}
+
+template <typename KEY, typename T, typename HASH, typename COMP,
+    typename ALLOC, typename POLICY>
+void concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::clear () {
+    _fan_out([this](size_type i) {
+        unique_guard<lock_type> guard(_shards[i].lock);
+        _shards[i].map.clear();
+    });
+}
+
+template <typename KEY, typename T, typename HASH, typename COMP,
+    typename ALLOC, typename POLICY>
+template <typename ITER>
+typename concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::size_type
+concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::insert (ITER first, ITER last) {
+    std::vector<std::vector<value_type> > parts(_count);
+    for (; first != last; ++first) {
+        value_type const& value = *first;
+        parts[_index(value.first)].push_back(value);
+    }
+    std::vector<size_type> added(_count, 0);
+    _fan_out([this, &parts, &added](size_type i) {
+        std::vector<value_type>& part = parts[i];
+        if (part.empty()) {
+            return;
+        }
+        //sorted, the part builds an empty shard in O(n) and otherwise
+        //inserts in order; stable, so the first of equal keys wins
+        key_compare comp = _comp;
+        std::stable_sort(part.begin(), part.end(),
+            [&comp](value_type const& lhs, value_type const& rhs) {
+                return !comp(rhs.first, lhs.first);
+            });
+        unique_guard<lock_type> guard(_shards[i].lock);
+        size_type n = _shards[i].map.size();
+        _shards[i].map.insert(part.data(), part.data() + part.size());
+        added[i] = _shards[i].map.size() - n;
+    });
+    size_type n = 0;
+    for (size_type i = 0; i < _count; ++i) {
+        n += added[i];
+    }
+    return n;
+}
+
+template <typename KEY, typename T, typename HASH, typename COMP,
+    typename ALLOC, typename POLICY>
+template <typename ITER>
+typename concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::size_type
+concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::erase (ITER first, ITER last) {
+    std::vector<std::vector<key_type> > parts(_count);
+    for (; first != last; ++first) {
+        key_type const& key = *first;
+        parts[_index(key)].push_back(key);
+    }
+    std::vector<size_type> erased(_count, 0);
+    _fan_out([this, &parts, &erased](size_type i) {
+        std::vector<key_type>& part = parts[i];
+        if (part.empty()) {
+            return;
+        }
+        unique_guard<lock_type> guard(_shards[i].lock);
+        size_type n = 0;
+        for (size_type j = 0; j < part.size(); ++j) {
+            n += _shards[i].map.erase(part[j]);
+        }
+        erased[i] = n;
+    });
+    size_type n = 0;
+    for (size_type i = 0; i < _count; ++i) {
+        n += erased[i];
+    }
+    return n;
+}
+
+template <typename KEY, typename T, typename HASH, typename COMP,
+    typename ALLOC, typename POLICY>
+template <typename F>
+void concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::for_each (F const& f) const {
+    _fan_out([this, &f](size_type i) {
+        shared_guard<lock_type> guard(_shards[i].lock);
+        shard_type& map = _shards[i].map;
+        for (_shard_iterator iter = map.begin(); iter != map.end(); ++iter) {
+            f(static_cast<value_type const&>(*iter));
+        }
+    });
+}
+
+template <typename KEY, typename T, typename HASH, typename COMP,
+    typename ALLOC, typename POLICY>
+template <typename F>
+void concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::_fan_out (F const& f) const {
+    size_type threads = TKF::parallel_threads();
+    if (threads > _count) {
+        threads = _count;
+    }
+    if (threads <= 1) {
+        for (size_type i = 0; i < _count; ++i) {
+            f(i);
+        }
+        return;
+    }
+    //worker t takes shards t, t + threads, ...; this thread is worker 0,
+    //and the first exception is passed on once everyone has joined
+    std::vector<std::exception_ptr> errors(threads);
+    auto work = [this, &f, &errors, threads](size_type t) {
+        try {
+            for (size_type i = t; i < _count; i += threads) {
+                f(i);
+            }
+        }
+        catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (size_type t = 1; t < threads; ++t) {
+        workers.push_back(std::thread(work, t));
+    }
+    work(0);
+    for (size_type t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+    for (size_type t = 0; t < threads; ++t) {
+        if (errors[t]) {
+            std::rethrow_exception(errors[t]);
+        }
+    }
+}
+
+template <typename KEY, typename T, typename HASH, typename COMP,
+    typename ALLOC, typename POLICY>
+concurrent_map<KEY, T, HASH, COMP, ALLOC, POLICY>::ordered_view::ordered_view (
+    concurrent_map const& owner, key_type const* lo, key_type const* hi)
+    : _owner(&owner), _heap() {
+    _heap.reserve(owner._count);
+    //every view locks in shard order, so two views never deadlock
+    for (size_type i = 0; i < owner._count; ++i) {
+        owner._shards[i].lock.lock_shared();
+    }
+    for (size_type i = 0; i < owner._count; ++i) {
+        shard_type& map = owner._shards[i].map;
+        _cursor cursor;
+        cursor.cur = lo == nullptr ? map.begin() : map.lower_bound(*lo);
+        cursor.last = hi == nullptr ? map.end() : map.lower_bound(*hi);
+        if (lo != nullptr && !owner._comp(*lo, *hi)) {
+            cursor.last = cursor.cur;
+        }
+        if (cursor.cur != cursor.last) {
+            _heap.push_back(cursor);
+        }
+    }
+    std::make_heap(_heap.begin(), _heap.end(), _later{owner._comp});
+}
+
+}
+
+#endif //!CONCURRENT_MAP_H
\ No newline at end of file
@@ -0,0 +1,519 @@
+//file: Concurrent_Skiplist.h
+#ifndef CONCURRENT_SKIPLIST_H
+#define CONCURRENT_SKIPLIST_H
+
+#include<new>
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include"Iterator.h"
+#include"Utility.h"
+#include"Algorithm.h"
+#include"Epoch.h"
+
+namespace TKF {
+
+//lock-free skiplist with unique keys: no operation ever waits for another.
+//Insert links a node level by level with CAS, bottom up. Erase deletes
+//logically first, by setting the low bit of each of the node's next links,
+//level 0 last, which decides the winner of racing erases; searches that
+//meet a marked node then unlink it physically. Unlinked nodes go back to
+//memory through epoch.
+//Readers never write shared memory: find and the bounds step over marked
+//nodes instead of unlinking them.
+//Values are immutable once inserted, so iterators are const. An iterator
+//pins the epoch while it lives, which keeps every node it may reach
+//alive; it belongs to the thread that made it. Iteration is weakly
+//consistent: it sees every key present for its whole duration, in order,
+//and may or may not see keys inserted or erased meanwhile.
+template <typename KEY, typename T, typename COMP = less<KEY> >
+class concurrent_skiplist_map {
+public:
+    typedef KEY                 key_type;
+    typedef T                   map_type;
+    typedef TKF::pair<KEY, T>   value_type;
+    typedef COMP                key_compare;
+    typedef size_t              size_type;
+    typedef ptrdiff_t           difference_type;
+    typedef value_type const&   const_reference;
+    typedef value_type const*   const_pointer;
+
+    //p = 1/4 per level, enough for 4^24 keys
+    static constexpr unsigned max_level = 24;
+
+private:
+    typedef std::atomic<uintptr_t> _link;
+
+    struct _node {
+        value_type          value;
+        unsigned            top;
+        //the inserter while it builds the tower and the erase that unlinks
+        //it: whichever lets go last retires the node
+        std::atomic<int>    refs;
+        _link               next[1];
+    };
+
+    static constexpr uintptr_t _mark = 1;
+    static constexpr unsigned _stripes = 16;
+
+    struct alignas(cache_line_size) _counter {
+        std::atomic<difference_type> n;
+    };
+
+    _node*                  _head;
+    std::atomic<unsigned>   _top;
+    key_compare             _comp;
+    _counter                _size[_stripes];
+
+public:
+    class iterator : public TKF::iterator<_forward_iterator, value_type,
+        ptrdiff_t, const_pointer, const_reference> {
+        friend class concurrent_skiplist_map;
+        epoch::guard    _guard;
+        _node*          _ptr;
+
+        explicit iterator(_node* ptr) : _guard(), _ptr(ptr) {}
+
+    public:
+        iterator() : _guard(), _ptr(nullptr) {}
+
+        const_reference operator * () const {
+            return _ptr->value;
+        }
+
+        const_pointer operator -> () const {
+            return &_ptr->value;
+        }
+
+        iterator& operator ++ () {
+            _ptr = _next_live(_ptr);
+            return *this;
+        }
+
+        iterator operator ++ (int) {
+            iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        friend bool operator == (iterator const& lhs, iterator const& rhs) {
+            return lhs._ptr == rhs._ptr;
+        }
+
+        friend bool operator != (iterator const& lhs, iterator const& rhs) {
+            return lhs._ptr != rhs._ptr;
+        }
+    };
+
+    typedef iterator const_iterator;
+
+public:
+    concurrent_skiplist_map() : _head(_allocate(max_level - 1)), _top(1), _comp() {
+        for (unsigned i = 0; i < max_level; ++i) {
+            ::new (static_cast<void*>(_head->next + i)) _link(0);
+        }
+        for (unsigned i = 0; i < _stripes; ++i) {
+            _size[i].n.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename ITER>
+    concurrent_skiplist_map(ITER first, ITER last) : concurrent_skiplist_map() {
+        insert(first, last);
+    }
+
+    concurrent_skiplist_map(concurrent_skiplist_map const&) = delete;
+    concurrent_skiplist_map& operator = (concurrent_skiplist_map const&) = delete;
+
+    //no other thread may use the map any more; what erase retired is
+    //left to epoch
+    ~concurrent_skiplist_map() {
+        _node* ptr = _ptr(_head->next[0].load(std::memory_order_relaxed));
+        while (ptr != nullptr) {
+            _node* next = _ptr(ptr->next[0].load(std::memory_order_relaxed));
+            _free(ptr);
+            ptr = next;
+        }
+        ::operator delete(static_cast<void*>(_head));
+    }
+
+    //API
+    key_compare key_comp() const {
+        return _comp;
+    }
+
+    iterator begin() const {
+        epoch::guard guard;
+        return iterator(_next_live(_head));
+    }
+
+    iterator end() const {
+        return iterator();
+    }
+
+    //counted as operations finish, so exact only while no writer runs
+    size_type size() const {
+        difference_type n = 0;
+        for (unsigned i = 0; i < _stripes; ++i) {
+            n += _size[i].n.load(std::memory_order_relaxed);
+        }
+        return n > 0 ? static_cast<size_type>(n) : 0;
+    }
+
+    bool empty() const {
+        return begin() == end();
+    }
+
+    size_type max_size() const noexcept {
+        return static_cast<size_type>(-1) / sizeof(_node);
+    }
+
+    //lookup
+    iterator find(key_type const& key) const {
+        epoch::guard guard;
+        _node* ptr = _lower_bound(key);
+        if (ptr == nullptr || !_comp(_key(ptr), key)) {
+            ptr = nullptr;
+        }
+        return iterator(ptr);
+    }
+
+    size_type count(key_type const& key) const {
+        return find(key) == end() ? 0 : 1;
+    }
+
+    bool contains(key_type const& key) const {
+        return find(key) != end();
+    }
+
+    iterator lower_bound(key_type const& key) const {
+        epoch::guard guard;
+        return iterator(_lower_bound(key));
+    }
+
+    iterator upper_bound(key_type const& key) const {
+        epoch::guard guard;
+        _node* ptr = _lower_bound(key);
+        if (ptr != nullptr && _comp(_key(ptr), key)) {
+            ptr = _next_live(ptr);
+        }
+        return iterator(ptr);
+    }
+
+    //modify
+    TKF::pair<iterator, bool> insert(value_type const& value) {
+        epoch::guard guard;
+        iterator iter = find(value.first);
+        if (iter != end()) {
+            return TKF::make_pair(iter, false);
+        }
+        return _insert(_create(value));
+    }
+
+    TKF::pair<iterator, bool> insert(value_type&& value) {
+        epoch::guard guard;
+        iterator iter = find(value.first);
+        if (iter != end()) {
+            return TKF::make_pair(iter, false);
+        }
+        return _insert(_create(TKF::move(value)));
+    }
+
+    template <typename ...Args>
+    TKF::pair<iterator, bool> emplace(Args&&... args) {
+        epoch::guard guard;
+        return _insert(_create(TKF::forward<Args>(args)...));
+    }
+
+    template <typename ...Args>
+    TKF::pair<iterator, bool> try_emplace(key_type const& key, Args&&... args) {
+        epoch::guard guard;
+        iterator iter = find(key);
+        if (iter != end()) {
+            return TKF::make_pair(iter, false);
+        }
+        return _insert(_create(TKF::piecewise_construct, std::forward_as_tuple(key),
+            std::forward_as_tuple(TKF::forward<Args>(args)...)));
+    }
+
+    template <typename ITER>
+    void insert(ITER first, ITER last) {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    size_type erase(key_type const& key);
+
+    size_type erase(iterator const& pos) {
+        return erase(pos->first);
+    }
+
+    //erases one key at a time, so concurrent inserts may survive it
+    void clear() {
+        epoch::guard guard;
+        for (_node* ptr = _next_live(_head); ptr != nullptr; ptr = _next_live(ptr)) {
+            erase(_key(ptr));
+        }
+    }
+
+private:
+    static _node* _ptr(uintptr_t link) {
+        return reinterpret_cast<_node*>(link & ~_mark);
+    }
+
+    static bool _marked(uintptr_t link) {
+        return (link & _mark) != 0;
+    }
+
+    static key_type const& _key(_node* ptr) {
+        return ptr->value.first;
+    }
+
+    //true when lhs goes strictly before rhs
+    bool _before(key_type const& lhs, key_type const& rhs) const {
+        return !_comp(rhs, lhs);
+    }
+
+    static _node* _allocate(unsigned top) {
+        void* raw = ::operator new(sizeof(_node) + sizeof(_link) * top);
+        return static_cast<_node*>(raw);
+    }
+
+    template <typename ...Args>
+    static _node* _create(Args&&... args) {
+        unsigned top = _random_level();
+        _node* ptr = _allocate(top);
+        try {
+            ::new (static_cast<void*>(&ptr->value)) value_type(TKF::forward<Args>(args)...);
+        }
+        catch (...) {
+            ::operator delete(static_cast<void*>(ptr));
+            throw;
+        }
+        ptr->top = top;
+        ::new (static_cast<void*>(&ptr->refs)) std::atomic<int>(2);
+        for (unsigned i = 0; i <= top; ++i) {
+            ::new (static_cast<void*>(ptr->next + i)) _link(0);
+        }
+        return ptr;
+    }
+
+    static void _free(_node* ptr) {
+        ptr->value.~value_type();
+        ::operator delete(static_cast<void*>(ptr));
+    }
+
+    static void _retire(void* ptr) {
+        _free(static_cast<_node*>(ptr));
+    }
+
+    static void _release(_node* ptr) {
+        if (ptr->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            epoch::retire(ptr, &concurrent_skiplist_map::_retire);
+        }
+    }
+
+    static unsigned _random_level() {
+        static thread_local uint64_t state = 0;
+        if (state == 0) {
+            static std::atomic<uint64_t> seed(0x9E3779B97F4A7C15ull);
+            state = seed.fetch_add(0x9E3779B97F4A7C15ull, std::memory_order_relaxed) | 1;
+        }
+        //xorshift64
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        uint64_t bits = state;
+        unsigned top = 0;
+        while ((bits & 3) == 0 && top < max_level - 1) {
+            bits >>= 2;
+            ++top;
+        }
+        return top;
+    }
+
+    //the first node after ptr at level 0 that is not erased
+    static _node* _next_live(_node* ptr) {
+        _node* next = _ptr(ptr->next[0].load(std::memory_order_acquire));
+        while (next != nullptr && _marked(next->next[0].load(std::memory_order_acquire))) {
+            next = _ptr(next->next[0].load(std::memory_order_acquire));
+        }
+        return next;
+    }
+
+    _node* _lower_bound(key_type const& key) const;
+
+    //fills preds and succs at every level up to _top, unlinking the marked
+    //nodes on the way; true when succs[0] holds key
+    bool _search(key_type const& key, _node** preds, _node** succs);
+
+    TKF::pair<iterator, bool> _insert(_node* node);
+
+    void _count(difference_type n) {
+        static thread_local unsigned stripe =
+            _stripe_seed().fetch_add(1, std::memory_order_relaxed) % _stripes;
+        _size[stripe].n.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    static std::atomic<unsigned>& _stripe_seed() {
+        static std::atomic<unsigned> seed(0);
+        return seed;
+    }
+};
+
+template <typename KEY, typename T, typename COMP>
+typename concurrent_skiplist_map<KEY, T, COMP>::_node*
+concurrent_skiplist_map<KEY, T, COMP>::_lower_bound (key_type const& key) const {
+    _node* pred = _head;
+    _node* curr = nullptr;
+    for (unsigned level = _top.load(std::memory_order_acquire); level-- > 0; ) {
+        curr = _ptr(pred->next[level].load(std::memory_order_acquire));
+        while (curr != nullptr) {
+            uintptr_t succ = curr->next[level].load(std::memory_order_acquire);
+            if (_marked(succ)) {
+                curr = _ptr(succ);
+            }
+            else if (_before(_key(curr), key)) {
+                pred = curr;
+                curr = _ptr(succ);
+            }
+            else {
+                break;
+            }
+        }
+    }
+    return curr;
+}
+
+template <typename KEY, typename T, typename COMP>
+bool concurrent_skiplist_map<KEY, T, COMP>::_search (key_type const& key,
+    _node** preds, _node** succs) {
+retry:
+    _node* pred = _head;
+    for (unsigned level = _top.load(std::memory_order_acquire); level-- > 0; ) {
+        _node* curr = _ptr(pred->next[level].load(std::memory_order_acquire));
+        while (curr != nullptr) {
+            uintptr_t succ = curr->next[level].load(std::memory_order_acquire);
+            if (_marked(succ)) {
+                //curr is erased: unlink it, or start over when pred
+                //changed or is being erased itself
+                uintptr_t expected = reinterpret_cast<uintptr_t>(curr);
+                if (!pred->next[level].compare_exchange_strong(expected, succ & ~_mark,
+                    std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    goto retry;
+                }
+                curr = _ptr(succ);
+            }
+            else if (_before(_key(curr), key)) {
+                pred = curr;
+                curr = _ptr(succ);
+            }
+            else {
+                break;
+            }
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return succs[0] != nullptr && _comp(_key(succs[0]), key);
+}
+
+template <typename KEY, typename T, typename COMP>
+TKF::pair<typename concurrent_skiplist_map<KEY, T, COMP>::iterator, bool>
+concurrent_skiplist_map<KEY, T, COMP>::_insert (_node* node) {
+    _node* preds[max_level];
+    _node* succs[max_level];
+    key_type const& key = _key(node);
+    unsigned top = node->top;
+    //searches must start at or above every level of the new node
+    unsigned levels = _top.load(std::memory_order_relaxed);
+    while (levels <= top && !_top.compare_exchange_weak(levels, top + 1,
+        std::memory_order_acq_rel, std::memory_order_relaxed)) {}
+
+    for (;;) {
+        if (_search(key, preds, succs)) {
+            _free(node);
+            return TKF::make_pair(iterator(succs[0]), false);
+        }
+        for (unsigned level = 0; level <= top; ++level) {
+            node->next[level].store(reinterpret_cast<uintptr_t>(succs[level]),
+                std::memory_order_relaxed);
+        }
+        uintptr_t expected = reinterpret_cast<uintptr_t>(succs[0]);
+        //once this succeeds the node is in the map
+        if (preds[0]->next[0].compare_exchange_strong(expected,
+            reinterpret_cast<uintptr_t>(node), std::memory_order_release,
+            std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    _count(1);
+    iterator result(node);
+
+    for (unsigned level = 1; level <= top; ++level) {
+        for (;;) {
+            //an erase that marked this level ends the building
+            uintptr_t next = node->next[level].load(std::memory_order_acquire);
+            uintptr_t succ = reinterpret_cast<uintptr_t>(succs[level]);
+            if (_marked(next) || (next != succ && !node->next[level].compare_exchange_strong(
+                next, succ, std::memory_order_acq_rel, std::memory_order_acquire))) {
+                goto built;
+            }
+            uintptr_t expected = succ;
+            if (preds[level]->next[level].compare_exchange_strong(expected,
+                reinterpret_cast<uintptr_t>(node), std::memory_order_release,
+                std::memory_order_relaxed)) {
+                break;
+            }
+            if (!_search(key, preds, succs) || succs[0] != node) {
+                goto built;
+            }
+        }
+    }
+built:
+    //an erase may have marked the node before a level was linked, and
+    //its own cleanup may have run before the link: unlink again
+    if (_marked(node->next[0].load(std::memory_order_acquire))) {
+        _search(key, preds, succs);
+    }
+    _release(node);
+    return TKF::make_pair(result, true);
+}
+
+template <typename KEY, typename T, typename COMP>
+typename concurrent_skiplist_map<KEY, T, COMP>::size_type
+concurrent_skiplist_map<KEY, T, COMP>::erase (key_type const& key) {
+    epoch::guard guard;
+    _node* preds[max_level];
+    _node* succs[max_level];
+    if (!_search(key, preds, succs)) {
+        return 0;
+    }
+    _node* node = succs[0];
+    //mark top down, so the node leaves the upper levels first
+    for (unsigned level = node->top; level > 0; --level) {
+        uintptr_t next = node->next[level].load(std::memory_order_acquire);
+        while (!_marked(next) && !node->next[level].compare_exchange_weak(
+            next, next | _mark, std::memory_order_acq_rel, std::memory_order_acquire)) {}
+    }
+    uintptr_t next = node->next[0].load(std::memory_order_acquire);
+    for (;;) {
+        if (_marked(next)) {
+            //another erase won
+            return 0;
+        }
+        if (node->next[0].compare_exchange_weak(next, next | _mark,
+            std::memory_order_acq_rel, std::memory_order_acquire)) {
+            break;
+        }
+    }
+    _count(-1);
+    _search(key, preds, succs);
+    _release(node);
+    return 1;
+}
+
+}
+
+#endif //!CONCURRENT_SKIPLIST_H
\ No newline at end of file
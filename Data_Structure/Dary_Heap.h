@@ -0,0 +1,532 @@
+//file: Dary_Heap.h
+#ifndef DARY_HEAP_H
+#define DARY_HEAP_H
+
+#include<new>
+#include<vector>
+#include<cstddef>
+#include<cstdint>
+#include<climits>
+#include"Allocator.h"
+#include"Algorithm.h"
+#include"Utility.h"
+#include"Fibonacci_Heap.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TKF_HEAP_SSE2 1
+#include<emmintrin.h>
+#endif
+
+namespace TKF {
+
+//names a value pushed into a DaryHeap that tracks positions: an id the
+//value keeps while it moves and the stamp it got, so that an id reused
+//for a later value no longer matches
+struct DARY_handle {
+    typedef size_t              id_type;
+    typedef unsigned long long  stamp_type;
+
+    id_type     id;
+    stamp_type  stamp;
+
+    DARY_handle() : id(static_cast<id_type>(-1)), stamp(0) {}
+    DARY_handle(id_type i, stamp_type s) : id(i), stamp(s) {}
+
+    friend bool operator == (DARY_handle const& lhs, DARY_handle const& rhs) {
+        return lhs.id == rhs.id && lhs.stamp == rhs.stamp;
+    }
+
+    friend bool operator != (DARY_handle const& lhs, DARY_handle const& rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+//which of D full children is least, by vector compares instead of D - 1
+//branches; only for plain 32-bit keys in TKF::less order
+template <typename T, typename COMP, size_t D>
+struct DARY_simd {
+    static constexpr bool enabled = false;
+
+    static size_t min_index(T const*) {
+        return 0;
+    }
+};
+
+#ifdef TKF_HEAP_SSE2
+//the children of a node start a group aligned to D keys, so 4 or 8 keys
+//are one or two aligned loads. BIAS flips the sign bit of unsigned keys,
+//which SSE2 only compares as signed.
+template <size_t D, int BIAS>
+struct DARY_simd_int32 {
+    static constexpr bool enabled = D == 4 || D == 8;
+
+    static __m128i _min(__m128i a, __m128i b) {
+        __m128i gt = _mm_cmpgt_epi32(a, b);
+        return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+    }
+
+    static size_t min_index(void const* p) {
+        __m128i const* v = static_cast<__m128i const*>(p);
+        __m128i bias = _mm_set1_epi32(BIAS);
+        __m128i a = _mm_xor_si128(_mm_load_si128(v), bias);
+        __m128i b = a;
+        if (D == 8) {
+            b = _mm_xor_si128(_mm_load_si128(v + 1), bias);
+        }
+        __m128i m = _min(a, b);
+        m = _min(m, _mm_shuffle_epi32(m, 0x4E));
+        m = _min(m, _mm_shuffle_epi32(m, 0xB1));
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, m)));
+        if (D == 8) {
+            mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(b, m))) << 4;
+        }
+        return TKF::count_trailing_zeros(mask);
+    }
+};
+
+template <size_t D>
+struct DARY_simd<int, TKF::less<int>, D> : public DARY_simd_int32<D, 0> {};
+
+template <size_t D>
+struct DARY_simd<unsigned, TKF::less<unsigned>, D> : public DARY_simd_int32<D, INT_MIN> {};
+
+//a NaN matches no lane; its order is undefined anyway, the first child
+//is as good as any
+template <size_t D>
+struct DARY_simd<float, TKF::less<float>, D> {
+    static constexpr bool enabled = D == 4 || D == 8;
+
+    static size_t min_index(float const* p) {
+        __m128 a = _mm_load_ps(p);
+        __m128 b = a;
+        if (D == 8) {
+            b = _mm_load_ps(p + 4);
+        }
+        __m128 m = _mm_min_ps(a, b);
+        m = _mm_min_ps(m, _mm_shuffle_ps(m, m, 0x4E));
+        m = _mm_min_ps(m, _mm_shuffle_ps(m, m, 0xB1));
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_cmpeq_ps(a, m));
+        if (D == 8) {
+            mask |= (unsigned)_mm_movemask_ps(_mm_cmpeq_ps(b, m)) << 4;
+        }
+        return mask == 0 ? 0 : TKF::count_trailing_zeros(mask);
+    }
+};
+#endif
+
+//implicit d-ary min-heap over one array, for priority_queue's HEAP.
+//Node k has its children at D * k + 1 ... D * k + D; the array starts
+//D - 1 slots into a cache line aligned buffer, so that every group of
+//children is aligned to D elements and, for D = 4 or 8 small keys, sits
+//in one cache line. Choosing the least child is then one line fetched
+//and, for 32-bit keys in TKF::less order, one vector compare.
+//TRACK: every value also gets an id that follows it through the array,
+//so handles can reach it for decrease, increase and erase; without it
+//push returns an empty handle and those are not available.
+template <typename T, typename COMP, size_t D = 4, bool TRACK = false>
+class DaryHeap {
+    static_assert(D >= 2, "DaryHeap needs at least two children per node");
+
+public:
+    typedef FIBH_value_traits<T>                value_traits;
+    typedef typename value_traits::key_type     key_type;
+    typedef typename value_traits::value_type   value_type;
+    typedef DARY_handle                         handle;
+
+    typedef COMP    key_compare;
+
+    typedef TKF::allocator<T>                   data_allocator;
+
+    typedef typename data_allocator::pointer        pointer;
+    typedef typename data_allocator::const_pointer  const_pointer;
+    typedef typename data_allocator::reference      reference;
+    typedef typename data_allocator::const_reference const_reference;
+    typedef typename data_allocator::size_type      size_type;
+    typedef typename data_allocator::difference_type difference_type;
+
+    static constexpr size_t arity = D;
+
+    key_compare key_comp() const { return _comp; }
+
+private:
+    typedef DARY_simd<T, COMP, D>               simd_type;
+
+    static constexpr size_type _npos = static_cast<size_type>(-1);
+
+    //where the value of an id is, or the next free id
+    struct _slot {
+        size_type               pos;
+        handle::stamp_type      stamp;  //0 while free
+    };
+
+    void*       _raw;
+    pointer     _data;
+    size_type   _num;
+    size_type   _cap;
+    key_compare _comp;
+    //TRACK only
+    std::vector<size_type>  _ids;       //id of the value at each position
+    std::vector<_slot>      _slots;
+    size_type               _free_id;
+    handle::stamp_type      _stamp;
+
+public:
+    DaryHeap() : _raw(nullptr), _data(nullptr), _num(0), _cap(0), _comp(),
+        _free_id(_npos), _stamp(0) {}
+
+    explicit DaryHeap(COMP const& comp) : _raw(nullptr), _data(nullptr), _num(0),
+        _cap(0), _comp(comp), _free_id(_npos), _stamp(0) {}
+
+    DaryHeap(DaryHeap const& rhs) : _raw(nullptr), _data(nullptr), _num(0), _cap(0),
+        _comp(rhs._comp), _ids(rhs._ids), _slots(rhs._slots), _free_id(rhs._free_id),
+        _stamp(rhs._stamp) {
+        reserve(rhs._num);
+        try {
+            for (; _num < rhs._num; ++_num) {
+                data_allocator::construct(_data + _num, rhs._data[_num]);
+            }
+        }
+        catch (...) {
+            //no destructor runs for a constructor that throws
+            clear();
+            ::operator delete(_raw);
+            throw;
+        }
+    }
+
+    DaryHeap(DaryHeap&& rhs) : _raw(rhs._raw), _data(rhs._data), _num(rhs._num),
+        _cap(rhs._cap), _comp(rhs._comp), _ids(TKF::move(rhs._ids)),
+        _slots(TKF::move(rhs._slots)), _free_id(rhs._free_id), _stamp(rhs._stamp) {
+        rhs._raw = nullptr;
+        rhs._data = nullptr;
+        rhs._num = 0;
+        rhs._cap = 0;
+        rhs._free_id = _npos;
+    }
+
+    DaryHeap& operator = (DaryHeap rhs) {
+        swap(rhs);
+        return *this;
+    }
+
+    ~DaryHeap() {
+        clear();
+        ::operator delete(_raw);
+    }
+
+    void swap(DaryHeap& rhs) noexcept {
+        std::swap(_raw, rhs._raw);
+        std::swap(_data, rhs._data);
+        std::swap(_num, rhs._num);
+        std::swap(_cap, rhs._cap);
+        std::swap(_comp, rhs._comp);
+        _ids.swap(rhs._ids);
+        _slots.swap(rhs._slots);
+        std::swap(_free_id, rhs._free_id);
+        std::swap(_stamp, rhs._stamp);
+    }
+
+    const_reference top_value() const {
+        return _data[0];
+    }
+
+    bool empty() const noexcept {
+        return _num == 0;
+    }
+
+    size_type size() const noexcept {
+        return _num;
+    }
+
+    size_type max_size() const noexcept {
+        return static_cast<size_type>(-1) / sizeof(T);
+    }
+
+    size_type capacity() const noexcept {
+        return _cap;
+    }
+
+    void reserve(size_type n) {
+        if (n > _cap) {
+            _grow(n);
+        }
+    }
+
+    template <typename ...Args>
+    handle emplace(Args&& ...args);
+
+    handle insert(value_type const& value) {
+        return emplace(value);
+    }
+
+    handle insert(value_type&& value) {
+        return emplace(TKF::move(value));
+    }
+
+    void pop();
+
+    void clear() noexcept;
+
+    //handles, need TRACK: whether the value a handle names is still in
+    bool contains(handle h) const noexcept {
+        static_assert(TRACK, "DaryHeap handles need TRACK");
+        return h.id < _slots.size() && h.stamp != 0 && _slots[h.id].stamp == h.stamp;
+    }
+
+    //false, and nothing changed, if h is stale or key is larger
+    bool decrease(handle h, key_type key) {
+        if (!contains(h) || !_comp(key, _key(_slots[h.id].pos))) {
+            return false;
+        }
+        size_type k = _slots[h.id].pos;
+        value_traits::change_key(_data[k], key);
+        _sift_up(k);
+        return true;
+    }
+
+    //false, and nothing changed, if h is stale or key is smaller
+    bool increase(handle h, key_type key) {
+        if (!contains(h) || !_comp(_key(_slots[h.id].pos), key)) {
+            return false;
+        }
+        size_type k = _slots[h.id].pos;
+        value_traits::change_key(_data[k], key);
+        _sift_down(k);
+        return true;
+    }
+
+    bool update(handle h, key_type key) {
+        if (!contains(h)) {
+            return false;
+        }
+        size_type k = _slots[h.id].pos;
+        value_traits::change_key(_data[k], key);
+        _restore(k);
+        return true;
+    }
+
+    bool erase(handle h);
+
+private:
+    key_type const& _key(size_type k) const {
+        return value_traits::get_key(_data[k]);
+    }
+
+    //strictly before, COMP being <=
+    bool _before(value_type const& lhs, value_type const& rhs) const {
+        return !_comp(value_traits::get_key(rhs), value_traits::get_key(lhs));
+    }
+
+    void _place(size_type k, size_type id) noexcept {
+        if (TRACK) {
+            _ids[k] = id;
+            _slots[id].pos = k;
+        }
+    }
+
+    size_type _min_child(size_type first) const;
+    void _sift_up(size_type k);
+    void _sift_down(size_type k);
+    void _restore(size_type k);
+    void _grow(size_type n);
+    void _reserve_id();
+    handle _take_id(size_type k) noexcept;
+    void _free(size_type id) noexcept;
+};
+
+template <typename T, typename COMP, size_t D, bool TRACK>
+template <typename ...Args>
+typename DaryHeap<T, COMP, D, TRACK>::handle
+DaryHeap<T, COMP, D, TRACK>::emplace (Args&&... args) {
+    THROW_OUT_OF_RANGE_IF(_num > max_size() - 1,
+        "DaryHeap<T, COMP> size is out of range");
+    if (_num == _cap) {
+        _grow(_cap < D ? D : 2 * _cap);
+    }
+    if (TRACK) {
+        _reserve_id();
+    }
+    data_allocator::construct(_data + _num, TKF::forward<Args>(args)...);
+    handle h = _take_id(_num);
+    _sift_up(_num++);
+    return h;
+}
+
+template <typename T, typename COMP, size_t D, bool TRACK>
+void DaryHeap<T, COMP, D, TRACK>::pop () {
+    if (TRACK) {
+        _free(_ids[0]);
+    }
+    --_num;
+    if (_num != 0) {
+        _data[0] = TKF::move(_data[_num]);
+        _place(0, TRACK ? _ids[_num] : 0);
+    }
+    data_allocator::destroy(_data + _num);
+    _sift_down(0);
+}
+
+template <typename T, typename COMP, size_t D, bool TRACK>
+bool DaryHeap<T, COMP, D, TRACK>::erase (handle h) {
+    if (!contains(h)) {
+        return false;
+    }
+    size_type k = _slots[h.id].pos;
+    _free(h.id);
+    --_num;
+    if (k != _num) {
+        _data[k] = TKF::move(_data[_num]);
+        _place(k, _ids[_num]);
+        data_allocator::destroy(_data + _num);
+        _restore(k);
+    }
+    else {
+        data_allocator::destroy(_data + _num);
+    }
+    return true;
+}
+
+template <typename T, typename COMP, size_t D, bool TRACK>
+void DaryHeap<T, COMP, D, TRACK>::clear () noexcept {
+    for (size_type k = 0; k < _num; ++k) {
+        data_allocator::destroy(_data + k);
+    }
+    _num = 0;
+    //stamps keep counting, so no handle from before matches a reused id
+    _slots.clear();
+    _free_id = _npos;
+}
+
+template <typename T, typename COMP, size_t D, bool TRACK>
+typename DaryHeap<T, COMP, D, TRACK>::size_type
+DaryHeap<T, COMP, D, TRACK>::_min_child (size_type first) const {
+    size_type last = first + D;
+    if (simd_type::enabled && last <= _num) {
+        return first + simd_type::min_index(_data + first);
+    }
+    if (last > _num) {
+        last = _num;
+    }
+    size_type m = first;
+    for (size_type c = first + 1; c < last; ++c) {
+        if (_before(_data[c], _data[m])) {
+            m = c;
+        }
+    }
+    return m;
+}
+
+//both sifts carry the value along in a hole and write it once at the end
+template <typename T, typename COMP, size_t D, bool TRACK>
+void DaryHeap<T, COMP, D, TRACK>::_sift_up (size_type k) {
+    if (k == 0) {
+        return;
+    }
+    value_type tmp = TKF::move(_data[k]);
+    size_type id = TRACK ? _ids[k] : 0;
+    while (k > 0) {
+        size_type p = (k - 1) / D;
+        if (!_before(tmp, _data[p])) {
+            break;
+        }
+        _data[k] = TKF::move(_data[p]);
+        _place(k, TRACK ? _ids[p] : 0);
+        k = p;
+    }
+    _data[k] = TKF::move(tmp);
+    _place(k, id);
+}
+
+template <typename T, typename COMP, size_t D, bool TRACK>
+void DaryHeap<T, COMP, D, TRACK>::_sift_down (size_type k) {
+    if (D * k + 1 >= _num) {
+        return;
+    }
+    value_type tmp = TKF::move(_data[k]);
+    size_type id = TRACK ? _ids[k] : 0;
+    for (size_type first; (first = D * k + 1) < _num; ) {
+        size_type m = _min_child(first);
+        if (!_before(_data[m], tmp)) {
+            break;
+        }
+        _data[k] = TKF::move(_data[m]);
+        _place(k, TRACK ? _ids[m] : 0);
+        k = m;
+    }
+    _data[k] = TKF::move(tmp);
+    _place(k, id);
+}
+
+template <typename T, typename COMP, size_t D, bool TRACK>
+void DaryHeap<T, COMP, D, TRACK>::_restore (size_type k) {
+    if (k > 0 && _before(_data[k], _data[(k - 1) / D])) {
+        _sift_up(k);
+    }
+    else {
+        _sift_down(k);
+    }
+}
+
+template <typename T, typename COMP, size_t D, bool TRACK>
+void DaryHeap<T, COMP, D, TRACK>::_grow (size_type n) {
+    if (TRACK) {
+        _ids.resize(n);
+    }
+    void* raw = ::operator new(sizeof(T) * (n + D - 1) + cache_line_size);
+    pointer data = reinterpret_cast<pointer>((reinterpret_cast<uintptr_t>(raw) +
+        cache_line_size - 1) & ~static_cast<uintptr_t>(cache_line_size - 1)) + (D - 1);
+    size_type k = 0;
+    try {
+        for (; k < _num; ++k) {
+            data_allocator::construct(data + k, TKF::move(_data[k]));
+        }
+    }
+    catch (...) {
+        while (k > 0) {
+            data_allocator::destroy(data + --k);
+        }
+        ::operator delete(raw);
+        throw;
+    }
+    for (k = 0; k < _num; ++k) {
+        data_allocator::destroy(_data + k);
+    }
+    ::operator delete(_raw);
+    _raw = raw;
+    _data = data;
+    _cap = n;
+}
+
+//ids are chained through pos while free
+template <typename T, typename COMP, size_t D, bool TRACK>
+void DaryHeap<T, COMP, D, TRACK>::_reserve_id () {
+    if (_free_id == _npos) {
+        _slot slot = { _npos, 0 };
+        _slots.push_back(slot);
+        _free_id = _slots.size() - 1;
+    }
+}
+
+template <typename T, typename COMP, size_t D, bool TRACK>
+typename DaryHeap<T, COMP, D, TRACK>::handle
+DaryHeap<T, COMP, D, TRACK>::_take_id (size_type k) noexcept {
+    if (!TRACK) {
+        return handle();
+    }
+    size_type id = _free_id;
+    _free_id = _slots[id].pos;
+    _slots[id].stamp = ++_stamp;
+    _place(k, id);
+    return handle(id, _stamp);
+}
+
+template <typename T, typename COMP, size_t D, bool TRACK>
+void DaryHeap<T, COMP, D, TRACK>::_free (size_type id) noexcept {
+    _slots[id].stamp = 0;
+    _slots[id].pos = _free_id;
+    _free_id = id;
+}
+
+}
+
+#endif //!DARY_HEAP_H
\ No newline at end of file
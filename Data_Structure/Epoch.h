@@ -0,0 +1,186 @@
+//file: Epoch.h
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include<atomic>
+#include<vector>
+#include<cstddef>
+#include<cstdint>
+#include"Algorithm.h"
+#include"Utility.h"
+
+namespace TKF {
+
+//epoch-based reclamation for lock-free structures.
+//A thread pins the global epoch while it may hold pointers into shared
+//nodes; an unlinked node is retired instead of freed, and freed once the
+//epoch has moved on twice, when no pinned thread can still see it.
+//The epoch moves on only when every pinned thread has seen the current
+//one, so a thread that stays pinned holds back reclamation for everyone.
+class epoch {
+public:
+    typedef void (*deleter_type)(void*);
+
+    //pins the calling thread while it lives; nests and copies freely,
+    //but must be destroyed on the thread that made it
+    class guard {
+    public:
+        guard() {
+            epoch::_pin();
+        }
+        guard(guard const&) {
+            epoch::_pin();
+        }
+        guard& operator = (guard const&) {
+            return *this;
+        }
+        ~guard() {
+            epoch::_unpin();
+        }
+    };
+
+    //frees p with deleter(p) once no thread pinned now can reach it.
+    //p must already be unreachable for threads that pin from now on.
+    static void retire(void* p, deleter_type deleter) {
+        _record& rec = _local();
+        uint64_t now = _global().load(std::memory_order_acquire);
+        _bag& bag = rec.bags[now % 3];
+        if (bag.epoch != now) {
+            //three epochs old, so at least two behind
+            _free(bag);
+            bag.epoch = now;
+        }
+        bag.items.push_back(TKF::make_pair(p, deleter));
+        if (++rec.retired >= _scan_period) {
+            rec.retired = 0;
+            collect();
+        }
+    }
+
+    //moves the epoch on if it can and frees what that made safe
+    static void collect() {
+        _collect(_local());
+    }
+
+private:
+    static constexpr unsigned _scan_period = 64;
+
+    struct _bag {
+        uint64_t epoch;
+        std::vector<TKF::pair<void*, deleter_type> > items;
+    };
+
+    //one per thread, never freed: a thread that exits hands its record,
+    //and whatever it retired, to the next thread that starts
+    struct _record {
+        std::atomic<uint64_t> state;    //epoch << 1 | 1 while pinned
+        std::atomic<bool>     in_use;
+        _record*              next;
+        unsigned              depth;
+        unsigned              retired;
+        _bag                  bags[3];
+
+        _record() : state(0), in_use(true), next(nullptr), depth(0), retired(0) {
+            for (unsigned i = 0; i < 3; ++i) {
+                bags[i].epoch = 0;
+            }
+        }
+    };
+
+    struct _owner {
+        _record* rec;
+        _owner() : rec(_acquire()) {}
+        //a thread on its way out frees what it can: with nobody else
+        //pinned, two more epochs free everything
+        ~_owner() {
+            _try_advance();
+            _try_advance();
+            _collect(*rec);
+            rec->in_use.store(false, std::memory_order_release);
+        }
+    };
+
+    static std::atomic<uint64_t>& _global() {
+        static std::atomic<uint64_t> global(0);
+        return global;
+    }
+
+    static std::atomic<_record*>& _records() {
+        static std::atomic<_record*> head(nullptr);
+        return head;
+    }
+
+    static _record& _local() {
+        static thread_local _owner owner;
+        return *owner.rec;
+    }
+
+    static _record* _acquire() {
+        for (_record* rec = _records().load(std::memory_order_acquire);
+            rec != nullptr; rec = rec->next) {
+            bool idle = false;
+            if (!rec->in_use.load(std::memory_order_relaxed) &&
+                rec->in_use.compare_exchange_strong(idle, true, std::memory_order_acquire)) {
+                return rec;
+            }
+        }
+        _record* rec = new _record();
+        _record* head = _records().load(std::memory_order_relaxed);
+        do {
+            rec->next = head;
+        } while (!_records().compare_exchange_weak(head, rec,
+            std::memory_order_release, std::memory_order_relaxed));
+        return rec;
+    }
+
+    static void _pin() {
+        _record& rec = _local();
+        if (rec.depth++ == 0) {
+            uint64_t now = _global().load(std::memory_order_relaxed);
+            rec.state.store(now << 1 | 1, std::memory_order_relaxed);
+            //the pin must be visible before any shared node is read
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    static void _unpin() {
+        _record& rec = _local();
+        if (--rec.depth == 0) {
+            rec.state.store(0, std::memory_order_release);
+        }
+    }
+
+    static void _try_advance() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t now = _global().load(std::memory_order_relaxed);
+        for (_record* rec = _records().load(std::memory_order_acquire);
+            rec != nullptr; rec = rec->next) {
+            uint64_t state = rec->state.load(std::memory_order_acquire);
+            if ((state & 1) && (state >> 1) != now) {
+                return;
+            }
+        }
+        _global().compare_exchange_strong(now, now + 1, std::memory_order_acq_rel);
+    }
+
+    static void _collect(_record& rec) {
+        _try_advance();
+        uint64_t now = _global().load(std::memory_order_acquire);
+        for (unsigned i = 0; i < 3; ++i) {
+            if (rec.bags[i].epoch + 2 <= now) {
+                _free(rec.bags[i]);
+            }
+        }
+    }
+
+    static void _free(_bag& bag) {
+        for (size_t i = 0; i < bag.items.size(); ++i) {
+            bag.items[i].second(bag.items[i].first);
+        }
+        bag.items.clear();
+    }
+};
+
+}
+
+#endif //!EPOCH_H
\ No newline at end of file
@@ -5,14 +5,10 @@
 #include"Allocator.h"
 #include"Utility.h"
 #include"Iterator.h"
-#include<cmath>
+#include"Algorithm.h"
 
 namespace TKF {
 
-#define phi 1.61803
-#define logphi(n) log2(n) / log2(phi)
-#define D(n) (unsigned int)(logphi(n)) + 1
-
 template <typename T, bool> struct FIBH_value_traits_;
 template <typename T> struct FIBH_value_traits;
 template <typename T> struct FIBH_node_traits;
@@ -20,6 +16,7 @@ template <typename T> struct FIBH_traits;
 
 template <typename T> struct FIBH_node_base;
 template <typename T> struct FIBH_node;
+template <typename T> struct FIBH_handle;
 
 typedef bool FIBH_mark_type;
 static const FIBH_mark_type marked = true;
@@ -37,7 +34,7 @@ struct FIBH_value_traits_ {
     }
 
     template <typename _Tp>
-    static void change_key (_Tp& old_key, _Tp const& new_key) {
+    static void change_key (_Tp& old_key, key_type const& new_key) {
         old_key = new_key;
     }
 
@@ -59,8 +56,8 @@ struct FIBH_value_traits_<T, true> {
     }
 
     template <typename _Tp>
-    static void change_key (_Tp& old_value, _Tp const& new_value) {
-        old_value.first = new_value.first;
+    static void change_key (_Tp& old_value, key_type const& new_key) {
+        old_value.first = new_key;
     }
 
     template <typename _Tp>
@@ -85,8 +82,8 @@ struct FIBH_value_traits {
     }
 
     template <typename _Tp>
-    static void change_key (_Tp& old_key, _Tp const& new_key) {
-        value_traits_type::change_key(old_key, new_key);
+    static void change_key (_Tp& old_value, key_type const& new_key) {
+        value_traits_type::change_key(old_value, new_key);
     }
 
     template <typename _Tp>
@@ -99,6 +96,7 @@ template <typename T>
 struct FIBH_node_traits {
     typedef FIBH_mark_type                     mark_type;
     typedef unsigned int                       degree_type;
+    typedef unsigned long long                 stamp_type;
 
     typedef FIBH_value_traits<T>               value_traits;
     typedef typename value_traits::key_type    key_type;
@@ -142,7 +140,9 @@ template <typename T>
 struct FIBH_node : public FIBH_node_base<T> {
     typedef FIBH_node_base<T>* base_ptr;
     typedef FIBH_node<T>*      node_ptr;
+    typedef typename FIBH_node_traits<T>::stamp_type stamp_type;
 
+    stamp_type stamp;   //which insert made the value, 0 once destroyed
     T value;
 
     base_ptr get_base_ptr() {
@@ -154,6 +154,28 @@ struct FIBH_node : public FIBH_node_base<T> {
     }
 };
 
+//names a value pushed into a FIBHeap: the node and the stamp it got,
+//so that a node recycled for a later value no longer matches
+template <typename T>
+struct FIBH_handle {
+    typedef FIBH_node<T>*                             node_ptr;
+    typedef typename FIBH_node_traits<T>::stamp_type  stamp_type;
+
+    node_ptr    node;
+    stamp_type  stamp;
+
+    FIBH_handle() : node(nullptr), stamp(0) {}
+    FIBH_handle(node_ptr ptr) : node(ptr), stamp(ptr->stamp) {}
+
+    friend bool operator == (FIBH_handle const& lhs, FIBH_handle const& rhs) {
+        return lhs.node == rhs.node && lhs.stamp == rhs.stamp;
+    }
+
+    friend bool operator != (FIBH_handle const& lhs, FIBH_handle const& rhs) {
+        return !(lhs == rhs);
+    }
+};
+
 template <typename T>
 struct FIBH_traits {
     typedef FIBH_value_traits<T>                value_traits;
@@ -171,9 +193,14 @@ struct FIBH_traits {
     typedef FIBH_node<T>                        node_type;
     typedef FIBH_node_base<T>*                  base_ptr;
     typedef FIBH_node<T>*                       node_ptr;
+    typedef FIBH_handle<T>                      handle;
 };
 
-template <typename T, typename COMP>
+//RECYCLE: nodes given back by pop, erase and destroy wait in a freelist
+//for the next insert or emplace instead of going back to the allocator,
+//so that a heap of steady size pushes and pops without allocating;
+//release() hands the cached nodes back
+template <typename T, typename COMP, bool RECYCLE = true>
 class FIBHeap {
 public:
     typedef FIBH_traits<T>                      heap_traits;
@@ -183,6 +210,7 @@ public:
     typedef typename heap_traits::node_type     node_type;
     typedef typename heap_traits::base_ptr      base_ptr;
     typedef typename heap_traits::node_ptr      node_ptr;
+    typedef typename heap_traits::handle        handle;
     typedef typename heap_traits::key_type      key_type;
     typedef typename heap_traits::value_type    value_type;
 
@@ -191,6 +219,7 @@ public:
     typedef TKF::allocator<T>                   data_allocator;
     typedef TKF::allocator<base_type>           base_allocator;
     typedef TKF::allocator<node_type>           node_allocator;
+    typedef TKF::allocator<base_ptr>            table_allocator;
 
     typedef typename data_allocator::pointer        pointer;
     typedef typename data_allocator::const_pointer  const_pointer;
@@ -206,6 +235,10 @@ protected:
     base_ptr _top;
     size_type _num;
     key_compare _comp;
+    base_ptr _free;         //recycled nodes, linked through right
+    base_ptr* _degrees;     //roots by degree while consolidating
+    size_type _degree_size;
+    typename handle::stamp_type _stamp;
 
 public:
     FIBHeap() {
@@ -214,27 +247,31 @@ public:
     
     FIBHeap(FIBHeap const& rhs) {
         _init();
-        if (rhs._num != 0)
-            _top = _copy(rhs.top());
+        try {
+            if (rhs._num != 0) {
+                _top->child = _copy(rhs.top(), _top);
+                _top->degree = rhs._top->degree;
+            }
+        }
+        catch (...) {
+            //_copy erased what it built, into the recycled nodes
+            release();
+            base_allocator::deallocate(_top);
+            throw;
+        }
         _num = rhs._num;
-        _comp = rhs._num;
+        _comp = rhs._comp;
     }
 
     FIBHeap(FIBHeap&& rhs) {
-        _top = TKF::move(rhs._top);
-        _num = rhs._num;
-        _comp = rhs._comp;
-        rhs._top = nullptr;
-        rhs._num = 0;
+        _init();
+        swap(rhs);
     }
 
     FIBHeap& operator = (FIBHeap const& rhs) {
         if (this != &rhs) {
-            clear();
-            if (rhs._num != 0)
-                _top = _copy(rhs.top());
-            _num = rhs._num;
-            _comp = rhs._num;
+            FIBHeap tmp(rhs);
+            swap(tmp);
         }
         return *this;
     }
@@ -242,21 +279,36 @@ public:
     FIBHeap& operator = (FIBHeap&& rhs) {
         if (this != &rhs) {
             clear();
-            _top = TKF::move(rhs._top);
-            _num = rhs._num;
-            _comp = rhs._num;
-            rhs._top = nullptr;
-            rhs._num = 0;
+            swap(rhs);
         }
         return *this;
     }
 
-    ~FIBHeap() { }
+    ~FIBHeap() {
+        clear();
+        release();
+        table_allocator::deallocate(_degrees, _degree_size);
+        base_allocator::deallocate(_top);
+    }
+
+    void swap(FIBHeap& rhs) noexcept {
+        std::swap(_top, rhs._top);
+        std::swap(_num, rhs._num);
+        std::swap(_comp, rhs._comp);
+        std::swap(_free, rhs._free);
+        std::swap(_degrees, rhs._degrees);
+        std::swap(_degree_size, rhs._degree_size);
+        std::swap(_stamp, rhs._stamp);
+    }
 
     base_ptr& top() const {
         return _top->child;
     }
 
+    const_reference top_value() const {
+        return top()->get_node_ptr()->value;
+    }
+
     bool empty() const noexcept { 
         return _num == 0; 
     }
@@ -278,13 +330,62 @@ public:
         return emplace(TKF::move(value));
     }
 
+    //unlinks the top node and hands it to the caller, who gives it back
+    //through destroy()
     node_ptr extract();
 
-    node_ptr decrease(base_ptr ptr, key_type key);
+    //extract() and destroy() in one
+    void pop() {
+        destroy(extract());
+    }
+
+    //the value of a node taken out by extract() is destroyed, the node
+    //recycled or freed
+    void destroy(node_ptr ptr) {
+        _destroy(ptr);
+    }
+
+    //false, and nothing changed, if key is larger than before
+    bool decrease(base_ptr ptr, key_type key);
+
+    //cuts the node out and puts it back in with the larger key; false,
+    //and nothing changed, if key is smaller than before
+    bool increase(base_ptr ptr, key_type key);
 
     void erase(base_ptr ptr);
 
+    //handles: whether the value a handle names is still in the heap.
+    //Only recycled nodes are checked, never freed ones, so this needs
+    //RECYCLE and no release() since the handle was made.
+    bool contains(handle h) const noexcept {
+        static_assert(RECYCLE, "FIBHeap handles need RECYCLE");
+        return h.node != nullptr && h.stamp != 0 && h.node->stamp == h.stamp;
+    }
+
+    //decrease or increase, whichever key asks for; false if h is stale
+    bool update(handle h, key_type key) {
+        if (!contains(h)) {
+            return false;
+        }
+        if (_comp(key, value_traits::get_key(h.node->value))) {
+            return decrease(h.node, key);
+        }
+        return increase(h.node, key);
+    }
+
+    bool erase(handle h) {
+        if (!contains(h)) {
+            return false;
+        }
+        erase(h.node);
+        return true;
+    }
+
     void clear();
+
+    //frees the recycled nodes
+    void release() noexcept;
+
 private:
     void _init() {
         _top = base_allocator::allocate(1);
@@ -295,14 +396,26 @@ private:
         _top->right = nullptr;
         _top->degree = 0;
         _num = 0;
+        _free = nullptr;
+        _degrees = nullptr;
+        _degree_size = 0;
+        _stamp = 0;
+    }
+
+    //a node of degree k roots at least F(k + 2) >= phi^k nodes, so degrees
+    //stay below log_phi(n) = log2(n) / 0.694..., and 3/2 per bit is above
+    static size_type _max_degree(size_type n) noexcept {
+        return 3 * (TKF::floor_log2(n) + 1) / 2 + 1;
     }
 
     template <typename ...Args>
     node_ptr _create(Args&&... args);
     node_ptr _clone(base_ptr ptr);
-    base_ptr _copy(base_ptr from);
+    base_ptr _copy(base_ptr from, base_ptr parent);
 
     void _destroy(node_ptr ptr);
+    void _recycle(node_ptr ptr) noexcept;
+    void _erase_list(base_ptr ptr);
 
     base_ptr _insert_list(base_ptr ptr, base_ptr head);
 
@@ -310,16 +423,25 @@ private:
 
     void _cut_list(base_ptr ptr, base_ptr head);
     void _cascading_cut(base_ptr ptr);
+    void _cut_to_top(base_ptr ptr);
 
 };
 
-template <typename T, typename COMP>
+template <typename T, typename COMP, bool RECYCLE>
 template <typename ...Args>
-typename FIBHeap<T, COMP>::node_ptr 
-FIBHeap<T, COMP>::_create (Args&&... args) {
-    auto tmp = node_allocator::allocate(1);
+typename FIBHeap<T, COMP, RECYCLE>::node_ptr 
+FIBHeap<T, COMP, RECYCLE>::_create (Args&&... args) {
+    node_ptr tmp;
+    if (_free != nullptr) {
+        tmp = _free->get_node_ptr();
+        _free = _free->right;
+    }
+    else {
+        tmp = node_allocator::allocate(1);
+    }
     try {
         data_allocator::construct(&tmp->value, TKF::forward<Args>(args)...);
+        tmp->stamp = ++_stamp;
         tmp->parent = nullptr;
         tmp->child = nullptr;
         tmp->left = tmp;
@@ -328,30 +450,113 @@ FIBHeap<T, COMP>::_create (Args&&... args) {
         tmp->degree = 0;
     }
     catch (...) {
-        node_allocator::deallocate(tmp);
+        _recycle(tmp);
         throw;
     }
     return tmp;
 }
 
-template <typename T, typename COMP>
-typename FIBHeap<T, COMP>::node_ptr
-FIBHeap<T, COMP>::_clone (base_ptr ptr) {
+template <typename T, typename COMP, bool RECYCLE>
+typename FIBHeap<T, COMP, RECYCLE>::node_ptr
+FIBHeap<T, COMP, RECYCLE>::_clone (base_ptr ptr) {
     node_ptr tmp = _create(ptr->get_node_ptr()->value);
     tmp->mark = ptr->mark;
+    tmp->degree = ptr->degree;
     return tmp;
 }
 
-template <typename T, typename COMP>
-void FIBHeap<T, COMP>::_destroy (node_ptr ptr) {
+//copies the circular list of from and everything below, each node put
+//in the list before its children are copied so that a throw leaves a
+//whole list to erase
+template <typename T, typename COMP, bool RECYCLE>
+typename FIBHeap<T, COMP, RECYCLE>::base_ptr
+FIBHeap<T, COMP, RECYCLE>::_copy (base_ptr from, base_ptr parent) {
+    base_ptr first = nullptr;
+    base_ptr link = from;
+    try {
+        do {
+            base_ptr tmp = _clone(link);
+            tmp->parent = parent;
+            if (first == nullptr) {
+                first = tmp;
+            }
+            else {
+                tmp->left = first->left;
+                tmp->right = first;
+                first->left->right = tmp;
+                first->left = tmp;
+            }
+            if (link->child != nullptr) {
+                tmp->child = _copy(link->child, tmp);
+            }
+            link = link->right;
+        } while (link != from);
+    }
+    catch (...) {
+        _erase_list(first);
+        throw;
+    }
+    return first;
+}
+
+template <typename T, typename COMP, bool RECYCLE>
+void FIBHeap<T, COMP, RECYCLE>::_destroy (node_ptr ptr) {
     data_allocator::destroy(&ptr->value);
-    node_allocator::deallocate(ptr);
+    ptr->stamp = 0;
+    _recycle(ptr);
+}
+
+template <typename T, typename COMP, bool RECYCLE>
+void FIBHeap<T, COMP, RECYCLE>::_recycle (node_ptr ptr) noexcept {
+    if (RECYCLE) {
+        ptr->right = _free;
+        _free = ptr;
+    }
+    else {
+        node_allocator::deallocate(ptr);
+    }
 }
 
-template <typename T, typename COMP>
+//destroys a circular list and all below it without recursion: the
+//children of each node are spliced in right after it before it goes
+template <typename T, typename COMP, bool RECYCLE>
+void FIBHeap<T, COMP, RECYCLE>::_erase_list (base_ptr ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    ptr->left->right = nullptr;
+    while (ptr != nullptr) {
+        base_ptr child = ptr->child;
+        if (child != nullptr) {
+            child->left->right = ptr->right;
+            ptr->right = child;
+        }
+        base_ptr next = ptr->right;
+        _destroy(ptr->get_node_ptr());
+        ptr = next;
+    }
+}
+
+template <typename T, typename COMP, bool RECYCLE>
+void FIBHeap<T, COMP, RECYCLE>::clear () {
+    _erase_list(_top->child);
+    _top->child = nullptr;
+    _top->degree = 0;
+    _num = 0;
+}
+
+template <typename T, typename COMP, bool RECYCLE>
+void FIBHeap<T, COMP, RECYCLE>::release () noexcept {
+    while (_free != nullptr) {
+        base_ptr next = _free->right;
+        node_allocator::deallocate(_free->get_node_ptr());
+        _free = next;
+    }
+}
+template <typename T, typename COMP, bool RECYCLE>
 template <typename ...Args>
-typename FIBHeap<T, COMP>::node_ptr
-FIBHeap<T, COMP>::emplace (Args&&... args) {
+typename FIBHeap<T, COMP, RECYCLE>::node_ptr
+FIBHeap<T, COMP, RECYCLE>::emplace (Args&&... args) {
     THROW_OUT_OF_RANGE_IF(_num > max_size() - 1,
         "FIBHeap<T, COMP> size is out of range");
     node_ptr ptr = _create(TKF::forward<Args>(args)...);
@@ -364,9 +569,9 @@ FIBHeap<T, COMP>::emplace (Args&&... args) {
     return ptr;
 }
 
-template <typename T, typename COMP>
-typename FIBHeap<T, COMP>::node_ptr
-FIBHeap<T, COMP>::insert (value_type const& value) {
+template <typename T, typename COMP, bool RECYCLE>
+typename FIBHeap<T, COMP, RECYCLE>::node_ptr
+FIBHeap<T, COMP, RECYCLE>::insert (value_type const& value) {
     THROW_OUT_OF_RANGE_IF(_num > max_size() - 1,
         "FIBHeap<T, COMP> size is out of range");
     node_ptr ptr = _create(value);
@@ -379,9 +584,9 @@ FIBHeap<T, COMP>::insert (value_type const& value) {
     return ptr;
 }
 
-template <typename T, typename COMP>
-typename FIBHeap<T, COMP>::base_ptr
-FIBHeap<T, COMP>::_insert_list (base_ptr ptr, base_ptr head) {
+template <typename T, typename COMP, bool RECYCLE>
+typename FIBHeap<T, COMP, RECYCLE>::base_ptr
+FIBHeap<T, COMP, RECYCLE>::_insert_list (base_ptr ptr, base_ptr head) {
     if (head->child == nullptr) {
         head->child = ptr;
         ptr->left = ptr;
@@ -408,14 +613,14 @@ FIBHeap<T, COMP>::_insert_list (base_ptr ptr, base_ptr head) {
     return ptr;
 }
 
-template <typename T, typename COMP>
-typename FIBHeap<T, COMP>::node_ptr
-FIBHeap<T, COMP>::extract() {
+template <typename T, typename COMP, bool RECYCLE>
+typename FIBHeap<T, COMP, RECYCLE>::node_ptr
+FIBHeap<T, COMP, RECYCLE>::extract() {
     base_ptr x = top()->child, z;
     node_ptr y = top()->get_node_ptr();
     if (x != nullptr) {
         x->parent = nullptr;
-        for (int i = 1; i <= y->degree; ++i) {
+        for (size_type i = 1; i <= y->degree; ++i) {
             z = x->right;
             z->left = x->left;
             z->left->right = z;
@@ -443,15 +648,22 @@ FIBHeap<T, COMP>::extract() {
     return y;
 }
 
-template <typename T, typename COMP>
-void FIBHeap<T, COMP>::_consolidate() {
-    auto n = D(_num);
-    auto aux_array = TKF::allocator<base_ptr>::allocate(n);
-    for (int i = 0; i < n; i++) {
+template <typename T, typename COMP, bool RECYCLE>
+void FIBHeap<T, COMP, RECYCLE>::_consolidate() {
+    size_type n = _max_degree(_num);
+    if (_degree_size < n) {
+        table_allocator::deallocate(_degrees, _degree_size);
+        _degrees = nullptr;
+        _degree_size = 0;
+        _degrees = table_allocator::allocate(n);
+        _degree_size = n;
+    }
+    base_ptr* aux_array = _degrees;
+    for (size_type i = 0; i < n; i++) {
         aux_array[i] = nullptr;
     }
     base_ptr x, y = top(), z;
-    for (int i = 1; i <= _top->degree; ++i) {
+    for (size_type i = 1; i <= _top->degree; ++i) {
         size_type d = y->degree;
         x = y->right;
         while (aux_array[d] != nullptr && aux_array[d] != y) {
@@ -487,8 +699,8 @@ void FIBHeap<T, COMP>::_consolidate() {
     _top->child->parent = _top;
 }
 
-template <typename T, typename COMP>
-void FIBHeap<T, COMP>::_cut_list (base_ptr ptr, base_ptr head) {
+template <typename T, typename COMP, bool RECYCLE>
+void FIBHeap<T, COMP, RECYCLE>::_cut_list (base_ptr ptr, base_ptr head) {
     if (ptr->right == ptr) {
         head->child = nullptr;
     }
@@ -504,8 +716,8 @@ void FIBHeap<T, COMP>::_cut_list (base_ptr ptr, base_ptr head) {
     --head->degree;
 }
 
-template <typename T, typename COMP>
-void FIBHeap<T, COMP>::_cascading_cut (base_ptr ptr) {
+template <typename T, typename COMP, bool RECYCLE>
+void FIBHeap<T, COMP, RECYCLE>::_cascading_cut (base_ptr ptr) {
     auto z = ptr->parent;
     if (z != nullptr && z != _top) {
         if (ptr->mark == unmarked) {
@@ -518,12 +730,11 @@ void FIBHeap<T, COMP>::_cascading_cut (base_ptr ptr) {
     }
 }
 
-template <typename T, typename COMP>
-typename FIBHeap<T, COMP>::node_ptr
-FIBHeap<T, COMP>::decrease (base_ptr ptr, key_type key) {
-    THROW_OUT_OF_RANGE_IF(!_comp(key, value_traits::
-        get_key(ptr->get_node_ptr()->value)),
-        "FIBHeap<T, COMP>::decrease: key is larger than before");
+template <typename T, typename COMP, bool RECYCLE>
+bool FIBHeap<T, COMP, RECYCLE>::decrease (base_ptr ptr, key_type key) {
+    if (!_comp(key, value_traits::get_key(ptr->get_node_ptr()->value))) {
+        return false;
+    }
     value_traits::change_key(ptr->get_node_ptr()->value, key);
     auto y = ptr->parent;
     if (y != nullptr && y != _top && 
@@ -535,14 +746,42 @@ FIBHeap<T, COMP>::decrease (base_ptr ptr, key_type key) {
         ptr->parent = _top;
         _top->child = ptr;
     }
-    return ptr->get_node_ptr();
+    return true;
 }
 
-template <typename T, typename COMP>
-void FIBHeap<T, COMP>::erase (base_ptr ptr) {
-    decrease(ptr, value_traits::get_key(top()->get_node_ptr()->value));
+template <typename T, typename COMP, bool RECYCLE>
+bool FIBHeap<T, COMP, RECYCLE>::increase (base_ptr ptr, key_type key) {
+    node_ptr node = ptr->get_node_ptr();
+    if (!_comp(value_traits::get_key(node->value), key)) {
+        return false;
+    }
+    _cut_to_top(ptr);
+    extract();
+    value_traits::change_key(node->value, key);
+    _insert_list(node, _top);
+    if (_comp(key, value_traits::get_key(top()->get_node_ptr()->value))) {
+        _top->child = node;
+    }
+    ++_num;
+    return true;
+}
+
+//moves the node to the root list and makes it the top whatever its key,
+//for an extract() to take it out next
+template <typename T, typename COMP, bool RECYCLE>
+void FIBHeap<T, COMP, RECYCLE>::_cut_to_top (base_ptr ptr) {
+    auto y = ptr->parent;
+    if (y != nullptr && y != _top) {
+        _cut_list(ptr, y);
+        _cascading_cut(y);
+    }
     _top->child = ptr;
-    _destroy(extract());
+}
+
+template <typename T, typename COMP, bool RECYCLE>
+void FIBHeap<T, COMP, RECYCLE>::erase (base_ptr ptr) {
+    _cut_to_top(ptr);
+    pop();
 }
 
 }
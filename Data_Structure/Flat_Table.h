@@ -0,0 +1,731 @@
+//file: Flat_Table.h
+#ifndef FLAT_TABLE_H
+#define FLAT_TABLE_H
+
+#include<new>
+#include<vector>
+#include<cstring>
+#include<cstddef>
+#include<algorithm>
+#include<type_traits>
+#include"Iterator.h"
+#include"Allocator.h"
+#include"Algorithm.h"
+#include"Utility.h"
+#include"B_Tree.h"
+
+namespace TKF {
+
+//sorted table: keys in one contiguous array and the mapped values in
+//another at the same index, so a search reads nothing but keys.
+//Meant for tables built once and read many times: a lookup is a binary
+//search over an array, but inserting or erasing one element shifts the
+//tail, O(n), and like BTree every change invalidates iterators.
+
+//what an iterator points at: the key and mapped value of one slot,
+//used like the pair the other maps hand out
+template <typename KEY, typename T>
+struct Flat_reference {
+    KEY const&  first;
+    T&          second;
+
+    Flat_reference(KEY const& key, T& value) : first(key), second(value) {}
+
+    operator TKF::pair<KEY, T> () const {
+        return TKF::pair<KEY, T>(first, second);
+    }
+};
+
+template <typename KEY, typename T>
+struct Flat_iterator : public TKF::iterator<TKF::_random_iterator, TKF::pair<KEY, T> > {
+    typedef Flat_reference<KEY, T>      reference;
+    typedef Flat_iterator<KEY, T>       self;
+    typedef ptrdiff_t                   difference_type;
+
+    //operator -> needs something to point at
+    struct pointer {
+        reference ref;
+        reference const* operator -> () const {
+            return &ref;
+        }
+    };
+
+    KEY* key;
+    T*   value;
+
+    Flat_iterator() : key(nullptr), value(nullptr) {}
+    Flat_iterator(KEY* k, T* v) : key(k), value(v) {}
+
+    reference operator *() const {
+        return reference(*key, *value);
+    }
+
+    pointer operator ->() const {
+        return pointer{ reference(*key, *value) };
+    }
+
+    reference operator [] (difference_type n) const {
+        return reference(key[n], value[n]);
+    }
+
+    self& operator ++ () {
+        ++key;
+        ++value;
+        return *this;
+    }
+
+    self operator ++ (int) {
+        self tmp(*this);
+        ++*this;
+        return tmp;
+    }
+
+    self& operator -- () {
+        --key;
+        --value;
+        return *this;
+    }
+
+    self operator -- (int) {
+        self tmp(*this);
+        --*this;
+        return tmp;
+    }
+
+    self& operator += (difference_type n) {
+        key += n;
+        value += n;
+        return *this;
+    }
+
+    self& operator -= (difference_type n) {
+        key -= n;
+        value -= n;
+        return *this;
+    }
+
+    self operator + (difference_type n) const {
+        return self(key + n, value + n);
+    }
+
+    self operator - (difference_type n) const {
+        return self(key - n, value - n);
+    }
+
+    difference_type operator - (self const& rhs) const {
+        return key - rhs.key;
+    }
+
+    bool operator == (self const& rhs) const {
+        return key == rhs.key;
+    }
+
+    bool operator != (self const& rhs) const {
+        return key != rhs.key;
+    }
+
+    bool operator < (self const& rhs) const {
+        return key < rhs.key;
+    }
+
+    bool operator > (self const& rhs) const {
+        return key > rhs.key;
+    }
+
+    bool operator <= (self const& rhs) const {
+        return key <= rhs.key;
+    }
+
+    bool operator >= (self const& rhs) const {
+        return key >= rhs.key;
+    }
+};
+
+//binary search over n sorted keys without a branch on the outcome:
+//lower gives the first i with key <= keys[i], upper the first i with
+//key < keys[i]. Each step halves the range and keeps the upper half by
+//a conditional move, so a mispredicted comparison costs nothing; the
+//two places the next probe may land are prefetched meanwhile.
+template <typename KEY, typename COMP, bool = BTree_search<KEY, COMP>::vector>
+struct Flat_search {
+    template <typename K>
+    static size_t lower(KEY const* keys, size_t n, K const& key, COMP const& comp) {
+        if (n == 0) {
+            return 0;
+        }
+        KEY const* base = keys;
+        while (n > 1) {
+            size_t half = n / 2;
+            TKF::prefetch(base + half / 2);
+            TKF::prefetch(base + half + half / 2);
+            base = !comp(key, base[half]) ? base + half : base;
+            n -= half;
+        }
+        return (base - keys) + !comp(key, *base);
+    }
+
+    template <typename K>
+    static size_t upper(KEY const* keys, size_t n, K const& key, COMP const& comp) {
+        if (n == 0) {
+            return 0;
+        }
+        KEY const* base = keys;
+        while (n > 1) {
+            size_t half = n / 2;
+            TKF::prefetch(base + half / 2);
+            TKF::prefetch(base + half + half / 2);
+            base = comp(base[half], key) ? base + half : base;
+            n -= half;
+        }
+        return (base - keys) + comp(*base, key);
+    }
+};
+
+//arithmetic keys under TKF::less: the halving stops at one cache line
+//of keys, which the SIMD compares of the B+ tree leaves finish off
+template <typename KEY>
+struct Flat_search<KEY, TKF::less<KEY>, true> {
+    typedef BTree_search<KEY, TKF::less<KEY> > block;
+    static constexpr size_t _window =
+        cache_line_size / sizeof(KEY) < 4 ? 4 : cache_line_size / sizeof(KEY);
+
+    static size_t lower(KEY const* keys, size_t n, KEY key, TKF::less<KEY> const& comp) {
+        KEY const* base = keys;
+        while (n > _window) {
+            size_t half = n / 2;
+            TKF::prefetch(base + half / 2);
+            TKF::prefetch(base + half + half / 2);
+            base = base[half] < key ? base + half : base;
+            n -= half;
+        }
+        return (base - keys) + block::lower(base, (unsigned)n, key, comp);
+    }
+
+    static size_t upper(KEY const* keys, size_t n, KEY key, TKF::less<KEY> const& comp) {
+        KEY const* base = keys;
+        while (n > _window) {
+            size_t half = n / 2;
+            TKF::prefetch(base + half / 2);
+            TKF::prefetch(base + half + half / 2);
+            base = base[half] <= key ? base + half : base;
+            n -= half;
+        }
+        return (base - keys) + block::upper(base, (unsigned)n, key, comp);
+    }
+};
+
+template <typename KEY, typename T, typename COMP,
+    typename ALLOC = TKF::allocator<TKF::pair<KEY, T> > >
+class FlatTable {
+public:
+    typedef KEY                                     key_type;
+    typedef T                                       map_type;
+    typedef TKF::pair<KEY, T>                       value_type;
+    typedef COMP                                    key_compare;
+    typedef ALLOC                                   allocator_type;
+    typedef typename ALLOC::template rebind<KEY>::other key_allocator;
+    typedef typename ALLOC::template rebind<T>::other   map_allocator;
+
+    typedef Flat_iterator<KEY, T>                   iterator;
+    typedef TKF::reverse_iterator<iterator>         reverse_iterator;
+    typedef typename iterator::reference            reference;
+    typedef typename iterator::pointer              pointer;
+    typedef size_t                                  size_type;
+    typedef ptrdiff_t                               difference_type;
+
+private:
+    typedef Flat_search<KEY, COMP>                  search;
+
+    KEY*            _keys;
+    T*              _values;
+    size_type       _num;
+    size_type       _cap;
+    COMP            _comp;
+    key_allocator   _key_alloc;
+    map_allocator   _map_alloc;
+
+public:
+    FlatTable() : _keys(nullptr), _values(nullptr), _num(0), _cap(0), _comp() {}
+
+    explicit FlatTable(COMP const& comp)
+        : _keys(nullptr), _values(nullptr), _num(0), _cap(0), _comp(comp) {}
+
+    FlatTable(FlatTable const& rhs)
+        : _keys(nullptr), _values(nullptr), _num(0), _cap(0), _comp(rhs._comp) {
+        reserve(rhs._num);
+        for (size_type i = 0; i < rhs._num; ++i) {
+            _push_back(rhs._keys[i], rhs._values[i]);
+        }
+    }
+
+    FlatTable(FlatTable&& rhs)
+        : _keys(rhs._keys), _values(rhs._values), _num(rhs._num), _cap(rhs._cap),
+        _comp(rhs._comp), _key_alloc(TKF::move(rhs._key_alloc)),
+        _map_alloc(TKF::move(rhs._map_alloc)) {
+        rhs._keys = nullptr;
+        rhs._values = nullptr;
+        rhs._num = rhs._cap = 0;
+    }
+
+    FlatTable& operator = (FlatTable const& rhs) {
+        if (this != &rhs) {
+            FlatTable tmp(rhs);
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    FlatTable& operator = (FlatTable&& rhs) {
+        if (this != &rhs) {
+            FlatTable tmp(TKF::move(rhs));
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    ~FlatTable() {
+        clear();
+        _free(_keys, _values, _cap);
+    }
+
+    void swap(FlatTable& rhs) {
+        std::swap(_keys, rhs._keys);
+        std::swap(_values, rhs._values);
+        std::swap(_num, rhs._num);
+        std::swap(_cap, rhs._cap);
+        std::swap(_comp, rhs._comp);
+        std::swap(_key_alloc, rhs._key_alloc);
+        std::swap(_map_alloc, rhs._map_alloc);
+    }
+
+    key_compare key_comp() const {
+        return _comp;
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_type();
+    }
+
+    iterator begin() const noexcept {
+        return iterator(_keys, _values);
+    }
+
+    iterator end() const noexcept {
+        return iterator(_keys + _num, _values + _num);
+    }
+
+    reverse_iterator rbegin() const noexcept {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() const noexcept {
+        return reverse_iterator(begin());
+    }
+
+    bool empty() const noexcept {
+        return _num == 0;
+    }
+
+    size_type size() const noexcept {
+        return _num;
+    }
+
+    size_type max_size() const noexcept {
+        return static_cast<size_type>(-1) / (sizeof(KEY) + sizeof(T));
+    }
+
+    size_type capacity() const noexcept {
+        return _cap;
+    }
+
+    //the key array, in order; for callers that search it themselves
+    KEY const* keys() const noexcept {
+        return _keys;
+    }
+
+    T* values() const noexcept {
+        return _values;
+    }
+
+    void reserve(size_type n) {
+        if (n > _cap) {
+            _reallocate(n);
+        }
+    }
+
+    void shrink_to_fit() {
+        if (_num < _cap) {
+            _reallocate(_num);
+        }
+    }
+
+    void clear() noexcept {
+        _destroy_range(0, _num);
+        _num = 0;
+    }
+
+    //search
+    template <typename K>
+    iterator lower_bound(K const& key) const {
+        return begin() + search::lower(_keys, _num, key, _comp);
+    }
+
+    template <typename K>
+    iterator upper_bound(K const& key) const {
+        return begin() + search::upper(_keys, _num, key, _comp);
+    }
+
+    template <typename K>
+    iterator find(K const& key) const {
+        size_type i = search::lower(_keys, _num, key, _comp);
+        return i < _num && _comp(_keys[i], key) ? begin() + i : end();
+    }
+
+    template <typename K>
+    size_type count(K const& key) const {
+        return search::upper(_keys, _num, key, _comp) -
+            search::lower(_keys, _num, key, _comp);
+    }
+
+    template <typename K>
+    TKF::pair<iterator, iterator> equal_range(K const& key) const {
+        return TKF::make_pair(lower_bound(key), upper_bound(key));
+    }
+
+    //insert: a unique table keeps the element already there, a multi
+    //table puts the new one after its equal keys
+    template <typename K, typename ...Args>
+    TKF::pair<iterator, bool> unique_emplace_key(K&& key, Args&&... args) {
+        size_type i = search::lower(_keys, _num, key, _comp);
+        if (i < _num && _comp(_keys[i], key)) {
+            return TKF::make_pair(begin() + i, false);
+        }
+        return TKF::make_pair(_emplace_at(i, TKF::forward<K>(key),
+            TKF::forward<Args>(args)...), true);
+    }
+
+    //a right hint is the position key goes to: then nothing is searched
+    template <typename K, typename ...Args>
+    iterator unique_emplace_key_hint(iterator hint, K&& key, Args&&... args) {
+        size_type i = hint - begin();
+        if (_hint_fits(i, key, true)) {
+            return _emplace_at(i, TKF::forward<K>(key), TKF::forward<Args>(args)...);
+        }
+        return unique_emplace_key(TKF::forward<K>(key),
+            TKF::forward<Args>(args)...).first;
+    }
+
+    template <typename K, typename ...Args>
+    iterator multi_emplace_key(K&& key, Args&&... args) {
+        size_type i = search::upper(_keys, _num, key, _comp);
+        return _emplace_at(i, TKF::forward<K>(key), TKF::forward<Args>(args)...);
+    }
+
+    template <typename K, typename ...Args>
+    iterator multi_emplace_key_hint(iterator hint, K&& key, Args&&... args) {
+        size_type i = hint - begin();
+        if (_hint_fits(i, key, false)) {
+            return _emplace_at(i, TKF::forward<K>(key), TKF::forward<Args>(args)...);
+        }
+        return multi_emplace_key(TKF::forward<K>(key), TKF::forward<Args>(args)...);
+    }
+
+    //bulk insert: sort the batch, then merge it in from the back, in
+    //place. O(n + m log m) for m new elements against m inserts of O(n)
+    template <typename ITER>
+    void unique_insert(ITER first, ITER last) {
+        _insert_batch(first, last, true);
+    }
+
+    template <typename ITER>
+    void multi_insert(ITER first, ITER last) {
+        _insert_batch(first, last, false);
+    }
+
+    //replaces the contents in O(n) from n elements in key order;
+    //a unique table keeps the first of equal keys
+    template <typename ITER>
+    void build_from_sorted(ITER first, size_type n, bool unique) {
+        clear();
+        reserve(n);
+        for (size_type i = 0; i < n; ++i, ++first) {
+            value_type const& value = *first;
+            if (unique && _num != 0 && _comp(value.first, _keys[_num - 1])) {
+                continue;
+            }
+            _push_back(value.first, value.second);
+        }
+    }
+
+    //erase
+    iterator erase(iterator pos) {
+        size_type i = pos - begin();
+        _destroy_range(i, i + 1);
+        _move_down(_keys + i + 1, _num - i - 1);
+        _move_down(_values + i + 1, _num - i - 1);
+        --_num;
+        return begin() + i;
+    }
+
+    iterator erase(iterator first, iterator last) {
+        size_type i = first - begin();
+        size_type j = last - begin();
+        if (i == j) {
+            return first;
+        }
+        _destroy_range(i, j);
+        for (size_type k = j; k < _num; ++k) {
+            _relocate(_keys + k - (j - i), _keys + k);
+            _relocate(_values + k - (j - i), _values + k);
+        }
+        _num -= j - i;
+        return begin() + i;
+    }
+
+    size_type unique_erase(key_type const& key) {
+        iterator pos = find(key);
+        if (pos == end()) {
+            return 0;
+        }
+        erase(pos);
+        return 1;
+    }
+
+    size_type multi_erase(key_type const& key) {
+        TKF::pair<iterator, iterator> range = equal_range(key);
+        size_type n = range.second - range.first;
+        erase(range.first, range.second);
+        return n;
+    }
+
+    bool operator == (FlatTable const& rhs) const {
+        if (_num != rhs._num) {
+            return false;
+        }
+        for (size_type i = 0; i < _num; ++i) {
+            if (!(_comp(_keys[i], rhs._keys[i]) && _comp(rhs._keys[i], _keys[i])) ||
+                !(_values[i] == rhs._values[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator < (FlatTable const& rhs) const {
+        size_type n = _num < rhs._num ? _num : rhs._num;
+        for (size_type i = 0; i < n; ++i) {
+            if (!_comp(rhs._keys[i], _keys[i])) {
+                return true;
+            }
+            if (!_comp(_keys[i], rhs._keys[i])) {
+                return false;
+            }
+            if (_values[i] < rhs._values[i]) {
+                return true;
+            }
+            if (rhs._values[i] < _values[i]) {
+                return false;
+            }
+        }
+        return _num < rhs._num;
+    }
+
+private:
+    //whether i is where key belongs: after every smaller key and, for a
+    //unique table, not next to an equal one
+    template <typename K>
+    bool _hint_fits(size_type i, K const& key, bool unique) const {
+        if (i > _num) {
+            return false;
+        }
+        if (i > 0 && (unique ? _comp(key, _keys[i - 1]) : !_comp(_keys[i - 1], key))) {
+            return false;
+        }
+        return i == _num || !_comp(_keys[i], key);
+    }
+
+    //key and args may refer into the table: the new element is built
+    //before anything moves, in the new arrays when they grow and aside
+    //when the tail has to shift
+    template <typename K, typename ...Args>
+    iterator _emplace_at(size_type i, K&& key, Args&&... args) {
+        THROW_OUT_OF_RANGE_IF(_num >= max_size(), "FlatTable<KEY, T> size out of range");
+        if (_num == _cap) {
+            _grow_at(i, TKF::forward<K>(key), TKF::forward<Args>(args)...);
+        }
+        else if (i == _num) {
+            _push_back(TKF::forward<K>(key), TKF::forward<Args>(args)...);
+        }
+        else {
+            KEY k(TKF::forward<K>(key));
+            T value(TKF::forward<Args>(args)...);
+            _move_up(_keys + i, _num - i);
+            _move_up(_values + i, _num - i);
+            ::new ((void*)(_keys + i)) KEY(TKF::move(k));
+            ::new ((void*)(_values + i)) T(TKF::move(value));
+            ++_num;
+        }
+        return begin() + i;
+    }
+
+    template <typename K, typename ...Args>
+    void _grow_at(size_type i, K&& key, Args&&... args) {
+        size_type cap = _cap < 8 ? 8 : 2 * _cap;
+        FlatTable tmp(_comp);
+        tmp._reallocate(cap);
+        ::new ((void*)(tmp._keys + i)) KEY(TKF::forward<K>(key));
+        try {
+            ::new ((void*)(tmp._values + i)) T(TKF::forward<Args>(args)...);
+        }
+        catch (...) {
+            tmp._keys[i].~KEY();
+            throw;
+        }
+        for (size_type k = 0; k < _num; ++k) {
+            size_type to = k < i ? k : k + 1;
+            _relocate(tmp._keys + to, _keys + k);
+            _relocate(tmp._values + to, _values + k);
+        }
+        tmp._num = _num + 1;
+        _num = 0;
+        swap(tmp);
+    }
+
+    template <typename K, typename ...Args>
+    void _push_back(K&& key, Args&&... args) {
+        ::new ((void*)(_keys + _num)) KEY(TKF::forward<K>(key));
+        try {
+            ::new ((void*)(_values + _num)) T(TKF::forward<Args>(args)...);
+        }
+        catch (...) {
+            _keys[_num].~KEY();
+            throw;
+        }
+        ++_num;
+    }
+
+    template <typename ITER>
+    void _insert_batch(ITER first, ITER last, bool unique) {
+        std::vector<value_type> batch(first, last);
+        if (batch.empty()) {
+            return;
+        }
+        COMP comp = _comp;
+        std::stable_sort(batch.begin(), batch.end(),
+            [&comp](value_type const& lhs, value_type const& rhs) {
+                return !comp(rhs.first, lhs.first);
+        });
+        size_type m = batch.size();
+        if (unique) {
+            //first of equal keys in the batch, and none already here
+            size_type k = 0;
+            for (size_type j = 0; j < m; ++j) {
+                if (k != 0 && comp(batch[j].first, batch[k - 1].first)) {
+                    continue;
+                }
+                if (find(batch[j].first) != end()) {
+                    continue;
+                }
+                if (k != j) {
+                    batch[k] = TKF::move(batch[j]);
+                }
+                ++k;
+            }
+            m = k;
+        }
+        if (m == 0) {
+            return;
+        }
+        THROW_OUT_OF_RANGE_IF(_num > max_size() - m, "FlatTable<KEY, T> size out of range");
+        if (_num + m > _cap) {
+            _reallocate(_num + m > 2 * _cap ? _num + m : 2 * _cap);
+        }
+        //from the back: every slot written to is free, either past the
+        //old end or vacated by an element already moved up
+        size_type i = _num, j = m, k = _num + m;
+        while (j > 0) {
+            --k;
+            if (i > 0 && !_comp(_keys[i - 1], batch[j - 1].first)) {
+                --i;
+                _relocate(_keys + k, _keys + i);
+                _relocate(_values + k, _values + i);
+            }
+            else {
+                --j;
+                ::new ((void*)(_keys + k)) KEY(TKF::move(batch[j].first));
+                ::new ((void*)(_values + k)) T(TKF::move(batch[j].second));
+            }
+        }
+        _num += m;
+    }
+
+    void _reallocate(size_type cap) {
+        KEY* keys = cap == 0 ? nullptr : _key_alloc.allocate(cap);
+        T* values = nullptr;
+        try {
+            values = cap == 0 ? nullptr : _map_alloc.allocate(cap);
+        }
+        catch (...) {
+            if (keys != nullptr) {
+                _key_alloc.deallocate(keys, cap);
+            }
+            throw;
+        }
+        for (size_type i = 0; i < _num; ++i) {
+            _relocate(keys + i, _keys + i);
+            _relocate(values + i, _values + i);
+        }
+        _free(_keys, _values, _cap);
+        _keys = keys;
+        _values = values;
+        _cap = cap;
+    }
+
+    void _free(KEY* keys, T* values, size_type cap) {
+        if (cap != 0) {
+            _key_alloc.deallocate(keys, cap);
+            _map_alloc.deallocate(values, cap);
+        }
+    }
+
+    void _destroy_range(size_type first, size_type last) noexcept {
+        for (size_type i = first; i < last; ++i) {
+            _keys[i].~KEY();
+            _values[i].~T();
+        }
+    }
+
+    //moving an element to raw memory and ending the old one
+    template <typename U>
+    static void _relocate(U* to, U* from) {
+        ::new ((void*)to) U(TKF::move(*from));
+        from->~U();
+    }
+
+    //[p, p + n) one slot up or down, into the raw slot at the far end
+    template <typename U>
+    static void _move_up(U* p, size_type n) {
+        if (std::is_trivially_copyable<U>::value) {
+            std::memmove((void*)(p + 1), (void const*)p, n * sizeof(U));
+            return;
+        }
+        for (size_type k = n; k > 0; --k) {
+            _relocate(p + k, p + k - 1);
+        }
+    }
+
+    template <typename U>
+    static void _move_down(U* p, size_type n) {
+        if (std::is_trivially_copyable<U>::value) {
+            std::memmove((void*)(p - 1), (void const*)p, n * sizeof(U));
+            return;
+        }
+        for (size_type k = 0; k < n; ++k) {
+            _relocate(p + k - 1, p + k);
+        }
+    }
+};
+
+}
+
+#endif //!FLAT_TABLE_H
\ No newline at end of file
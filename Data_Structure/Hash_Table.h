@@ -0,0 +1,632 @@
+//file: Hash_Table.h
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+#include<new>
+#include<tuple>
+#include<cstring>
+#include<cstddef>
+#include<cstdint>
+#include<utility>
+#include"Iterator.h"
+#include"Allocator.h"
+#include"Algorithm.h"
+#include"Utility.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TKF_HASH_SSE2 1
+#include<emmintrin.h>
+#endif
+
+namespace TKF {
+
+//open addressing hash table in the swiss table manner: a flat array of
+//slots and, next to it, one control byte per slot, empty or the low 7
+//bits of the hash of the element there. A lookup compares a whole group
+//of control bytes with those 7 bits at once and only looks at the slots
+//that match.
+//Probing is linear, one group after the other from the home slot of a
+//hash, so no element has an empty slot between its home and itself.
+//That lets erase move the later elements of the run back into the hole
+//instead of leaving a tombstone: lookups never wade through deleted
+//slots, however many erases there were, but erase invalidates iterators.
+
+//control bytes: full slots hold 0..127
+static constexpr signed char Hash_empty = -128;
+//past the last slot, where iteration stops; never empty, never matches
+static constexpr signed char Hash_sentinel = -1;
+
+//the bits of a group mask set for the bytes that matched
+template <typename WORD, unsigned SHIFT>
+struct Hash_bitmask {
+    WORD bits;
+
+    explicit Hash_bitmask(WORD mask) : bits(mask) {}
+
+    explicit operator bool () const {
+        return bits != 0;
+    }
+
+    //byte of the first match
+    unsigned lowest() const {
+        return TKF::count_trailing_zeros(bits) >> SHIFT;
+    }
+
+    void next() {
+        bits &= bits - 1;
+    }
+};
+
+#ifdef TKF_HASH_SSE2
+//16 control bytes: one bit per byte from movemask
+struct Hash_group {
+    static constexpr size_t width = 16;
+    typedef Hash_bitmask<unsigned, 0> mask_type;
+
+    __m128i ctrl;
+
+    explicit Hash_group(signed char const* pos)
+        : ctrl(_mm_loadu_si128(reinterpret_cast<__m128i const*>(pos))) {}
+
+    mask_type match(signed char h2) const {
+        return mask_type((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+    }
+
+    mask_type match_empty() const {
+        return mask_type((unsigned)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_set1_epi8(Hash_empty), ctrl)));
+    }
+};
+#else
+//8 control bytes in a word: the high bit of each byte. match() may also
+//report a byte right after a real match, which the key compare rejects
+struct Hash_group {
+    static constexpr size_t width = 8;
+    typedef Hash_bitmask<uint64_t, 3> mask_type;
+
+    static constexpr uint64_t _lsbs = 0x0101010101010101ULL;
+    static constexpr uint64_t _msbs = 0x8080808080808080ULL;
+
+    uint64_t ctrl;
+
+    explicit Hash_group(signed char const* pos) {
+        std::memcpy(&ctrl, pos, sizeof(ctrl));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        ctrl = __builtin_bswap64(ctrl);
+#endif
+    }
+
+    mask_type match(signed char h2) const {
+        uint64_t x = ctrl ^ (_lsbs * (unsigned char)h2);
+        return mask_type((x - _lsbs) & ~x & _msbs);
+    }
+
+    //only empty has the high bit without bit 1
+    mask_type match_empty() const {
+        return mask_type(ctrl & ~(ctrl << 6) & _msbs);
+    }
+};
+#endif
+
+//what the table stores: pair<KEY, T> for a map, the key for a set
+template <typename KEY, typename T>
+struct Hash_value_traits {
+    typedef TKF::pair<KEY, T>   value_type;
+    typedef value_type          element_type;
+
+    static KEY const& get_key(value_type const& value) {
+        return value.first;
+    }
+};
+
+template <typename KEY>
+struct Hash_value_traits<KEY, void> {
+    typedef KEY                 value_type;
+    typedef KEY const           element_type;
+
+    static KEY const& get_key(value_type const& value) {
+        return value;
+    }
+};
+
+template <typename E>
+struct Hash_iterator : public TKF::iterator<TKF::_forward_iterator, E> {
+    typedef Hash_iterator<E>    self;
+    typedef E&                  reference;
+    typedef E*                  pointer;
+
+    signed char const*  ctrl;
+    E*                  slot;
+
+    Hash_iterator() : ctrl(nullptr), slot(nullptr) {}
+    Hash_iterator(signed char const* c, E* s) : ctrl(c), slot(s) {}
+
+    reference operator *() const {
+        return *slot;
+    }
+
+    pointer operator ->() const {
+        return slot;
+    }
+
+    //to the next full slot; the sentinel stops it
+    self& operator ++ () {
+        do {
+            ++ctrl;
+            ++slot;
+        } while (*ctrl < Hash_sentinel);
+        return *this;
+    }
+
+    self operator ++ (int) {
+        self tmp(*this);
+        ++*this;
+        return tmp;
+    }
+
+    bool operator == (self const& rhs) const {
+        return slot == rhs.slot;
+    }
+
+    bool operator != (self const& rhs) const {
+        return slot != rhs.slot;
+    }
+};
+
+//T = void makes a set. The number of positions is a power of two, at
+//least a group wide; the last one is the sentinel, so there is one slot
+//less. The control bytes of the first width - 1 slots are repeated past
+//the sentinel, so a group can be read from any position without wrapping.
+template <typename KEY, typename T, typename HASH, typename EQUAL,
+    typename ALLOC = TKF::allocator<typename Hash_value_traits<KEY, T>::value_type> >
+class HashTable {
+public:
+    typedef Hash_value_traits<KEY, T>                   value_traits;
+    typedef KEY                                         key_type;
+    typedef typename value_traits::value_type           value_type;
+    typedef HASH                                        hasher;
+    typedef EQUAL                                       key_equal;
+    typedef ALLOC                                       allocator_type;
+    typedef typename ALLOC::template rebind<value_type>::other  slot_allocator;
+    typedef typename ALLOC::template rebind<signed char>::other ctrl_allocator;
+
+    typedef Hash_iterator<typename value_traits::element_type>  iterator;
+    typedef typename iterator::reference                reference;
+    typedef typename iterator::pointer                  pointer;
+    typedef size_t                                      size_type;
+    typedef ptrdiff_t                                   difference_type;
+
+private:
+    static constexpr size_type _width = Hash_group::width;
+    static constexpr size_type _npos = static_cast<size_type>(-1);
+
+    signed char*    _ctrl;
+    value_type*     _slots;
+    size_type       _mask;      //positions - 1, also the sentinel's index
+    size_type       _num;
+    size_type       _growth;    //elements that fit before the next rehash
+    HASH            _hash;
+    EQUAL           _equal;
+    ctrl_allocator  _ctrl_alloc;
+    slot_allocator  _slot_alloc;
+
+public:
+    HashTable() : _ctrl(nullptr), _slots(nullptr), _mask(0), _num(0), _growth(0),
+        _hash(), _equal() {}
+
+    HashTable(HASH const& hash, EQUAL const& equal)
+        : _ctrl(nullptr), _slots(nullptr), _mask(0), _num(0), _growth(0),
+        _hash(hash), _equal(equal) {}
+
+    //same positions, so nothing is hashed again
+    HashTable(HashTable const& rhs)
+        : _ctrl(nullptr), _slots(nullptr), _mask(0), _num(0), _growth(0),
+        _hash(rhs._hash), _equal(rhs._equal) {
+        if (rhs._num == 0) {
+            return;
+        }
+        _allocate(rhs._mask + 1);
+        size_type i = 0;
+        try {
+            for (; i < _mask; ++i) {
+                if (rhs._ctrl[i] >= 0) {
+                    ::new ((void*)(_slots + i)) value_type(rhs._slots[i]);
+                    _set_ctrl(i, rhs._ctrl[i]);
+                    ++_num;
+                }
+            }
+        }
+        catch (...) {
+            clear();
+            _deallocate();
+            throw;
+        }
+        _growth -= _num;
+    }
+
+    HashTable(HashTable&& rhs)
+        : _ctrl(rhs._ctrl), _slots(rhs._slots), _mask(rhs._mask), _num(rhs._num),
+        _growth(rhs._growth), _hash(rhs._hash), _equal(rhs._equal),
+        _ctrl_alloc(TKF::move(rhs._ctrl_alloc)), _slot_alloc(TKF::move(rhs._slot_alloc)) {
+        rhs._ctrl = nullptr;
+        rhs._slots = nullptr;
+        rhs._mask = rhs._num = rhs._growth = 0;
+    }
+
+    HashTable& operator = (HashTable const& rhs) {
+        if (this != &rhs) {
+            HashTable tmp(rhs);
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    HashTable& operator = (HashTable&& rhs) {
+        if (this != &rhs) {
+            HashTable tmp(TKF::move(rhs));
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    ~HashTable() {
+        clear();
+        _deallocate();
+    }
+
+    void swap(HashTable& rhs) {
+        std::swap(_ctrl, rhs._ctrl);
+        std::swap(_slots, rhs._slots);
+        std::swap(_mask, rhs._mask);
+        std::swap(_num, rhs._num);
+        std::swap(_growth, rhs._growth);
+        std::swap(_hash, rhs._hash);
+        std::swap(_equal, rhs._equal);
+        std::swap(_ctrl_alloc, rhs._ctrl_alloc);
+        std::swap(_slot_alloc, rhs._slot_alloc);
+    }
+
+    hasher hash_function() const {
+        return _hash;
+    }
+
+    key_equal key_eq() const {
+        return _equal;
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_type();
+    }
+
+    iterator begin() const noexcept {
+        if (_ctrl == nullptr) {
+            return end();
+        }
+        iterator iter(_ctrl, _slots);
+        if (*_ctrl < Hash_sentinel) {
+            ++iter;
+        }
+        return iter;
+    }
+
+    iterator end() const noexcept {
+        return iterator(_ctrl + _mask, _slots + _mask);
+    }
+
+    bool empty() const noexcept {
+        return _num == 0;
+    }
+
+    size_type size() const noexcept {
+        return _num;
+    }
+
+    size_type max_size() const noexcept {
+        return static_cast<size_type>(-1) / (sizeof(value_type) + 1) / 2;
+    }
+
+    //slots, full or not
+    size_type capacity() const noexcept {
+        return _mask;
+    }
+
+    double load_factor() const noexcept {
+        return _mask == 0 ? 0.0 : (double)_num / (double)_mask;
+    }
+
+    //3/4: linear probing runs grow fast past that
+    static constexpr double max_load_factor() noexcept {
+        return 0.75;
+    }
+
+    void clear() noexcept {
+        if (_num == 0) {
+            return;
+        }
+        for (size_type i = 0; i < _mask; ++i) {
+            if (_ctrl[i] >= 0) {
+                _slots[i].~value_type();
+            }
+        }
+        _reset_ctrl();
+        _growth = _max_load(_mask);
+        _num = 0;
+    }
+
+    //room for n elements without a rehash
+    void reserve(size_type n) {
+        if (n > _num + _growth) {
+            _rehash(_positions(n));
+        }
+    }
+
+    //search
+    template <typename K>
+    iterator find(K const& key) const {
+        size_type i = _find(key, _hash_of(key));
+        return i == _npos ? end() : _at(i);
+    }
+
+    template <typename K>
+    size_type count(K const& key) const {
+        return _find(key, _hash_of(key)) == _npos ? 0 : 1;
+    }
+
+    template <typename K>
+    TKF::pair<iterator, iterator> equal_range(K const& key) const {
+        iterator iter = find(key);
+        if (iter == end()) {
+            return TKF::make_pair(iter, iter);
+        }
+        iterator next = iter;
+        return TKF::make_pair(iter, ++next);
+    }
+
+    //insert: the element is built from args only when key is missing
+    template <typename K, typename ...Args>
+    TKF::pair<iterator, bool> emplace_key(K const& key, Args&&... args) {
+        size_t hash = _hash_of(key);
+        size_type i = _find(key, hash);
+        if (i != _npos) {
+            return TKF::make_pair(_at(i), false);
+        }
+        if (_growth == 0) {
+            return TKF::make_pair(_grow_emplace(hash, TKF::forward<Args>(args)...), true);
+        }
+        i = _find_empty(hash);
+        ::new ((void*)(_slots + i)) value_type(TKF::forward<Args>(args)...);
+        _set_ctrl(i, _h2(hash));
+        ++_num;
+        --_growth;
+        return TKF::make_pair(_at(i), true);
+    }
+
+    //the key is only known once the element is built
+    template <typename ...Args>
+    TKF::pair<iterator, bool> emplace(Args&&... args) {
+        value_type value(TKF::forward<Args>(args)...);
+        return emplace_key(value_traits::get_key(value), TKF::move(value));
+    }
+
+    template <typename ITER>
+    void insert(ITER first, ITER last) {
+        for (; first != last; ++first) {
+            value_type const& value = *first;
+            emplace_key(value_traits::get_key(value), value);
+        }
+    }
+
+    //erase: moves later elements of the run back, iterators are invalid
+    void erase(iterator pos) {
+        _erase_at(pos.slot - _slots);
+    }
+
+    template <typename K>
+    size_type erase(K const& key) {
+        size_type i = _find(key, _hash_of(key));
+        if (i == _npos) {
+            return 0;
+        }
+        _erase_at(i);
+        return 1;
+    }
+
+    //same elements, compared with ==, whatever the positions
+    bool operator == (HashTable const& rhs) const {
+        if (_num != rhs._num) {
+            return false;
+        }
+        for (iterator iter = begin(); iter != end(); ++iter) {
+            iterator other = rhs.find(value_traits::get_key(*iter));
+            if (other == rhs.end() || !(*other == *iter)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    iterator _at(size_type i) const {
+        return iterator(_ctrl + i, _slots + i);
+    }
+
+    //the hash spread over all the bits: std::hash of an integer is the
+    //integer itself. The low 7 bits go to the control byte, the rest
+    //picks the home position
+    template <typename K>
+    size_t _hash_of(K const& key) const {
+        uint64_t x = static_cast<uint64_t>(_hash(key)) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(x ^ (x >> 32));
+    }
+
+    static signed char _h2(size_t hash) {
+        return static_cast<signed char>(hash & 0x7F);
+    }
+
+    size_type _home(size_t hash) const {
+        return (hash >> 7) & _mask;
+    }
+
+    template <typename K>
+    size_type _find(K const& key, size_t hash) const {
+        if (_num == 0) {
+            return _npos;
+        }
+        size_type pos = _home(hash);
+        TKF::prefetch(_slots + pos);
+        signed char h2 = _h2(hash);
+        for (;;) {
+            Hash_group group(_ctrl + pos);
+            for (typename Hash_group::mask_type match = group.match(h2); match;
+                match.next()) {
+                size_type i = (pos + match.lowest()) & _mask;
+                if (_equal(value_traits::get_key(_slots[i]), key)) {
+                    return i;
+                }
+            }
+            if (group.match_empty()) {
+                return _npos;
+            }
+            pos = (pos + _width) & _mask;
+        }
+    }
+
+    //the first empty slot from the home of hash on; there is always one
+    size_type _find_empty(size_t hash) const {
+        size_type pos = _home(hash);
+        for (;;) {
+            typename Hash_group::mask_type empty = Hash_group(_ctrl + pos).match_empty();
+            if (empty) {
+                return (pos + empty.lowest()) & _mask;
+            }
+            pos = (pos + _width) & _mask;
+        }
+    }
+
+    void _set_ctrl(size_type i, signed char c) {
+        _ctrl[i] = c;
+        if (i < _width - 1) {
+            _ctrl[_mask + 1 + i] = c;
+        }
+    }
+
+    //backward shift: walks the run after the hole, and every element
+    //that may sit in the hole, its home not past the hole, moves there
+    //and leaves its own slot as the new hole
+    void _erase_at(size_type hole) {
+        _slots[hole].~value_type();
+        --_num;
+        ++_growth;
+        for (size_type j = (hole + 1) & _mask; ; j = (j + 1) & _mask) {
+            if (j == _mask) {
+                continue;
+            }
+            if (_ctrl[j] == Hash_empty) {
+                break;
+            }
+            size_type home = _home(_hash_of(value_traits::get_key(_slots[j])));
+            if (((j - home) & _mask) >= ((j - hole) & _mask)) {
+                ::new ((void*)(_slots + hole)) value_type(TKF::move(_slots[j]));
+                _slots[j].~value_type();
+                _set_ctrl(hole, _ctrl[j]);
+                hole = j;
+            }
+        }
+        _set_ctrl(hole, Hash_empty);
+    }
+
+    //args may refer to an element here: the new element is built in the
+    //new arrays before the old ones are moved over
+    template <typename ...Args>
+    iterator _grow_emplace(size_t hash, Args&&... args) {
+        THROW_OUT_OF_RANGE_IF(_num >= max_size(), "HashTable<KEY, T> size out of range");
+        HashTable tmp(_hash, _equal);
+        tmp._allocate(_mask == 0 ? _width : 2 * (_mask + 1));
+        size_type i = tmp._find_empty(hash);
+        ::new ((void*)(tmp._slots + i)) value_type(TKF::forward<Args>(args)...);
+        tmp._set_ctrl(i, _h2(hash));
+        ++tmp._num;
+        --tmp._growth;
+        _move_into(tmp);
+        swap(tmp);
+        return _at(i);
+    }
+
+    void _rehash(size_type positions) {
+        HashTable tmp(_hash, _equal);
+        tmp._allocate(positions);
+        _move_into(tmp);
+        swap(tmp);
+    }
+
+    //every element to its place in an empty enough table, which leaves
+    //this one empty
+    void _move_into(HashTable& to) {
+        for (size_type i = 0; i < _mask; ++i) {
+            if (_ctrl[i] >= 0) {
+                size_t hash = _hash_of(value_traits::get_key(_slots[i]));
+                size_type j = to._find_empty(hash);
+                ::new ((void*)(to._slots + j)) value_type(TKF::move(_slots[i]));
+                _slots[i].~value_type();
+                to._set_ctrl(j, _h2(hash));
+            }
+        }
+        to._num += _num;
+        to._growth -= _num;
+        _num = 0;
+        _growth = _max_load(_mask);
+        _reset_ctrl();
+    }
+
+    static size_type _max_load(size_type slots) {
+        return slots - slots / 4;
+    }
+
+    //the fewest positions with room for n elements
+    static size_type _positions(size_type n) {
+        size_type positions = _width;
+        while (_max_load(positions - 1) < n) {
+            positions *= 2;
+        }
+        return positions;
+    }
+
+    void _allocate(size_type positions) {
+        _ctrl = _ctrl_alloc.allocate(positions + _width - 1);
+        try {
+            _slots = _slot_alloc.allocate(positions - 1);
+        }
+        catch (...) {
+            _ctrl_alloc.deallocate(_ctrl, positions + _width - 1);
+            _ctrl = nullptr;
+            throw;
+        }
+        _mask = positions - 1;
+        _reset_ctrl();
+        _growth = _max_load(_mask);
+    }
+
+    void _reset_ctrl() noexcept {
+        if (_ctrl == nullptr) {
+            return;
+        }
+        std::memset(_ctrl, (unsigned char)Hash_empty, _mask + _width);
+        _ctrl[_mask] = Hash_sentinel;
+    }
+
+    void _deallocate() noexcept {
+        if (_ctrl == nullptr) {
+            return;
+        }
+        _ctrl_alloc.deallocate(_ctrl, _mask + _width);
+        _slot_alloc.deallocate(_slots, _mask);
+        _ctrl = nullptr;
+        _slots = nullptr;
+        _mask = 0;
+        _growth = 0;
+    }
+};
+
+}
+
+#endif //!HASH_TABLE_H
\ No newline at end of file
@@ -125,7 +125,7 @@ template <typename INPUTITER>
 inline typename iterator_traits<INPUTITER>::difference_type 
     _distance(INPUTITER first, INPUTITER last, _input_iterator) {
         typename iterator_traits<INPUTITER>::difference_type n = 0;
-        while(first ^ last) {
+        while(first != last) {
             ++first;
             ++n;
         }
@@ -182,12 +182,12 @@ private:
     ITER current;
 
 public:
-    typedef iterator_traits<ITER>                       iterator_traits;
-    typedef typename iterator_traits::iterator_category iterator_category;
-    typedef typename iterator_traits::value_type        value_type;
-    typedef typename iterator_traits::difference_type   difference_type;
-    typedef typename iterator_traits::pointer           pointer;
-    typedef typename iterator_traits::reference         reference;
+    typedef TKF::iterator_traits<ITER>                  traits;
+    typedef typename traits::iterator_category          iterator_category;
+    typedef typename traits::value_type                 value_type;
+    typedef typename traits::difference_type            difference_type;
+    typedef typename traits::pointer                    pointer;
+    typedef typename traits::reference                  reference;
 
     typedef ITER                                        iterator_type;
     typedef reverse_iterator<ITER>                      self;
@@ -197,6 +197,19 @@ public:
     explicit reverse_iterator(iterator_type iter) : current(iter) {}
     reverse_iterator(self const& rhs) : current(rhs.current) {}
 
+private:
+    //a pointer for plain arrays, whatever operator -> gives otherwise;
+    //iterators over proxies have no address to take
+    template <typename T>
+    static T* _arrow(T* ptr) {
+        return ptr;
+    }
+
+    template <typename I>
+    static typename I::pointer _arrow(I const& iter) {
+        return iter.operator->();
+    }
+
 public:
     iterator_type base() const {
         return current;
@@ -206,7 +219,8 @@ public:
         return *(--tmp);
     }
     pointer operator ->() const{
-        return &(operator*());
+        auto tmp = current;
+        return _arrow(--tmp);
     }
 
     self& operator ++ () {
@@ -2,18 +2,24 @@
 #define MAP_H
 
 #include"RB_Tree.h"
+#include"B_Tree.h"
+#include"Flat_Table.h"
+#include"Static_Index.h"
 #include"Utility.h"
 
 namespace TKF {
 
-template <typename T>
-struct less {
-    bool operator () (T const& lhs, T const& rhs) const {
-        return lhs <= rhs;
-    }
-};
-
-template <typename KEY, typename T, typename COMP = less<KEY> >
+//ordered map on a red-black tree. POLICY picks the node layout, see
+//RBT_node_policy: RBT_rank_node for rank/select, RBT_compact_node and
+//RBT_threaded_node for smaller nodes or faster iteration. RBT_index_node
+//halves the links with 32-bit indices, but its nodes come from one pool
+//per node type for the whole process: every map of that type shares the
+//2^31 - 1 node limit, the pool's memory is never given back, and each
+//node allocated or freed takes the pool's one lock, so maps of that
+//type on different threads wait for each other.
+template <typename KEY, typename T, typename COMP = less<KEY>,
+    typename ALLOC = TKF::pool_allocator<TKF::pair<KEY, T> >,
+    typename POLICY = TKF::RBT_plain_node, typename STATS = TKF::RBT_no_stats>
 class map {
 public:
     typedef KEY                     key_type;
@@ -22,7 +28,7 @@ public:
     typedef COMP                    key_compare;
     
     class value_compare {
-        friend class map<KEY, T, COMP>;
+        friend class map<KEY, T, COMP, ALLOC, POLICY, STATS>;
     private:
         COMP _comp;
         value_compare(COMP comp) : _comp(comp) {}
@@ -33,11 +39,11 @@ public:
     };
     
 private:
-    typedef TKF::RBT<value_type, key_compare> base_type;
+    typedef TKF::RBT<value_type, key_compare, ALLOC, POLICY, STATS> base_type;
     base_type _tree;
 
 public:
-    typedef typename base_type::node_type            node_type;
+    typedef typename base_type::node_handle          node_type;
     typedef typename base_type::node_ptr             node_ptr;
     typedef typename base_type::pointer              pointer;
     typedef typename base_type::const_pointer        const_pointer;
@@ -48,6 +54,7 @@ public:
     typedef typename base_type::allocator_type       allocator_type;
     typedef typename base_type::iterator             iterator;
     typedef typename base_type::reverse_iterator     reverse_iterator;
+    typedef typename base_type::insert_return_type   insert_return_type;
 
 public:
     map() : _tree() {}
@@ -118,31 +125,104 @@ public:
 
 
     map_type& at (key_type const& key) {
-        iterator iter = _tree.lower_bound(key);
-        THROW_OUT_OF_RANGE_IF(iter == end() || !key_comp()(iter->first, key)
-            ,"map<KEY, T> has no such element");
+        iterator iter = _tree.find(key);
+        THROW_OUT_OF_RANGE_IF(iter == end(), "map<KEY, T> has no such element");
         return iter->second;
     }
 
-    map_type& operator [] (key_type& key) {
-        iterator iter = _tree.lower_bound(key);
-        if (iter == end() || !key_comp()(iter->first, key)) {
-            std::cout << "ok";
-            iter = emplace_hint(iter, key, T{});
-        }
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    map_type& at (K const& key) {
+        iterator iter = _tree.find(key);
+        THROW_OUT_OF_RANGE_IF(iter == end(), "map<KEY, T> has no such element");
         return iter->second;
     }
 
+    map_type& operator [] (key_type const& key) {
+        return try_emplace(key).first->second;
+    }
+
     map_type& operator [] (key_type&& key) {
-        iterator iter = _tree.lower_bound(key);
-        if (iter == end() || !key_comp()(iter->first, key)) {
-            iter = emplace_hint(iter, TKF::move(key), T{});
+        return try_emplace(TKF::move(key)).first->second;
+    }
+
+    //transparent COMP: the key_type is built only when key is inserted
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    map_type& operator [] (K const& key) {
+        return _tree.unique_emplace_key(key, TKF::piecewise_construct, 
+            std::forward_as_tuple(key), std::forward_as_tuple()).first->second;
+    }
+
+    //search first: on a hit nothing is built and args are not moved from,
+    //on a miss the mapped value is built in place from args
+    template <typename ...Args>
+    TKF::pair<iterator, bool> try_emplace (key_type const& key, Args&&... args) {
+        return _tree.unique_emplace_key(key, TKF::piecewise_construct, 
+            std::forward_as_tuple(key), 
+            std::forward_as_tuple(TKF::forward<Args>(args)...));
+    }
+
+    template <typename ...Args>
+    TKF::pair<iterator, bool> try_emplace (key_type&& key, Args&&... args) {
+        return _tree.unique_emplace_key(key, TKF::piecewise_construct, 
+            std::forward_as_tuple(TKF::move(key)), 
+            std::forward_as_tuple(TKF::forward<Args>(args)...));
+    }
+
+    template <typename ...Args>
+    iterator try_emplace (iterator hint, key_type const& key, Args&&... args) {
+        return _tree.unique_emplace_key_hint(hint, key, TKF::piecewise_construct, 
+            std::forward_as_tuple(key), 
+            std::forward_as_tuple(TKF::forward<Args>(args)...));
+    }
+
+    template <typename ...Args>
+    iterator try_emplace (iterator hint, key_type&& key, Args&&... args) {
+        return _tree.unique_emplace_key_hint(hint, key, TKF::piecewise_construct, 
+            std::forward_as_tuple(TKF::move(key)), 
+            std::forward_as_tuple(TKF::forward<Args>(args)...));
+    }
+
+    //assigns obj to the mapped value of key, inserting key if missing
+    template <typename M>
+    TKF::pair<iterator, bool> insert_or_assign (key_type const& key, M&& obj) {
+        auto res = try_emplace(key, TKF::forward<M>(obj));
+        if (!res.second) {
+            res.first->second = TKF::forward<M>(obj);
         }
-        return iter->second;
+        return res;
+    }
+
+    template <typename M>
+    TKF::pair<iterator, bool> insert_or_assign (key_type&& key, M&& obj) {
+        auto res = try_emplace(TKF::move(key), TKF::forward<M>(obj));
+        if (!res.second) {
+            res.first->second = TKF::forward<M>(obj);
+        }
+        return res;
+    }
+
+    template <typename M>
+    iterator insert_or_assign (iterator hint, key_type const& key, M&& obj) {
+        size_type n = size();
+        iterator iter = try_emplace(hint, key, TKF::forward<M>(obj));
+        if (size() == n) {
+            iter->second = TKF::forward<M>(obj);
+        }
+        return iter;
+    }
+
+    template <typename M>
+    iterator insert_or_assign (iterator hint, key_type&& key, M&& obj) {
+        size_type n = size();
+        iterator iter = try_emplace(hint, TKF::move(key), TKF::forward<M>(obj));
+        if (size() == n) {
+            iter->second = TKF::forward<M>(obj);
+        }
+        return iter;
     }
     
     template <typename ...Args>
-    iterator emplace (Args&&... args) {
+    TKF::pair<iterator, bool> emplace (Args&&... args) {
         return _tree.unique_emplace(TKF::forward<Args>(args)...);
     }
 
@@ -167,11 +247,26 @@ public:
         return _tree.unique_insert(hint, TKF::move(value));
     }
 
+    //relinks the node of nh; if the key is taken, nh comes back in .node
+    insert_return_type insert (node_type&& nh) {
+        return _tree.unique_insert(TKF::move(nh));
+    }
+
+    iterator insert (iterator hint, node_type&& nh) {
+        return _tree.unique_insert(hint, TKF::move(nh));
+    }
+
     template <typename ITER>
     void insert (ITER const& first, ITER const& last) {
         _tree.unique_insert(first, last);
     }
 
+    //replaces the contents in O(n); [first, last) must be in key order
+    template <typename ITER>
+    void build_from_sorted (ITER const& first, ITER const& last) {
+        _tree.unique_build_from_sorted(first, last);
+    }
+
     void erase (iterator iter) {
         _tree.erase(iter);
     }
@@ -188,6 +283,16 @@ public:
         _tree.clear();
     }
 
+    //unlinks the element without destroying it; its key may be changed
+    //before it is inserted again, here or into another map
+    node_type extract (iterator iter) {
+        return _tree.extract(iter);
+    }
+
+    node_type extract (key_type const& key) {
+        return _tree.extract(key);
+    }
+
     iterator find (key_type const& key) {
         return _tree.find(key);
     }
@@ -200,6 +305,111 @@ public:
         return _tree.upper_bound(key);
     }
 
+    size_type count (key_type const& key) const {
+        return _tree.count(key);
+    }
+
+    TKF::pair<iterator, iterator> equal_range (key_type const& key) const {
+        return _tree.equal_range(key);
+    }
+
+    //heterogeneous lookup, with a transparent COMP such as less<void>:
+    //a map keyed by std::string takes const char* without copies
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator find (K const& key) {
+        return _tree.find(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator lower_bound (K const& key) {
+        return _tree.lower_bound(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator upper_bound (K const& key) {
+        return _tree.upper_bound(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    size_type count (K const& key) const {
+        return _tree.count(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    TKF::pair<iterator, iterator> equal_range (K const& key) const {
+        return _tree.equal_range(key);
+    }
+
+    //a batch of keys searched side by side, one iterator each to out;
+    //see RBT::find_many
+    template <typename ITER, typename OUT>
+    OUT find_many (ITER first, ITER last, OUT out) {
+        return _tree.find_many(first, last, out);
+    }
+
+    template <typename ITER, typename OUT>
+    OUT lower_bound_many (ITER first, ITER last, OUT out) {
+        return _tree.lower_bound_many(first, last, out);
+    }
+
+    //order statistics, need POLICY = RBT_rank_node
+    size_type rank (key_type const& key) const {
+        return _tree.rank(key);
+    }
+
+    iterator select (size_type i) const {
+        return _tree.select(i);
+    }
+
+    //counters of the tree, need STATS = RBT_stats
+    RBT_stats_snapshot stats () const {
+        return _tree.stats();
+    }
+
+    void reset_stats () {
+        _tree.reset_stats();
+    }
+
+    //join/split, see RBT; left and right are other maps and end up empty
+    void join (map&& left, value_type const& value, map&& right) {
+        _tree.join(TKF::move(left._tree), value, TKF::move(right._tree));
+    }
+
+    //moves the keys less than key into left and the rest into right,
+    //O(log n) with the RANK policy and O(min(left, right)) without; the
+    //halves allocate apart and may be used from different threads
+    void split (key_type const& key, map& left, map& right) {
+        _tree.split(key, left._tree, right._tree);
+    }
+
+    //set operations, rhs is consumed; equal keys keep this map's value
+    void unite (map&& rhs) {
+        _tree.unique_union(TKF::move(rhs._tree));
+    }
+
+    void intersect (map&& rhs) {
+        _tree.unique_intersection(TKF::move(rhs._tree));
+    }
+
+    void subtract (map&& rhs) {
+        _tree.unique_difference(TKF::move(rhs._tree));
+    }
+
+    //a read-only copy for lookups only: see static_index
+    template <static_layout LAYOUT = static_eytzinger>
+    static_index<KEY, T, COMP, LAYOUT> freeze () const {
+        return static_index<KEY, T, COMP, LAYOUT>(begin(), size(), key_comp());
+    }
+
+    //moves over the nodes of rhs whose keys are not here; the rest stay
+    void merge (map& rhs) {
+        _tree.unique_merge(rhs._tree);
+    }
+
+    void merge (map&& rhs) {
+        _tree.unique_merge(rhs._tree);
+    }
+
     friend bool operator == (map const& lhs, map const& rhs) {
         return (lhs._tree == rhs._tree);
     }
@@ -226,7 +436,9 @@ public:
     
 };
 
-template <typename KEY, typename T, typename COMP = less<KEY> >
+template <typename KEY, typename T, typename COMP = less<KEY>,
+    typename ALLOC = TKF::pool_allocator<TKF::pair<KEY, T> >,
+    typename POLICY = TKF::RBT_plain_node, typename STATS = TKF::RBT_no_stats>
 class multimap {
 public:
     typedef KEY                     key_type;
@@ -235,7 +447,7 @@ public:
     typedef COMP                    key_compare;
     
     class value_compare {
-        friend class map<KEY, T, COMP>;
+        friend class multimap<KEY, T, COMP, ALLOC, POLICY, STATS>;
     private:
         COMP _comp;
         value_compare(COMP comp) : _comp(comp) {}
@@ -246,11 +458,11 @@ public:
     };
     
 private:
-    typedef TKF::RBT<value_type, key_compare> base_type;
+    typedef TKF::RBT<value_type, key_compare, ALLOC, POLICY, STATS> base_type;
     base_type _tree;
 
 public:
-    typedef typename base_type::node_type            node_type;
+    typedef typename base_type::node_handle          node_type;
     typedef typename base_type::node_ptr             node_ptr;
     typedef typename base_type::pointer              pointer;
     typedef typename base_type::const_pointer        const_pointer;
@@ -267,7 +479,7 @@ public:
 
     template <typename ITER>
     multimap(ITER first, ITER second) : _tree() {
-        _tree.unique_insert(first, second);
+        _tree.multi_insert(first, second);
     }
     
     multimap(multimap const& rhs) : _tree(rhs._tree) {}
@@ -343,11 +555,25 @@ public:
         return _tree.multi_insert(hint, TKF::move(value));
     }
 
+    iterator insert (node_type&& nh) {
+        return _tree.multi_insert(TKF::move(nh));
+    }
+
+    iterator insert (iterator hint, node_type&& nh) {
+        return _tree.multi_insert(hint, TKF::move(nh));
+    }
+
     template <typename ITER>
     void insert (ITER const& first, ITER const& last) {
         _tree.multi_insert(first, last);
     }
 
+    //replaces the contents in O(n); [first, last) must be in key order
+    template <typename ITER>
+    void build_from_sorted (ITER const& first, ITER const& last) {
+        _tree.multi_build_from_sorted(first, last);
+    }
+
     void erase (iterator iter) {
         _tree.erase(iter);
     }
@@ -364,6 +590,14 @@ public:
         _tree.clear();
     }
 
+    node_type extract (iterator iter) {
+        return _tree.extract(iter);
+    }
+
+    node_type extract (key_type const& key) {
+        return _tree.extract(key);
+    }
+
     iterator find (key_type const& key) {
         return _tree.find(key);
     }
@@ -376,6 +610,97 @@ public:
         return _tree.upper_bound(key);
     }
 
+    size_type count (key_type const& key) const {
+        return _tree.count(key);
+    }
+
+    TKF::pair<iterator, iterator> equal_range (key_type const& key) const {
+        return _tree.equal_range(key);
+    }
+
+    //heterogeneous lookup, with a transparent COMP such as less<void>:
+    //a map keyed by std::string takes const char* without copies
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator find (K const& key) {
+        return _tree.find(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator lower_bound (K const& key) {
+        return _tree.lower_bound(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator upper_bound (K const& key) {
+        return _tree.upper_bound(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    size_type count (K const& key) const {
+        return _tree.count(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    TKF::pair<iterator, iterator> equal_range (K const& key) const {
+        return _tree.equal_range(key);
+    }
+
+    //a batch of keys searched side by side, one iterator each to out;
+    //see RBT::find_many
+    template <typename ITER, typename OUT>
+    OUT find_many (ITER first, ITER last, OUT out) {
+        return _tree.find_many(first, last, out);
+    }
+
+    template <typename ITER, typename OUT>
+    OUT lower_bound_many (ITER first, ITER last, OUT out) {
+        return _tree.lower_bound_many(first, last, out);
+    }
+
+    //order statistics, need POLICY = RBT_rank_node
+    size_type rank (key_type const& key) const {
+        return _tree.rank(key);
+    }
+
+    iterator select (size_type i) const {
+        return _tree.select(i);
+    }
+
+    //counters of the tree, need STATS = RBT_stats
+    RBT_stats_snapshot stats () const {
+        return _tree.stats();
+    }
+
+    void reset_stats () {
+        _tree.reset_stats();
+    }
+
+    //join/split, see RBT; left and right are other multimaps and end up empty
+    void join (multimap&& left, value_type const& value, multimap&& right) {
+        _tree.join(TKF::move(left._tree), value, TKF::move(right._tree));
+    }
+
+    //moves the keys less than key into left and the rest into right,
+    //O(log n) with the RANK policy and O(min(left, right)) without; the
+    //halves allocate apart and may be used from different threads
+    void split (key_type const& key, multimap& left, multimap& right) {
+        _tree.split(key, left._tree, right._tree);
+    }
+
+    template <static_layout LAYOUT = static_eytzinger>
+    static_index<KEY, T, COMP, LAYOUT> freeze () const {
+        return static_index<KEY, T, COMP, LAYOUT>(begin(), size(), key_comp());
+    }
+
+    //takes every element of rhs, after this multimap's equal keys
+    void merge (multimap&& rhs) {
+        _tree.multi_merge(TKF::move(rhs._tree));
+    }
+
+    void merge (multimap& rhs) {
+        _tree.multi_merge(TKF::move(rhs._tree));
+    }
+
     friend bool operator == (multimap const& lhs, multimap const& rhs) {
         return (lhs._tree == rhs._tree);
     }
@@ -403,6 +728,1048 @@ public:
 };
 
 
+//same interface as map, on a B+ tree: several keys per cache line
+//and far fewer nodes, but inserting and erasing invalidate iterators
+template <typename KEY, typename T, typename COMP = less<KEY>,
+    typename ALLOC = TKF::pool_allocator<TKF::pair<KEY, T> > >
+class btree_map {
+public:
+    typedef KEY                     key_type;
+    typedef T                       map_type;
+    typedef TKF::pair<KEY, T>       value_type;
+    typedef COMP                    key_compare;
+    
+    class value_compare {
+        friend class btree_map<KEY, T, COMP, ALLOC>;
+    private:
+        COMP _comp;
+        value_compare(COMP comp) : _comp(comp) {}
+    public:
+        bool operator () (value_type const& lhs, value_type const& rhs) {
+            return _comp(lhs.first, rhs.first);
+        }
+    };
+    
+private:
+    typedef TKF::BTree<value_type, key_compare, ALLOC> base_type;
+    base_type _tree;
+
+public:
+    typedef typename base_type::pointer              pointer;
+    typedef typename base_type::const_pointer        const_pointer;
+    typedef typename base_type::reference            reference;
+    typedef typename base_type::const_reference      const_reference;
+    typedef typename base_type::size_type            size_type;
+    typedef typename base_type::difference_type      difference_type;
+    typedef typename base_type::allocator_type       allocator_type;
+    typedef typename base_type::iterator             iterator;
+    typedef typename base_type::reverse_iterator     reverse_iterator;
+
+public:
+    btree_map() : _tree() {}
+
+    template <typename ITER>
+    btree_map(ITER first, ITER second) : _tree() {
+        _tree.unique_insert(first, second);
+    }
+    
+    btree_map(btree_map const& rhs) : _tree(rhs._tree) {}
+
+    btree_map(btree_map&& rhs) : _tree(TKF::move(rhs._tree)) {}
+
+    btree_map& operator = (btree_map const& rhs) {
+        _tree = rhs._tree;
+        return *this;
+    }
+
+    btree_map& operator = (btree_map&& rhs) {
+        _tree = TKF::move(rhs._tree);
+        return *this;
+    }
+
+    ~btree_map() = default;
+    
+    //API
+    key_compare key_comp() const { 
+        return _tree.key_comp();
+    }
+
+    value_compare value_comp() const {
+        return value_compare(_tree.key_comp());
+    }
+
+    allocator_type get_allocator() const {
+        return _tree.get_allocator();
+    }
+
+    //Iterator
+    iterator begin() const noexcept {
+        return _tree.begin();
+    }
+
+    iterator end() const noexcept {
+        return _tree.end();
+    }
+
+    reverse_iterator rbegin() const noexcept {
+        return _tree.rbegin();
+    }
+
+    reverse_iterator rend() const noexcept {
+        return _tree.rend();
+    }
+
+    bool empty() const noexcept {
+        return _tree.empty();
+    }
+
+    size_type size() const noexcept {
+        return _tree.size();
+    }
+
+    size_type max_size() const noexcept {
+        return _tree.max_size();
+    }
+
+    map_type& at (key_type const& key) {
+        iterator iter = _tree.find(key);
+        THROW_OUT_OF_RANGE_IF(iter == end(), "btree_map<KEY, T> has no such element");
+        return iter->second;
+    }
+
+    map_type& operator [] (key_type const& key) {
+        return try_emplace(key).first->second;
+    }
+
+    //search first: on a hit nothing is built and args are not moved from
+    template <typename ...Args>
+    TKF::pair<iterator, bool> try_emplace (key_type const& key, Args&&... args) {
+        iterator iter = _tree.lower_bound(key);
+        if (iter != end() && key_comp()(iter->first, key)) {
+            return TKF::make_pair(iter, false);
+        }
+        iter = _tree.unique_emplace_hint(iter, TKF::piecewise_construct, 
+            std::forward_as_tuple(key), 
+            std::forward_as_tuple(TKF::forward<Args>(args)...));
+        return TKF::make_pair(iter, true);
+    }
+
+    template <typename M>
+    TKF::pair<iterator, bool> insert_or_assign (key_type const& key, M&& obj) {
+        auto res = try_emplace(key, TKF::forward<M>(obj));
+        if (!res.second) {
+            res.first->second = TKF::forward<M>(obj);
+        }
+        return res;
+    }
+
+    template <typename ...Args>
+    TKF::pair<iterator, bool> emplace (Args&&... args) {
+        return _tree.unique_emplace(TKF::forward<Args>(args)...);
+    }
+
+    template <typename ...Args>
+    iterator emplace_hint (iterator hint, Args&&... args) {
+        return _tree.unique_emplace_hint(hint, TKF::forward<Args>(args)...);
+    }
+
+    TKF::pair<iterator, bool> insert (value_type const& value) {
+        return _tree.unique_insert(value);
+    }
+
+    TKF::pair<iterator, bool> insert (value_type&& value) {
+        return _tree.unique_insert(TKF::move(value));
+    }
+
+    iterator insert (iterator hint, value_type const& value) {
+        return _tree.unique_insert(hint, value);
+    }
+
+    iterator insert (iterator hint, value_type&& value) {
+        return _tree.unique_insert(hint, TKF::move(value));
+    }
+
+    template <typename ITER>
+    void insert (ITER const& first, ITER const& last) {
+        _tree.unique_insert(first, last);
+    }
+
+    //returns the element after the erased one
+    iterator erase (iterator iter) {
+        return _tree.erase(iter);
+    }
+
+    size_type erase(key_type const& key) {
+        return _tree.unique_erase(key);
+    }
+
+    void erase (iterator first, iterator last) {
+        _tree.erase(first, last);
+    }
+
+    void clear () {
+        _tree.clear();
+    }
+
+    iterator find (key_type const& key) const {
+        return _tree.find(key);
+    }
+
+    iterator lower_bound (key_type const& key) const {
+        return _tree.lower_bound(key);
+    }
+
+    iterator upper_bound (key_type const& key) const {
+        return _tree.upper_bound(key);
+    }
+
+    size_type count (key_type const& key) const {
+        return _tree.count(key);
+    }
+
+    TKF::pair<iterator, iterator> equal_range (key_type const& key) const {
+        return _tree.equal_range(key);
+    }
+
+    friend bool operator == (btree_map const& lhs, btree_map const& rhs) {
+        return (lhs._tree == rhs._tree);
+    }
+
+    friend bool operator != (btree_map const& lhs, btree_map const& rhs) {
+        return !(lhs == rhs);
+    }
+
+    friend bool operator < (btree_map const& lhs, btree_map const& rhs) {
+        return lhs._tree < rhs._tree;
+    }
+
+    friend bool operator > (btree_map const& lhs, btree_map const& rhs) {
+        return rhs < lhs;
+    }
+
+    friend bool operator >= (btree_map const& lhs, btree_map const& rhs) {
+        return !(lhs < rhs);
+    }
+
+    friend bool operator <= (btree_map const& lhs, btree_map const& rhs) {
+        return !(rhs < lhs);
+    }
+    
+};
+
+//same interface as multimap, on a B+ tree: several keys per cache line
+//and far fewer nodes, but inserting and erasing invalidate iterators
+template <typename KEY, typename T, typename COMP = less<KEY>,
+    typename ALLOC = TKF::pool_allocator<TKF::pair<KEY, T> > >
+class btree_multimap {
+public:
+    typedef KEY                     key_type;
+    typedef T                       map_type;
+    typedef TKF::pair<KEY, T>       value_type;
+    typedef COMP                    key_compare;
+    
+    class value_compare {
+        friend class btree_multimap<KEY, T, COMP, ALLOC>;
+    private:
+        COMP _comp;
+        value_compare(COMP comp) : _comp(comp) {}
+    public:
+        bool operator () (value_type const& lhs, value_type const& rhs) {
+            return _comp(lhs.first, rhs.first);
+        }
+    };
+    
+private:
+    typedef TKF::BTree<value_type, key_compare, ALLOC> base_type;
+    base_type _tree;
+
+public:
+    typedef typename base_type::pointer              pointer;
+    typedef typename base_type::const_pointer        const_pointer;
+    typedef typename base_type::reference            reference;
+    typedef typename base_type::const_reference      const_reference;
+    typedef typename base_type::size_type            size_type;
+    typedef typename base_type::difference_type      difference_type;
+    typedef typename base_type::allocator_type       allocator_type;
+    typedef typename base_type::iterator             iterator;
+    typedef typename base_type::reverse_iterator     reverse_iterator;
+
+public:
+    btree_multimap() : _tree() {}
+
+    template <typename ITER>
+    btree_multimap(ITER first, ITER second) : _tree() {
+        _tree.multi_insert(first, second);
+    }
+    
+    btree_multimap(btree_multimap const& rhs) : _tree(rhs._tree) {}
+
+    btree_multimap(btree_multimap&& rhs) : _tree(TKF::move(rhs._tree)) {}
+
+    btree_multimap& operator = (btree_multimap const& rhs) {
+        _tree = rhs._tree;
+        return *this;
+    }
+
+    btree_multimap& operator = (btree_multimap&& rhs) {
+        _tree = TKF::move(rhs._tree);
+        return *this;
+    }
+
+    ~btree_multimap() = default;
+    
+    //API
+    key_compare key_comp() const { 
+        return _tree.key_comp();
+    }
+
+    value_compare value_comp() const {
+        return value_compare(_tree.key_comp());
+    }
+
+    allocator_type get_allocator() const {
+        return _tree.get_allocator();
+    }
+
+    //Iterator
+    iterator begin() const noexcept {
+        return _tree.begin();
+    }
+
+    iterator end() const noexcept {
+        return _tree.end();
+    }
+
+    reverse_iterator rbegin() const noexcept {
+        return _tree.rbegin();
+    }
+
+    reverse_iterator rend() const noexcept {
+        return _tree.rend();
+    }
+
+    bool empty() const noexcept {
+        return _tree.empty();
+    }
+
+    size_type size() const noexcept {
+        return _tree.size();
+    }
+
+    size_type max_size() const noexcept {
+        return _tree.max_size();
+    }
+
+    template <typename ...Args>
+    iterator emplace (Args&&... args) {
+        return _tree.multi_emplace(TKF::forward<Args>(args)...);
+    }
+
+    template <typename ...Args>
+    iterator emplace_hint (iterator hint, Args&&... args) {
+        return _tree.multi_emplace_hint(hint, TKF::forward<Args>(args)...);
+    }
+
+    iterator insert (value_type const& value) {
+        return _tree.multi_insert(value);
+    }
+
+    iterator insert (value_type&& value) {
+        return _tree.multi_insert(TKF::move(value));
+    }
+
+    iterator insert (iterator hint, value_type const& value) {
+        return _tree.multi_insert(hint, value);
+    }
+
+    iterator insert (iterator hint, value_type&& value) {
+        return _tree.multi_insert(hint, TKF::move(value));
+    }
+
+    template <typename ITER>
+    void insert (ITER const& first, ITER const& last) {
+        _tree.multi_insert(first, last);
+    }
+
+    //returns the element after the erased one
+    iterator erase (iterator iter) {
+        return _tree.erase(iter);
+    }
+
+    size_type erase(key_type const& key) {
+        return _tree.multi_erase(key);
+    }
+
+    void erase (iterator first, iterator last) {
+        _tree.erase(first, last);
+    }
+
+    void clear () {
+        _tree.clear();
+    }
+
+    iterator find (key_type const& key) const {
+        return _tree.find(key);
+    }
+
+    iterator lower_bound (key_type const& key) const {
+        return _tree.lower_bound(key);
+    }
+
+    iterator upper_bound (key_type const& key) const {
+        return _tree.upper_bound(key);
+    }
+
+    size_type count (key_type const& key) const {
+        return _tree.count(key);
+    }
+
+    TKF::pair<iterator, iterator> equal_range (key_type const& key) const {
+        return _tree.equal_range(key);
+    }
+
+    friend bool operator == (btree_multimap const& lhs, btree_multimap const& rhs) {
+        return (lhs._tree == rhs._tree);
+    }
+
+    friend bool operator != (btree_multimap const& lhs, btree_multimap const& rhs) {
+        return !(lhs == rhs);
+    }
+
+    friend bool operator < (btree_multimap const& lhs, btree_multimap const& rhs) {
+        return lhs._tree < rhs._tree;
+    }
+
+    friend bool operator > (btree_multimap const& lhs, btree_multimap const& rhs) {
+        return rhs < lhs;
+    }
+
+    friend bool operator >= (btree_multimap const& lhs, btree_multimap const& rhs) {
+        return !(lhs < rhs);
+    }
+
+    friend bool operator <= (btree_multimap const& lhs, btree_multimap const& rhs) {
+        return !(rhs < lhs);
+    }
+    
+};
+
+//same interface as map over a sorted array, keys apart from the values:
+//the fastest lookups and scans of the family, for tables that are built
+//once and read a lot. Inserting or erasing one element is O(n) and
+//invalidates iterators; insert a batch through insert(first, last).
+//Iterators give a pair of references, first and second, not a value_type&.
+template <typename KEY, typename T, typename COMP = less<KEY>,
+    typename ALLOC = TKF::allocator<TKF::pair<KEY, T> > >
+class flat_map {
+public:
+    typedef KEY                     key_type;
+    typedef T                       map_type;
+    typedef TKF::pair<KEY, T>       value_type;
+    typedef COMP                    key_compare;
+    
+    class value_compare {
+        friend class flat_map<KEY, T, COMP, ALLOC>;
+    private:
+        COMP _comp;
+        value_compare(COMP comp) : _comp(comp) {}
+    public:
+        bool operator () (value_type const& lhs, value_type const& rhs) {
+            return _comp(lhs.first, rhs.first);
+        }
+    };
+    
+private:
+    typedef TKF::FlatTable<KEY, T, key_compare, ALLOC> base_type;
+    base_type _table;
+
+public:
+    typedef typename base_type::pointer              pointer;
+    typedef typename base_type::reference            reference;
+    typedef typename base_type::size_type            size_type;
+    typedef typename base_type::difference_type      difference_type;
+    typedef typename base_type::allocator_type       allocator_type;
+    typedef typename base_type::iterator             iterator;
+    typedef typename base_type::reverse_iterator     reverse_iterator;
+
+public:
+    flat_map() : _table() {}
+
+    template <typename ITER>
+    flat_map(ITER first, ITER second) : _table() {
+        _table.unique_insert(first, second);
+    }
+
+    //O(n): a map is already in key order
+    template <typename A, typename P, typename S>
+    explicit flat_map(map<KEY, T, COMP, A, P, S> const& rhs) : _table() {
+        _table.build_from_sorted(rhs.begin(), rhs.size(), true);
+    }
+    
+    flat_map(flat_map const& rhs) : _table(rhs._table) {}
+
+    flat_map(flat_map&& rhs) : _table(TKF::move(rhs._table)) {}
+
+    flat_map& operator = (flat_map const& rhs) {
+        _table = rhs._table;
+        return *this;
+    }
+
+    flat_map& operator = (flat_map&& rhs) {
+        _table = TKF::move(rhs._table);
+        return *this;
+    }
+
+    ~flat_map() = default;
+    
+    //API
+    key_compare key_comp() const { 
+        return _table.key_comp();
+    }
+
+    value_compare value_comp() const {
+        return value_compare(_table.key_comp());
+    }
+
+    allocator_type get_allocator() const {
+        return _table.get_allocator();
+    }
+
+    //Iterator
+    iterator begin() const noexcept {
+        return _table.begin();
+    }
+
+    iterator end() const noexcept {
+        return _table.end();
+    }
+
+    reverse_iterator rbegin() const noexcept {
+        return _table.rbegin();
+    }
+
+    reverse_iterator rend() const noexcept {
+        return _table.rend();
+    }
+
+    bool empty() const noexcept {
+        return _table.empty();
+    }
+
+    size_type size() const noexcept {
+        return _table.size();
+    }
+
+    size_type max_size() const noexcept {
+        return _table.max_size();
+    }
+
+    size_type capacity() const noexcept {
+        return _table.capacity();
+    }
+
+    void reserve (size_type n) {
+        _table.reserve(n);
+    }
+
+    void shrink_to_fit () {
+        _table.shrink_to_fit();
+    }
+
+    //the sorted key array and the values in the same order
+    KEY const* keys() const noexcept {
+        return _table.keys();
+    }
+
+    T* values() const noexcept {
+        return _table.values();
+    }
+
+    map_type& at (key_type const& key) {
+        iterator iter = _table.find(key);
+        THROW_OUT_OF_RANGE_IF(iter == end(), "flat_map<KEY, T> has no such element");
+        return iter->second;
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    map_type& at (K const& key) {
+        iterator iter = _table.find(key);
+        THROW_OUT_OF_RANGE_IF(iter == end(), "flat_map<KEY, T> has no such element");
+        return iter->second;
+    }
+
+    map_type& operator [] (key_type const& key) {
+        return try_emplace(key).first->second;
+    }
+
+    map_type& operator [] (key_type&& key) {
+        return try_emplace(TKF::move(key)).first->second;
+    }
+
+    //transparent COMP: the key_type is built only when key is inserted
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    map_type& operator [] (K const& key) {
+        return _table.unique_emplace_key(key).first->second;
+    }
+
+    //search first: on a hit nothing is built and args are not moved from
+    template <typename ...Args>
+    TKF::pair<iterator, bool> try_emplace (key_type const& key, Args&&... args) {
+        return _table.unique_emplace_key(key, TKF::forward<Args>(args)...);
+    }
+
+    template <typename ...Args>
+    TKF::pair<iterator, bool> try_emplace (key_type&& key, Args&&... args) {
+        return _table.unique_emplace_key(TKF::move(key), TKF::forward<Args>(args)...);
+    }
+
+    template <typename ...Args>
+    iterator try_emplace (iterator hint, key_type const& key, Args&&... args) {
+        return _table.unique_emplace_key_hint(hint, key, TKF::forward<Args>(args)...);
+    }
+
+    template <typename ...Args>
+    iterator try_emplace (iterator hint, key_type&& key, Args&&... args) {
+        return _table.unique_emplace_key_hint(hint, TKF::move(key), 
+            TKF::forward<Args>(args)...);
+    }
+
+    //assigns obj to the mapped value of key, inserting key if missing
+    template <typename M>
+    TKF::pair<iterator, bool> insert_or_assign (key_type const& key, M&& obj) {
+        auto res = try_emplace(key, TKF::forward<M>(obj));
+        if (!res.second) {
+            res.first->second = TKF::forward<M>(obj);
+        }
+        return res;
+    }
+
+    template <typename M>
+    TKF::pair<iterator, bool> insert_or_assign (key_type&& key, M&& obj) {
+        auto res = try_emplace(TKF::move(key), TKF::forward<M>(obj));
+        if (!res.second) {
+            res.first->second = TKF::forward<M>(obj);
+        }
+        return res;
+    }
+
+    template <typename M>
+    iterator insert_or_assign (iterator hint, key_type const& key, M&& obj) {
+        size_type n = size();
+        iterator iter = try_emplace(hint, key, TKF::forward<M>(obj));
+        if (size() == n) {
+            iter->second = TKF::forward<M>(obj);
+        }
+        return iter;
+    }
+
+    template <typename M>
+    iterator insert_or_assign (iterator hint, key_type&& key, M&& obj) {
+        size_type n = size();
+        iterator iter = try_emplace(hint, TKF::move(key), TKF::forward<M>(obj));
+        if (size() == n) {
+            iter->second = TKF::forward<M>(obj);
+        }
+        return iter;
+    }
+
+    template <typename ...Args>
+    TKF::pair<iterator, bool> emplace (Args&&... args) {
+        return insert(value_type(TKF::forward<Args>(args)...));
+    }
+
+    template <typename ...Args>
+    iterator emplace_hint (iterator hint, Args&&... args) {
+        return insert(hint, value_type(TKF::forward<Args>(args)...));
+    }
+
+    TKF::pair<iterator, bool> insert (value_type const& value) {
+        return _table.unique_emplace_key(value.first, value.second);
+    }
+
+    TKF::pair<iterator, bool> insert (value_type&& value) {
+        return _table.unique_emplace_key(TKF::move(value.first), TKF::move(value.second));
+    }
+
+    iterator insert (iterator hint, value_type const& value) {
+        return _table.unique_emplace_key_hint(hint, value.first, value.second);
+    }
+
+    iterator insert (iterator hint, value_type&& value) {
+        return _table.unique_emplace_key_hint(hint, TKF::move(value.first), 
+            TKF::move(value.second));
+    }
+
+    //sorts the batch and merges it in: O(n + m log m)
+    template <typename ITER>
+    void insert (ITER const& first, ITER const& last) {
+        _table.unique_insert(first, last);
+    }
+
+    //replaces the contents in O(n); [first, last) must be in key order
+    template <typename ITER>
+    void build_from_sorted (ITER const& first, ITER const& last) {
+        _table.build_from_sorted(first, TKF::distance(first, last), true);
+    }
+
+    //returns the element after the erased one
+    iterator erase (iterator iter) {
+        return _table.erase(iter);
+    }
+
+    size_type erase(key_type const& key) {
+        return _table.unique_erase(key);
+    }
+
+    void erase (iterator first, iterator last) {
+        _table.erase(first, last);
+    }
+
+    void clear () {
+        _table.clear();
+    }
+
+    iterator find (key_type const& key) const {
+        return _table.find(key);
+    }
+
+    iterator lower_bound (key_type const& key) const {
+        return _table.lower_bound(key);
+    }
+
+    iterator upper_bound (key_type const& key) const {
+        return _table.upper_bound(key);
+    }
+
+    size_type count (key_type const& key) const {
+        return _table.count(key);
+    }
+
+    TKF::pair<iterator, iterator> equal_range (key_type const& key) const {
+        return _table.equal_range(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator find (K const& key) const {
+        return _table.find(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator lower_bound (K const& key) const {
+        return _table.lower_bound(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator upper_bound (K const& key) const {
+        return _table.upper_bound(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    size_type count (K const& key) const {
+        return _table.count(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    TKF::pair<iterator, iterator> equal_range (K const& key) const {
+        return _table.equal_range(key);
+    }
+
+    //order statistics come free with an array
+    size_type rank (key_type const& key) const {
+        return _table.lower_bound(key) - begin();
+    }
+
+    iterator select (size_type i) const {
+        return begin() + i;
+    }
+
+    friend bool operator == (flat_map const& lhs, flat_map const& rhs) {
+        return (lhs._table == rhs._table);
+    }
+
+    friend bool operator != (flat_map const& lhs, flat_map const& rhs) {
+        return !(lhs == rhs);
+    }
+
+    friend bool operator < (flat_map const& lhs, flat_map const& rhs) {
+        return lhs._table < rhs._table;
+    }
+
+    friend bool operator > (flat_map const& lhs, flat_map const& rhs) {
+        return rhs < lhs;
+    }
+
+    friend bool operator >= (flat_map const& lhs, flat_map const& rhs) {
+        return !(lhs < rhs);
+    }
+
+    friend bool operator <= (flat_map const& lhs, flat_map const& rhs) {
+        return !(rhs < lhs);
+    }
+    
+};
+
+//same interface as multimap over a sorted array, see flat_map
+template <typename KEY, typename T, typename COMP = less<KEY>,
+    typename ALLOC = TKF::allocator<TKF::pair<KEY, T> > >
+class flat_multimap {
+public:
+    typedef KEY                     key_type;
+    typedef T                       map_type;
+    typedef TKF::pair<KEY, T>       value_type;
+    typedef COMP                    key_compare;
+    
+    class value_compare {
+        friend class flat_multimap<KEY, T, COMP, ALLOC>;
+    private:
+        COMP _comp;
+        value_compare(COMP comp) : _comp(comp) {}
+    public:
+        bool operator () (value_type const& lhs, value_type const& rhs) {
+            return _comp(lhs.first, rhs.first);
+        }
+    };
+    
+private:
+    typedef TKF::FlatTable<KEY, T, key_compare, ALLOC> base_type;
+    base_type _table;
+
+public:
+    typedef typename base_type::pointer              pointer;
+    typedef typename base_type::reference            reference;
+    typedef typename base_type::size_type            size_type;
+    typedef typename base_type::difference_type      difference_type;
+    typedef typename base_type::allocator_type       allocator_type;
+    typedef typename base_type::iterator             iterator;
+    typedef typename base_type::reverse_iterator     reverse_iterator;
+
+public:
+    flat_multimap() : _table() {}
+
+    template <typename ITER>
+    flat_multimap(ITER first, ITER second) : _table() {
+        _table.multi_insert(first, second);
+    }
+
+    //O(n): a multimap is already in key order
+    template <typename A, typename P, typename S>
+    explicit flat_multimap(multimap<KEY, T, COMP, A, P, S> const& rhs) : _table() {
+        _table.build_from_sorted(rhs.begin(), rhs.size(), false);
+    }
+    
+    flat_multimap(flat_multimap const& rhs) : _table(rhs._table) {}
+
+    flat_multimap(flat_multimap&& rhs) : _table(TKF::move(rhs._table)) {}
+
+    flat_multimap& operator = (flat_multimap const& rhs) {
+        _table = rhs._table;
+        return *this;
+    }
+
+    flat_multimap& operator = (flat_multimap&& rhs) {
+        _table = TKF::move(rhs._table);
+        return *this;
+    }
+
+    ~flat_multimap() = default;
+    
+    //API
+    key_compare key_comp() const { 
+        return _table.key_comp();
+    }
+
+    value_compare value_comp() const {
+        return value_compare(_table.key_comp());
+    }
+
+    allocator_type get_allocator() const {
+        return _table.get_allocator();
+    }
+
+    //Iterator
+    iterator begin() const noexcept {
+        return _table.begin();
+    }
+
+    iterator end() const noexcept {
+        return _table.end();
+    }
+
+    reverse_iterator rbegin() const noexcept {
+        return _table.rbegin();
+    }
+
+    reverse_iterator rend() const noexcept {
+        return _table.rend();
+    }
+
+    bool empty() const noexcept {
+        return _table.empty();
+    }
+
+    size_type size() const noexcept {
+        return _table.size();
+    }
+
+    size_type max_size() const noexcept {
+        return _table.max_size();
+    }
+
+    size_type capacity() const noexcept {
+        return _table.capacity();
+    }
+
+    void reserve (size_type n) {
+        _table.reserve(n);
+    }
+
+    void shrink_to_fit () {
+        _table.shrink_to_fit();
+    }
+
+    KEY const* keys() const noexcept {
+        return _table.keys();
+    }
+
+    T* values() const noexcept {
+        return _table.values();
+    }
+
+    template <typename ...Args>
+    iterator emplace (Args&&... args) {
+        return insert(value_type(TKF::forward<Args>(args)...));
+    }
+
+    template <typename ...Args>
+    iterator emplace_hint (iterator hint, Args&&... args) {
+        return insert(hint, value_type(TKF::forward<Args>(args)...));
+    }
+
+    iterator insert (value_type const& value) {
+        return _table.multi_emplace_key(value.first, value.second);
+    }
+
+    iterator insert (value_type&& value) {
+        return _table.multi_emplace_key(TKF::move(value.first), TKF::move(value.second));
+    }
+
+    iterator insert (iterator hint, value_type const& value) {
+        return _table.multi_emplace_key_hint(hint, value.first, value.second);
+    }
+
+    iterator insert (iterator hint, value_type&& value) {
+        return _table.multi_emplace_key_hint(hint, TKF::move(value.first), 
+            TKF::move(value.second));
+    }
+
+    //sorts the batch and merges it in: O(n + m log m)
+    template <typename ITER>
+    void insert (ITER const& first, ITER const& last) {
+        _table.multi_insert(first, last);
+    }
+
+    //replaces the contents in O(n); [first, last) must be in key order
+    template <typename ITER>
+    void build_from_sorted (ITER const& first, ITER const& last) {
+        _table.build_from_sorted(first, TKF::distance(first, last), false);
+    }
+
+    //returns the element after the erased one
+    iterator erase (iterator iter) {
+        return _table.erase(iter);
+    }
+
+    size_type erase(key_type const& key) {
+        return _table.multi_erase(key);
+    }
+
+    void erase (iterator first, iterator last) {
+        _table.erase(first, last);
+    }
+
+    void clear () {
+        _table.clear();
+    }
+
+    iterator find (key_type const& key) const {
+        return _table.find(key);
+    }
+
+    iterator lower_bound (key_type const& key) const {
+        return _table.lower_bound(key);
+    }
+
+    iterator upper_bound (key_type const& key) const {
+        return _table.upper_bound(key);
+    }
+
+    size_type count (key_type const& key) const {
+        return _table.count(key);
+    }
+
+    TKF::pair<iterator, iterator> equal_range (key_type const& key) const {
+        return _table.equal_range(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator find (K const& key) const {
+        return _table.find(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator lower_bound (K const& key) const {
+        return _table.lower_bound(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator upper_bound (K const& key) const {
+        return _table.upper_bound(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    size_type count (K const& key) const {
+        return _table.count(key);
+    }
+
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    TKF::pair<iterator, iterator> equal_range (K const& key) const {
+        return _table.equal_range(key);
+    }
+
+    size_type rank (key_type const& key) const {
+        return _table.lower_bound(key) - begin();
+    }
+
+    iterator select (size_type i) const {
+        return begin() + i;
+    }
+
+    friend bool operator == (flat_multimap const& lhs, flat_multimap const& rhs) {
+        return (lhs._table == rhs._table);
+    }
+
+    friend bool operator != (flat_multimap const& lhs, flat_multimap const& rhs) {
+        return !(lhs == rhs);
+    }
+
+    friend bool operator < (flat_multimap const& lhs, flat_multimap const& rhs) {
+        return lhs._table < rhs._table;
+    }
+
+    friend bool operator > (flat_multimap const& lhs, flat_multimap const& rhs) {
+        return rhs < lhs;
+    }
+
+    friend bool operator >= (flat_multimap const& lhs, flat_multimap const& rhs) {
+        return !(lhs < rhs);
+    }
+
+    friend bool operator <= (flat_multimap const& lhs, flat_multimap const& rhs) {
+        return !(rhs < lhs);
+    }
+    
+};
+
 }
 
 #endif //!MAP_H
\ No newline at end of file
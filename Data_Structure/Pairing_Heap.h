@@ -0,0 +1,419 @@
+//file: Pairing_Heap.h
+#ifndef PAIRING_HEAP_H
+#define PAIRING_HEAP_H
+
+#include<vector>
+#include"Allocator.h"
+#include"Utility.h"
+#include"Fibonacci_Heap.h"
+
+namespace TKF {
+
+template <typename T> struct PH_node;
+template <typename T> struct PH_handle;
+
+//children hang off child in a list through next; prev is the sibling
+//before, or the parent for a first child. The stamp stays clear of the
+//first word, which a pool slot reuses as its freelist link once freed.
+template <typename T>
+struct PH_node {
+    typedef PH_node<T>*          node_ptr;
+    typedef unsigned long long   stamp_type;
+
+    node_ptr    child;
+    node_ptr    next;
+    node_ptr    prev;
+    stamp_type  stamp;  //which insert made the value, 0 once destroyed
+    T           value;
+};
+
+//names a value pushed into a PairingHeap, as FIBH_handle does
+template <typename T>
+struct PH_handle {
+    typedef PH_node<T>*                             node_ptr;
+    typedef typename PH_node<T>::stamp_type         stamp_type;
+
+    node_ptr    node;
+    stamp_type  stamp;
+
+    PH_handle() : node(nullptr), stamp(0) {}
+    PH_handle(node_ptr ptr) : node(ptr), stamp(ptr->stamp) {}
+
+    friend bool operator == (PH_handle const& lhs, PH_handle const& rhs) {
+        return lhs.node == rhs.node && lhs.stamp == rhs.stamp;
+    }
+
+    friend bool operator != (PH_handle const& lhs, PH_handle const& rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+//pairing heap, for priority_queue's HEAP: a single tree where insert and
+//decrease link one more subtree under the root or the root under it,
+//and extract pairs the children of the root up left to right, then
+//melds the pairs right to left (the two-pass variant), both in loops.
+//Nodes are three links smaller than those of FIBHeap and come from a
+//pool_allocator by default, whose chunks stay with the heap: a handle is
+//checked against its node's stamp even after the node is freed, which an
+//ALLOC that gives memory back would not allow.
+template <typename T, typename COMP, typename ALLOC = TKF::pool_allocator<T> >
+class PairingHeap {
+public:
+    typedef FIBH_value_traits<T>                value_traits;
+    typedef typename value_traits::key_type     key_type;
+    typedef typename value_traits::value_type   value_type;
+
+    typedef PH_node<T>                          node_type;
+    typedef PH_node<T>*                         node_ptr;
+    typedef PH_handle<T>                        handle;
+
+    typedef COMP    key_compare;
+
+    typedef TKF::allocator<T>                   data_allocator;
+    typedef typename ALLOC::template rebind<node_type>::other node_allocator;
+
+    typedef typename data_allocator::pointer        pointer;
+    typedef typename data_allocator::const_pointer  const_pointer;
+    typedef typename data_allocator::reference      reference;
+    typedef typename data_allocator::const_reference const_reference;
+    typedef typename data_allocator::size_type      size_type;
+    typedef typename data_allocator::difference_type difference_type;
+
+    key_compare key_comp() const { return _comp; }
+
+protected:
+    node_ptr _root;
+    size_type _num;
+    key_compare _comp;
+    node_allocator _alloc;
+    typename handle::stamp_type _stamp;
+
+public:
+    PairingHeap() : _root(nullptr), _num(0), _comp(), _alloc(), _stamp(0) {}
+
+    explicit PairingHeap(COMP const& comp) : _root(nullptr), _num(0), _comp(comp),
+        _alloc(), _stamp(0) {}
+
+    //the copy is built by inserting every value, so handles stay with rhs
+    PairingHeap(PairingHeap const& rhs) : _root(nullptr), _num(0), _comp(rhs._comp),
+        _alloc(), _stamp(0) {
+        try {
+            std::vector<node_ptr> stack;
+            if (rhs._root != nullptr) {
+                stack.push_back(rhs._root);
+            }
+            while (!stack.empty()) {
+                node_ptr ptr = stack.back();
+                stack.pop_back();
+                insert(ptr->value);
+                if (ptr->next != nullptr) {
+                    stack.push_back(ptr->next);
+                }
+                if (ptr->child != nullptr) {
+                    stack.push_back(ptr->child);
+                }
+            }
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    PairingHeap(PairingHeap&& rhs) : _root(rhs._root), _num(rhs._num),
+        _comp(rhs._comp), _alloc(TKF::move(rhs._alloc)), _stamp(rhs._stamp) {
+        rhs._root = nullptr;
+        rhs._num = 0;
+    }
+
+    PairingHeap& operator = (PairingHeap rhs) {
+        swap(rhs);
+        return *this;
+    }
+
+    ~PairingHeap() {
+        clear();
+    }
+
+    void swap(PairingHeap& rhs) noexcept {
+        std::swap(_root, rhs._root);
+        std::swap(_num, rhs._num);
+        std::swap(_comp, rhs._comp);
+        std::swap(_alloc, rhs._alloc);
+        std::swap(_stamp, rhs._stamp);
+    }
+
+    node_ptr top() const {
+        return _root;
+    }
+
+    const_reference top_value() const {
+        return _root->value;
+    }
+
+    bool empty() const noexcept {
+        return _num == 0;
+    }
+
+    size_type size() const noexcept {
+        return _num;
+    }
+
+    size_type max_size() const noexcept {
+        return static_cast<size_type>(-1);
+    }
+
+    template <typename ...Args>
+    node_ptr emplace(Args&& ...args);
+
+    node_ptr insert(value_type const& value) {
+        return emplace(value);
+    }
+
+    node_ptr insert(value_type&& value) {
+        return emplace(TKF::move(value));
+    }
+
+    //unlinks the top node and hands it to the caller, who gives it back
+    //through destroy()
+    node_ptr extract();
+
+    void pop() {
+        destroy(extract());
+    }
+
+    void destroy(node_ptr ptr) {
+        _destroy(ptr);
+    }
+
+    //false, and nothing changed, if key is larger than before
+    bool decrease(node_ptr ptr, key_type key);
+
+    //cuts the node out, melds its children back and links it again with
+    //the larger key; false, and nothing changed, if key is smaller
+    bool increase(node_ptr ptr, key_type key);
+
+    void erase(node_ptr ptr);
+
+    void clear() noexcept;
+
+    bool contains(handle h) const noexcept {
+        return h.node != nullptr && h.stamp != 0 && h.node->stamp == h.stamp;
+    }
+
+    bool update(handle h, key_type key) {
+        if (!contains(h)) {
+            return false;
+        }
+        if (_comp(key, value_traits::get_key(h.node->value))) {
+            return decrease(h.node, key);
+        }
+        return increase(h.node, key);
+    }
+
+    bool erase(handle h) {
+        if (!contains(h)) {
+            return false;
+        }
+        erase(h.node);
+        return true;
+    }
+
+private:
+    //strictly before, COMP being <=
+    bool _before(node_ptr lhs, node_ptr rhs) const {
+        return !_comp(value_traits::get_key(rhs->value), value_traits::get_key(lhs->value));
+    }
+
+    node_ptr _link(node_ptr lhs, node_ptr rhs) noexcept;
+    node_ptr _merge_pairs(node_ptr first) noexcept;
+    void _cut(node_ptr ptr) noexcept;
+    void _destroy(node_ptr ptr) noexcept;
+};
+
+template <typename T, typename COMP, typename ALLOC>
+template <typename ...Args>
+typename PairingHeap<T, COMP, ALLOC>::node_ptr
+PairingHeap<T, COMP, ALLOC>::emplace (Args&&... args) {
+    THROW_OUT_OF_RANGE_IF(_num > max_size() - 1,
+        "PairingHeap<T, COMP> size is out of range");
+    node_ptr ptr = _alloc.allocate(1);
+    try {
+        data_allocator::construct(&ptr->value, TKF::forward<Args>(args)...);
+    }
+    catch (...) {
+        _alloc.deallocate(ptr);
+        throw;
+    }
+    ptr->child = nullptr;
+    ptr->next = nullptr;
+    ptr->prev = nullptr;
+    ptr->stamp = ++_stamp;
+    _root = _root == nullptr ? ptr : _link(_root, ptr);
+    ++_num;
+    return ptr;
+}
+
+template <typename T, typename COMP, typename ALLOC>
+typename PairingHeap<T, COMP, ALLOC>::node_ptr
+PairingHeap<T, COMP, ALLOC>::extract () {
+    node_ptr ptr = _root;
+    _root = _merge_pairs(ptr->child);
+    ptr->child = nullptr;
+    --_num;
+    return ptr;
+}
+
+template <typename T, typename COMP, typename ALLOC>
+bool PairingHeap<T, COMP, ALLOC>::decrease (node_ptr ptr, key_type key) {
+    if (!_comp(key, value_traits::get_key(ptr->value))) {
+        return false;
+    }
+    value_traits::change_key(ptr->value, key);
+    if (ptr != _root) {
+        _cut(ptr);
+        _root = _link(_root, ptr);
+    }
+    return true;
+}
+
+template <typename T, typename COMP, typename ALLOC>
+bool PairingHeap<T, COMP, ALLOC>::increase (node_ptr ptr, key_type key) {
+    if (!_comp(value_traits::get_key(ptr->value), key)) {
+        return false;
+    }
+    node_ptr rest = _merge_pairs(ptr->child);
+    ptr->child = nullptr;
+    if (ptr == _root) {
+        _root = rest;
+    }
+    else {
+        _cut(ptr);
+        if (rest != nullptr) {
+            _root = _link(_root, rest);
+        }
+    }
+    value_traits::change_key(ptr->value, key);
+    _root = _root == nullptr ? ptr : _link(_root, ptr);
+    return true;
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void PairingHeap<T, COMP, ALLOC>::erase (node_ptr ptr) {
+    if (ptr == _root) {
+        pop();
+        return;
+    }
+    _cut(ptr);
+    node_ptr rest = _merge_pairs(ptr->child);
+    ptr->child = nullptr;
+    if (rest != nullptr) {
+        _root = _link(_root, rest);
+    }
+    --_num;
+    _destroy(ptr);
+}
+
+//every child list is spliced in right after its parent, so one walk
+//along next reaches the whole tree
+template <typename T, typename COMP, typename ALLOC>
+void PairingHeap<T, COMP, ALLOC>::clear () noexcept {
+    node_ptr ptr = _root;
+    while (ptr != nullptr) {
+        node_ptr child = ptr->child;
+        if (child != nullptr) {
+            node_ptr last = child;
+            while (last->next != nullptr) {
+                last = last->next;
+            }
+            last->next = ptr->next;
+            ptr->next = child;
+        }
+        node_ptr next = ptr->next;
+        _destroy(ptr);
+        ptr = next;
+    }
+    _root = nullptr;
+    _num = 0;
+}
+
+//the root of the two, the other made its first child
+template <typename T, typename COMP, typename ALLOC>
+typename PairingHeap<T, COMP, ALLOC>::node_ptr
+PairingHeap<T, COMP, ALLOC>::_link (node_ptr lhs, node_ptr rhs) noexcept {
+    if (_before(rhs, lhs)) {
+        std::swap(lhs, rhs);
+    }
+    rhs->next = lhs->child;
+    if (lhs->child != nullptr) {
+        lhs->child->prev = rhs;
+    }
+    rhs->prev = lhs;
+    lhs->child = rhs;
+    lhs->next = nullptr;
+    lhs->prev = nullptr;
+    return lhs;
+}
+
+//first pass: link the siblings two by two, pushing each pair on a stack
+//threaded through next; second pass: meld the stack, last pair first
+template <typename T, typename COMP, typename ALLOC>
+typename PairingHeap<T, COMP, ALLOC>::node_ptr
+PairingHeap<T, COMP, ALLOC>::_merge_pairs (node_ptr first) noexcept {
+    node_ptr stack = nullptr;
+    while (first != nullptr) {
+        node_ptr second = first->next;
+        node_ptr pair;
+        if (second == nullptr) {
+            pair = first;
+            first = nullptr;
+        }
+        else {
+            first->next = nullptr;
+            node_ptr rest = second->next;
+            pair = _link(first, second);
+            first = rest;
+        }
+        pair->next = stack;
+        stack = pair;
+    }
+    if (stack == nullptr) {
+        return nullptr;
+    }
+    node_ptr root = stack;
+    stack = stack->next;
+    while (stack != nullptr) {
+        node_ptr next = stack->next;
+        root = _link(root, stack);
+        stack = next;
+    }
+    root->next = nullptr;
+    root->prev = nullptr;
+    return root;
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void PairingHeap<T, COMP, ALLOC>::_cut (node_ptr ptr) noexcept {
+    if (ptr->prev->child == ptr) {
+        ptr->prev->child = ptr->next;
+    }
+    else {
+        ptr->prev->next = ptr->next;
+    }
+    if (ptr->next != nullptr) {
+        ptr->next->prev = ptr->prev;
+    }
+    ptr->next = nullptr;
+    ptr->prev = nullptr;
+}
+
+template <typename T, typename COMP, typename ALLOC>
+void PairingHeap<T, COMP, ALLOC>::_destroy (node_ptr ptr) noexcept {
+    data_allocator::destroy(&ptr->value);
+    ptr->stamp = 0;
+    _alloc.deallocate(ptr);
+}
+
+}
+
+#endif //!PAIRING_HEAP_H
\ No newline at end of file
@@ -0,0 +1,670 @@
+//file: Persistent_Map.h
+#ifndef PERSISTENT_MAP_H
+#define PERSISTENT_MAP_H
+
+#include<atomic>
+#include<cstddef>
+#include<climits>
+#include<tuple>
+#include<utility>
+#include"Iterator.h"
+#include"Allocator.h"
+#include"Type_Traits.h"
+#include"Utility.h"
+
+namespace TKF {
+
+//persistent map: a left-leaning red-black tree whose nodes are shared
+//between versions and reference counted.
+//snapshot() and copying are O(1): they share the root. A write copies
+//only the nodes it changes that another version still reaches, so with
+//k live snapshots it allocates at most O(log n) nodes, and none at all
+//between snapshots, when every node belongs to the writer alone.
+//A snapshot is immutable and may be read, copied and destroyed on any
+//thread while the writer goes on; the reference counts are atomic, so
+//ALLOC must be thread-safe when snapshots cross threads.
+//Iterators are const and stack based; those of the map itself are
+//invalidated by every write, those of a snapshot live as long as it.
+template <typename KEY, typename T, typename COMP = less<KEY>,
+    typename ALLOC = TKF::allocator<TKF::pair<KEY, T> > >
+class persistent_map {
+public:
+    typedef KEY                 key_type;
+    typedef T                   map_type;
+    typedef TKF::pair<KEY, T>   value_type;
+    typedef COMP                key_compare;
+    typedef size_t              size_type;
+    typedef ptrdiff_t           difference_type;
+    typedef value_type const&   const_reference;
+    typedef value_type const*   const_pointer;
+
+private:
+    struct _node {
+        value_type              value;
+        _node*                  left;
+        _node*                  right;
+        //one per parent, map or snapshot holding the node
+        std::atomic<size_t>     refs;
+        bool                    red;
+
+        template <typename ...Args>
+        _node(bool color, Args&&... args)
+            : value(TKF::forward<Args>(args)...), left(nullptr), right(nullptr),
+            refs(1), red(color) {}
+    };
+
+    typedef typename ALLOC::template rebind<_node>::other node_allocator;
+
+    //an LLRB of n nodes is at most 2 log2(n + 1) high
+    static constexpr unsigned _max_height = 2 * sizeof(size_type) * CHAR_BIT;
+
+    static bool _is_red(_node* ptr) {
+        return ptr != nullptr && ptr->red;
+    }
+
+    static void _acquire(_node* ptr) {
+        if (ptr != nullptr) {
+            ptr->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    //drops one reference, freeing the subtree that nobody else holds
+    static void _release(_node* ptr) {
+        while (ptr != nullptr && ptr->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            _node* right = ptr->right;
+            _release(ptr->left);
+            _free(ptr);
+            ptr = right;
+        }
+    }
+
+    static void _free(_node* ptr) {
+        node_allocator::destroy(ptr);
+        node_allocator::deallocate(ptr);
+    }
+
+public:
+    class iterator : public TKF::iterator<_forward_iterator, value_type,
+        ptrdiff_t, const_pointer, const_reference> {
+        friend class persistent_map;
+        //the nodes still to visit: top is the current one, below it the
+        //ancestors whose left subtree the walk is in
+        _node*      _stack[_max_height];
+        unsigned    _depth;
+
+        void _push_left(_node* ptr) {
+            for (; ptr != nullptr; ptr = ptr->left) {
+                _stack[_depth++] = ptr;
+            }
+        }
+
+    public:
+        iterator() : _depth(0) {}
+
+        iterator(iterator const& rhs) : _depth(rhs._depth) {
+            for (unsigned i = 0; i < _depth; ++i) {
+                _stack[i] = rhs._stack[i];
+            }
+        }
+
+        iterator& operator = (iterator const& rhs) {
+            _depth = rhs._depth;
+            for (unsigned i = 0; i < _depth; ++i) {
+                _stack[i] = rhs._stack[i];
+            }
+            return *this;
+        }
+
+        const_reference operator * () const {
+            return _stack[_depth - 1]->value;
+        }
+
+        const_pointer operator -> () const {
+            return &_stack[_depth - 1]->value;
+        }
+
+        iterator& operator ++ () {
+            _node* ptr = _stack[--_depth];
+            _push_left(ptr->right);
+            return *this;
+        }
+
+        iterator operator ++ (int) {
+            iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        friend bool operator == (iterator const& lhs, iterator const& rhs) {
+            if (lhs._depth == 0 || rhs._depth == 0) {
+                return lhs._depth == rhs._depth;
+            }
+            return lhs._stack[lhs._depth - 1] == rhs._stack[rhs._depth - 1];
+        }
+
+        friend bool operator != (iterator const& lhs, iterator const& rhs) {
+            return !(lhs == rhs);
+        }
+    };
+
+    typedef iterator const_iterator;
+
+    //the read side, shared by the map and its snapshots
+    class version {
+        friend class persistent_map;
+    protected:
+        _node*      _root;
+        size_type   _num;
+        key_compare _comp;
+
+        version() : _root(nullptr), _num(0), _comp() {}
+
+        version(_node* root, size_type num, key_compare const& comp)
+            : _root(root), _num(num), _comp(comp) {
+            _acquire(_root);
+        }
+
+        version(version const& rhs) : version(rhs._root, rhs._num, rhs._comp) {}
+
+        version& operator = (version const& rhs) {
+            if (_root != rhs._root) {
+                _acquire(rhs._root);
+                _release(_root);
+                _root = rhs._root;
+            }
+            _num = rhs._num;
+            _comp = rhs._comp;
+            return *this;
+        }
+
+        ~version() {
+            _release(_root);
+        }
+
+        //true when lhs goes strictly before rhs
+        bool _before(key_type const& lhs, key_type const& rhs) const {
+            return !_comp(rhs, lhs);
+        }
+
+    public:
+        key_compare key_comp() const {
+            return _comp;
+        }
+
+        size_type size() const noexcept {
+            return _num;
+        }
+
+        bool empty() const noexcept {
+            return _num == 0;
+        }
+
+        size_type max_size() const noexcept {
+            return static_cast<size_type>(-1) / sizeof(_node);
+        }
+
+        iterator begin() const {
+            iterator iter;
+            iter._push_left(_root);
+            return iter;
+        }
+
+        iterator end() const {
+            return iterator();
+        }
+
+        iterator lower_bound(key_type const& key) const {
+            iterator iter;
+            for (_node* ptr = _root; ptr != nullptr; ) {
+                if (_before(ptr->value.first, key)) {
+                    ptr = ptr->right;
+                }
+                else {
+                    iter._stack[iter._depth++] = ptr;
+                    ptr = ptr->left;
+                }
+            }
+            return iter;
+        }
+
+        iterator upper_bound(key_type const& key) const {
+            iterator iter;
+            for (_node* ptr = _root; ptr != nullptr; ) {
+                if (_before(key, ptr->value.first)) {
+                    iter._stack[iter._depth++] = ptr;
+                    ptr = ptr->left;
+                }
+                else {
+                    ptr = ptr->right;
+                }
+            }
+            return iter;
+        }
+
+        iterator find(key_type const& key) const {
+            iterator iter = lower_bound(key);
+            if (iter != end() && _before(key, iter->first)) {
+                return end();
+            }
+            return iter;
+        }
+
+        size_type count(key_type const& key) const {
+            return _lookup(key) != nullptr ? 1 : 0;
+        }
+
+        bool contains(key_type const& key) const {
+            return _lookup(key) != nullptr;
+        }
+
+        map_type const& at(key_type const& key) const {
+            _node* ptr = _lookup(key);
+            THROW_OUT_OF_RANGE_IF(ptr == nullptr, "persistent_map<KEY, T> has no such element");
+            return ptr->value.second;
+        }
+
+    protected:
+        _node* _lookup(key_type const& key) const {
+            _node* ptr = _root;
+            while (ptr != nullptr) {
+                if (_before(key, ptr->value.first)) {
+                    ptr = ptr->left;
+                }
+                else if (_before(ptr->value.first, key)) {
+                    ptr = ptr->right;
+                }
+                else {
+                    break;
+                }
+            }
+            return ptr;
+        }
+    };
+
+    //an immutable version of the map, frozen by persistent_map::snapshot()
+    class snapshot_type : public version {
+        friend class persistent_map;
+        snapshot_type(version const& rhs) : version(rhs) {}
+    public:
+        snapshot_type() : version() {}
+        snapshot_type(snapshot_type const& rhs) : version(rhs) {}
+        snapshot_type& operator = (snapshot_type const& rhs) {
+            version::operator = (rhs);
+            return *this;
+        }
+        ~snapshot_type() = default;
+    };
+
+private:
+    //the writer's version
+    class _state : public version {
+        friend class persistent_map;
+        _state() : version() {}
+        _state(_state const& rhs) : version(rhs) {}
+        _state& operator = (_state const& rhs) {
+            version::operator = (rhs);
+            return *this;
+        }
+    };
+
+    _state _tree;
+
+public:
+    persistent_map() : _tree() {}
+
+    template <typename ITER>
+    persistent_map(ITER first, ITER last) : _tree() {
+        insert(first, last);
+    }
+
+    //O(1): the two maps share every node until one of them writes
+    persistent_map(persistent_map const& rhs) : _tree(rhs._tree) {}
+
+    persistent_map(persistent_map&& rhs) : _tree() {
+        swap(rhs);
+    }
+
+    persistent_map& operator = (persistent_map const& rhs) {
+        _tree = rhs._tree;
+        return *this;
+    }
+
+    persistent_map& operator = (persistent_map&& rhs) {
+        if (this != &rhs) {
+            clear();
+            swap(rhs);
+        }
+        return *this;
+    }
+
+    ~persistent_map() = default;
+
+    //O(1): the current version, unchanged by later writes
+    snapshot_type snapshot() const {
+        return snapshot_type(_tree);
+    }
+
+    //API
+    key_compare key_comp() const {
+        return _tree.key_comp();
+    }
+
+    size_type size() const noexcept {
+        return _tree.size();
+    }
+
+    bool empty() const noexcept {
+        return _tree.empty();
+    }
+
+    size_type max_size() const noexcept {
+        return _tree.max_size();
+    }
+
+    iterator begin() const {
+        return _tree.begin();
+    }
+
+    iterator end() const {
+        return _tree.end();
+    }
+
+    iterator find(key_type const& key) const {
+        return _tree.find(key);
+    }
+
+    iterator lower_bound(key_type const& key) const {
+        return _tree.lower_bound(key);
+    }
+
+    iterator upper_bound(key_type const& key) const {
+        return _tree.upper_bound(key);
+    }
+
+    size_type count(key_type const& key) const {
+        return _tree.count(key);
+    }
+
+    bool contains(key_type const& key) const {
+        return _tree.contains(key);
+    }
+
+    map_type const& at(key_type const& key) const {
+        return _tree.at(key);
+    }
+
+    //modify: each write returns whether it changed the set of keys
+    bool insert(value_type const& value) {
+        return try_emplace(value.first, value.second);
+    }
+
+    bool insert(value_type&& value) {
+        if (_tree._lookup(value.first) != nullptr) {
+            return false;
+        }
+        _put(value.first, TKF::move(value));
+        return true;
+    }
+
+    template <typename ITER>
+    void insert(ITER first, ITER last) {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    template <typename ...Args>
+    bool emplace(Args&&... args) {
+        return insert(value_type(TKF::forward<Args>(args)...));
+    }
+
+    //searches first, so a hit copies no node and builds no value
+    template <typename ...Args>
+    bool try_emplace(key_type const& key, Args&&... args) {
+        if (_tree._lookup(key) != nullptr) {
+            return false;
+        }
+        _put(key, TKF::piecewise_construct, std::forward_as_tuple(key),
+            std::forward_as_tuple(TKF::forward<Args>(args)...));
+        return true;
+    }
+
+    template <typename M>
+    bool insert_or_assign(key_type const& key, M&& obj) {
+        bool inserted = _tree._lookup(key) == nullptr;
+        if (inserted) {
+            _put(key, key, TKF::forward<M>(obj));
+        }
+        else {
+            _assign(key, TKF::forward<M>(obj));
+        }
+        return inserted;
+    }
+
+    size_type erase(key_type const& key);
+
+    void clear() {
+        _release(_tree._root);
+        _tree._root = nullptr;
+        _tree._num = 0;
+    }
+
+    void swap(persistent_map& rhs) {
+        std::swap(_tree._root, rhs._tree._root);
+        std::swap(_tree._num, rhs._tree._num);
+        std::swap(_tree._comp, rhs._tree._comp);
+    }
+
+private:
+    bool _before(key_type const& lhs, key_type const& rhs) const {
+        return _tree._before(lhs, rhs);
+    }
+
+    template <typename ...Args>
+    static _node* _create(Args&&... args) {
+        _node* ptr = node_allocator::allocate(1);
+        try {
+            node_allocator::construct(ptr, true, TKF::forward<Args>(args)...);
+        }
+        catch (...) {
+            node_allocator::deallocate(ptr);
+            throw;
+        }
+        return ptr;
+    }
+
+    //the reference held to ptr becomes one to a node only the writer
+    //reaches: ptr itself when nobody else holds it, else a copy of it
+    static _node* _own(_node* ptr) {
+        if (ptr == nullptr || ptr->refs.load(std::memory_order_acquire) == 1) {
+            return ptr;
+        }
+        _node* copy = _create(ptr->value);
+        copy->red = ptr->red;
+        copy->left = ptr->left;
+        copy->right = ptr->right;
+        _acquire(copy->left);
+        _acquire(copy->right);
+        _release(ptr);
+        return copy;
+    }
+
+    //the LLRB primitives, on owned nodes only
+    static _node* _rotate_left(_node* ptr) {
+        _node* right = _own(ptr->right);
+        ptr->right = right->left;
+        right->left = ptr;
+        right->red = ptr->red;
+        ptr->red = true;
+        return right;
+    }
+
+    static _node* _rotate_right(_node* ptr) {
+        _node* left = _own(ptr->left);
+        ptr->left = left->right;
+        left->right = ptr;
+        left->red = ptr->red;
+        ptr->red = true;
+        return left;
+    }
+
+    static void _flip_colors(_node* ptr) {
+        ptr->left = _own(ptr->left);
+        ptr->right = _own(ptr->right);
+        ptr->red = !ptr->red;
+        ptr->left->red = !ptr->left->red;
+        ptr->right->red = !ptr->right->red;
+    }
+
+    static _node* _balance(_node* ptr) {
+        if (_is_red(ptr->right) && !_is_red(ptr->left)) {
+            ptr = _rotate_left(ptr);
+        }
+        if (_is_red(ptr->left) && _is_red(ptr->left->left)) {
+            ptr = _rotate_right(ptr);
+        }
+        if (_is_red(ptr->left) && _is_red(ptr->right)) {
+            _flip_colors(ptr);
+        }
+        return ptr;
+    }
+
+    static _node* _move_red_left(_node* ptr) {
+        _flip_colors(ptr);
+        if (_is_red(ptr->right->left)) {
+            ptr->right = _rotate_right(ptr->right);
+            ptr = _rotate_left(ptr);
+            _flip_colors(ptr);
+        }
+        return ptr;
+    }
+
+    static _node* _move_red_right(_node* ptr) {
+        _flip_colors(ptr);
+        if (_is_red(ptr->left->left)) {
+            ptr = _rotate_right(ptr);
+            _flip_colors(ptr);
+        }
+        return ptr;
+    }
+
+    //key must be missing
+    template <typename ...Args>
+    void _put(key_type const& key, Args&&... args) {
+        _tree._root = _put(_tree._root, key, TKF::forward<Args>(args)...);
+        _tree._root->red = false;
+        ++_tree._num;
+    }
+
+    template <typename ...Args>
+    _node* _put(_node* ptr, key_type const& key, Args&&... args) {
+        if (ptr == nullptr) {
+            return _create(TKF::forward<Args>(args)...);
+        }
+        ptr = _own(ptr);
+        if (_before(key, ptr->value.first)) {
+            ptr->left = _put(ptr->left, key, TKF::forward<Args>(args)...);
+        }
+        else {
+            ptr->right = _put(ptr->right, key, TKF::forward<Args>(args)...);
+        }
+        return _balance(ptr);
+    }
+
+    //key must be present; copies the path to it
+    template <typename M>
+    void _assign(key_type const& key, M&& obj) {
+        _node** link = &_tree._root;
+        for (;;) {
+            _node* ptr = *link = _own(*link);
+            if (_before(key, ptr->value.first)) {
+                link = &ptr->left;
+            }
+            else if (_before(ptr->value.first, key)) {
+                link = &ptr->right;
+            }
+            else {
+                ptr->value.second = TKF::forward<M>(obj);
+                return;
+            }
+        }
+    }
+
+    //unlinks the smallest node below ptr into min, still owned
+    static _node* _erase_min(_node* ptr, _node*& min) {
+        ptr = _own(ptr);
+        if (ptr->left == nullptr) {
+            min = ptr;
+            return nullptr;
+        }
+        if (!_is_red(ptr->left) && !_is_red(ptr->left->left)) {
+            ptr = _move_red_left(ptr);
+        }
+        ptr->left = _erase_min(ptr->left, min);
+        return _balance(ptr);
+    }
+
+    _node* _erase(_node* ptr, key_type const& key);
+};
+
+template <typename KEY, typename T, typename COMP, typename ALLOC>
+typename persistent_map<KEY, T, COMP, ALLOC>::size_type
+persistent_map<KEY, T, COMP, ALLOC>::erase (key_type const& key) {
+    if (_tree._lookup(key) == nullptr) {
+        return 0;
+    }
+    _node* root = _own(_tree._root);
+    if (!_is_red(root->left) && !_is_red(root->right)) {
+        root->red = true;
+    }
+    root = _erase(root, key);
+    if (root != nullptr) {
+        root->red = false;
+    }
+    _tree._root = root;
+    --_tree._num;
+    return 1;
+}
+
+template <typename KEY, typename T, typename COMP, typename ALLOC>
+typename persistent_map<KEY, T, COMP, ALLOC>::_node*
+persistent_map<KEY, T, COMP, ALLOC>::_erase (_node* ptr, key_type const& key) {
+    ptr = _own(ptr);
+    if (_before(key, ptr->value.first)) {
+        if (!_is_red(ptr->left) && !_is_red(ptr->left->left)) {
+            ptr = _move_red_left(ptr);
+        }
+        ptr->left = _erase(ptr->left, key);
+    }
+    else {
+        if (_is_red(ptr->left)) {
+            ptr = _rotate_right(ptr);
+        }
+        if (ptr->right == nullptr && !_before(ptr->value.first, key)) {
+            //a leaf now: the left link of an LLRB node without right is null
+            _release(ptr);
+            return nullptr;
+        }
+        if (!_is_red(ptr->right) && !_is_red(ptr->right->left)) {
+            ptr = _move_red_right(ptr);
+        }
+        if (!_before(ptr->value.first, key)) {
+            //the successor takes the place of ptr, which is freed alone
+            _node* min = nullptr;
+            ptr->right = _erase_min(ptr->right, min);
+            min->left = ptr->left;
+            min->right = ptr->right;
+            min->red = ptr->red;
+            _free(ptr);
+            ptr = min;
+        }
+        else {
+            ptr->right = _erase(ptr->right, key);
+        }
+    }
+    return _balance(ptr);
+}
+
+}
+
+#endif //!PERSISTENT_MAP_H
\ No newline at end of file
@@ -5,30 +5,222 @@
 #include"Allocator.h"
 #include"Type_Traits.h"
 #include"Utility.h"
+#include"Algorithm.h"
+#include<new>
+#include<mutex>
+#include<cstdint>
 
 namespace TKF {
 
 template <typename T, bool> struct RBT_value_traits_;
 template <typename T> struct RBT_value_traits;
-template <typename T> struct RBT_node_traits;
-template <typename T> struct RBT_traits;
+template <typename T, typename POLICY> struct RBT_node_traits;
+template <typename T, typename POLICY> struct RBT_traits;
 
-template <typename T> struct RBT_node_base;
-template <typename T> struct RBT_node;
+template <typename T, typename POLICY> struct RBT_node_base;
+template <typename T, typename POLICY> struct RBT_node;
 
-template <typename T> struct RBT_iterator_base;
-template <typename T> struct RBT_iterator;
+template <typename T, typename POLICY> struct RBT_iterator_base;
+template <typename T, typename POLICY> struct RBT_iterator;
 
-template <typename T, typename COMP> class RBT;
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS> class RBT;
 
 typedef bool RBT_color_type;
 static constexpr RBT_color_type RBT_color_red = true;
 static constexpr RBT_color_type RBT_color_black = false;
 
+//searches find_many and lower_bound_many run side by side
+static constexpr size_t RBT_batch_width = 16;
+//successors a key in a sorted batch may be from the result before
+static constexpr size_t RBT_finger_steps = 4;
+
 typedef bool RBT_insert_type;
 static constexpr RBT_insert_type RBT_left_insert = true;
 static constexpr RBT_insert_type RBT_right_insert = false;
 
+//link layouts
+//RBT_pointer_links: three pointers and a color byte
+//RBT_packed_links:  the color lives in the low bit of the parent pointer
+//RBT_index_links:   32-bit indices into a node pool shared by every tree 
+//                   of the same node type, the color in the parent's top
+//                   bit; up to 2^31 - 1 nodes per node type in the whole
+//                   process, not per tree (see RBT_index_pool)
+struct RBT_pointer_links {};
+struct RBT_packed_links {};
+struct RBT_index_links {};
+
+//node layout policy
+//RANK:  every node keeps the size of its subtree, which gives
+//       rank/select and O(log n) iterator arithmetic
+//LINKS: one of the link layouts above
+//THREAD: every node also links its in-order neighbours, so iterators
+//        step in O(1) with a single load instead of walking the tree
+template <bool RANK = false, typename LINKS = RBT_pointer_links, 
+    bool THREAD = false>
+struct RBT_node_policy {
+    static constexpr bool rank = RANK;
+    static constexpr bool thread = THREAD;
+    typedef LINKS links;
+};
+
+typedef RBT_node_policy<false>  RBT_plain_node;
+typedef RBT_node_policy<true>   RBT_rank_node;
+typedef RBT_node_policy<false, RBT_packed_links>    RBT_compact_node;
+typedef RBT_node_policy<false, RBT_index_links>     RBT_index_node;
+typedef RBT_node_policy<false, RBT_pointer_links, true> RBT_threaded_node;
+
+//statistics policy
+//RBT_no_stats: every hook is empty and the tree holds nothing for it
+//RBT_stats:    counts what the tree does, read back through stats();
+//              the counters are plain integers, so readers running
+//              lookups on one tree at the same time race on them. For
+//              the same reason a counted tree builds and runs set
+//              operations on the calling thread alone.
+//A search's path length is the number of nodes it compared with.
+struct RBT_stats_snapshot {
+    static constexpr size_t path_buckets = 64;
+
+    uint64_t comparisons;
+    uint64_t rotations;
+    uint64_t recolorings;
+    uint64_t allocations;
+    uint64_t deallocations;
+    uint64_t searches;
+    //searches by path length; the last bucket takes every longer one
+    uint64_t path_lengths[path_buckets];
+    size_t   size;
+    size_t   height;
+};
+
+struct RBT_no_stats {
+    static constexpr bool enabled = false;
+
+    void on_rotate() const noexcept {}
+    void on_recolor(unsigned) const noexcept {}
+    void on_search(size_t) const noexcept {}
+    void on_allocate() const noexcept {}
+    void on_deallocate() const noexcept {}
+};
+
+struct RBT_stats {
+    static constexpr bool enabled = true;
+
+    mutable RBT_stats_snapshot counters;
+
+    RBT_stats() noexcept : counters() {}
+    //a copy of a tree starts counting from zero
+    RBT_stats(RBT_stats const&) noexcept : counters() {}
+    RBT_stats& operator = (RBT_stats const&) noexcept {
+        return *this;
+    }
+
+    void on_rotate() const noexcept {
+        ++counters.rotations;
+    }
+
+    void on_recolor(unsigned n) const noexcept {
+        counters.recolorings += n;
+    }
+
+    void on_search(size_t length) const noexcept {
+        ++counters.searches;
+        ++counters.path_lengths[length < RBT_stats_snapshot::path_buckets ?
+            length : RBT_stats_snapshot::path_buckets - 1];
+    }
+
+    void on_allocate() const noexcept {
+        ++counters.allocations;
+    }
+
+    void on_deallocate() const noexcept {
+        ++counters.deallocations;
+    }
+};
+
+//the comparator a tree calls: COMP itself, or with RBT_stats, COMP
+//counting its calls. key_comp() hands out the plain COMP.
+template <typename COMP, bool COUNT>
+struct RBT_counted_compare : public COMP {
+    RBT_counted_compare() {}
+    RBT_counted_compare(COMP const& comp) : COMP(comp) {}
+
+    uint64_t calls() const noexcept {
+        return 0;
+    }
+
+    void reset() noexcept {}
+};
+
+template <typename COMP>
+struct RBT_counted_compare<COMP, true> : public COMP {
+    mutable uint64_t _calls;
+
+    RBT_counted_compare() : _calls(0) {}
+    RBT_counted_compare(COMP const& comp) : COMP(comp), _calls(0) {}
+    RBT_counted_compare(RBT_counted_compare const& rhs) : COMP(rhs), _calls(0) {}
+    RBT_counted_compare& operator = (RBT_counted_compare const& rhs) {
+        COMP::operator=(rhs);
+        return *this;
+    }
+
+    template <typename T1, typename T2>
+    bool operator () (T1 const& lhs, T2 const& rhs) const {
+        ++_calls;
+        return COMP::operator()(lhs, rhs);
+    }
+
+    //C keeps the check dependent, so a COMP without compare only loses this
+    template <typename T1, typename T2, typename C = COMP>
+    auto compare (T1 const& lhs, T2 const& rhs) const
+        -> decltype(TKF::declval<C const&>().compare(lhs, rhs)) {
+        ++_calls;
+        return COMP::compare(lhs, rhs);
+    }
+
+    uint64_t calls() const noexcept {
+        return _calls;
+    }
+
+    void reset() noexcept {
+        _calls = 0;
+    }
+};
+
+template <bool>
+struct RBT_node_size {
+    size_t get_size() const noexcept { return 0; }
+    void set_size(size_t) noexcept {}
+};
+
+template <>
+struct RBT_node_size<true> {
+    size_t size;
+
+    size_t get_size() const noexcept { return size; }
+    void set_size(size_t n) noexcept { size = n; }
+};
+
+//in-order neighbours, THREAD policy only: the list is circular through
+//the header, whose next is the minimum and whose prev the maximum
+template <typename BASE, bool>
+struct RBT_node_thread {
+    BASE* get_next() const noexcept { return nullptr; }
+    BASE* get_prev() const noexcept { return nullptr; }
+    void set_next(BASE*) noexcept {}
+    void set_prev(BASE*) noexcept {}
+};
+
+template <typename BASE>
+struct RBT_node_thread<BASE, true> {
+    BASE* next;
+    BASE* prev;
+
+    BASE* get_next() const noexcept { return next; }
+    BASE* get_prev() const noexcept { return prev; }
+    void set_next(BASE* ptr) noexcept { next = ptr; }
+    void set_prev(BASE* ptr) noexcept { prev = ptr; }
+};
+
 template <typename T, bool>
 struct RBT_value_traits_ {
     typedef T key_type;
@@ -44,6 +236,10 @@ struct RBT_value_traits_ {
     static const value_type& get_value(_Tp const& value) {
         return value;
     }
+
+    static key_type& get_key_ref(value_type& value) {
+        return value;
+    }
 };
 
 template <typename T>
@@ -61,6 +257,10 @@ struct RBT_value_traits_<T, true> {
     static const value_type&  get_value(_Tp const& value) {
         return value;
     }
+
+    static key_type& get_key_ref(value_type& value) {
+        return value.first;
+    }
 };
 
 template <typename T>
@@ -82,10 +282,25 @@ struct RBT_value_traits {
     static const value_type& get_value(_Tp const& value) {
         return value_traits_type::get_value(value);
     }
+
+    static key_type& get_key_ref(value_type& value) {
+        return value_traits_type::get_key_ref(value);
+    }
 };
 
 
-template <typename T>
+//comparators with a compare(lhs, rhs) member returning <0, 0 or >0, such
+//as TKF::less, let find() stop at the first equal key with one comparison
+//per node; the others answer through the plain order
+template <typename COMP, typename K, typename KEY, typename = void>
+struct RBT_three_way : public TKF::false_type {};
+
+template <typename COMP, typename K, typename KEY>
+struct RBT_three_way<COMP, K, KEY, typename TKF::void_type<decltype(
+    TKF::declval<COMP const&>().compare(TKF::declval<K const&>(), 
+        TKF::declval<KEY const&>()))>::type> : public TKF::true_type {};
+
+template <typename T, typename POLICY>
 struct RBT_node_traits {
     typedef RBT_color_type                      color_type;
 
@@ -94,20 +309,266 @@ struct RBT_node_traits {
     typedef typename value_traits::value_type   value_type;
     typedef typename value_traits::map_type     map_type;
 
-    typedef RBT_node_base<T>*                   base_ptr;
-    typedef RBT_node<T>*                        node_ptr;
+    typedef RBT_node_base<T, POLICY>*           base_ptr;
+    typedef RBT_node<T, POLICY>*                node_ptr;
 };
 
-template <typename T>
-struct RBT_node_base {
-    typedef RBT_color_type      color_type;
-    typedef RBT_node_base<T>*   base_ptr;
-    typedef RBT_node<T>*        node_ptr;
+//the packed and index layouts read and write links through small proxy
+//members, so the tree algorithms keep using ptr->parent and ptr->color
+template <typename T, typename POLICY, typename LINKS = typename POLICY::links>
+struct RBT_node_links;
+
+template <typename T, typename POLICY>
+struct RBT_node_links<T, POLICY, RBT_pointer_links> {
+    typedef RBT_node_base<T, POLICY>*   parent_type;
+    typedef RBT_node_base<T, POLICY>*   child_type;
+
+    RBT_node_base<T, POLICY>*   parent;
+    RBT_node_base<T, POLICY>*   left;
+    RBT_node_base<T, POLICY>*   right;
+    RBT_color_type              color;
+};
+
+//parent and color share one word, COLOR_BIT marks the color; the rest
+//of the word is the parent, decoded by LINK.
+//Both proxies go through _word() so the compiler sees plain WORD accesses
+//to the same storage, which may alias, rather than two unrelated members.
+template <typename WORD, WORD COLOR_BIT, typename LINK>
+struct RBT_tagged_parent {
+    typedef typename LINK::base_ptr base_ptr;
+
+    WORD word;
+
+    WORD& _word() noexcept { 
+        return *reinterpret_cast<WORD*>(this); 
+    }
+    WORD _word() const noexcept { 
+        return *reinterpret_cast<WORD const*>(this); 
+    }
+
+    operator base_ptr () const noexcept { 
+        return LINK::decode(_word() & ~COLOR_BIT); 
+    }
+    base_ptr operator -> () const noexcept { 
+        return *this; 
+    }
+    RBT_tagged_parent& operator = (base_ptr ptr) noexcept {
+        _word() = LINK::encode(ptr) | (_word() & COLOR_BIT);
+        return *this;
+    }
+    RBT_tagged_parent& operator = (RBT_tagged_parent const& rhs) noexcept {
+        return *this = static_cast<base_ptr>(rhs);
+    }
+};
+
+template <typename WORD, WORD COLOR_BIT>
+struct RBT_tagged_color {
+    WORD word;
+
+    WORD& _word() noexcept { 
+        return *reinterpret_cast<WORD*>(this); 
+    }
+    WORD _word() const noexcept { 
+        return *reinterpret_cast<WORD const*>(this); 
+    }
+
+    operator RBT_color_type () const noexcept { 
+        return (_word() & COLOR_BIT) != 0; 
+    }
+    RBT_tagged_color& operator = (RBT_color_type color) noexcept {
+        _word() = color ? (_word() | COLOR_BIT) : (_word() & ~COLOR_BIT);
+        return *this;
+    }
+    RBT_tagged_color& operator = (RBT_tagged_color const& rhs) noexcept {
+        return *this = static_cast<RBT_color_type>(rhs);
+    }
+};
+
+template <typename T, typename POLICY>
+struct RBT_pointer_codec {
+    typedef RBT_node_base<T, POLICY>* base_ptr;
+
+    static base_ptr decode(uintptr_t word) noexcept {
+        return reinterpret_cast<base_ptr>(word);
+    }
+    static uintptr_t encode(base_ptr ptr) noexcept {
+        return reinterpret_cast<uintptr_t>(ptr);
+    }
+};
+
+template <typename T, typename POLICY>
+struct RBT_node_links<T, POLICY, RBT_packed_links> {
+    typedef RBT_tagged_parent<uintptr_t, 1, RBT_pointer_codec<T, POLICY> > parent_type;
+    typedef RBT_node_base<T, POLICY>*   child_type;
+
+    union {
+        parent_type                     parent;
+        RBT_tagged_color<uintptr_t, 1>  color;
+    };
+    RBT_node_base<T, POLICY>*   left;
+    RBT_node_base<T, POLICY>*   right;
+};
+
+//every node of one type lives in a segmented array shared by all trees
+//of that type, so a node is named by a 32-bit index; 0 stands for null.
+//The links decode an index without knowing their tree, which is why the
+//pool is one per node type and not per tree. That has costs: the 2^31 - 1
+//node limit is shared by every tree of the type, after which allocate
+//throws bad_alloc; segments are never given back, only freed nodes are
+//reused; and one mutex guards every allocate and deallocate, so trees
+//of the type on different threads contend for it.
+template <typename NODE>
+class RBT_index_pool {
+public:
+    typedef NODE            value_type;
+    typedef NODE*           pointer;
+    typedef size_t          size_type;
+
+    static constexpr uint32_t segment_bits = 16;
+    static constexpr uint32_t segment_size = 1u << segment_bits;
+    static constexpr uint32_t max_segments = (1u << 31) >> segment_bits;
+
+    template <typename U>
+    struct rebind {
+        typedef RBT_index_pool<NODE> other;
+    };
+
+    static NODE* at(uint32_t index) noexcept {
+        return index == 0 ? nullptr : 
+            _segments[index >> segment_bits] + (index & (segment_size - 1));
+    }
+
+    static NODE* allocate(size_type = 1) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_free != 0) {
+            NODE* node = at(_free);
+            _free = node->left.index;
+            return node;
+        }
+        uint32_t index = _next;
+        if (index == 0) {
+            index = 1; //slot 0 of segment 0 is the null index
+        }
+        uint32_t segment = index >> segment_bits;
+        if (segment == max_segments) {
+            throw std::bad_alloc();
+        }
+        if (_segments[segment] == nullptr) {
+            _segments[segment] = static_cast<NODE*>(
+                ::operator new(sizeof(NODE) * segment_size));
+        }
+        _next = index + 1;
+        NODE* node = at(index);
+        node->self = index;
+        return node;
+    }
+
+    template <typename U>
+    static void deallocate(U* ptr, size_type = 1) {
+        if (ptr == nullptr) {
+            return;
+        }
+        NODE* node = reinterpret_cast<NODE*>(ptr);
+        std::lock_guard<std::mutex> lock(_mutex);
+        node->left.index = _free;
+        _free = node->self;
+    }
+
+    //the pool is shared, so there is nothing to give back or take over
+    static void release() {}
+    static void absorb(RBT_index_pool&, bool = false) {}
+
+private:
+    static NODE* _segments[max_segments];
+    static uint32_t _next;
+    static uint32_t _free;
+    static std::mutex _mutex;
+};
+
+template <typename NODE>
+NODE* RBT_index_pool<NODE>::_segments[RBT_index_pool<NODE>::max_segments];
+template <typename NODE>
+uint32_t RBT_index_pool<NODE>::_next = 0;
+template <typename NODE>
+uint32_t RBT_index_pool<NODE>::_free = 0;
+template <typename NODE>
+std::mutex RBT_index_pool<NODE>::_mutex;
+
+template <typename T, typename POLICY>
+struct RBT_index_codec {
+    typedef RBT_node_base<T, POLICY>* base_ptr;
+    typedef RBT_index_pool<RBT_node<T, POLICY> > pool;
+
+    static base_ptr decode(uint32_t index) noexcept {
+        return pool::at(index);
+    }
+    static uint32_t encode(base_ptr ptr) noexcept {
+        return ptr == nullptr ? 0 : ptr->self;
+    }
+};
+
+template <typename T, typename POLICY>
+struct RBT_index_child {
+    typedef RBT_index_codec<T, POLICY>  codec;
+    typedef typename codec::base_ptr    base_ptr;
+
+    uint32_t index;
+
+    operator base_ptr () const noexcept { 
+        return codec::decode(index); 
+    }
+    base_ptr operator -> () const noexcept { 
+        return codec::decode(index); 
+    }
+    RBT_index_child& operator = (base_ptr ptr) noexcept {
+        index = codec::encode(ptr);
+        return *this;
+    }
+};
+
+template <typename T, typename POLICY>
+struct RBT_node_links<T, POLICY, RBT_index_links> {
+    typedef RBT_tagged_parent<uint32_t, 0x80000000u, RBT_index_codec<T, POLICY> > parent_type;
+    typedef RBT_index_child<T, POLICY>  child_type;
+
+    union {
+        parent_type                             parent;
+        RBT_tagged_color<uint32_t, 0x80000000u> color;
+    };
+    child_type  left;
+    child_type  right;
+    uint32_t    self;
+};
+
+//nodes come from ALLOC, except for the index layout's shared pool;
+//the header is allocated the same way as the nodes are
+template <typename NODE, typename ALLOC, typename LINKS>
+struct RBT_node_allocator {
+    typedef typename ALLOC::template rebind<NODE>::other type;
+};
 
-    base_ptr    parent;
-    base_ptr    left;
-    base_ptr    right;
-    color_type  color;
+template <typename NODE, typename ALLOC>
+struct RBT_node_allocator<NODE, ALLOC, RBT_index_links> {
+    typedef RBT_index_pool<NODE> type;
+};
+
+template <typename NODE, typename BASE, typename LINKS>
+struct RBT_head_allocator {
+    typedef TKF::allocator<BASE> type;
+};
+
+template <typename NODE, typename BASE>
+struct RBT_head_allocator<NODE, BASE, RBT_index_links> {
+    typedef RBT_index_pool<NODE> type;
+};
+
+template <typename T, typename POLICY>
+struct RBT_node_base : public RBT_node_size<POLICY::rank>, 
+    public RBT_node_links<T, POLICY>,
+    public RBT_node_thread<RBT_node_base<T, POLICY>, POLICY::thread> {
+    typedef RBT_color_type              color_type;
+    typedef RBT_node_base<T, POLICY>*   base_ptr;
+    typedef RBT_node<T, POLICY>*        node_ptr;
 
     base_ptr get_base_ptr() {
         return &*this;
@@ -118,10 +579,10 @@ struct RBT_node_base {
     }
 };
 
-template <typename T>
-struct RBT_node : public RBT_node_base<T> {
-    typedef RBT_node_base<T>*   base_ptr;
-    typedef RBT_node<T>*        node_ptr;
+template <typename T, typename POLICY>
+struct RBT_node : public RBT_node_base<T, POLICY> {
+    typedef RBT_node_base<T, POLICY>*   base_ptr;
+    typedef RBT_node<T, POLICY>*        node_ptr;
 
     T value;
 
@@ -134,7 +595,7 @@ struct RBT_node : public RBT_node_base<T> {
     }
 };
 
-template <typename T>
+template <typename T, typename POLICY>
 struct RBT_traits {
     typedef RBT_value_traits<T>                 value_traits;
 
@@ -147,16 +608,17 @@ struct RBT_traits {
     typedef const pointer                       const_pointer;
     typedef const reference                     const_reference;
 
-    typedef RBT_node_base<T>                    base_type;
-    typedef RBT_node<T>                         node_type;
-    typedef RBT_node_base<T>*                   base_ptr;
-    typedef RBT_node<T>*                        node_ptr;
+    typedef RBT_node_base<T, POLICY>            base_type;
+    typedef RBT_node<T, POLICY>                 node_type;
+    typedef RBT_node_base<T, POLICY>*           base_ptr;
+    typedef RBT_node<T, POLICY>*                node_ptr;
 };
 
-template <typename T>
+template <typename T, typename POLICY>
 struct RBT_iterator_base 
     : public TKF::iterator<TKF::_bidirectional_iterator, T>{
-    typedef typename RBT_traits<T>::base_ptr base_ptr;
+    typedef typename RBT_traits<T, POLICY>::base_ptr base_ptr;
+    typedef typename TKF::int_constant<bool, POLICY::rank>::type rank_tag;
 
     base_ptr ptr;
 
@@ -179,11 +641,14 @@ struct RBT_iterator_base
     }
 
     void increase() {
-        if(ptr->right != nullptr) {
+        if (POLICY::thread) {
+            ptr = ptr->get_next();
+        }
+        else if(ptr->right != nullptr) {
             ptr = RBT_minimum(ptr->right);
         } 
         else {
-            auto y = ptr->parent;
+            base_ptr y = ptr->parent;
             while (y->right == ptr) {
                 ptr = y;
                 y = y->parent;
@@ -195,11 +660,14 @@ struct RBT_iterator_base
     }
 
     void decrease() {
-        if (ptr->left != nullptr) {
+        if (POLICY::thread) {
+            ptr = ptr->get_prev();
+        }
+        else if (ptr->left != nullptr) {
             ptr = RBT_maximum(ptr->left);
         } 
         else {
-            auto y = ptr->parent;
+            base_ptr y = ptr->parent;
             while (y->left == ptr) {
                 ptr = y;
                 y = y->parent;
@@ -209,21 +677,128 @@ struct RBT_iterator_base
             }
         }
     }
+
+    //order statistics, RANK policy only
+    //the header is the one node whose size is 0
+    static size_t RBT_size (base_ptr ptr) {
+        return ptr == nullptr ? 0 : ptr->get_size();
+    }
+
+    static base_ptr RBT_select (base_ptr ptr, size_t i) {
+        base_ptr link = ptr;
+        while (true) {
+            size_t l = RBT_size(link->left);
+            if (i < l) {
+                link = link->left;
+            }
+            else if (i == l) {
+                return link;
+            }
+            else {
+                i -= l + 1;
+                link = link->right;
+            }
+        }
+    }
+
+    //number of elements in front of ptr
+    size_t RBT_rank () const {
+        if (ptr->get_size() == 0) {
+            return RBT_size(ptr->parent);
+        }
+        size_t r = RBT_size(ptr->left);
+        for (base_ptr x = ptr; x->parent->get_size() != 0; x = x->parent) {
+            if (x == x->parent->right) {
+                r += RBT_size(x->parent->left) + 1;
+            }
+        }
+        return r;
+    }
+
+    void advance(ptrdiff_t n) {
+        _advance(n, rank_tag());
+    }
+
+private:
+    void _advance(ptrdiff_t n, TKF::false_type) {
+        while (n > 0) {
+            increase();
+            --n;
+        }
+        while (n < 0) {
+            decrease();
+            ++n;
+        }
+    }
+
+    void _advance(ptrdiff_t n, TKF::true_type) {
+        if (n > 0) {
+            _forward(static_cast<size_t>(n));
+        }
+        else if (n < 0) {
+            _backward(static_cast<size_t>(-n));
+        }
+    }
+
+    //climb only as far as the answer lies outside the current subtree
+    void _forward(size_t n) {
+        if (ptr->get_size() == 0) {
+            ptr = ptr->right;
+            --n;
+        }
+        while (n > 0) {
+            size_t r = RBT_size(ptr->right);
+            if (n <= r) {
+                ptr = RBT_select(ptr->right, n - 1);
+                return;
+            }
+            n -= r + 1;
+            while (ptr->parent->get_size() != 0 && ptr == ptr->parent->right) {
+                ptr = ptr->parent;
+            }
+            ptr = ptr->parent;
+            if (ptr->get_size() == 0) {
+                return;
+            }
+        }
+    }
+
+    void _backward(size_t n) {
+        if (ptr->get_size() == 0) {
+            ptr = ptr->left;
+            --n;
+        }
+        while (n > 0) {
+            size_t l = RBT_size(ptr->left);
+            if (n <= l) {
+                ptr = RBT_select(ptr->left, l - n);
+                return;
+            }
+            n -= l + 1;
+            while (ptr->parent->get_size() != 0 && ptr == ptr->parent->left) {
+                ptr = ptr->parent;
+            }
+            ptr = ptr->parent;
+            if (ptr->get_size() == 0) {
+                return;
+            }
+        }
+    }
 };
 
-template <typename T>
-struct RBT_iterator : public RBT_iterator_base<T> {
-    typedef RBT_traits<T>       traits;
+template <typename T, typename POLICY>
+struct RBT_iterator : public RBT_iterator_base<T, POLICY> {
+    typedef RBT_traits<T, POLICY>       traits;
     
-    typedef typename traits::pointer     pointer;
-    typedef typename traits::reference   reference;
-    typedef typename traits::base_ptr    base_ptr;
-    typedef typename traits::node_ptr    node_ptr;
+    typedef typename traits::pointer    pointer;
+    typedef typename traits::reference  reference;
+    typedef typename traits::base_ptr   base_ptr;
+    typedef typename traits::node_ptr   node_ptr;
 
-    typedef RBT_iterator<T>     iterator;
-    typedef iterator            self;
+    typedef RBT_iterator<T, POLICY>     iterator;
+    typedef iterator                    self;
 
-    using RBT_iterator_base<T>::ptr;
+    using RBT_iterator_base<T, POLICY>::ptr;
 
     RBT_iterator() = default;
     RBT_iterator(base_ptr x) { 
@@ -280,49 +855,175 @@ struct RBT_iterator : public RBT_iterator_base<T> {
     }
 
     self& operator += (ptrdiff_t n) {
-        while (n--) {
-            this->increase();
-        }
+        this->advance(n);
         return *this;
     }
 
     self operator + (ptrdiff_t n) const {
         self tmp(*this);
-        while (n--) {
-            tmp.increase();
-        }
+        tmp.advance(n);
         return tmp; 
     }
 
     self& operator -= (ptrdiff_t n) {
-        while (n--) {
-            this->decrease();
-        }
+        this->advance(-n);
         return *this;
     }
 
     self operator - (ptrdiff_t n) const {
         self tmp(*this);
-        while (n--) {
-            tmp.decrease();
-        }
+        tmp.advance(-n);
         return tmp; 
     }
 
-    bool operator == (iterator const& rhs) {
+    bool operator == (iterator const& rhs) const {
         return rhs.ptr == ptr;
     }
 
-    bool operator != (iterator const& rhs) {
+    bool operator != (iterator const& rhs) const {
         return rhs.ptr != ptr;
     }
 };
 
-template <typename T, typename COMP>
-class RBT {
+template <typename T, typename POLICY>
+inline ptrdiff_t _distance(RBT_iterator<T, POLICY> first, 
+    RBT_iterator<T, POLICY> last, TKF::true_type) {
+        return static_cast<ptrdiff_t>(last.RBT_rank()) - 
+            static_cast<ptrdiff_t>(first.RBT_rank());
+}
+
+template <typename T, typename POLICY>
+inline ptrdiff_t _distance(RBT_iterator<T, POLICY> first, 
+    RBT_iterator<T, POLICY> last, TKF::false_type) {
+        return TKF::_distance(first, last, TKF::_input_iterator());
+}
+
+//O(log n) with the RANK policy
+template <typename T, typename POLICY>
+inline ptrdiff_t distance(RBT_iterator<T, POLICY> first, 
+    RBT_iterator<T, POLICY> last) {
+        typedef typename RBT_iterator<T, POLICY>::rank_tag rank_tag;
+        return _distance(first, last, rank_tag());
+}
+
+//node handle: owns a node extracted from an RBT, value and all, until it
+//is inserted into a tree of the same type or destroyed. Nothing is
+//copied or reallocated on the way. It keeps a copy of the allocator the
+//node came from, which the tree it goes into absorbs, so the node's
+//memory stays valid whichever tree dies first.
+//While detached, the key may be changed through key().
+template <typename T, typename POLICY, typename NODE_ALLOC>
+class RBT_node_handle {
+    template <typename, typename, typename, typename, typename> friend class RBT;
+public:
+    typedef RBT_value_traits<T>                     value_traits;
+    typedef typename value_traits::key_type         key_type;
+    typedef typename value_traits::map_type         map_type;
+    typedef typename value_traits::value_type       value_type;
+    typedef NODE_ALLOC                              allocator_type;
+
+private:
+    typedef typename RBT_traits<T, POLICY>::node_ptr node_ptr;
+
+    node_ptr _ptr;
+    //only alive while there is a node: an empty handle costs nothing,
+    //not even a default allocator
+    union {
+        NODE_ALLOC _alloc;
+    };
+
+    RBT_node_handle(node_ptr ptr, NODE_ALLOC const& alloc) : _ptr(ptr) {
+        ::new ((void*)&_alloc) NODE_ALLOC(alloc);
+    }
+
+    //gives up the node; the allocator goes with the caller's absorb
+    node_ptr _release() noexcept {
+        node_ptr ptr = _ptr;
+        if (ptr != nullptr) {
+            _alloc.~NODE_ALLOC();
+            _ptr = nullptr;
+        }
+        return ptr;
+    }
+
+public:
+    RBT_node_handle() : _ptr(nullptr) {}
+
+    RBT_node_handle(RBT_node_handle&& rhs) : _ptr(nullptr) {
+        *this = TKF::move(rhs);
+    }
+
+    RBT_node_handle& operator = (RBT_node_handle&& rhs) {
+        if (this != &rhs) {
+            _reset();
+            if (rhs._ptr != nullptr) {
+                ::new ((void*)&_alloc) NODE_ALLOC(TKF::move(rhs._alloc));
+                _ptr = rhs._release();
+            }
+        }
+        return *this;
+    }
+
+    RBT_node_handle(RBT_node_handle const&) = delete;
+    RBT_node_handle& operator = (RBT_node_handle const&) = delete;
+
+    ~RBT_node_handle() {
+        _reset();
+    }
+
+    bool empty() const noexcept {
+        return _ptr == nullptr;
+    }
+
+    explicit operator bool () const noexcept {
+        return _ptr != nullptr;
+    }
+
+    value_type& value() const {
+        return _ptr->value;
+    }
+
+    key_type& key() const {
+        return value_traits::get_key_ref(_ptr->value);
+    }
+
+    map_type& mapped() const {
+        return _ptr->value.second;
+    }
+
+    void swap(RBT_node_handle& rhs) {
+        RBT_node_handle tmp(TKF::move(rhs));
+        rhs = TKF::move(*this);
+        *this = TKF::move(tmp);
+    }
+
+private:
+    void _reset() {
+        if (_ptr != nullptr) {
+            _ptr->value.~value_type();
+            _alloc.deallocate(_ptr);
+            _release();
+        }
+    }
+};
+
+//what inserting a node handle into a unique tree gives back: where the
+//key is, whether the node went in, and the node itself when it did not
+template <typename ITER, typename HANDLE>
+struct RBT_insert_return {
+    ITER position;
+    bool inserted;
+    HANDLE node;
+};
+
+template <typename T, typename COMP, typename ALLOC = TKF::pool_allocator<T>,
+    typename POLICY = RBT_node_policy<>, typename STATS = RBT_no_stats>
+class RBT : private STATS {
 public:
-    typedef RBT_traits<T>                           tree_traits;
+    typedef RBT_traits<T, POLICY>                   tree_traits;
     typedef RBT_value_traits<T>                     value_traits;
+    typedef POLICY                                  node_policy;
+    typedef STATS                                   stats_policy;
 
     typedef typename tree_traits::base_type         base_type;
     typedef typename tree_traits::node_type         node_type;
@@ -333,9 +1034,15 @@ public:
 
     typedef COMP                                    key_compare;
 
-    typedef TKF::allocator<T>                       allocator_type;
-    typedef TKF::allocator<base_type>               base_allocator;
-    typedef TKF::allocator<node_type>               node_allocator;
+    typedef ALLOC                                   allocator_type;
+    typedef typename RBT_head_allocator<node_type, base_type,
+        typename POLICY::links>::type               base_allocator;
+    typedef typename RBT_node_allocator<node_type, ALLOC,
+        typename POLICY::links>::type               node_allocator;
+    //what root() and min()/max() refer to: a plain pointer, or a proxy
+    //for the packed and index layouts
+    typedef typename base_type::parent_type         parent_link;
+    typedef typename base_type::child_type          child_link;
 
     typedef typename allocator_type::pointer        pointer;
     typedef typename allocator_type::const_pointer  const_pointer;
@@ -344,44 +1051,57 @@ public:
     typedef typename allocator_type::size_type      size_type;
     typedef typename allocator_type::difference_type difference_type;
 
-    typedef RBT_iterator<T>                         iterator;
+    typedef RBT_iterator<T, POLICY>                 iterator;
     typedef TKF::reverse_iterator<iterator>         reverse_iterator;
+    typedef RBT_node_handle<T, POLICY, node_allocator> node_handle;
+    typedef RBT_insert_return<iterator, node_handle> insert_return_type;
+
+    static constexpr bool ranked = node_policy::rank;
+    static constexpr bool threaded = node_policy::thread;
+    //integer keys in the default order pick the child without a branch
+    //while searching, and find() may test equality with ==
+    static constexpr bool branchless = TKF::is_integral<key_type>::value
+        && (TKF::is_same<COMP, TKF::less<key_type> >::value 
+            || TKF::is_same<COMP, TKF::less<void> >::value);
         
-    allocator_type get_allocator() const { return node_allocator(); }
+    allocator_type get_allocator() const { return allocator_type(); }
     key_compare key_comp() const { return _comp; }
 
 private:
     base_ptr _head;
     size_type _num;
-    key_compare _comp;
+    RBT_counted_compare<COMP, STATS::enabled> _comp;
+    node_allocator _alloc;
 
 public:
     RBT() { 
         _init(); 
     }
 
-    base_ptr& root() const noexcept { 
+    parent_link& root() const noexcept { 
         return _head->parent; 
     }
-    base_ptr& min() const noexcept { 
+    child_link& min() const noexcept { 
         return _head->right; 
     }
-    base_ptr& max() const noexcept { 
+    child_link& max() const noexcept { 
         return _head->left; 
     }
 
-    RBT(RBT const& rhs) {
+    //a copy counts from zero
+    RBT(RBT const& rhs) : STATS() {
         _init();
         if(rhs._num != 0) {
             _head->parent = _copy(rhs.root(), _head);
             _head->right = _minimum(root());
             _head->left = _maximum(root());
+            _rethread();
         }
         _num = rhs._num;
         _comp = rhs._comp;
     }
 
-    RBT(RBT&& rhs) noexcept {
+    RBT(RBT&& rhs) noexcept : _alloc(TKF::move(rhs._alloc)) {
         _head = TKF::move(rhs._head);
         _num = rhs._num;
         _comp = rhs._comp;
@@ -395,6 +1115,7 @@ public:
                 _head->parent = _copy(rhs.root(), _head);
                 _head->right = _minimum(root());
                 _head->left = _maximum(root());
+                _rethread();
             }
             _num = rhs._num;
             _comp = rhs._comp;
@@ -405,15 +1126,20 @@ public:
     RBT& operator = (RBT&& rhs) {
         if(this != &rhs) {
             clear();
+            base_allocator::deallocate(_head);
             _head = TKF::move(rhs._head);
             _num = rhs._num;
             _comp = rhs._comp;
+            _alloc = TKF::move(rhs._alloc);
             rhs._reset();
         }
         return *this;
     }
 
-    ~RBT() { clear(); }
+    ~RBT() { 
+        clear(); 
+        base_allocator::deallocate(_head);
+    }
     
     friend bool operator == (RBT const& lhs, RBT const& rhs) {
         if (lhs._num != rhs._num) {
@@ -451,7 +1177,7 @@ public:
 public:
     //iterator 
     iterator begin() const noexcept {
-        return min();
+        return static_cast<base_ptr>(min());
     }
 
     iterator end() const noexcept {
@@ -512,23 +1238,48 @@ public:
     TKF::pair<iterator, bool> unique_insert(value_type const& value);
     
     TKF::pair<iterator, bool> unique_insert(value_type&& value) {
-        unique_insert(TKF::move(value));
+        return unique_emplace_key(value_traits::get_key(value), TKF::move(value));
     }
 
     iterator unique_insert(iterator hint, value_type const& value) {
-        return unique_emplace_hint(hint, value);
+        return unique_emplace_key_hint(hint, value_traits::get_key(value), value);
     }
 
     iterator unique_insert(iterator hint, value_type&& value) {
-        return unique_emplace_hint(hint, TKF::move(value));
+        return unique_emplace_key_hint(hint, value_traits::get_key(value), 
+            TKF::move(value));
     }
 
+    //lookup before construct: the value is built from args only when key
+    //is missing, and whose key must then be equal to key; on a hit 
+    //nothing is allocated and args are left untouched.
+    //K is key_type, or any type a transparent comparator accepts.
+    template <typename K, typename ...Args>
+    TKF::pair<iterator, bool> unique_emplace_key(K const& key, Args&& ...args);
+
+    template <typename K, typename ...Args>
+    iterator unique_emplace_key_hint(iterator hint, K const& key, Args&& ...args);
+
     template <typename ITER>
     void unique_insert(ITER const& first, ITER const& last);
 
+    //bulk build: replaces the contents with [first, last) in O(n).
+    //The input must already be in key order; duplicate keys keep the
+    //first occurrence in the unique form.
+    template <typename ITER>
+    void multi_build_from_sorted(ITER const& first, ITER const& last) {
+        _build(first, last, false, true);
+    }
+
+    template <typename ITER>
+    void unique_build_from_sorted(ITER const& first, ITER const& last) {
+        _build(first, last, true, true);
+    }
+
     //erase
     iterator erase(iterator hint);
 
+    //removes exactly the span of equal keys: O(log n + k)
     size_type multi_erase(key_type const& key);
     size_type unique_erase(key_type const& key);
 
@@ -536,10 +1287,142 @@ public:
 
     void clear();
 
+    //node handles: extract unlinks a node without destroying it, and
+    //inserting the handle links that same node into this tree
+    node_handle extract(iterator pos) {
+        node_ptr ptr = pos.ptr->get_node_ptr();
+        _erase(pos.ptr);
+        --_num;
+        return node_handle(ptr, _alloc);
+    }
+
+    //the first element with key, or an empty handle
+    node_handle extract(key_type const& key) {
+        //find() may stop at any of several equal keys, the lower bound
+        //is the first of them
+        base_ptr link = _lower_bound(key);
+        if (link == _head || !_comp(_key(link), key)) {
+            return node_handle();
+        }
+        return extract(iterator(link));
+    }
+
+    insert_return_type unique_insert(node_handle&& nh);
+    iterator unique_insert(iterator hint, node_handle&& nh);
+    iterator multi_insert(node_handle&& nh);
+    iterator multi_insert(iterator hint, node_handle&& nh);
+
+    //moves in every node of rhs whose key is not here yet, relinking it;
+    //the others stay in rhs. O(m log(n + m)) and no allocation.
+    void unique_merge(RBT& rhs);
+
     //find
-    iterator find(key_type const& key) const;
-    iterator lower_bound(key_type const& key) const;
-    iterator upper_bound(key_type const& key) const;
+    //find: one comparison per node
+    iterator find(key_type const& key) const {
+        return _find(key);
+    }
+    iterator lower_bound(key_type const& key) const {
+        return _lower_bound(key);
+    }
+    iterator upper_bound(key_type const& key) const {
+        return _upper_bound(key);
+    }
+
+    size_type count(key_type const& key) const {
+        return TKF::distance(lower_bound(key), upper_bound(key));
+    }
+
+    TKF::pair<iterator, iterator> equal_range(key_type const& key) const {
+        return TKF::pair<iterator, iterator>(lower_bound(key), upper_bound(key));
+    }
+
+    //heterogeneous lookup: with a transparent comparator (is_transparent,
+    //e.g. TKF::less<void>) any K it compares with key_type will do, and
+    //no key_type is built for the search
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator find(K const& key) const {
+        return _find(key);
+    }
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator lower_bound(K const& key) const {
+        return _lower_bound(key);
+    }
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    iterator upper_bound(K const& key) const {
+        return _upper_bound(key);
+    }
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    size_type count(K const& key) const {
+        return TKF::distance(lower_bound(key), upper_bound(key));
+    }
+    template <typename K, typename C = COMP, typename = typename C::is_transparent>
+    TKF::pair<iterator, iterator> equal_range(K const& key) const {
+        return TKF::pair<iterator, iterator>(lower_bound(key), upper_bound(key));
+    }
+
+    //batched lookups: one iterator per key of [first, last) goes to out,
+    //find_many writes end() for a missing key. Up to RBT_batch_width
+    //searches go down the tree side by side, each prefetching the node it
+    //moves to while the others compare, so that their cache misses
+    //overlap. In a sorted batch a key a few elements past the result
+    //before is walked to instead. The keys are read twice, in place.
+    template <typename ITER, typename OUT>
+    OUT lower_bound_many(ITER first, ITER last, OUT out) const {
+        return _search_many(first, last, out, TKF::false_type());
+    }
+    template <typename ITER, typename OUT>
+    OUT find_many(ITER first, ITER last, OUT out) const {
+        return _search_many(first, last, out, TKF::true_type());
+    }
+
+    //order statistics, RANK policy only
+    //rank: number of elements less than key
+    size_type rank(key_type const& key) const;
+    //select: the i-th element in order, end() if i >= size()
+    iterator select(size_type i) const;
+
+    //the counters so far, STATS = RBT_stats only; height is measured
+    //here, in O(n). The temporary trees of split/join and the set
+    //operations count apart and are not included.
+    RBT_stats_snapshot stats() const {
+        static_assert(STATS::enabled, "RBT::stats needs the RBT_stats policy");
+        RBT_stats_snapshot res = STATS::counters;
+        res.comparisons = _comp.calls();
+        res.size = _num;
+        res.height = _height(root());
+        return res;
+    }
+
+    void reset_stats() noexcept {
+        static_assert(STATS::enabled, "RBT::reset_stats needs the RBT_stats policy");
+        STATS::counters = RBT_stats_snapshot();
+        _comp.reset();
+    }
+
+    //join/split: nodes are relinked and never copied. join is O(log n),
+    //split too with the RANK policy; see split for the others.
+    //join replaces the contents with left, value and right, where every
+    //key of left is not greater than value's and every key of right is
+    //not less; left and right must be other trees and are left empty.
+    void join(RBT&& left, value_type const& value, RBT&& right);
+    //split moves the elements less than key into left and the rest into
+    //right, leaving this tree empty. Only the RANK policy knows the sizes
+    //of the halves in O(log n); the others count the smaller half, in
+    //O(min(left, right)). left and right each get an allocator of their
+    //own that keeps this tree's memory alive, so the two halves may go
+    //on to different threads.
+    void split(key_type const& key, RBT& left, RBT& right);
+
+    //set operations by divide and conquer over split/join, O(m log(n/m + 1))
+    //for sizes m <= n; both halves of large subproblems run concurrently.
+    //The result is stored here, rhs is consumed and left empty.
+    //unique_*: equal keys are taken from this tree
+    void unique_union(RBT&& rhs) { _set_operation(rhs, _op_union); }
+    void unique_intersection(RBT&& rhs) { _set_operation(rhs, _op_intersection); }
+    void unique_difference(RBT&& rhs) { _set_operation(rhs, _op_difference); }
+    //multi_merge: every element of both trees is kept, and rhs's come 
+    //after this tree's equal keys
+    void multi_merge(RBT&& rhs) { _set_operation(rhs, _op_merge); }
 
 private:
     //helpers: untouchable and invisible for users
@@ -549,6 +1432,8 @@ private:
         _head->parent = nullptr; //root() = nullptr;
         _head->left = _head; //max() = _head;
         _head->right = _head; //min() = _head;
+        _head->set_size(0);
+        _thread(_head, _head);
         _num = 0;
     }
 
@@ -557,105 +1442,269 @@ private:
         _head = nullptr;
     }
 
-    void _left_rotate(base_ptr ptr) noexcept;
-    void _right_rotate(base_ptr ptr) noexcept;
+    static size_type _size(base_ptr ptr) noexcept {
+        return iterator::RBT_size(ptr);
+    }
 
-    base_ptr _minimum(base_ptr const& ptr) noexcept;
-    base_ptr _maximum(base_ptr const& ptr) noexcept;
+    //elements in front of pos without the RANK policy: walks in from
+    //both ends at once, so only the shorter side is stepped through
+    size_type _count_before(iterator pos) const noexcept {
+        iterator front = begin(), back = end();
+        size_type k = 0;
+        while (front != pos && back != pos) {
+            ++front;
+            --back;
+            ++k;
+        }
+        return front == pos ? k : _num - k;
+    }
+
+    //nodes on the longest path down from ptr; the recursion is as deep
+    //as the tree, O(log n)
+    static size_type _height(base_ptr ptr) noexcept {
+        if (ptr == nullptr) {
+            return 0;
+        }
+        size_type left = _height(ptr->left);
+        size_type right = _height(ptr->right);
+        return (left < right ? right : left) + 1;
+    }
+
+    static key_type const& _key(base_ptr ptr) noexcept {
+        return value_traits::get_key(ptr->get_node_ptr()->value);
+    }
+
+    //lhs when cond, else rhs, computed with masks so that the compiler
+    //cannot turn it back into an unpredictable branch
+    static base_ptr _select(bool cond, base_ptr lhs, base_ptr rhs) noexcept {
+        uintptr_t mask = uintptr_t(0) - uintptr_t(cond);
+        return reinterpret_cast<base_ptr>(
+            (reinterpret_cast<uintptr_t>(lhs) & mask) | 
+            (reinterpret_cast<uintptr_t>(rhs) & ~mask));
+    }
+
+    template <typename K>
+    base_ptr _find(K const& key) const {
+        return _find(key, typename TKF::int_constant<bool, 
+            RBT_three_way<COMP, K, key_type>::value && !branchless>::type());
+    }
+    template <typename K>
+    base_ptr _find(K const& key, TKF::true_type) const;
+    template <typename K>
+    base_ptr _find(K const& key, TKF::false_type) const;
+    template <typename K>
+    base_ptr _lower_bound(K const& key) const;
+    template <typename K>
+    base_ptr _upper_bound(K const& key) const;
+    template <typename ITER, typename OUT, typename FIND>
+    OUT _search_many(ITER first, ITER last, OUT out, FIND) const;
+
+    //THREAD policy: the in-order list must follow every change of the tree
+    static void _thread(base_ptr lhs, base_ptr rhs) noexcept {
+        lhs->set_next(rhs);
+        rhs->set_prev(lhs);
+    }
+    //relink the whole list in O(n), after the tree was rebuilt wholesale
+    void _rethread() noexcept {
+        if (threaded) {
+            _thread(_thread_from(root(), _head), _head);
+        }
+    }
+    static base_ptr _thread_from(base_ptr ptr, base_ptr last) noexcept;
+
+    void _left_rotate(base_ptr ptr) noexcept;
+    void _right_rotate(base_ptr ptr) noexcept;
+
+    base_ptr _minimum(base_ptr const& ptr) noexcept;
+    base_ptr _maximum(base_ptr const& ptr) noexcept;
 
     template <typename ...Args>
     node_ptr _create(Args&&... args);
     node_ptr _clone(base_ptr ptr);
     void _destroy(node_ptr ptr);
 
+    template <typename ITER>
+    void _build(ITER const& first, ITER const& last, bool unique, bool sorted);
+    base_ptr _link_balanced(node_ptr* nodes, size_type n, 
+        size_type depth, size_type red, base_ptr parent) noexcept;
+
     TKF::pair<base_ptr, bool> _multi_insert_pos(key_type const& key);
-    TKF::pair<TKF::pair<base_ptr, bool>, bool> _unique_insert_pos(key_type const& key);
+    //where key goes: (parent, side) and true, or the equal node and false
+    template <typename K>
+    TKF::pair<TKF::pair<base_ptr, bool>, bool> _unique_insert_pos(K const& key);
+    template <typename K>
+    TKF::pair<TKF::pair<base_ptr, bool>, bool> _unique_hint_pos(iterator hint, K const& key);
 
     void _insert_fix(base_ptr ptr); 
     iterator _insert_value_at (base_ptr ptr, value_type const& value, RBT_insert_type insert) {
             return _insert_node_at(ptr, _create(value), insert);
     }
     iterator _insert_node_at(base_ptr ptr, node_ptr node, RBT_insert_type);
+    //takes over a node handle's node, as fresh as _create leaves it
+    node_ptr _adopt(node_handle& nh);
 
-    iterator _multi_insert_hint(iterator hint, key_type key, value_type const& value){
+    iterator _multi_insert_hint(iterator hint, key_type const& key, value_type const& value){
         return _multi_insert_hint(hint, key, _create(value));
     }
-    iterator _multi_insert_hint(iterator hint, key_type key, node_ptr node);
-    iterator _unique_insert_hint(iterator hint, key_type key, value_type const& value) {
-        return _unique_insert_hint(hint, key, _create(value));
-    }
-    iterator _unique_insert_hint(iterator hint, key_type key, node_ptr node);
+    iterator _multi_insert_hint(iterator hint, key_type const& key, node_ptr node);
+    //links a new node next to hint when that keeps the order, else searches
+    iterator _multi_link_hint(iterator hint, node_ptr node);
 
-    base_ptr _copy(base_ptr const& from, base_ptr ptr) const;
-    void _erase_from(base_ptr from);
+    base_ptr _copy(base_ptr const& from, base_ptr ptr);
+    size_type _erase_from(base_ptr from);
     void _transplant(base_ptr u, base_ptr v); 
-    void _delete_fix(base_ptr ptr);
+    void _delete_fix(base_ptr ptr, base_ptr parent);
     void _erase(base_ptr ptr);
+
+    //join/split work on detached subtrees: a root and its black height,
+    //counting black nodes from the root down to a leaf
+    struct _subtree {
+        base_ptr root;
+        size_type height;
+    };
+
+    struct _split_result {
+        _subtree left;
+        base_ptr equal;
+        _subtree right;
+    };
+
+    //nodes dropped by a set operation, chained through parent and 
+    //destroyed once every branch has finished
+    struct _dead_list {
+        base_ptr head;
+        base_ptr tail;
+
+        _dead_list() : head(nullptr), tail(nullptr) {}
+
+        void push(base_ptr ptr) noexcept {
+            ptr->parent = nullptr;
+            if (tail != nullptr) {
+                tail->parent = ptr;
+            }
+            else {
+                head = ptr;
+            }
+            tail = ptr;
+        }
+
+        void splice(_dead_list& rhs) noexcept {
+            if (rhs.head == nullptr) {
+                return;
+            }
+            if (tail != nullptr) {
+                tail->parent = rhs.head;
+            }
+            else {
+                head = rhs.head;
+            }
+            tail = rhs.tail;
+        }
+    };
+
+    enum _set_op { _op_union, _op_intersection, _op_difference, _op_merge };
+
+    //below this black height a subproblem is not worth a thread
+    static constexpr size_type _fork_height = 10;
+    //spans of equal keys at least this long are cut out with split/join
+    //rather than erased node by node
+    static constexpr size_type _span_erase = 64;
+
+    _subtree _detach() noexcept;
+    void _attach(base_ptr ptr, size_type n) noexcept;
+    size_type _destroy_list(_dead_list& dead);
+
+    static size_type _black_height(base_ptr ptr) noexcept;
+    static void _link(base_ptr ptr, base_ptr left, base_ptr right) noexcept;
+    static base_ptr _rotate_left_detached(base_ptr ptr) noexcept;
+    static base_ptr _rotate_right_detached(base_ptr ptr) noexcept;
+
+    static base_ptr _join_right(base_ptr left, size_type hl, 
+        base_ptr ptr, base_ptr right, size_type hr) noexcept;
+    static base_ptr _join_left(base_ptr left, size_type hl, 
+        base_ptr ptr, base_ptr right, size_type hr) noexcept;
+    static _subtree _join(_subtree left, base_ptr ptr, _subtree right) noexcept;
+    static _subtree _join2(_subtree left, _subtree right) noexcept;
+    static TKF::pair<_subtree, base_ptr> _split_last(_subtree tree) noexcept;
+    _split_result _split(_subtree tree, key_type const& key, bool unique) const;
+    _split_result _split_upper(_subtree tree, key_type const& key) const;
+
+    void _set_operation(RBT& rhs, _set_op op);
+    _subtree _union(_subtree lhs, _subtree rhs, bool unique, 
+        _dead_list& dead, unsigned depth) const;
+    _subtree _intersection(_subtree lhs, _subtree rhs, 
+        _dead_list& dead, unsigned depth) const;
+    _subtree _difference(_subtree lhs, _subtree rhs, 
+        _dead_list& dead, unsigned depth) const;
 };
 
-template <typename T, typename COMP>
-bool operator == (RBT<T, COMP> const& lhs, RBT<T, COMP> const& rhs) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+bool operator == (RBT<T, COMP, ALLOC, POLICY, STATS> const& lhs, RBT<T, COMP, ALLOC, POLICY, STATS> const& rhs) {
     return lhs == rhs;
 }
 
-template <typename T, typename COMP>
-bool operator != (RBT<T, COMP> const& lhs, RBT<T, COMP> const& rhs) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+bool operator != (RBT<T, COMP, ALLOC, POLICY, STATS> const& lhs, RBT<T, COMP, ALLOC, POLICY, STATS> const& rhs) {
     return !(lhs == rhs);
 }
     
-template <typename T, typename COMP>
-bool operator >= (RBT<T, COMP> const& lhs, RBT<T, COMP> const& rhs) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+bool operator >= (RBT<T, COMP, ALLOC, POLICY, STATS> const& lhs, RBT<T, COMP, ALLOC, POLICY, STATS> const& rhs) {
     return !(lhs < rhs);
 }
 
-template <typename T, typename COMP>
-bool operator > (RBT<T, COMP> const& lhs, RBT<T, COMP> const& rhs) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+bool operator > (RBT<T, COMP, ALLOC, POLICY, STATS> const& lhs, RBT<T, COMP, ALLOC, POLICY, STATS> const& rhs) {
         return rhs < lhs;
 }
 
-template <typename T, typename COMP>
-bool operator <= (RBT<T, COMP> const& lhs, RBT<T, COMP> const& rhs) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+bool operator <= (RBT<T, COMP, ALLOC, POLICY, STATS> const& lhs, RBT<T, COMP, ALLOC, POLICY, STATS> const& rhs) {
         return !(rhs < lhs);
 }
 
-template <typename T, typename COMP>
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
 template <typename ...Args>
-typename RBT<T, COMP>::node_ptr
-RBT<T, COMP>::_create (Args&&... args) {
-    auto tmp = node_allocator::allocate(1);
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::node_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_create (Args&&... args) {
+    auto tmp = _alloc.allocate(1);
     try {
         allocator_type::construct(&tmp->value, TKF::forward<Args>(args)...);
         tmp->left = nullptr;
         tmp->right = nullptr;
         tmp->parent = nullptr;
         tmp->color = RBT_color_red;
+        tmp->set_size(1);
     }
     catch (...) {
-        node_allocator::deallocate(tmp);
+        _alloc.deallocate(tmp);
         throw;
     }
+    STATS::on_allocate();
     return tmp;
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::node_ptr
-RBT<T, COMP>::_clone (base_ptr ptr) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::node_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_clone (base_ptr ptr) {
     node_ptr tmp = _create(ptr->get_node_ptr()->value);
     tmp->color = ptr->color;
+    tmp->set_size(ptr->get_size());
     tmp->left = nullptr;
     tmp->right = nullptr;
     return tmp;
 }
 
-template <typename T, typename COMP>
-void RBT<T, COMP>::_destroy (node_ptr ptr) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_destroy (node_ptr ptr) {
     allocator_type::destroy(&ptr->value);
-    node_allocator::deallocate(ptr);
+    _alloc.deallocate(ptr);
+    STATS::on_deallocate();
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::base_ptr
-RBT<T, COMP>::_minimum (base_ptr const& ptr) noexcept {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_minimum (base_ptr const& ptr) noexcept {
     base_ptr link = ptr;
     while (link->left != nullptr) {
         link = link->left;
@@ -663,9 +1712,9 @@ RBT<T, COMP>::_minimum (base_ptr const& ptr) noexcept {
     return link;
 }   
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::base_ptr
-RBT<T, COMP>::_maximum (base_ptr const& ptr) noexcept {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_maximum (base_ptr const& ptr) noexcept {
     base_ptr link = ptr;
     while (link->right != nullptr) {
         link = link->right;
@@ -673,10 +1722,10 @@ RBT<T, COMP>::_maximum (base_ptr const& ptr) noexcept {
     return link;
 }
 
-template <typename T, typename COMP>
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
 template <typename ...Args>
-typename RBT<T, COMP>::iterator 
-RBT<T, COMP>::multi_emplace (Args&& ...args) {
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator 
+RBT<T, COMP, ALLOC, POLICY, STATS>::multi_emplace (Args&& ...args) {
     THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
         , "RBT<T, COMP> size is out of range");
     node_ptr ptr = _create(TKF::forward<Args>(args)...);
@@ -685,10 +1734,10 @@ RBT<T, COMP>::multi_emplace (Args&& ...args) {
     return _insert_node_at(res.first, ptr, res.second);
 }
 
-template <typename T, typename COMP>
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
 template <typename ...Args>
-TKF::pair<typename RBT<T, COMP>::iterator, bool>
-RBT<T, COMP>::unique_emplace (Args&& ...args) {
+TKF::pair<typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator, bool>
+RBT<T, COMP, ALLOC, POLICY, STATS>::unique_emplace (Args&& ...args) {
     THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
         , "RBT<T, COMP> size out of range");
     node_ptr ptr = _create(TKF::forward<Args>(args)...);
@@ -701,27 +1750,32 @@ RBT<T, COMP>::unique_emplace (Args&& ...args) {
     return TKF::make_pair(_insert_node_at(res.first.first, ptr, res.first.second), true);
 }
 
-template <typename T, typename COMP>
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
 template <typename ...Args>
-typename RBT<T, COMP>::iterator 
-RBT<T, COMP>::multi_emplace_hint (iterator hint, Args&&... args) {
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator 
+RBT<T, COMP, ALLOC, POLICY, STATS>::multi_emplace_hint (iterator hint, Args&&... args) {
     THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
         , "RBT<T, COMP> size out of range");
-    node_ptr ptr = _create(TKF::forward<Args>(args)...);
-    key_type key = value_traits::get_key(ptr->get_node_ptr()->value);
+    return _multi_link_hint(hint, _create(TKF::forward<Args>(args)...));
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator 
+RBT<T, COMP, ALLOC, POLICY, STATS>::_multi_link_hint (iterator hint, node_ptr ptr) {
+    key_type const& key = value_traits::get_key(ptr->get_node_ptr()->value);
     if (_num == 0) {
         return _insert_node_at(hint.ptr, ptr, RBT_left_insert);
     }
-    if (hint == min()) {
+    if (hint == begin()) {
         if(_comp(key, value_traits::get_key(*hint))) {
             return _insert_node_at(hint.ptr, ptr, RBT_left_insert);
         }
         auto res = _multi_insert_pos(key);
         return _insert_node_at(res.first, ptr, res.second);
     }
-    else if (hint == max()) {
-        if(!_comp(key, value_traits::get_key(*hint))) {
-            return _insert_node_at(hint.ptr, ptr, RBT_right_insert);
+    else if (hint == end()) {
+        if(!_comp(key, value_traits::get_key(max()->get_node_ptr()->value))) {
+            return _insert_node_at(max(), ptr, RBT_right_insert);
         }
         auto res = _multi_insert_pos(key);
         return _insert_node_at(res.first, ptr, res.second);
@@ -729,55 +1783,63 @@ RBT<T, COMP>::multi_emplace_hint (iterator hint, Args&&... args) {
     return _multi_insert_hint(hint, key, ptr);
 }
 
-template <typename T, typename COMP>
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
 template <typename ...Args>
-typename RBT<T, COMP>::iterator
-RBT<T, COMP>::unique_emplace_hint (iterator hint, Args&&... args) {
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator
+RBT<T, COMP, ALLOC, POLICY, STATS>::unique_emplace_hint (iterator hint, Args&&... args) {
     THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
         , "RBT<T, COMP> size out of range");
     node_ptr ptr = _create(TKF::forward<Args>(args)...);
-    key_type key = value_traits::get_key(ptr->get_node_ptr()->value);
-    if(_num == 0) {
-        return _insert_node_at(hint.ptr, ptr, RBT_left_insert);
+    auto res = _unique_hint_pos(hint, value_traits::
+        get_key(ptr->get_node_ptr()->value));
+    if (!res.second) {
+        _destroy(ptr);
+        return iterator(res.first.first);
     }
-    if(hint == min()) {
-        if (_comp(key, value_traits::get_key(*hint))
-            && key != value_traits::get_key(*hint)) {
-                return _insert_node_at(hint.ptr, ptr, RBT_left_insert);
-            }
-        auto res = _unique_insert_pos(key);
-        if(!res.second) {
-            _destroy(ptr);
-            return res.first.first;
-        }
-        return _insert_node_at(res.first.first, ptr, res.first.second);
+    return _insert_node_at(res.first.first, ptr, res.first.second);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+template <typename K, typename ...Args>
+TKF::pair<typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator, bool>
+RBT<T, COMP, ALLOC, POLICY, STATS>::unique_emplace_key (K const& key, Args&& ...args) {
+    THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
+        , "RBT<T, COMP> size out of range");
+    auto res = _unique_insert_pos(key);
+    if (!res.second) {
+        return TKF::make_pair(iterator(res.first.first), false);
     }
-    else if (hint == max()) {
-        if (!_comp(key, value_traits::get_key(*hint))) {
-            return _insert_node_at(hint.ptr, ptr, RBT_left_insert);
-        }
-        auto res = _unique_insert_pos(key);
-        if(!res.second) {
-            _destroy(ptr);
-            return iterator(res.first.first);
-        }
-        return _insert_node_at(res.first.first, ptr, res.first.second);
+    node_ptr ptr = _create(TKF::forward<Args>(args)...);
+    return TKF::make_pair(_insert_node_at(res.first.first, ptr, res.first.second), true);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+template <typename K, typename ...Args>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator
+RBT<T, COMP, ALLOC, POLICY, STATS>::unique_emplace_key_hint (iterator hint, K const& key, 
+    Args&& ...args) {
+    THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
+        , "RBT<T, COMP> size out of range");
+    auto res = _unique_hint_pos(hint, key);
+    if (!res.second) {
+        return iterator(res.first.first);
     }
-    return _unique_insert_hint(hint, key, ptr);
+    node_ptr ptr = _create(TKF::forward<Args>(args)...);
+    return _insert_node_at(res.first.first, ptr, res.first.second);
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::iterator
-RBT<T, COMP>::multi_insert (value_type const& value) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator
+RBT<T, COMP, ALLOC, POLICY, STATS>::multi_insert (value_type const& value) {
     THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
         , "RBT<T, COMP> size out of range");
     auto res = _multi_insert_pos(value_traits::get_key(value));
     return _insert_value_at(res.first, value, res.second);
 }
 
-template <typename T, typename COMP>
-TKF::pair<typename RBT<T, COMP>::iterator, bool>
-RBT<T, COMP>::unique_insert (value_type const& value) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+TKF::pair<typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator, bool>
+RBT<T, COMP, ALLOC, POLICY, STATS>::unique_insert (value_type const& value) {
     THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
         , "RBT<T, COMP> size out of range");
     auto res = _unique_insert_pos(value_traits::get_key(value));
@@ -787,35 +1849,134 @@ RBT<T, COMP>::unique_insert (value_type const& value) {
     return TKF::make_pair(_insert_value_at(res.first.first, value, res.first.second), true);
 }
 
-template <typename T, typename COMP>
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
 template <typename ITER>
-void RBT<T, COMP>::multi_insert (ITER const& first, ITER const& last) {
+void RBT<T, COMP, ALLOC, POLICY, STATS>::multi_insert (ITER const& first, ITER const& last) {
     ITER ptr = first;
     difference_type n = TKF::distance(first, last);
     THROW_OUT_OF_RANGE_IF(_num > max_size() - n
         , "RBT<T, COMP> size is out of range");
+    if (_num == 0) {
+        _build(first, last, false, false);
+        return;
+    }
     while (ptr != last) {
         multi_insert(end(), *ptr);
         ++ptr;
     }
 }
 
-template <typename T, typename COMP>
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
 template <typename ITER>
-void RBT<T, COMP>::unique_insert (ITER const& first, ITER const& last) {
+void RBT<T, COMP, ALLOC, POLICY, STATS>::unique_insert (ITER const& first, ITER const& last) {
     ITER ptr = first;
     difference_type n = TKF::distance(first, last);
     THROW_OUT_OF_RANGE_IF(_num > max_size() - n
         , "RBT<T, COMP> size is out of range");
+    if (_num == 0) {
+        _build(first, last, true, false);
+        return;
+    }
     while (ptr != last) {
         unique_insert(end(), *ptr);
         ++ptr;
     }
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::iterator
-RBT<T, COMP>::erase (iterator hint) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+template <typename ITER>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_build (ITER const& first, ITER const& last, 
+    bool unique, bool sorted) {
+    typedef TKF::allocator<node_ptr> buffer_allocator;
+    clear();
+    size_type n = TKF::distance(first, last);
+    if (n == 0) {
+        return;
+    }
+    //one pass to allocate and construct every node, then sort pointers
+    node_ptr* nodes = buffer_allocator::allocate(n);
+    size_type m = 0;
+    try {
+        for (ITER ptr = first; ptr != last; ++ptr) {
+            nodes[m] = _create(*ptr);
+            ++m;
+        }
+    }
+    catch (...) {
+        for (size_type i = 0; i < m; ++i) {
+            _destroy(nodes[i]);
+        }
+        buffer_allocator::deallocate(nodes);
+        throw;
+    }
+    auto const& comp = _comp;
+    auto less = [&comp](node_ptr lhs, node_ptr rhs) {
+        return !comp(value_traits::get_key(rhs->value), 
+            value_traits::get_key(lhs->value));
+    };
+    if (!sorted) {
+        size_type i = 1;
+        while (i < m && !less(nodes[i], nodes[i - 1])) {
+            ++i;
+        }
+        if (i < m && STATS::enabled) {
+            std::stable_sort(nodes, nodes + m, less);
+        }
+        else if (i < m) {
+            TKF::parallel_sort(nodes, nodes + m, less);
+        }
+    }
+    if (unique) {
+        size_type k = 1;
+        for (size_type i = 1; i < m; ++i) {
+            if (less(nodes[k - 1], nodes[i])) {
+                nodes[k++] = nodes[i];
+            }
+            else {
+                _destroy(nodes[i]);
+            }
+        }
+        m = k;
+    }
+    //every level above the last one is full: color the last one red
+    size_type red = 0;
+    while ((size_type(2) << red) - 1 <= m) {
+        ++red;
+    }
+    root() = _link_balanced(nodes, m, 0, red, _head);
+    min() = nodes[0];
+    max() = nodes[m - 1];
+    if (threaded) {
+        _thread(_head, nodes[0]);
+        for (size_type i = 1; i < m; ++i) {
+            _thread(nodes[i - 1], nodes[i]);
+        }
+        _thread(nodes[m - 1], _head);
+    }
+    _num = m;
+    buffer_allocator::deallocate(nodes);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_link_balanced (node_ptr* nodes, size_type n,
+    size_type depth, size_type red, base_ptr parent) noexcept {
+    if (n == 0) {
+        return nullptr;
+    }
+    size_type mid = n / 2;
+    base_ptr x = nodes[mid]->get_base_ptr();
+    x->parent = parent;
+    x->color = depth == red ? RBT_color_red : RBT_color_black;
+    x->set_size(n);
+    x->left = _link_balanced(nodes, mid, depth + 1, red, x);
+    x->right = _link_balanced(nodes + mid + 1, n - mid - 1, depth + 1, red, x);
+    return x;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator
+RBT<T, COMP, ALLOC, POLICY, STATS>::erase (iterator hint) {
     node_ptr ptr = hint.ptr->get_node_ptr();
     iterator next(ptr);
     ++next;
@@ -825,29 +1986,34 @@ RBT<T, COMP>::erase (iterator hint) {
     return next;
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::size_type
-RBT<T, COMP>::multi_erase (key_type const& key) {
-    size_type n = 0;
-    if (find(key) != end()) {
-        iterator iter = begin(), tmp;
-        while (iter != end()) {
-            if(key == value_traits::
-                get_key(iter.ptr->get_node_ptr()->value)) {
-                    tmp = iter++;
-                    erase(tmp);
-                    ++n;
-                    continue;
-                }
-            ++iter;
-        }
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::size_type
+RBT<T, COMP, ALLOC, POLICY, STATS>::multi_erase (key_type const& key) {
+    iterator first = lower_bound(key);
+    iterator last = upper_bound(key);
+    size_type n = TKF::distance(first, last);
+    if (n < _span_erase || (first == begin() && last == end())) {
+        erase(first, last);
+        return n;
+    }
+    //split off the keys less than key, then the equal ones, and join the
+    //outer parts again: O(log n) relinking whatever the span's length
+    base_ptr before = first.ptr->get_prev();
+    size_type m = _num - n;
+    _subtree tree = { root(), _black_height(root()) };
+    _split_result lower = _split(tree, key, false);
+    _split_result upper = _split_upper(lower.right, key);
+    _erase_from(upper.left.root);
+    _attach(_join2(lower.left, upper.right).root, m);
+    if (threaded) {
+        _thread(before, last.ptr);
     }
     return n;
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::size_type
-RBT<T, COMP>::unique_erase (key_type const& key) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::size_type
+RBT<T, COMP, ALLOC, POLICY, STATS>::unique_erase (key_type const& key) {
     iterator target = find(key);
     if (target != end()) {
         erase(target);
@@ -856,8 +2022,102 @@ RBT<T, COMP>::unique_erase (key_type const& key) {
     return 0;
 }
 
-template <typename T, typename COMP>
-void RBT<T, COMP>::erase (iterator first, iterator last) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::node_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_adopt (node_handle& nh) {
+    _alloc.absorb(nh._alloc);
+    node_ptr ptr = nh._release();
+    ptr->left = nullptr;
+    ptr->right = nullptr;
+    ptr->parent = nullptr;
+    ptr->color = RBT_color_red;
+    ptr->set_size(1);
+    return ptr;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::insert_return_type
+RBT<T, COMP, ALLOC, POLICY, STATS>::unique_insert (node_handle&& nh) {
+    if (nh.empty()) {
+        return insert_return_type{end(), false, node_handle()};
+    }
+    auto res = _unique_insert_pos(value_traits::get_key(nh._ptr->value));
+    if (!res.second) {
+        return insert_return_type{iterator(res.first.first), false, TKF::move(nh)};
+    }
+    THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
+        , "RBT<T, COMP> size out of range");
+    iterator pos = _insert_node_at(res.first.first, _adopt(nh), res.first.second);
+    return insert_return_type{pos, true, node_handle()};
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator
+RBT<T, COMP, ALLOC, POLICY, STATS>::unique_insert (iterator hint, node_handle&& nh) {
+    if (nh.empty()) {
+        return end();
+    }
+    auto res = _unique_hint_pos(hint, value_traits::get_key(nh._ptr->value));
+    if (!res.second) {
+        return iterator(res.first.first);
+    }
+    THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
+        , "RBT<T, COMP> size out of range");
+    return _insert_node_at(res.first.first, _adopt(nh), res.first.second);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator
+RBT<T, COMP, ALLOC, POLICY, STATS>::multi_insert (node_handle&& nh) {
+    if (nh.empty()) {
+        return end();
+    }
+    THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
+        , "RBT<T, COMP> size out of range");
+    auto res = _multi_insert_pos(value_traits::get_key(nh._ptr->value));
+    return _insert_node_at(res.first, _adopt(nh), res.second);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator
+RBT<T, COMP, ALLOC, POLICY, STATS>::multi_insert (iterator hint, node_handle&& nh) {
+    if (nh.empty()) {
+        return end();
+    }
+    THROW_OUT_OF_RANGE_IF(_num > max_size() - 1
+        , "RBT<T, COMP> size out of range");
+    return _multi_link_hint(hint, _adopt(nh));
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::unique_merge (RBT& rhs) {
+    if (this == &rhs || rhs._num == 0) {
+        return;
+    }
+    THROW_OUT_OF_RANGE_IF(_num > max_size() - rhs._num
+        , "RBT<T, COMP> size out of range");
+    iterator iter = rhs.begin();
+    while (iter != rhs.end()) {
+        base_ptr ptr = iter.ptr;
+        ++iter;
+        node_ptr node = ptr->get_node_ptr();
+        auto res = _unique_insert_pos(value_traits::get_key(node->value));
+        if (res.second) {
+            rhs._erase(ptr);
+            --rhs._num;
+            node->left = nullptr;
+            node->right = nullptr;
+            node->color = RBT_color_red;
+            node->set_size(1);
+            _insert_node_at(res.first.first, node, res.first.second);
+        }
+    }
+    //the nodes left behind with colliding keys still live in rhs's arena
+    _alloc.absorb(rhs._alloc, rhs._num != 0);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::erase (iterator first, iterator last) {
     if(first == begin() && last == end()) {
         clear();
     }
@@ -870,113 +2130,278 @@ void RBT<T, COMP>::erase (iterator first, iterator last) {
     }
 }
 
-template <typename T, typename COMP>
-void RBT<T, COMP>::clear () {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::clear () {
     if (_num != 0) {
         _erase_from(root());
         min() = _head;
         max() = _head;
         root() = nullptr;
+        _thread(_head, _head);
         _num = 0;
+        _alloc.release();
     }
 }
-template <typename T, typename COMP>
-typename RBT<T, COMP>::iterator 
-RBT<T, COMP>::find (key_type const& key) const {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+template <typename K>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_find (K const& key, TKF::true_type) const {
+    base_ptr ptr = root();
+    size_type length = 0;
+    while (ptr != nullptr) {
+        ++length;
+        int res = _comp.compare(key, _key(ptr));
+        if (res == 0) {
+            STATS::on_search(length);
+            return ptr;
+        }
+        ptr = res < 0 ? ptr->left : ptr->right;
+    }
+    STATS::on_search(length);
+    return _head;
+}
+
+//integer keys: == and the order fold into one compare, whose flags pick
+//the child with a conditional move. Otherwise the lower bound is equal
+//to key when it is not greater, one more comparison at the end.
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+template <typename K>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_find (K const& key, TKF::false_type) const {
+    if (branchless) {
+        base_ptr ptr = root();
+        size_type length = 0;
+        while (ptr != nullptr) {
+            ++length;
+            if (key == _key(ptr)) {
+                STATS::on_search(length);
+                return ptr;
+            }
+            ptr = _comp(key, _key(ptr)) ? ptr->left : ptr->right;
+        }
+        STATS::on_search(length);
+        return _head;
+    }
+    base_ptr link = _lower_bound(key);
+    if (link != _head && _comp(_key(link), key)) {
+        return link;
+    }
+    return _head;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+template <typename K>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_lower_bound (K const& key) const {
     base_ptr ptr = root();
     base_ptr link = _head;
+    size_type length = 0;
     while (ptr != nullptr) {
-        link = ptr;
-        if (key == value_traits::get_key(link->get_node_ptr()->value)) {
-            return iterator(link);
+        ++length;
+        bool left = _comp(key, _key(ptr));
+        if (branchless) {
+            link = _select(left, ptr, link);
+            ptr = _select(left, ptr->left, ptr->right);
         }
-        if(_comp(key, value_traits::get_key(link->get_node_ptr()->value))) {
+        else if (left) {
+            link = ptr;
             ptr = ptr->left;
         }
         else {
             ptr = ptr->right;
         }
     }
-    return end();
+    STATS::on_search(length);
+    return link;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+template <typename ITER, typename OUT, typename FIND>
+OUT RBT<T, COMP, ALLOC, POLICY, STATS>::_search_many (ITER first, ITER last, OUT out, 
+    FIND) const {
+    typedef typename TKF::rmv_reference<decltype(*first)>::type key_ref;
+    //alone the search branches, going down ahead of its comparisons
+    ITER second = first;
+    if (first != last && ++second == last) {
+        *out = iterator(FIND::value ? _find(*first) : _lower_bound(*first));
+        return ++out;
+    }
+    //keys in order are walked to from the result before, a few successors
+    //on; the first that is further away and the rest of its group are
+    //searched from the root
+    bool sorted = true;
+    for (ITER prev = first, next = first; first != last && ++next != last; prev = next) {
+        if (!_comp(*prev, *next)) {
+            sorted = false;
+            break;
+        }
+    }
+    base_ptr finger = nullptr;
+    key_ref* keys[RBT_batch_width];
+    base_ptr ptr[RBT_batch_width];
+    base_ptr link[RBT_batch_width];
+    size_type length[RBT_batch_width];
+    while (first != last) {
+        size_type m = 0;
+        for (; m < RBT_batch_width && first != last; ++m, ++first) {
+            keys[m] = &*first;
+            ptr[m] = root();
+            link[m] = _head;
+            length[m] = 0;
+            for (; finger != nullptr && length[m] < RBT_finger_steps; ++length[m]) {
+                if (finger == _head || _comp(*first, _key(finger))) {
+                    ptr[m] = nullptr;
+                    link[m] = finger;
+                    break;
+                }
+                finger = (++iterator(finger)).ptr;
+            }
+            if (ptr[m] != nullptr) {
+                finger = nullptr;
+                length[m] = 0;
+            }
+        }
+        //round robin over the searches still going, one level each
+        for (bool going = root() != nullptr; going; ) {
+            going = false;
+            for (size_type i = 0; i < m; ++i) {
+                base_ptr p = ptr[i];
+                if (p == nullptr) {
+                    continue;
+                }
+                ++length[i];
+                bool left = _comp(*keys[i], _key(p));
+                link[i] = _select(left, p, link[i]);
+                p = _select(left, p->left, p->right);
+                TKF::prefetch(p);
+                ptr[i] = p;
+                going |= p != nullptr;
+            }
+        }
+        for (size_type i = 0; i < m; ++i) {
+            STATS::on_search(length[i]);
+            *out = (FIND::value && link[i] != _head && !_comp(_key(link[i]), *keys[i])) ? 
+                end() : iterator(link[i]);
+            ++out;
+        }
+        if (sorted) {
+            finger = link[m - 1];
+        }
+    }
+    return out;
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::iterator 
-RBT<T, COMP>::lower_bound (key_type const& key) const {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+template <typename K>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_upper_bound (K const& key) const {
     base_ptr ptr = root();
     base_ptr link = _head;
+    size_type length = 0;
     while (ptr != nullptr) {
-        if(_comp(key, value_traits::get_key(ptr->get_node_ptr()->value))) {
-            link = ptr;
-            ptr = ptr->left;
+        ++length;
+        bool right = _comp(_key(ptr), key);
+        if (branchless) {
+            link = _select(right, link, ptr);
+            ptr = _select(right, ptr->right, ptr->left);
         }
-        else {
+        else if (right) {
             ptr = ptr->right;
         }
+        else {
+            link = ptr;
+            ptr = ptr->left;
+        }
     }
-    return iterator(link);
+    STATS::on_search(length);
+    return link;
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::iterator 
-RBT<T, COMP>::upper_bound (key_type const& key) const{
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::size_type
+RBT<T, COMP, ALLOC, POLICY, STATS>::rank (key_type const& key) const {
+    static_assert(ranked, "RBT::rank needs the RBT_rank_node policy");
     base_ptr ptr = root();
-    base_ptr link = _head;
+    size_type n = 0;
     while (ptr != nullptr) {
-        if(_comp(key, value_traits::get_key(ptr->get_node_ptr()->value))) {
+        if (_comp(key, value_traits::get_key(ptr->get_node_ptr()->value))) {
             ptr = ptr->left;
         }
         else {
-            link = ptr;
+            n += _size(ptr->left) + 1;
             ptr = ptr->right;
         }
     }
-    return iterator(link);
+    return n;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator
+RBT<T, COMP, ALLOC, POLICY, STATS>::select (size_type i) const {
+    static_assert(ranked, "RBT::select needs the RBT_rank_node policy");
+    if (i >= _num) {
+        return end();
+    }
+    return iterator(iterator::RBT_select(root(), i));
 }
 
-template <typename T, typename COMP>
-TKF::pair<typename RBT<T, COMP>::base_ptr, bool>
-RBT<T, COMP>::_multi_insert_pos (key_type const& key) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+TKF::pair<typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr, bool>
+RBT<T, COMP, ALLOC, POLICY, STATS>::_multi_insert_pos (key_type const& key) {
     base_ptr ptr = root();
     base_ptr link = _head;
     RBT_insert_type insert = RBT_left_insert;
+    size_type length = 0;
     while (ptr != nullptr) {
+        ++length;
         link = ptr;
-        insert = _comp(key, value_traits::
-            get_key(ptr->get_node_ptr()->value));
-        ptr = (insert == RBT_left_insert) ? ptr->left : ptr->right;
+        insert = _comp(key, _key(ptr));
+        if (branchless) {
+            ptr = _select(insert == RBT_left_insert, ptr->left, ptr->right);
+        }
+        else {
+            ptr = (insert == RBT_left_insert) ? ptr->left : ptr->right;
+        }
     }
+    STATS::on_search(length);
     return TKF::make_pair(link, insert);
 }
 
-template <typename T, typename COMP>
-TKF::pair<TKF::pair<typename RBT<T, COMP>::base_ptr, bool>, bool>
-RBT<T, COMP>::_unique_insert_pos (key_type const& key) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+template <typename K>
+TKF::pair<TKF::pair<typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr, bool>, bool>
+RBT<T, COMP, ALLOC, POLICY, STATS>::_unique_insert_pos (K const& key) {
     base_ptr ptr = root();
     base_ptr link = _head;
+    base_ptr bound = _head; //last node we turned left at: the lower bound
     RBT_insert_type insert = RBT_left_insert;
+    size_type length = 0;
     while (ptr != nullptr) {
+        ++length;
         link = ptr;
-        insert = _comp(key, value_traits::
-            get_key(ptr->get_node_ptr()->value));
-        ptr = (insert == RBT_left_insert) ? ptr->left : ptr->right;
-    }
-    if (insert == RBT_left_insert) {
-        if (link == _head || key != value_traits::
-            get_key(link->get_node_ptr()->value)) {
-                return TKF::make_pair(TKF::make_pair(link, insert), true);
-            }
-        return TKF::make_pair(TKF::make_pair(link, insert), false);
+        insert = _comp(key, _key(ptr));
+        if (branchless) {
+            bound = _select(insert == RBT_left_insert, ptr, bound);
+            ptr = _select(insert == RBT_left_insert, ptr->left, ptr->right);
+        }
+        else if (insert == RBT_left_insert) {
+            bound = ptr;
+            ptr = ptr->left;
+        }
+        else {
+            ptr = ptr->right;
+        }
     }
-    if (link == root() || key !=  value_traits::
-        get_key(link->parent->get_node_ptr()->value)) {
+    STATS::on_search(length);
+    //key is not greater than the bound: equal when the bound is not greater
+    if (bound == _head || !_comp(_key(bound), key)) {
             return TKF::make_pair(TKF::make_pair(link, insert), true);
         }
-    return TKF::make_pair(TKF::make_pair(link, insert), false);
+    return TKF::make_pair(TKF::make_pair(bound, insert), false);
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::iterator RBT<T, COMP>::
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator RBT<T, COMP, ALLOC, POLICY, STATS>::
 _insert_node_at (base_ptr ptr, node_ptr node, RBT_insert_type insert) {
     node->parent = ptr;
     base_ptr base = node->get_base_ptr();
@@ -984,30 +2409,46 @@ _insert_node_at (base_ptr ptr, node_ptr node, RBT_insert_type insert) {
         _head->parent = base;
         _head->right = base;
         _head->left = base;
+        _thread(_head, base);
+        _thread(base, _head);
     }
     else if (insert == RBT_left_insert) {
         ptr->left = base;
         if (min() == ptr) {
             _head->right = base;
         } 
+        if (threaded) {
+            _thread(ptr->get_prev(), base);
+            _thread(base, ptr);
+        }
     }
     else {
         ptr->right = base;
         if (max() == ptr) {
             _head->left = base;
         }
+        if (threaded) {
+            _thread(base, ptr->get_next());
+            _thread(ptr, base);
+        }
+    }
+    if (ranked) {
+        for (base_ptr x = ptr; x != _head; x = x->parent) {
+            x->set_size(x->get_size() + 1);
+        }
     }
     _insert_fix(base);
     ++_num;
     return iterator(node);
 }
 
-template <typename T, typename COMP>
-void RBT<T, COMP>::_left_rotate(base_ptr ptr) noexcept {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_left_rotate(base_ptr ptr) noexcept {
     base_ptr x = ptr, y = ptr->right;
     if (y == nullptr) {
         return;
     }
+    STATS::on_rotate();
     x->right = y->left;
     y->parent = x->parent;
     if(y->left != nullptr) {
@@ -1024,14 +2465,19 @@ void RBT<T, COMP>::_left_rotate(base_ptr ptr) noexcept {
     }
     y->left = x;
     x->parent = y;
+    if (ranked) {
+        y->set_size(x->get_size());
+        x->set_size(_size(x->left) + _size(x->right) + 1);
+    }
 }
 
-template <typename T, typename COMP>
-void RBT<T, COMP>::_right_rotate(base_ptr ptr) noexcept {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_right_rotate(base_ptr ptr) noexcept {
     base_ptr x = ptr, y = ptr->left;
     if (y == nullptr) {
         return;
     }
+    STATS::on_rotate();
     x->left = y->right;
     y->parent = x->parent;
     if (y->right != nullptr) {
@@ -1048,59 +2494,66 @@ void RBT<T, COMP>::_right_rotate(base_ptr ptr) noexcept {
     }
     y->right = x;
     x->parent = y;
+    if (ranked) {
+        y->set_size(x->get_size());
+        x->set_size(_size(x->left) + _size(x->right) + 1);
+    }
 }
 
-template <typename T, typename COMP>
-void RBT<T, COMP>::_insert_fix(base_ptr ptr){
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_insert_fix(base_ptr ptr){
     base_ptr x = ptr, y;
-    while (x->parent->color == RBT_color_red) {
+    while (x != root() && x->parent->color == RBT_color_red) {
         if (x->parent == x->parent->parent->left) {
             y = x->parent->parent->right;
-            if(y != nullptr) {
-                if (y->color == RBT_color_red) {
-                    x->parent->color = RBT_color_black;
-                    x->parent->parent->color = RBT_color_red;
-                    y->color = RBT_color_black;
-                    x = x->parent->parent;
-                }
-            }
-            else if (x == x->parent->right) {
-                x = x->parent;
-                _left_rotate(x);
+            if (y != nullptr && y->color == RBT_color_red) {
+                x->parent->color = RBT_color_black;
+                x->parent->parent->color = RBT_color_red;
+                y->color = RBT_color_black;
+                STATS::on_recolor(3);
+                x = x->parent->parent;
             }
-            if (x != root() && x->parent->parent != _head) {
+            else {
+                if (x == x->parent->right) {
+                    x = x->parent;
+                    _left_rotate(x);
+                }
                 x->parent->color = RBT_color_black;
                 x->parent->parent->color = RBT_color_red;
+                STATS::on_recolor(2);
                 _right_rotate(x->parent->parent);
-            } 
+            }
         } 
         else {
             y = x->parent->parent->left;
-            if(y != nullptr) {
-                if (y->color == RBT_color_red) {
-                    x->parent->color = RBT_color_black;
-                    x->parent->parent->color = RBT_color_red;
-                    y->color = RBT_color_black;
-                    x = x->parent->parent;
-                }
-            }
-            else if (x == x->parent->left) {
-                x = x->parent;
-                _right_rotate(x);
+            if (y != nullptr && y->color == RBT_color_red) {
+                x->parent->color = RBT_color_black;
+                x->parent->parent->color = RBT_color_red;
+                y->color = RBT_color_black;
+                STATS::on_recolor(3);
+                x = x->parent->parent;
             }
-            if (x != root() && x->parent->parent != _head) {
+            else {
+                if (x == x->parent->left) {
+                    x = x->parent;
+                    _right_rotate(x);
+                }
                 x->parent->color = RBT_color_black;
                 x->parent->parent->color = RBT_color_red;
+                STATS::on_recolor(2);
                 _left_rotate(x->parent->parent);
             }
         }
     }
+    if (root()->color == RBT_color_red) {
+        STATS::on_recolor(1);
+    }
     root()->color = RBT_color_black;
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::iterator RBT<T, COMP>::
-_multi_insert_hint (iterator hint, key_type key, node_ptr node) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::iterator RBT<T, COMP, ALLOC, POLICY, STATS>::
+_multi_insert_hint (iterator hint, key_type const& key, node_ptr node) {
     base_ptr ptr = hint.ptr;
     iterator before = hint;
     --before;
@@ -1118,33 +2571,46 @@ _multi_insert_hint (iterator hint, key_type key, node_ptr node) {
     return _insert_node_at(pos.first, node, pos.second);
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::iterator RBT<T, COMP>::
-_unique_insert_hint (iterator hint, key_type key, node_ptr node) {
-    base_ptr ptr = hint.ptr;
-    iterator before = hint;
-    --before;
-    base_ptr bptr = before.ptr;
-    if (!_comp(key, value_traits::get_key(*before)) 
-        && !_comp(value_traits::get_key(*hint), key)) {
+//a right hint is the successor of key: then key goes next to it in O(1),
+//otherwise this is a full search
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+template <typename K>
+TKF::pair<TKF::pair<typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr, bool>, bool>
+RBT<T, COMP, ALLOC, POLICY, STATS>::_unique_hint_pos (iterator hint, K const& key) {
+    typedef TKF::pair<base_ptr, bool> pos_type;
+    if (_num == 0) {
+        return TKF::make_pair(pos_type(_head, RBT_left_insert), true);
+    }
+    if (hint == begin()) {
+        if (!_comp(_key(hint.ptr), key)) {
+            return TKF::make_pair(pos_type(hint.ptr, RBT_left_insert), true);
+        }
+    }
+    else if (hint == end()) {
+        if (!_comp(key, _key(max()))) {
+            return TKF::make_pair(pos_type(max(), RBT_right_insert), true);
+        }
+    }
+    else {
+        base_ptr ptr = hint.ptr;
+        iterator before = hint;
+        --before;
+        base_ptr bptr = before.ptr;
+        if (!_comp(key, _key(bptr)) && !_comp(_key(ptr), key)) {
             if (bptr->right == nullptr) {
-                return _insert_node_at(bptr, node, RBT_right_insert);
+                return TKF::make_pair(pos_type(bptr, RBT_right_insert), true);
             }
             else if (ptr->left == nullptr) {
-                return _insert_node_at(ptr, node, RBT_left_insert);
+                return TKF::make_pair(pos_type(ptr, RBT_left_insert), true);
             }
         }
-    auto pos = _unique_insert_pos(key);
-    if (!pos.second) {
-        _destroy(node);
-        return iterator(pos.first.first);
     }
-    return _insert_node_at(pos.first.first, node, pos.first.second);
+    return _unique_insert_pos(key);
 }
 
-template <typename T, typename COMP>
-typename RBT<T, COMP>::base_ptr 
-RBT<T, COMP>::_copy (base_ptr const& from, base_ptr ptr) const {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr 
+RBT<T, COMP, ALLOC, POLICY, STATS>::_copy (base_ptr const& from, base_ptr ptr) {
     base_ptr link = from;
     base_ptr head = ptr;
     node_ptr _root = _clone(from);
@@ -1173,21 +2639,24 @@ RBT<T, COMP>::_copy (base_ptr const& from, base_ptr ptr) const {
     return _root;
 }
 
-template <typename T, typename COMP>
-void RBT<T, COMP>::_erase_from (base_ptr from) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::size_type
+RBT<T, COMP, ALLOC, POLICY, STATS>::_erase_from (base_ptr from) {
     base_ptr ptr = from;
+    size_type n = 0;
     while (ptr != nullptr) {
-        _erase_from(ptr->right);
+        n += _erase_from(ptr->right);
         base_ptr tmp = ptr->left;
         _destroy(ptr->get_node_ptr());
         ptr = tmp;
+        ++n;
     }
-    return;
+    return n;
 }
 
 
-template <typename T, typename COMP>
-void RBT<T, COMP>::_transplant (base_ptr u, base_ptr v) {
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_transplant (base_ptr u, base_ptr v) {
     if (u->parent == _head) {
         root() = v;
     }
@@ -1202,128 +2671,135 @@ void RBT<T, COMP>::_transplant (base_ptr u, base_ptr v) {
     }
 }
 
-template <typename T, typename COMP>
-void RBT<T, COMP>::_delete_fix (base_ptr ptr){
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_delete_fix (base_ptr ptr, base_ptr parent){
+    //ptr may be a null leaf, so its parent is passed along explicitly
     base_ptr x = ptr, y;
-    while (x != root() && x->color == RBT_color_black) {
-        if (x == x->parent->left) {
-            y = x->parent->right;
-            if (y != nullptr) {
-                if (y->color == RBT_color_red) {
-                    x->parent->color = RBT_color_red;
-                    y->color = RBT_color_black;
-                    _left_rotate(x->parent);
-                    y = x->parent->right;
-                }
-                if (y->left == nullptr && y->right != nullptr) {
-                    if (y->right->color == RBT_color_black) {
-                        y->color = RBT_color_red;
-                        x = x->parent;
-                    }
+    while (x != root() && (x == nullptr || x->color == RBT_color_black)) {
+        if (x == parent->left) {
+            y = parent->right;
+            if (y->color == RBT_color_red) {
+                y->color = RBT_color_black;
+                parent->color = RBT_color_red;
+                STATS::on_recolor(2);
+                _left_rotate(parent);
+                y = parent->right;
+            }
+            if ((y->left == nullptr || y->left->color == RBT_color_black) &&
+                (y->right == nullptr || y->right->color == RBT_color_black)) {
+                    y->color = RBT_color_red;
+                    STATS::on_recolor(1);
+                    x = parent;
+                    parent = x->parent;
                 }
-                else if (y->left != nullptr && y->right != nullptr) {
-                    if (y->left->color == RBT_color_black && y->right->color == RBT_color_black) {
-                        y->color = RBT_color_red;
-                        x = x->parent;
-                    }
-                    else if (y->right->color == RBT_color_black) {
-                        y->color = RBT_color_red;
-                        y->left->color = RBT_color_black;
-                        _right_rotate(y);
-                        y = x->parent->right;
-                    }
+            else {
+                if (y->right == nullptr || y->right->color == RBT_color_black) {
+                    y->left->color = RBT_color_black;
+                    y->color = RBT_color_red;
+                    STATS::on_recolor(2);
+                    _right_rotate(y);
+                    y = parent->right;
                 }
-                y->color = x->parent->color;
+                y->color = parent->color;
+                parent->color = RBT_color_black;
                 if (y->right != nullptr) {
                     y->right->color = RBT_color_black;
                 }
-            }
-            if (x != root()) {
-                x->parent->color = RBT_color_black;
-                _left_rotate(x->parent);
+                STATS::on_recolor(3);
+                _left_rotate(parent);
                 x = root();
             }
         }
         else {
-            y = x->parent->left;
-            if (y != nullptr) {
-                if (y->color == RBT_color_red) {
-                    x->parent->color = RBT_color_red;
-                    y->color = RBT_color_black;
-                    _right_rotate(x->parent);
-                    y = x->parent->left;
-                }
-                if (y->right == nullptr && y->left != nullptr) {
-                    if (y->left->color == RBT_color_black) {
-                        y->color = RBT_color_red;
-                        x = x->parent;
-                    }
+            y = parent->left;
+            if (y->color == RBT_color_red) {
+                y->color = RBT_color_black;
+                parent->color = RBT_color_red;
+                STATS::on_recolor(2);
+                _right_rotate(parent);
+                y = parent->left;
+            }
+            if ((y->right == nullptr || y->right->color == RBT_color_black) &&
+                (y->left == nullptr || y->left->color == RBT_color_black)) {
+                    y->color = RBT_color_red;
+                    STATS::on_recolor(1);
+                    x = parent;
+                    parent = x->parent;
                 }
-                else if (y->right != nullptr && y->left != nullptr) {
-                    if (y->right->color == RBT_color_black && y->left->color == RBT_color_black) {
-                        y->color = RBT_color_red;
-                        x = x->parent;
-                    }
-                    else if (y->left->color == RBT_color_black) {
-                        y->color = RBT_color_red;
-                        y->right->color = RBT_color_black;
-                        _left_rotate(y);
-                        y = x->parent->left;
-                    }
+            else {
+                if (y->left == nullptr || y->left->color == RBT_color_black) {
+                    y->right->color = RBT_color_black;
+                    y->color = RBT_color_red;
+                    STATS::on_recolor(2);
+                    _left_rotate(y);
+                    y = parent->left;
                 }
-                y->color = x->parent->color;
+                y->color = parent->color;
+                parent->color = RBT_color_black;
                 if (y->left != nullptr) {
                     y->left->color = RBT_color_black;
                 }
-            }
-            if (x != root()) {
-                x->parent->color = RBT_color_black;
-                _left_rotate(x->parent);
+                STATS::on_recolor(3);
+                _right_rotate(parent);
                 x = root();
             }
         }
     }
-    x->color = RBT_color_black;
+    if (x != nullptr && x->color == RBT_color_red) {
+        x->color = RBT_color_black;
+        STATS::on_recolor(1);
+    }
 }
 
-template <typename T, typename COMP>
-void RBT<T, COMP>::_erase (base_ptr ptr) {
-    base_ptr x, y = ptr;
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_erase (base_ptr ptr) {
+    base_ptr x, parent, y = ptr;
     RBT_color_type origin = ptr->color;
-    if (ptr->left == nullptr && ptr->right == nullptr) {
+    //min() has no left child and max() no right child
+    if (threaded) {
         if (ptr == min()) {
-            min() = ptr->parent;
+            min() = ptr->get_next();
         }
         if (ptr == max()) {
-            max() = ptr->parent;
+            max() = ptr->get_prev();
         }
-        _transplant(ptr, nullptr);
-        return;
+        _thread(ptr->get_prev(), ptr->get_next());
     }
-    else if (ptr->left == nullptr) {
-        x = ptr->right;
-        _transplant(ptr, ptr->right);
+    else {
         if (ptr == min()) {
-            min() = ptr->right;
+            min() = ptr->right != nullptr ? _minimum(ptr->right) : ptr->parent;
+        }
+        if (ptr == max()) {
+            max() = ptr->left != nullptr ? _maximum(ptr->left) : ptr->parent;
+        }
+    }
+    if (ranked) {
+        //every ancestor of the node that physically leaves loses one
+        base_ptr gone = (ptr->left != nullptr && ptr->right != nullptr) 
+            ? _minimum(ptr->right) : ptr;
+        for (base_ptr z = gone->parent; z != _head; z = z->parent) {
+            z->set_size(z->get_size() - 1);
         }
     }
+    if (ptr->left == nullptr) {
+        x = ptr->right;
+        parent = ptr->parent;
+        _transplant(ptr, ptr->right);
+    }
     else if (ptr->right == nullptr) {
         x = ptr->left;
+        parent = ptr->parent;
         _transplant(ptr, ptr->left);
-        if (ptr == max()) {
-            max() = ptr->left;
-        }
     }
     else {
         y = _minimum(ptr->right);
         x = y->right;
         origin = y->color;
         if (y->parent == ptr) {
-            if (x != nullptr) {
-                x->parent = y;
-            }
+            parent = y;
         }
         else {
+            parent = y->parent;
             _transplant(y, y->right);
             y->right = ptr->right;
             y->right->parent = y;
@@ -1332,12 +2808,455 @@ void RBT<T, COMP>::_erase (base_ptr ptr) {
         y->left = ptr->left;
         y->left->parent = y;
         y->color = ptr->color;
+        y->set_size(ptr->get_size());
     }
     if (origin == RBT_color_black) {
-        _delete_fix(x);
+        _delete_fix(x, parent);
+    }
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::join (RBT&& left, value_type const& value, RBT&& right) {
+    clear();
+    node_ptr node = _create(value);
+    _alloc.absorb(left._alloc);
+    _alloc.absorb(right._alloc);
+    size_type n = left._num + right._num + 1;
+    if (threaded) {
+        //splice the three lists: O(1)
+        base_ptr base = node->get_base_ptr(), last = _head;
+        if (left._num != 0) {
+            _thread(_head, left.min());
+            last = left.max();
+        }
+        _thread(last, base);
+        last = base;
+        if (right._num != 0) {
+            _thread(base, right.min());
+            last = right.max();
+        }
+        _thread(last, _head);
+    }
+    _subtree res = _join(left._detach(), node, right._detach());
+    _attach(res.root, n);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::split (key_type const& key, RBT& left, RBT& right) {
+    left.clear();
+    right.clear();
+    //fresh arenas that only hold on to ours: the halves allocate and free
+    //apart from each other and from this tree
+    left._alloc = node_allocator();
+    right._alloc = node_allocator();
+    left._alloc.absorb(_alloc, true);
+    right._alloc.absorb(_alloc, true);
+    left._comp = right._comp = _comp;
+    size_type n = _num;
+    iterator bound = lower_bound(key);
+    size_type nl = ranked ? 0 : _count_before(bound);
+    //cut the list in front of the bound: O(1)
+    base_ptr first = min(), last = max(), cut = bound.ptr->get_prev();
+    _split_result res = _split(_detach(), key, false);
+    if (ranked) {
+        nl = _size(res.left.root);
+    }
+    left._attach(res.left.root, nl);
+    right._attach(res.right.root, n - nl);
+    if (threaded && nl != 0) {
+        _thread(left._head, first);
+        _thread(cut, left._head);
+    }
+    if (threaded && nl != n) {
+        _thread(right._head, bound.ptr);
+        _thread(last, right._head);
     }
 }
 
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::_subtree
+RBT<T, COMP, ALLOC, POLICY, STATS>::_detach () noexcept {
+    _subtree tree = { root(), _black_height(root()) };
+    root() = nullptr;
+    min() = _head;
+    max() = _head;
+    _thread(_head, _head);
+    _num = 0;
+    return tree;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_attach (base_ptr ptr, size_type n) noexcept {
+    root() = ptr;
+    if (ptr != nullptr) {
+        ptr->color = RBT_color_black;
+        ptr->parent = _head;
+        min() = _minimum(ptr);
+        max() = _maximum(ptr);
+    }
+    else {
+        min() = _head;
+        max() = _head;
+    }
+    _num = n;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::size_type
+RBT<T, COMP, ALLOC, POLICY, STATS>::_destroy_list (_dead_list& dead) {
+    size_type n = 0;
+    for (base_ptr ptr = dead.head; ptr != nullptr; ) {
+        base_ptr next = ptr->parent;
+        n += _erase_from(ptr);
+        ptr = next;
+    }
+    dead.head = dead.tail = nullptr;
+    return n;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::size_type
+RBT<T, COMP, ALLOC, POLICY, STATS>::_black_height (base_ptr ptr) noexcept {
+    size_type height = 0;
+    for (; ptr != nullptr; ptr = ptr->left) {
+        if (ptr->color == RBT_color_black) {
+            ++height;
+        }
+    }
+    return height;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_link (base_ptr ptr, base_ptr left, base_ptr right) noexcept {
+    ptr->left = left;
+    ptr->right = right;
+    if (left != nullptr) {
+        left->parent = ptr;
+    }
+    if (right != nullptr) {
+        right->parent = ptr;
+    }
+    ptr->set_size(_size(left) + _size(right) + 1);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_rotate_left_detached (base_ptr ptr) noexcept {
+    base_ptr y = ptr->right;
+    _link(ptr, ptr->left, y->left);
+    _link(y, ptr, y->right);
+    return y;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_rotate_right_detached (base_ptr ptr) noexcept {
+    base_ptr y = ptr->left;
+    _link(ptr, y->right, ptr->right);
+    _link(y, y->left, ptr);
+    return y;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_join_right (base_ptr left, size_type hl, 
+    base_ptr ptr, base_ptr right, size_type hr) noexcept {
+    //walk down the right spine of the taller left tree to a black node
+    //of right's height, hang ptr there in red and fix red-red on the way up
+    if ((left == nullptr || left->color == RBT_color_black) && hl == hr) {
+        ptr->color = RBT_color_red;
+        _link(ptr, left, right);
+        return ptr;
+    }
+    base_ptr child = _join_right(left->right, 
+        hl - (left->color == RBT_color_black), ptr, right, hr);
+    _link(left, left->left, child);
+    if (left->color == RBT_color_black && child->color == RBT_color_red &&
+        child->right != nullptr && child->right->color == RBT_color_red) {
+        child->right->color = RBT_color_black;
+        return _rotate_left_detached(left);
+    }
+    return left;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_join_left (base_ptr left, size_type hl, 
+    base_ptr ptr, base_ptr right, size_type hr) noexcept {
+    if ((right == nullptr || right->color == RBT_color_black) && hl == hr) {
+        ptr->color = RBT_color_red;
+        _link(ptr, left, right);
+        return ptr;
+    }
+    base_ptr child = _join_left(left, hl, ptr, right->left, 
+        hr - (right->color == RBT_color_black));
+    _link(right, child, right->right);
+    if (right->color == RBT_color_black && child->color == RBT_color_red &&
+        child->left != nullptr && child->left->color == RBT_color_red) {
+        child->left->color = RBT_color_black;
+        return _rotate_right_detached(right);
+    }
+    return right;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::_subtree
+RBT<T, COMP, ALLOC, POLICY, STATS>::_join (_subtree left, base_ptr ptr, _subtree right) noexcept {
+    if (left.height > right.height) {
+        base_ptr root = _join_right(left.root, left.height, ptr, right.root, right.height);
+        if (root->color == RBT_color_red && 
+            root->right != nullptr && root->right->color == RBT_color_red) {
+            root->color = RBT_color_black;
+            return { root, left.height + 1 };
+        }
+        return { root, left.height };
+    }
+    if (left.height < right.height) {
+        base_ptr root = _join_left(left.root, left.height, ptr, right.root, right.height);
+        if (root->color == RBT_color_red && 
+            root->left != nullptr && root->left->color == RBT_color_red) {
+            root->color = RBT_color_black;
+            return { root, right.height + 1 };
+        }
+        return { root, right.height };
+    }
+    _link(ptr, left.root, right.root);
+    if ((left.root == nullptr || left.root->color == RBT_color_black) &&
+        (right.root == nullptr || right.root->color == RBT_color_black)) {
+        ptr->color = RBT_color_red;
+        return { ptr, left.height };
+    }
+    ptr->color = RBT_color_black;
+    return { ptr, left.height + 1 };
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::_subtree
+RBT<T, COMP, ALLOC, POLICY, STATS>::_join2 (_subtree left, _subtree right) noexcept {
+    if (left.root == nullptr) {
+        return right;
+    }
+    auto last = _split_last(left);
+    return _join(last.first, last.second, right);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+TKF::pair<typename RBT<T, COMP, ALLOC, POLICY, STATS>::_subtree,
+    typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr>
+RBT<T, COMP, ALLOC, POLICY, STATS>::_split_last (_subtree tree) noexcept {
+    //tree must not be empty: returns it without its maximum, and the maximum
+    base_ptr ptr = tree.root;
+    size_type height = tree.height - (ptr->color == RBT_color_black);
+    _subtree left = { ptr->left, height };
+    if (ptr->right == nullptr) {
+        return TKF::pair<_subtree, base_ptr>(left, ptr);
+    }
+    _subtree right = { ptr->right, height };
+    auto last = _split_last(right);
+    return TKF::pair<_subtree, base_ptr>(_join(left, ptr, last.first), last.second);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::_split_result
+RBT<T, COMP, ALLOC, POLICY, STATS>::_split (_subtree tree, key_type const& key, bool unique) const {
+    //left gets the keys less than key; an equal key goes to equal when 
+    //unique, to right otherwise
+    if (tree.root == nullptr) {
+        return { { nullptr, 0 }, nullptr, { nullptr, 0 } };
+    }
+    base_ptr ptr = tree.root;
+    size_type height = tree.height - (ptr->color == RBT_color_black);
+    _subtree left = { ptr->left, height };
+    _subtree right = { ptr->right, height };
+    key_type const& cur = value_traits::get_key(ptr->get_node_ptr()->value);
+    if (_comp(key, cur)) {
+        if (unique && _comp(cur, key)) {
+            return { left, ptr, right };
+        }
+        _split_result res = _split(left, key, unique);
+        res.right = _join(res.right, ptr, right);
+        return res;
+    }
+    _split_result res = _split(right, key, unique);
+    res.left = _join(left, ptr, res.left);
+    return res;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::_split_result
+RBT<T, COMP, ALLOC, POLICY, STATS>::_split_upper (_subtree tree, key_type const& key) const {
+    //left gets the keys not greater than key, right the rest
+    if (tree.root == nullptr) {
+        return { { nullptr, 0 }, nullptr, { nullptr, 0 } };
+    }
+    base_ptr ptr = tree.root;
+    size_type height = tree.height - (ptr->color == RBT_color_black);
+    _subtree left = { ptr->left, height };
+    _subtree right = { ptr->right, height };
+    if (_comp(_key(ptr), key)) {
+        _split_result res = _split_upper(right, key);
+        res.left = _join(left, ptr, res.left);
+        return res;
+    }
+    _split_result res = _split_upper(left, key);
+    res.right = _join(res.right, ptr, right);
+    return res;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+void RBT<T, COMP, ALLOC, POLICY, STATS>::_set_operation (RBT& rhs, _set_op op) {
+    if (this == &rhs) {
+        if (op == _op_difference) {
+            clear();
+        }
+        else if (op == _op_merge) {
+            RBT tmp(*this);
+            _set_operation(tmp, op);
+        }
+        return;
+    }
+    _alloc.absorb(rhs._alloc);
+    size_type n = _num + rhs._num;
+    _subtree lhs_tree = _detach();
+    _subtree rhs_tree = rhs._detach();
+    _dead_list dead;
+    _subtree res;
+    //the counters of RBT_stats are not atomic
+    unsigned depth = STATS::enabled ? 0 : TKF::parallel_depth();
+    switch (op) {
+    case _op_union:
+        res = _union(lhs_tree, rhs_tree, true, dead, depth);
+        break;
+    case _op_merge:
+        res = _union(lhs_tree, rhs_tree, false, dead, depth);
+        break;
+    case _op_intersection:
+        res = _intersection(lhs_tree, rhs_tree, dead, depth);
+        break;
+    default:
+        res = _difference(lhs_tree, rhs_tree, dead, depth);
+        break;
+    }
+    _attach(res.root, n);
+    _num -= _destroy_list(dead);
+    _rethread();
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::base_ptr
+RBT<T, COMP, ALLOC, POLICY, STATS>::_thread_from (base_ptr ptr, base_ptr last) noexcept {
+    while (ptr != nullptr) {
+        last = _thread_from(ptr->left, last);
+        _thread(last, ptr);
+        last = ptr;
+        ptr = ptr->right;
+    }
+    return last;
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::_subtree
+RBT<T, COMP, ALLOC, POLICY, STATS>::_union (_subtree lhs, _subtree rhs, bool unique,
+    _dead_list& dead, unsigned depth) const {
+    if (lhs.root == nullptr) {
+        return rhs;
+    }
+    if (rhs.root == nullptr) {
+        return lhs;
+    }
+    base_ptr ptr = lhs.root;
+    size_type height = lhs.height - (ptr->color == RBT_color_black);
+    _subtree lhs_left = { ptr->left, height };
+    _subtree lhs_right = { ptr->right, height };
+    //without unique, rhs's equal keys go right and so after lhs's
+    _split_result parts = _split(rhs, 
+        value_traits::get_key(ptr->get_node_ptr()->value), unique);
+    bool fork = depth > 0 && lhs.height >= _fork_height && rhs.height >= _fork_height;
+    _subtree left, right;
+    _dead_list dead_right;
+    TKF::parallel_invoke(
+        [&] { left = _union(lhs_left, parts.left, unique, dead, depth - fork); },
+        [&] { right = _union(lhs_right, parts.right, unique, dead_right, depth - fork); },
+        fork);
+    dead.splice(dead_right);
+    if (parts.equal != nullptr) {
+        parts.equal->left = parts.equal->right = nullptr;
+        dead.push(parts.equal);
+    }
+    return _join(left, ptr, right);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::_subtree
+RBT<T, COMP, ALLOC, POLICY, STATS>::_intersection (_subtree lhs, _subtree rhs,
+    _dead_list& dead, unsigned depth) const {
+    if (lhs.root == nullptr || rhs.root == nullptr) {
+        if (lhs.root != nullptr) {
+            dead.push(lhs.root);
+        }
+        if (rhs.root != nullptr) {
+            dead.push(rhs.root);
+        }
+        return { nullptr, 0 };
+    }
+    base_ptr ptr = lhs.root;
+    size_type height = lhs.height - (ptr->color == RBT_color_black);
+    _subtree lhs_left = { ptr->left, height };
+    _subtree lhs_right = { ptr->right, height };
+    _split_result parts = _split(rhs, 
+        value_traits::get_key(ptr->get_node_ptr()->value), true);
+    bool fork = depth > 0 && lhs.height >= _fork_height && rhs.height >= _fork_height;
+    _subtree left, right;
+    _dead_list dead_right;
+    TKF::parallel_invoke(
+        [&] { left = _intersection(lhs_left, parts.left, dead, depth - fork); },
+        [&] { right = _intersection(lhs_right, parts.right, dead_right, depth - fork); },
+        fork);
+    dead.splice(dead_right);
+    if (parts.equal != nullptr) {
+        parts.equal->left = parts.equal->right = nullptr;
+        dead.push(parts.equal);
+        return _join(left, ptr, right);
+    }
+    ptr->left = ptr->right = nullptr;
+    dead.push(ptr);
+    return _join2(left, right);
+}
+
+template <typename T, typename COMP, typename ALLOC, typename POLICY, typename STATS>
+typename RBT<T, COMP, ALLOC, POLICY, STATS>::_subtree
+RBT<T, COMP, ALLOC, POLICY, STATS>::_difference (_subtree lhs, _subtree rhs,
+    _dead_list& dead, unsigned depth) const {
+    if (lhs.root == nullptr || rhs.root == nullptr) {
+        if (rhs.root != nullptr) {
+            dead.push(rhs.root);
+        }
+        return lhs;
+    }
+    //split lhs around rhs's root, which is dropped together with its match
+    base_ptr ptr = rhs.root;
+    size_type height = rhs.height - (ptr->color == RBT_color_black);
+    _subtree rhs_left = { ptr->left, height };
+    _subtree rhs_right = { ptr->right, height };
+    _split_result parts = _split(lhs, 
+        value_traits::get_key(ptr->get_node_ptr()->value), true);
+    bool fork = depth > 0 && lhs.height >= _fork_height && rhs.height >= _fork_height;
+    _subtree left, right;
+    _dead_list dead_right;
+    TKF::parallel_invoke(
+        [&] { left = _difference(parts.left, rhs_left, dead, depth - fork); },
+        [&] { right = _difference(parts.right, rhs_right, dead_right, depth - fork); },
+        fork);
+    dead.splice(dead_right);
+    ptr->left = ptr->right = nullptr;
+    dead.push(ptr);
+    if (parts.equal != nullptr) {
+        parts.equal->left = parts.equal->right = nullptr;
+        dead.push(parts.equal);
+    }
+    return _join2(left, right);
+}
+
 }
 
 #endif // !RB_TREE_H
\ No newline at end of file
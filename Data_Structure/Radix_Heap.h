@@ -0,0 +1,330 @@
+//file: Radix_Heap.h
+#ifndef RADIX_HEAP_H
+#define RADIX_HEAP_H
+
+#include<limits>
+#include<vector>
+#include<cstddef>
+#include<type_traits>
+#include"Allocator.h"
+#include"Algorithm.h"
+#include"Utility.h"
+#include"Fibonacci_Heap.h"
+#include"Dary_Heap.h"
+
+namespace TKF {
+
+//whether KEY in COMP order can go in the buckets of RadixHeap and
+//DialQueue: an unsigned integer ordered by TKF::less
+template <typename KEY, typename COMP>
+struct monotone_key {
+    static constexpr bool value = std::is_integral<KEY>::value &&
+        std::is_unsigned<KEY>::value && !std::is_same<KEY, bool>::value &&
+        std::is_same<COMP, TKF::less<KEY> >::value;
+};
+
+//radix heap, for priority_queue's HEAP when no key pushed is below the
+//last one popped, as in Dijkstra or a timer wheel. Bucket 0 holds the
+//keys equal to the last popped, bucket i those whose highest bit apart
+//from it is bit i - 1. A pop from an empty bucket 0 takes the lowest
+//other bucket, makes its least key the last and spreads it over lower
+//buckets; a value moves down at most once per bit, so push is O(1) and
+//pop O(log C) amortized for keys below C. No handles: lower a key by
+//pushing it again and skipping the stale value when it comes out. A key
+//below the last popped is refused, insert returns false.
+template <typename T, typename COMP = TKF::less<typename FIBH_value_traits<T>::key_type> >
+class RadixHeap {
+public:
+    typedef FIBH_value_traits<T>                value_traits;
+    typedef typename value_traits::key_type     key_type;
+    typedef typename value_traits::value_type   value_type;
+    //no handles: priority_queue::push gives back insert's bool instead
+    typedef void                                handle;
+
+    typedef COMP    key_compare;
+
+    typedef TKF::allocator<T>                   data_allocator;
+
+    typedef typename data_allocator::pointer        pointer;
+    typedef typename data_allocator::const_pointer  const_pointer;
+    typedef typename data_allocator::reference      reference;
+    typedef typename data_allocator::const_reference const_reference;
+    typedef typename data_allocator::size_type      size_type;
+    typedef typename data_allocator::difference_type difference_type;
+
+    static_assert(monotone_key<key_type, COMP>::value,
+        "RadixHeap needs unsigned integer keys in TKF::less order");
+
+    key_compare key_comp() const { return COMP(); }
+
+private:
+    static constexpr unsigned _buckets = std::numeric_limits<key_type>::digits + 1;
+
+    //top() moves values down, so the buckets are mutable
+    mutable std::vector<T>  _bucket[_buckets];
+    mutable key_type        _last;
+    size_type               _num;
+
+public:
+    RadixHeap() : _last(0), _num(0) {}
+
+    explicit RadixHeap(COMP const&) : _last(0), _num(0) {}
+
+    void swap(RadixHeap& rhs) noexcept {
+        for (unsigned i = 0; i < _buckets; ++i) {
+            _bucket[i].swap(rhs._bucket[i]);
+        }
+        std::swap(_last, rhs._last);
+        std::swap(_num, rhs._num);
+    }
+
+    const_reference top_value() const {
+        _refill();
+        return _bucket[0].back();
+    }
+
+    //the least key a push may have
+    key_type last_key() const noexcept {
+        return _last;
+    }
+
+    bool empty() const noexcept {
+        return _num == 0;
+    }
+
+    size_type size() const noexcept {
+        return _num;
+    }
+
+    size_type max_size() const noexcept {
+        return static_cast<size_type>(-1) / sizeof(T);
+    }
+
+    template <typename ...Args>
+    bool emplace(Args&& ...args) {
+        T value(TKF::forward<Args>(args)...);
+        return insert(TKF::move(value));
+    }
+
+    bool insert(value_type const& value) {
+        return _push(value);
+    }
+
+    bool insert(value_type&& value) {
+        return _push(TKF::move(value));
+    }
+
+
+    void pop() {
+        _refill();
+        _bucket[0].pop_back();
+        --_num;
+    }
+
+    //keeps the bucket memory; pushes start over from key 0
+    void clear() noexcept {
+        for (unsigned i = 0; i < _buckets; ++i) {
+            _bucket[i].clear();
+        }
+        _last = 0;
+        _num = 0;
+    }
+
+private:
+    template <typename V>
+    bool _push(V&& value) {
+        key_type key = value_traits::get_key(value);
+        if (key < _last) {
+            return false;
+        }
+        _bucket[_index(key)].push_back(TKF::forward<V>(value));
+        ++_num;
+        return true;
+    }
+
+    unsigned _index(key_type key) const noexcept {
+        return key == _last ? 0 : TKF::floor_log2(key ^ _last) + 1;
+    }
+
+    void _refill() const {
+        if (!_bucket[0].empty()) {
+            return;
+        }
+        unsigned i = 1;
+        while (_bucket[i].empty()) {
+            ++i;
+        }
+        std::vector<T>& from = _bucket[i];
+        key_type least = value_traits::get_key(from[0]);
+        for (size_type j = 1; j < from.size(); ++j) {
+            key_type key = value_traits::get_key(from[j]);
+            least = key < least ? key : least;
+        }
+        _last = least;
+        for (size_type j = 0; j < from.size(); ++j) {
+            _bucket[_index(value_traits::get_key(from[j]))].push_back(TKF::move(from[j]));
+        }
+        from.clear();
+    }
+};
+
+//Dial's bucket queue, for priority_queue's HEAP when no key pushed is
+//below the last popped and the keys waiting span a small range, like
+//distances in Dijkstra with small integer weights. One bucket per key in
+//a ring that covers [last, last + buckets); a pop walks forward to the
+//next full one, so pushes and pops are O(1) and all the walking adds up
+//to the largest key. A key past the ring doubles it. No handles, and
+//keys below the last popped are refused, as for RadixHeap.
+template <typename T, typename COMP = TKF::less<typename FIBH_value_traits<T>::key_type> >
+class DialQueue {
+public:
+    typedef FIBH_value_traits<T>                value_traits;
+    typedef typename value_traits::key_type     key_type;
+    typedef typename value_traits::value_type   value_type;
+    //no handles: priority_queue::push gives back insert's bool instead
+    typedef void                                handle;
+
+    typedef COMP    key_compare;
+
+    typedef TKF::allocator<T>                   data_allocator;
+
+    typedef typename data_allocator::pointer        pointer;
+    typedef typename data_allocator::const_pointer  const_pointer;
+    typedef typename data_allocator::reference      reference;
+    typedef typename data_allocator::const_reference const_reference;
+    typedef typename data_allocator::size_type      size_type;
+    typedef typename data_allocator::difference_type difference_type;
+
+    static_assert(monotone_key<key_type, COMP>::value,
+        "DialQueue needs unsigned integer keys in TKF::less order");
+
+    key_compare key_comp() const { return COMP(); }
+
+private:
+    mutable std::vector<std::vector<T> >    _bucket;    //size a power of 2
+    mutable key_type                        _last;
+    size_type                               _num;
+
+public:
+    DialQueue() : _bucket(64), _last(0), _num(0) {}
+
+    explicit DialQueue(COMP const&) : _bucket(64), _last(0), _num(0) {}
+
+    //range: how far apart the keys waiting may be, the largest weight
+    //plus one in Dijkstra; more only costs a doubling
+    explicit DialQueue(size_type range, COMP const& = COMP()) : _last(0), _num(0) {
+        _bucket.resize(_ring(range));
+    }
+
+    void swap(DialQueue& rhs) noexcept {
+        _bucket.swap(rhs._bucket);
+        std::swap(_last, rhs._last);
+        std::swap(_num, rhs._num);
+    }
+
+    const_reference top_value() const {
+        _advance();
+        return _bucket[_last & (_bucket.size() - 1)].back();
+    }
+
+    key_type last_key() const noexcept {
+        return _last;
+    }
+
+    bool empty() const noexcept {
+        return _num == 0;
+    }
+
+    size_type size() const noexcept {
+        return _num;
+    }
+
+    size_type max_size() const noexcept {
+        return static_cast<size_type>(-1) / sizeof(T);
+    }
+
+    template <typename ...Args>
+    bool emplace(Args&& ...args) {
+        T value(TKF::forward<Args>(args)...);
+        return insert(TKF::move(value));
+    }
+
+    bool insert(value_type const& value) {
+        return _push(value);
+    }
+
+    bool insert(value_type&& value) {
+        return _push(TKF::move(value));
+    }
+
+
+    void pop() {
+        _advance();
+        _bucket[_last & (_bucket.size() - 1)].pop_back();
+        --_num;
+    }
+
+    void clear() noexcept {
+        for (size_type i = 0; i < _bucket.size(); ++i) {
+            _bucket[i].clear();
+        }
+        _last = 0;
+        _num = 0;
+    }
+
+private:
+    template <typename V>
+    bool _push(V&& value) {
+        key_type key = value_traits::get_key(value);
+        if (key < _last) {
+            return false;
+        }
+        if (key - _last >= _bucket.size()) {
+            _grow(static_cast<size_type>(key - _last) + 1);
+        }
+        _bucket[key & (_bucket.size() - 1)].push_back(TKF::forward<V>(value));
+        ++_num;
+        return true;
+    }
+
+    static size_type _ring(size_type range) {
+        return range <= 1 ? 1 : size_type(2) << TKF::floor_log2(range - 1);
+    }
+
+    void _advance() const {
+        size_type mask = _bucket.size() - 1;
+        while (_bucket[_last & mask].empty()) {
+            ++_last;
+        }
+    }
+
+    void _grow(size_type range) {
+        std::vector<std::vector<T> > bucket(_ring(range));
+        size_type mask = bucket.size() - 1;
+        for (size_type i = 0; i < _bucket.size(); ++i) {
+            for (size_type j = 0; j < _bucket[i].size(); ++j) {
+                T& value = _bucket[i][j];
+                bucket[value_traits::get_key(value) & mask].push_back(TKF::move(value));
+            }
+        }
+        _bucket.swap(bucket);
+    }
+};
+
+//the engine for a priority_queue whose keys never go below the last one
+//popped: RadixHeap for unsigned integer keys in TKF::less order, or
+//DialQueue when SMALL_RANGE says the keys waiting are never far apart;
+//DaryHeap for any other key, which takes every order
+template <typename T, typename COMP = TKF::less<typename FIBH_value_traits<T>::key_type>,
+    bool SMALL_RANGE = false>
+struct monotone_heap {
+    typedef typename FIBH_value_traits<T>::key_type key_type;
+    typedef typename std::conditional<!monotone_key<key_type, COMP>::value,
+        DaryHeap<T, COMP, 4>,
+        typename std::conditional<SMALL_RANGE, DialQueue<T, COMP>, RadixHeap<T, COMP> >::type
+        >::type type;
+};
+
+}
+
+#endif //!RADIX_HEAP_H
\ No newline at end of file
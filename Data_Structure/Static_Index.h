@@ -0,0 +1,318 @@
+//file: Static_Index.h
+#ifndef STATIC_INDEX_H
+#define STATIC_INDEX_H
+
+#include<new>
+#include<vector>
+#include<cstddef>
+#include<cstdint>
+#include"Allocator.h"
+#include"Algorithm.h"
+#include"Utility.h"
+#include"Flat_Table.h"
+
+namespace TKF {
+
+//how the search keys of a static_index are laid out.
+//Eytzinger: the implicit binary search tree in BFS order, node i has its
+//children at 2i and 2i + 1; the four levels below i share one cache line
+//for small keys, fetched ahead while the upper levels are compared.
+//van Emde Boas: the tree cut in half by height, the top half laid out
+//first and then each bottom half, recursively; every subtree of about
+//sqrt(n) nodes is contiguous, whatever the cache line or page size.
+enum static_layout { static_eytzinger, static_veb };
+
+//read-only ordered index, made by map::freeze(): the search runs over a
+//copy of the keys in one of the layouts above, padded to a complete tree
+//so that every lookup takes the same number of steps and no branch
+//depends on a comparison. Elements are kept in key order next to it,
+//which is what iterators walk and what a search returns into.
+template <typename KEY, typename T, typename COMP = less<KEY>,
+    static_layout LAYOUT = static_eytzinger,
+    typename ALLOC = TKF::allocator<TKF::pair<KEY, T> > >
+class static_index {
+private:
+    typedef TKF::FlatTable<KEY, T, COMP, ALLOC>      table_type;
+
+public:
+    typedef KEY                                     key_type;
+    typedef T                                       map_type;
+    typedef TKF::pair<KEY, T>                       value_type;
+    typedef COMP                                    key_compare;
+    typedef typename table_type::iterator           iterator;
+    typedef typename table_type::reverse_iterator   reverse_iterator;
+    typedef typename table_type::reference          reference;
+    typedef typename table_type::pointer            pointer;
+    typedef typename table_type::size_type          size_type;
+    typedef typename table_type::difference_type    difference_type;
+
+    static constexpr static_layout layout = LAYOUT;
+
+private:
+    //the van Emde Boas split that makes depth d the root of a bottom
+    //tree: root is the depth of the root of the tree that was split,
+    //top and bottom the sizes of its top and of each bottom tree
+    struct _level {
+        unsigned    root;
+        size_type   top;
+        size_type   bottom;
+    };
+
+    static constexpr unsigned _max_height = 64;
+    //levels below a node whose Eytzinger children fit in a cache line
+    static constexpr size_type _stride =
+        cache_line_size / sizeof(KEY) == 0 ? 1 : cache_line_size / sizeof(KEY);
+
+    table_type  _table;
+    void*       _raw;
+    KEY*        _index;     //Eytzinger: [1, 2^h), vEB: [0, 2^h - 1)
+    size_type   _slots;
+    unsigned    _height;
+    COMP        _comp;
+    _level      _levels[_max_height];
+
+public:
+    static_index() : _raw(nullptr), _index(nullptr), _slots(0), _height(0), _comp(),
+        _levels() {}
+
+    //n elements in key order
+    template <typename ITER>
+    static_index(ITER first, size_type n, COMP const& comp = COMP())
+        : _table(comp), _raw(nullptr), _index(nullptr), _slots(0), _height(0), 
+        _comp(comp), _levels() {
+        _table.build_from_sorted(first, n, false);
+        _build();
+    }
+
+    static_index(static_index const& rhs)
+        : _table(rhs._table), _raw(nullptr), _index(nullptr), _slots(0), _height(0),
+        _comp(rhs._comp), _levels() {
+        _build();
+    }
+
+    static_index(static_index&& rhs)
+        : _table(TKF::move(rhs._table)), _raw(rhs._raw), _index(rhs._index),
+        _slots(rhs._slots), _height(rhs._height), _comp(rhs._comp) {
+        for (unsigned d = 0; d < _max_height; ++d) {
+            _levels[d] = rhs._levels[d];
+        }
+        rhs._raw = nullptr;
+        rhs._index = nullptr;
+        rhs._slots = 0;
+        rhs._height = 0;
+    }
+
+    static_index& operator = (static_index rhs) {
+        swap(rhs);
+        return *this;
+    }
+
+    ~static_index() {
+        _free();
+    }
+
+    void swap(static_index& rhs) {
+        _table.swap(rhs._table);
+        std::swap(_raw, rhs._raw);
+        std::swap(_index, rhs._index);
+        std::swap(_slots, rhs._slots);
+        std::swap(_height, rhs._height);
+        std::swap(_comp, rhs._comp);
+        for (unsigned d = 0; d < _max_height; ++d) {
+            std::swap(_levels[d], rhs._levels[d]);
+        }
+    }
+
+    key_compare key_comp() const {
+        return _comp;
+    }
+
+    iterator begin() const noexcept {
+        return _table.begin();
+    }
+
+    iterator end() const noexcept {
+        return _table.end();
+    }
+
+    reverse_iterator rbegin() const noexcept {
+        return _table.rbegin();
+    }
+
+    reverse_iterator rend() const noexcept {
+        return _table.rend();
+    }
+
+    bool empty() const noexcept {
+        return _table.empty();
+    }
+
+    size_type size() const noexcept {
+        return _table.size();
+    }
+
+    map_type& at (key_type const& key) const {
+        iterator iter = find(key);
+        THROW_OUT_OF_RANGE_IF(iter == end(), "static_index<KEY, T> has no such element");
+        return iter->second;
+    }
+
+    iterator lower_bound (key_type const& key) const {
+        return begin() + _search<false>(key);
+    }
+
+    iterator upper_bound (key_type const& key) const {
+        return begin() + _search<true>(key);
+    }
+
+    iterator find (key_type const& key) const {
+        size_type i = _search<false>(key);
+        return i < size() && _comp(_table.keys()[i], key) ? begin() + i : end();
+    }
+
+    size_type count (key_type const& key) const {
+        return _search<true>(key) - _search<false>(key);
+    }
+
+    TKF::pair<iterator, iterator> equal_range (key_type const& key) const {
+        return TKF::make_pair(lower_bound(key), upper_bound(key));
+    }
+
+private:
+    //UPPER: first element with key < element, else key <= element;
+    //both descend all the levels and turn the last step into a rank
+    template <bool UPPER>
+    size_type _search(key_type const& key) const {
+        if (_height == 0) {
+            return 0;
+        }
+        size_type i = 1;
+        if (LAYOUT == static_eytzinger) {
+            for (unsigned d = 0; d < _height; ++d) {
+                TKF::prefetch(_index + i * _stride);
+                i = 2 * i + _right<UPPER>(_index[i], key);
+            }
+        }
+        else {
+            size_type pos[_max_height];
+            pos[0] = 0;
+            for (unsigned d = 0; d < _height; ++d) {
+                i = 2 * i + _right<UPPER>(_index[pos[d]], key);
+                if (d + 1 < _height) {
+                    _level const& level = _levels[d + 1];
+                    pos[d + 1] = pos[level.root] + level.top + (i & level.top) * level.bottom;
+                }
+            }
+        }
+        return _rank(i);
+    }
+
+    //whether the search goes on right of node
+    template <bool UPPER>
+    bool _right(KEY const& node, key_type const& key) const {
+        return UPPER ? _comp(node, key) : !_comp(key, node);
+    }
+
+    //i is the BFS index below the last level the search reached; the
+    //answer is the last node it went left at, i with the trailing right
+    //turns and that left turn shifted out. In a complete tree the
+    //in-order rank of node j on depth d follows from j alone.
+    size_type _rank(size_type i) const {
+        size_type j = i >> (TKF::count_trailing_zeros(~(unsigned long long)i) + 1);
+        if (j == 0) {
+            return size();
+        }
+        size_type r = _inorder(j);
+        return r < size() ? r : size();
+    }
+
+    size_type _inorder(size_type j) const {
+        unsigned d = TKF::floor_log2(j);
+        size_type k = j - (size_type(1) << d);
+        return ((2 * k + 1) << (_height - 1 - d)) - 1;
+    }
+
+    //the key the complete tree has at BFS index j; the padding past the
+    //last element repeats the largest key, which no search stops at
+    //before the real one
+    KEY const& _key_at(size_type j) const {
+        size_type r = _inorder(j);
+        return _table.keys()[r < size() ? r : size() - 1];
+    }
+
+    void _split(unsigned depth, unsigned height) {
+        if (height <= 1) {
+            return;
+        }
+        unsigned top = height / 2;
+        unsigned bottom = height - top;
+        _level& level = _levels[depth + top];
+        level.root = depth;
+        level.top = (size_type(1) << top) - 1;
+        level.bottom = (size_type(1) << bottom) - 1;
+        _split(depth, top);
+        _split(depth + top, bottom);
+    }
+
+    void _build() {
+        size_type n = size();
+        if (n == 0) {
+            return;
+        }
+        _height = TKF::floor_log2(n) + 1;
+        _raw = ::operator new(sizeof(KEY) * ((size_type(1) << _height) + 1) + cache_line_size);
+        _index = reinterpret_cast<KEY*>((reinterpret_cast<uintptr_t>(_raw) +
+            cache_line_size - 1) & ~static_cast<uintptr_t>(cache_line_size - 1));
+        try {
+            _fill();
+        }
+        catch (...) {
+            _free();
+            throw;
+        }
+    }
+
+    void _fill() {
+        size_type m = (size_type(1) << _height) - 1;
+        if (LAYOUT == static_eytzinger) {
+            for (size_type j = 1; j <= m; ++j) {
+                ::new ((void*)(_index + j)) KEY(_key_at(j));
+                ++_slots;
+            }
+            return;
+        }
+        _split(0, _height);
+        std::vector<size_type> pos(m + 1);
+        pos[1] = 0;
+        for (size_type j = 2; j <= m; ++j) {
+            unsigned d = TKF::floor_log2(j);
+            _level const& level = _levels[d];
+            pos[j] = pos[j >> (d - level.root)] + level.top + (j & level.top) * level.bottom;
+        }
+        //constructed in position order, so that _slots counts a prefix
+        std::vector<size_type> node(m);
+        for (size_type j = 1; j <= m; ++j) {
+            node[pos[j]] = j;
+        }
+        for (size_type p = 0; p < m; ++p) {
+            ::new ((void*)(_index + p)) KEY(_key_at(node[p]));
+            ++_slots;
+        }
+    }
+
+    void _free() noexcept {
+        size_type first = LAYOUT == static_eytzinger ? 1 : 0;
+        for (size_type p = first; p < first + _slots; ++p) {
+            _index[p].~KEY();
+        }
+        ::operator delete(_raw);
+        _raw = nullptr;
+        _index = nullptr;
+        _slots = 0;
+        _height = 0;
+    }
+};
+
+}
+
+#endif //!STATIC_INDEX_H
\ No newline at end of file
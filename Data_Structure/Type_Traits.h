@@ -93,6 +93,39 @@ struct _is_integral_helper<long long> : public true_type{};
 template <>
 struct _is_integral_helper<int> : public true_type{};
 
+template <>
+struct _is_integral_helper<signed char> : public true_type{};
+
+template <>
+struct _is_integral_helper<unsigned char> : public true_type{};
+
+template <>
+struct _is_integral_helper<short> : public true_type{};
+
+template <>
+struct _is_integral_helper<unsigned short> : public true_type{};
+
+template <>
+struct _is_integral_helper<unsigned int> : public true_type{};
+
+template <>
+struct _is_integral_helper<long> : public true_type{};
+
+template <>
+struct _is_integral_helper<unsigned long> : public true_type{};
+
+template <>
+struct _is_integral_helper<unsigned long long> : public true_type{};
+
+template <>
+struct _is_integral_helper<wchar_t> : public true_type{};
+
+template <>
+struct _is_integral_helper<char16_t> : public true_type{};
+
+template <>
+struct _is_integral_helper<char32_t> : public true_type{};
+
 template <typename _Tp>
 struct is_integral : public _is_integral_helper<typename rmv_cv<_Tp>::type>::type{};
 
@@ -108,6 +141,31 @@ struct is_volatile : public false_type{};
 template <typename _Tp>
 struct is_volatile<_Tp volatile> : public true_type{};
 
+template <typename _Tp1, typename _Tp2>
+struct is_same : public false_type{};
+
+template <typename _Tp>
+struct is_same<_Tp, _Tp> : public true_type{};
+
+//only for unevaluated operands such as decltype
+template <typename _Tp>
+_Tp&& declval() noexcept;
+
+//void for every well-formed _Tp, to detect members by SFINAE
+template <typename _Tp>
+struct void_type {
+    typedef void type;
+};
+
+//comparators that declare is_transparent accept any key type they can
+//compare, which enables heterogeneous lookup in the trees
+template <typename _Tp, typename = void>
+struct is_transparent : public false_type{};
+
+template <typename _Tp>
+struct is_transparent<_Tp, typename void_type<typename _Tp::is_transparent>::type> 
+    : public true_type{};
+
 }
 
 #endif //!TYPE_TRAITS_H
\ No newline at end of file
@@ -0,0 +1,369 @@
+//file: Unordered_Map.h
+#ifndef UNORDERED_MAP_H
+#define UNORDERED_MAP_H
+
+#include<tuple>
+#include<functional>
+#include"Hash_Table.h"
+#include"Utility.h"
+
+namespace TKF {
+
+//same interface as map without the order: O(1) lookups on a HashTable,
+//for keys that are only ever looked up. No lower_bound or rank; iteration
+//goes in slot order. Inserting may rehash and erasing moves elements, so
+//both invalidate iterators.
+template <typename KEY, typename T, typename HASH = std::hash<KEY>,
+    typename EQUAL = std::equal_to<KEY>,
+    typename ALLOC = TKF::allocator<TKF::pair<KEY, T> > >
+class unordered_map {
+private:
+    typedef TKF::HashTable<KEY, T, HASH, EQUAL, ALLOC> base_type;
+    base_type _table;
+
+public:
+    typedef KEY                                     key_type;
+    typedef T                                       map_type;
+    typedef TKF::pair<KEY, T>                       value_type;
+    typedef HASH                                    hasher;
+    typedef EQUAL                                   key_equal;
+    typedef typename base_type::allocator_type      allocator_type;
+    typedef typename base_type::iterator            iterator;
+    typedef typename base_type::reference           reference;
+    typedef typename base_type::pointer             pointer;
+    typedef typename base_type::size_type           size_type;
+    typedef typename base_type::difference_type     difference_type;
+
+public:
+    unordered_map() : _table() {}
+
+    explicit unordered_map(size_type n, HASH const& hash = HASH(),
+        EQUAL const& equal = EQUAL()) : _table(hash, equal) {
+        _table.reserve(n);
+    }
+
+    template <typename ITER>
+    unordered_map(ITER first, ITER last) : _table() {
+        _table.insert(first, last);
+    }
+
+    unordered_map(unordered_map const& rhs) : _table(rhs._table) {}
+
+    unordered_map(unordered_map&& rhs) : _table(TKF::move(rhs._table)) {}
+
+    unordered_map& operator = (unordered_map const& rhs) {
+        _table = rhs._table;
+        return *this;
+    }
+
+    unordered_map& operator = (unordered_map&& rhs) {
+        _table = TKF::move(rhs._table);
+        return *this;
+    }
+
+    ~unordered_map() = default;
+
+    //API
+    hasher hash_function() const {
+        return _table.hash_function();
+    }
+
+    key_equal key_eq() const {
+        return _table.key_eq();
+    }
+
+    allocator_type get_allocator() const {
+        return _table.get_allocator();
+    }
+
+    //Iterator
+    iterator begin() const noexcept {
+        return _table.begin();
+    }
+
+    iterator end() const noexcept {
+        return _table.end();
+    }
+
+    bool empty() const noexcept {
+        return _table.empty();
+    }
+
+    size_type size() const noexcept {
+        return _table.size();
+    }
+
+    size_type max_size() const noexcept {
+        return _table.max_size();
+    }
+
+    size_type capacity() const noexcept {
+        return _table.capacity();
+    }
+
+    double load_factor() const noexcept {
+        return _table.load_factor();
+    }
+
+    void reserve (size_type n) {
+        _table.reserve(n);
+    }
+
+    map_type& at (key_type const& key) const {
+        iterator iter = _table.find(key);
+        THROW_OUT_OF_RANGE_IF(iter == end(), "unordered_map<KEY, T> has no such element");
+        return iter->second;
+    }
+
+    map_type& operator [] (key_type const& key) {
+        return try_emplace(key).first->second;
+    }
+
+    map_type& operator [] (key_type&& key) {
+        return try_emplace(TKF::move(key)).first->second;
+    }
+
+    //search first: on a hit nothing is built and args are not moved from,
+    //on a miss the mapped value is built in place from args
+    template <typename ...Args>
+    TKF::pair<iterator, bool> try_emplace (key_type const& key, Args&&... args) {
+        return _table.emplace_key(key, TKF::piecewise_construct,
+            std::forward_as_tuple(key),
+            std::forward_as_tuple(TKF::forward<Args>(args)...));
+    }
+
+    template <typename ...Args>
+    TKF::pair<iterator, bool> try_emplace (key_type&& key, Args&&... args) {
+        return _table.emplace_key(key, TKF::piecewise_construct,
+            std::forward_as_tuple(TKF::move(key)),
+            std::forward_as_tuple(TKF::forward<Args>(args)...));
+    }
+
+    //assigns obj to the mapped value of key, inserting key if missing
+    template <typename M>
+    TKF::pair<iterator, bool> insert_or_assign (key_type const& key, M&& obj) {
+        auto res = try_emplace(key, TKF::forward<M>(obj));
+        if (!res.second) {
+            res.first->second = TKF::forward<M>(obj);
+        }
+        return res;
+    }
+
+    template <typename M>
+    TKF::pair<iterator, bool> insert_or_assign (key_type&& key, M&& obj) {
+        auto res = try_emplace(TKF::move(key), TKF::forward<M>(obj));
+        if (!res.second) {
+            res.first->second = TKF::forward<M>(obj);
+        }
+        return res;
+    }
+
+    template <typename ...Args>
+    TKF::pair<iterator, bool> emplace (Args&&... args) {
+        return _table.emplace(TKF::forward<Args>(args)...);
+    }
+
+    TKF::pair<iterator, bool> insert (value_type const& value) {
+        return _table.emplace_key(value.first, value);
+    }
+
+    TKF::pair<iterator, bool> insert (value_type&& value) {
+        return _table.emplace_key(value.first, TKF::move(value));
+    }
+
+    template <typename ITER>
+    void insert (ITER const& first, ITER const& last) {
+        _table.insert(first, last);
+    }
+
+    void erase (iterator iter) {
+        _table.erase(iter);
+    }
+
+    size_type erase (key_type const& key) {
+        return _table.erase(key);
+    }
+
+    void clear () {
+        _table.clear();
+    }
+
+    iterator find (key_type const& key) const {
+        return _table.find(key);
+    }
+
+    size_type count (key_type const& key) const {
+        return _table.count(key);
+    }
+
+    TKF::pair<iterator, iterator> equal_range (key_type const& key) const {
+        return _table.equal_range(key);
+    }
+
+    void swap (unordered_map& rhs) {
+        _table.swap(rhs._table);
+    }
+
+    friend bool operator == (unordered_map const& lhs, unordered_map const& rhs) {
+        return lhs._table == rhs._table;
+    }
+
+    friend bool operator != (unordered_map const& lhs, unordered_map const& rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+//the keys of an unordered_map alone; iterators give KEY const&
+template <typename KEY, typename HASH = std::hash<KEY>,
+    typename EQUAL = std::equal_to<KEY>,
+    typename ALLOC = TKF::allocator<KEY> >
+class unordered_set {
+private:
+    typedef TKF::HashTable<KEY, void, HASH, EQUAL, ALLOC> base_type;
+    base_type _table;
+
+public:
+    typedef KEY                                     key_type;
+    typedef KEY                                     value_type;
+    typedef HASH                                    hasher;
+    typedef EQUAL                                   key_equal;
+    typedef typename base_type::allocator_type      allocator_type;
+    typedef typename base_type::iterator            iterator;
+    typedef typename base_type::reference           reference;
+    typedef typename base_type::pointer             pointer;
+    typedef typename base_type::size_type           size_type;
+    typedef typename base_type::difference_type     difference_type;
+
+public:
+    unordered_set() : _table() {}
+
+    explicit unordered_set(size_type n, HASH const& hash = HASH(),
+        EQUAL const& equal = EQUAL()) : _table(hash, equal) {
+        _table.reserve(n);
+    }
+
+    template <typename ITER>
+    unordered_set(ITER first, ITER last) : _table() {
+        _table.insert(first, last);
+    }
+
+    unordered_set(unordered_set const& rhs) : _table(rhs._table) {}
+
+    unordered_set(unordered_set&& rhs) : _table(TKF::move(rhs._table)) {}
+
+    unordered_set& operator = (unordered_set const& rhs) {
+        _table = rhs._table;
+        return *this;
+    }
+
+    unordered_set& operator = (unordered_set&& rhs) {
+        _table = TKF::move(rhs._table);
+        return *this;
+    }
+
+    ~unordered_set() = default;
+
+    //API
+    hasher hash_function() const {
+        return _table.hash_function();
+    }
+
+    key_equal key_eq() const {
+        return _table.key_eq();
+    }
+
+    allocator_type get_allocator() const {
+        return _table.get_allocator();
+    }
+
+    //Iterator
+    iterator begin() const noexcept {
+        return _table.begin();
+    }
+
+    iterator end() const noexcept {
+        return _table.end();
+    }
+
+    bool empty() const noexcept {
+        return _table.empty();
+    }
+
+    size_type size() const noexcept {
+        return _table.size();
+    }
+
+    size_type max_size() const noexcept {
+        return _table.max_size();
+    }
+
+    size_type capacity() const noexcept {
+        return _table.capacity();
+    }
+
+    double load_factor() const noexcept {
+        return _table.load_factor();
+    }
+
+    void reserve (size_type n) {
+        _table.reserve(n);
+    }
+
+    template <typename ...Args>
+    TKF::pair<iterator, bool> emplace (Args&&... args) {
+        return _table.emplace(TKF::forward<Args>(args)...);
+    }
+
+    TKF::pair<iterator, bool> insert (value_type const& value) {
+        return _table.emplace_key(value, value);
+    }
+
+    TKF::pair<iterator, bool> insert (value_type&& value) {
+        return _table.emplace_key(value, TKF::move(value));
+    }
+
+    template <typename ITER>
+    void insert (ITER const& first, ITER const& last) {
+        _table.insert(first, last);
+    }
+
+    void erase (iterator iter) {
+        _table.erase(iter);
+    }
+
+    size_type erase (key_type const& key) {
+        return _table.erase(key);
+    }
+
+    void clear () {
+        _table.clear();
+    }
+
+    iterator find (key_type const& key) const {
+        return _table.find(key);
+    }
+
+    size_type count (key_type const& key) const {
+        return _table.count(key);
+    }
+
+    TKF::pair<iterator, iterator> equal_range (key_type const& key) const {
+        return _table.equal_range(key);
+    }
+
+    void swap (unordered_set& rhs) {
+        _table.swap(rhs._table);
+    }
+
+    friend bool operator == (unordered_set const& lhs, unordered_set const& rhs) {
+        return lhs._table == rhs._table;
+    }
+
+    friend bool operator != (unordered_set const& lhs, unordered_set const& rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+}
+
+#endif //!UNORDERED_MAP_H
\ No newline at end of file
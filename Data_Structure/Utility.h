@@ -3,9 +3,27 @@
 #define UTILITY_H
 
 #include"Type_Traits.h"
+#include<cstddef>
+#include<tuple>
+#include<ostream>
 
 namespace TKF {
 
+//tag of pair's piecewise constructor
+struct piecewise_construct_t {};
+static constexpr piecewise_construct_t piecewise_construct = piecewise_construct_t();
+
+template <size_t... I>
+struct index_sequence {};
+
+template <size_t N, size_t... I>
+struct make_index_sequence : public make_index_sequence<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct make_index_sequence<0, I...> {
+    typedef index_sequence<I...> type;
+};
+
 template <typename T1, typename T2>
 struct pair {
     typedef pair<T1, T2>    Pair;
@@ -20,14 +38,21 @@ struct pair {
     pair (first_type const& _first, second_type const& _second)
         : first(_first), second(_second) {} 
 
-    pair (Pair const& rhs) {
-        first = rhs.first;
-        second = rhs.second;
-    }
-    pair (Pair&& rhs) {
-        first = TKF::move(rhs.first);
-        second = TKF::move(rhs.second);
-    }
+    template <typename U1, typename U2>
+    pair (U1&& _first, U2&& _second)
+        : first(TKF::forward<U1>(_first)), second(TKF::forward<U2>(_second)) {}
+
+    //first and second are built in place from the two argument tuples,
+    //as made by std::forward_as_tuple
+    template <typename ...Args1, typename ...Args2>
+    pair (piecewise_construct_t, std::tuple<Args1...> args1, std::tuple<Args2...> args2)
+        : pair(args1, args2, 
+            typename make_index_sequence<sizeof...(Args1)>::type(),
+            typename make_index_sequence<sizeof...(Args2)>::type()) {}
+
+    pair (Pair const& rhs) : first(rhs.first), second(rhs.second) {}
+    pair (Pair&& rhs) 
+        : first(TKF::move(rhs.first)), second(TKF::move(rhs.second)) {}
     pair& operator = (Pair const& rhs) {
         if(this != &rhs) {
             first = rhs.first;
@@ -98,6 +123,14 @@ struct pair {
         out << rhs.first << " " << rhs.second;
         return out;
     }
+
+private:
+    template <typename TUPLE1, typename TUPLE2, size_t... I1, size_t... I2>
+    pair (TUPLE1& args1, TUPLE2& args2, index_sequence<I1...>, index_sequence<I2...>)
+        : first(TKF::forward<typename std::tuple_element<I1, TUPLE1>::type>(
+            std::get<I1>(args1))...), 
+        second(TKF::forward<typename std::tuple_element<I2, TUPLE2>::type>(
+            std::get<I2>(args2))...) {}
 };
 
 template <typename T1, typename T2>
@@ -111,6 +144,63 @@ struct is_pair : public false_type{};
 template <typename T1, typename T2>
 struct is_pair<TKF::pair<T1, T2> > : public true_type{};
 
+//three-way comparison: negative, zero or positive as lhs is less than,
+//equal to or greater than rhs. Types with a compare() member, such as
+//std::string, answer in one call; the rest take two <= without branches.
+template <typename T1, typename T2>
+auto _three_way(T1 const& lhs, T2 const& rhs, int, int) 
+    -> decltype(int(lhs.compare(rhs))) {
+    return lhs.compare(rhs);
+}
+
+template <typename T1, typename T2>
+auto _three_way(T1 const& lhs, T2 const& rhs, int, long) 
+    -> decltype(int(rhs.compare(lhs))) {
+    //only the sign is flipped: negating INT_MIN would overflow
+    int c = rhs.compare(lhs);
+    return int(c < 0) - int(c > 0);
+}
+
+template <typename T1, typename T2>
+int _three_way(T1 const& lhs, T2 const& rhs, long, long) {
+    return int(!(lhs <= rhs)) - int(!(rhs <= lhs));
+}
+
+template <typename T1, typename T2>
+int three_way(T1 const& lhs, T2 const& rhs) {
+    return _three_way(lhs, rhs, 0, 0);
+}
+
+//default key order of the trees: true when lhs is not greater than rhs.
+//compare() is the three-way form the tree searches use when present.
+template <typename T>
+struct less {
+    bool operator () (T const& lhs, T const& rhs) const {
+        return lhs <= rhs;
+    }
+
+    int compare (T const& lhs, T const& rhs) const {
+        return TKF::three_way(lhs, rhs);
+    }
+};
+
+//transparent order: compares any two types with <=, so a tree keyed by
+//std::string can be searched with a const char* or a string_view
+template <>
+struct less<void> {
+    typedef void is_transparent;
+
+    template <typename T1, typename T2>
+    bool operator () (T1 const& lhs, T2 const& rhs) const {
+        return lhs <= rhs;
+    }
+
+    template <typename T1, typename T2>
+    int compare (T1 const& lhs, T2 const& rhs) const {
+        return TKF::three_way(lhs, rhs);
+    }
+};
+
 }
 
 #endif //!UTILITY_H
\ No newline at end of file
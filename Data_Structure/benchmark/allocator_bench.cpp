@@ -0,0 +1,91 @@
+//file: allocator_bench.cpp
+//insert/erase throughput and RSS of TKF::map with the default
+//pool_allocator against the plain ::operator new allocator, and of the
+//compact (color in the parent pointer) and 32-bit index node layouts.
+//build: g++ -std=c++11 -O2 -I.. allocator_bench.cpp -o allocator_bench
+//usage: ./allocator_bench [n = 1000000] [new|pool|compact|index]
+//freed memory is kept by malloc, so compare RSS across separate runs
+#include<iostream>
+#include<fstream>
+#include<string>
+#include<chrono>
+#include<random>
+#include<vector>
+#include<cstdlib>
+#include"../Map.h"
+
+using namespace std;
+
+//resident set size in KiB, read from /proc on Linux (0 elsewhere)
+static long rss_kb() {
+    ifstream in("/proc/self/status");
+    string line;
+    while (getline(in, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+    return 0;
+}
+
+template <typename MAP>
+void run(string const& name, vector<int> const& keys) {
+    typedef chrono::steady_clock clock;
+    long before = rss_kb();
+    MAP* m = new MAP;
+
+    auto t0 = clock::now();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        m->insert(TKF::make_pair(keys[i], (int)i));
+    }
+    auto t1 = clock::now();
+    long after = rss_kb();
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        m->erase(keys[i]);
+    }
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        m->insert(TKF::make_pair(keys[i], (int)i));
+    }
+    auto t2 = clock::now();
+    delete m;
+    auto t3 = clock::now();
+
+    double n = (double)keys.size();
+    double ins = chrono::duration<double>(t1 - t0).count();
+    double churn = chrono::duration<double>(t2 - t1).count();
+    double dtor = chrono::duration<double>(t3 - t2).count();
+    cout << name
+         << "\tinsert " << n / ins / 1e6 << " Mops/s"
+         << "\terase+reinsert " << n / churn / 1e6 << " Mops/s"
+         << "\tdestroy " << dtor * 1e3 << " ms"
+         << "\trss +" << (after - before) / 1024 << " MiB" << endl;
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    string which = argc > 2 ? argv[2] : "";
+    vector<int> keys(n);
+    mt19937 gen(42);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = (int)gen();
+    }
+
+    typedef TKF::pair<int, int> value_type;
+    cout << "n = " << n << endl;
+    if (which == "" || which == "new") {
+        run<TKF::map<int, int, TKF::less<int>, TKF::allocator<value_type> > >
+            ("operator new", keys);
+    }
+    if (which == "" || which == "pool") {
+        run<TKF::map<int, int> >("pool", keys);
+    }
+    if (which == "" || which == "compact") {
+        run<TKF::map<int, int, TKF::less<int>, TKF::pool_allocator<value_type>,
+            TKF::RBT_compact_node> >("compact", keys);
+    }
+    if (which == "" || which == "index") {
+        run<TKF::map<int, int, TKF::less<int>, TKF::pool_allocator<value_type>,
+            TKF::RBT_index_node> >("index", keys);
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+//file: batch_bench.cpp
+//lower_bound on TKF::map one key at a time against lower_bound_many in
+//batches of 1 to 256 keys, for trees in and out of cache. Random: keys
+//anywhere, in any order. Sorted: the same, each batch sorted. Dense:
+//each batch is a run of neighbouring keys from a random place.
+//build: g++ -std=c++11 -O2 -march=native -I.. batch_bench.cpp -o batch_bench
+//usage: ./batch_bench [n ...]   (default 64K to 16M by powers of four)
+#include<iostream>
+#include<chrono>
+#include<random>
+#include<vector>
+#include<algorithm>
+#include<cstdlib>
+#include"../Map.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+typedef TKF::map<int, int> map_type;
+
+static double ns_per_op(Clock::time_point t0, Clock::time_point t1, size_t n) {
+    return chrono::duration<double, nano>(t1 - t0).count() / (double)n;
+}
+
+static long long sum_of(map_type& m, vector<map_type::iterator> const& res) {
+    long long sum = 0;
+    for (size_t i = 0; i < res.size(); ++i) {
+        if (res[i] != m.end()) {
+            sum += (*res[i]).second;
+        }
+    }
+    return sum;
+}
+
+//ns per key for the keys searched batch by batch
+static void run(map_type& m, vector<int> const& probes, size_t batch) {
+    vector<map_type::iterator> res(probes.size());
+    auto t0 = Clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        res[i] = m.lower_bound(probes[i]);
+    }
+    auto t1 = Clock::now();
+    long long single = sum_of(m, res);
+    auto t2 = Clock::now();
+    for (size_t i = 0; i < probes.size(); i += batch) {
+        size_t last = min(i + batch, probes.size());
+        m.lower_bound_many(probes.begin() + i, probes.begin() + last, res.begin() + i);
+    }
+    auto t3 = Clock::now();
+    double one = ns_per_op(t0, t1, probes.size());
+    double many = ns_per_op(t2, t3, probes.size());
+    cout << "\t" << batch << ": " << one << " / " << many << " ns";
+    if (sum_of(m, res) != single) {
+        cout << " MISMATCH";
+    }
+}
+
+int main(int argc, char** argv) {
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        for (size_t n = 64 * 1024; n <= 16 * 1024 * 1024; n *= 4) {
+            sizes.push_back(n);
+        }
+    }
+
+    size_t const batches[] = { 1, 4, 16, 64, 256 };
+    mt19937 gen(42);
+    for (size_t k = 0; k < sizes.size(); ++k) {
+        size_t n = sizes[k];
+        map_type m;
+        while (m.size() < n) {
+            m.insert(TKF::make_pair((int)gen(), (int)m.size()));
+        }
+        vector<int> probes(1 << 20);
+        for (size_t i = 0; i < probes.size(); ++i) {
+            probes[i] = (int)gen();
+        }
+
+        cout << "n = " << n << " random (single / many)";
+        for (size_t b = 0; b < sizeof(batches) / sizeof(*batches); ++b) {
+            run(m, probes, batches[b]);
+        }
+        cout << endl;
+        cout << "n = " << n << " sorted (single / many)";
+        for (size_t b = 0; b < sizeof(batches) / sizeof(*batches); ++b) {
+            vector<int> sorted(probes);
+            for (size_t i = 0; i < sorted.size(); i += batches[b]) {
+                sort(sorted.begin() + i, sorted.begin() + min(i + batches[b], sorted.size()));
+            }
+            run(m, sorted, batches[b]);
+        }
+        cout << endl;
+        vector<int> keys;
+        for (auto iter = m.begin(); iter != m.end(); ++iter) {
+            keys.push_back((*iter).first);
+        }
+        cout << "n = " << n << " dense (single / many)";
+        for (size_t b = 0; b < sizeof(batches) / sizeof(*batches); ++b) {
+            vector<int> dense(probes.size());
+            for (size_t i = 0; i < dense.size(); i += batches[b]) {
+                size_t from = gen() % (n - batches[b]);
+                for (size_t j = i; j < min(i + batches[b], dense.size()); ++j) {
+                    dense[j] = keys[from + j - i];
+                }
+            }
+            run(m, dense, batches[b]);
+        }
+        cout << endl;
+    }
+    return 0;
+}
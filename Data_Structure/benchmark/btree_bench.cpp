@@ -0,0 +1,94 @@
+//file: btree_bench.cpp
+//TKF::btree_map against the red-black TKF::map: random insert, lookups
+//that hit, lower_bound on missing keys, a full scan and random erase.
+//build: g++ -std=c++11 -O2 -march=native -I.. btree_bench.cpp -o btree_bench
+//usage: ./btree_bench [n ...]   (default 1K to 10M by powers of ten;
+//       100M takes about 10 GiB for both maps)
+#include<iostream>
+#include<string>
+#include<chrono>
+#include<random>
+#include<vector>
+#include<cstdlib>
+#include"../Map.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double ns_per_op(Clock::time_point t0, Clock::time_point t1, size_t n) {
+    return chrono::duration<double, nano>(t1 - t0).count() / (double)n;
+}
+
+template <typename MAP>
+void run(string const& name, vector<long long> const& keys, 
+    vector<long long> const& probes) {
+    MAP* m = new MAP;
+    size_t n = keys.size();
+    long long sum = 0;
+
+    auto t0 = Clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        m->insert(TKF::make_pair(keys[i], (long long)i));
+    }
+    auto t1 = Clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        sum += (*m->find(keys[probes[i]])).second;
+    }
+    auto t2 = Clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        auto iter = m->lower_bound(keys[probes[i]] + 1);
+        if (iter != m->end()) {
+            sum += (*iter).second;
+        }
+    }
+    auto t3 = Clock::now();
+    for (auto iter = m->begin(); iter != m->end(); ++iter) {
+        sum += (*iter).second;
+    }
+    auto t4 = Clock::now();
+    for (size_t i = 0; i < n; i += 2) {
+        m->erase(keys[i]);
+    }
+    auto t5 = Clock::now();
+    delete m;
+
+    cout << name
+         << "\tinsert " << ns_per_op(t0, t1, n) << " ns"
+         << "\tfind " << ns_per_op(t1, t2, probes.size()) << " ns"
+         << "\tlower_bound " << ns_per_op(t2, t3, probes.size()) << " ns"
+         << "\tscan " << ns_per_op(t3, t4, n) << " ns"
+         << "\terase " << ns_per_op(t4, t5, (n + 1) / 2) << " ns"
+         << "\t(" << (sum & 1) << ")" << endl;
+}
+
+int main(int argc, char** argv) {
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        for (size_t n = 1000; n <= 10000000; n *= 10) {
+            sizes.push_back(n);
+        }
+    }
+
+    mt19937_64 gen(42);
+    for (size_t k = 0; k < sizes.size(); ++k) {
+        size_t n = sizes[k];
+        //even keys, so key + 1 is always a miss
+        vector<long long> keys(n);
+        for (size_t i = 0; i < n; ++i) {
+            keys[i] = (long long)(gen() >> 2) * 2;
+        }
+        vector<long long> probes(n < 1000000 ? 1000000 : n);
+        for (size_t i = 0; i < probes.size(); ++i) {
+            probes[i] = (long long)(gen() % n);
+        }
+
+        cout << "n = " << n << endl;
+        run<TKF::map<long long, long long> >("map", keys, probes);
+        run<TKF::btree_map<long long, long long> >("btree_map", keys, probes);
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+//file: concurrent_bench.cpp
+//multi-threaded throughput of TKF::concurrent_skiplist_map against
+//TKF::map behind one std::mutex, and the sharded TKF::concurrent_map, at
+//1 to 64 threads. The key range is preloaded half full, then every thread
+//runs a random mix of find and, for the update share, insert and erase
+//in equal parts, so the size stays near half the range.
+//build: g++ -std=c++11 -O2 -pthread -I.. concurrent_bench.cpp -o concurrent_bench
+//usage: ./concurrent_bench [keys = 1000000] [update % = 50] [max threads = 64]
+//       [ops per thread = 1000000]
+#include<iostream>
+#include<string>
+#include<chrono>
+#include<random>
+#include<vector>
+#include<thread>
+#include<mutex>
+#include<atomic>
+#include<cstdlib>
+#include"../Map.h"
+#include"../Concurrent_Map.h"
+#include"../Concurrent_Skiplist.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+//the three maps behind one interface
+struct locked_map {
+    TKF::map<long long, long long> map;
+    mutex lock;
+
+    void insert(long long key) {
+        lock_guard<mutex> guard(lock);
+        map.insert(TKF::make_pair(key, key));
+    }
+    void erase(long long key) {
+        lock_guard<mutex> guard(lock);
+        map.erase(key);
+    }
+    bool find(long long key) {
+        lock_guard<mutex> guard(lock);
+        return map.find(key) != map.end();
+    }
+};
+
+struct sharded_map {
+    TKF::concurrent_map<long long, long long> map;
+
+    void insert(long long key) {
+        map.insert(TKF::make_pair(key, key));
+    }
+    void erase(long long key) {
+        map.erase(key);
+    }
+    bool find(long long key) {
+        return map.contains(key);
+    }
+};
+
+struct skiplist_map {
+    TKF::concurrent_skiplist_map<long long, long long> map;
+
+    void insert(long long key) {
+        map.insert(TKF::make_pair(key, key));
+    }
+    void erase(long long key) {
+        map.erase(key);
+    }
+    bool find(long long key) {
+        return map.contains(key);
+    }
+};
+
+template <typename MAP>
+double run(size_t keys, unsigned update, unsigned threads, size_t ops) {
+    MAP m;
+    mt19937_64 gen(42);
+    for (size_t i = 0; i < keys / 2; ++i) {
+        m.insert((long long)(gen() % keys));
+    }
+
+    atomic<unsigned> ready(0);
+    atomic<bool> go(false);
+    atomic<long long> found(0);
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.push_back(thread([&, t]() {
+            mt19937_64 rng(t + 1);
+            long long hits = 0;
+            ++ready;
+            while (!go.load()) {
+                this_thread::yield();
+            }
+            for (size_t i = 0; i < ops; ++i) {
+                uint64_t r = rng();
+                long long key = (long long)((r >> 8) % keys);
+                unsigned dice = (unsigned)(r % 200);
+                if (dice < update) {
+                    m.insert(key);
+                }
+                else if (dice < 2 * update) {
+                    m.erase(key);
+                }
+                else {
+                    hits += m.find(key);
+                }
+            }
+            found += hits;
+        }));
+    }
+    while (ready.load() != threads) {
+        this_thread::yield();
+    }
+    auto t0 = Clock::now();
+    go.store(true);
+    for (unsigned t = 0; t < threads; ++t) {
+        workers[t].join();
+    }
+    auto t1 = Clock::now();
+    double seconds = chrono::duration<double>(t1 - t0).count();
+    return (double)ops * threads / seconds / 1e6;
+}
+
+int main(int argc, char** argv) {
+    size_t keys = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    unsigned update = argc > 2 ? (unsigned)atoi(argv[2]) : 50;
+    unsigned max_threads = argc > 3 ? (unsigned)atoi(argv[3]) : 64;
+    size_t ops = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1000000;
+    if (update > 100) {
+        update = 100;
+    }
+
+    cout << "keys = " << keys << ", updates " << update << "%, "
+         << thread::hardware_concurrency() << " hardware threads, Mops/s" << endl;
+    cout << "threads\tmutex map\tconcurrent_map\tskiplist" << endl;
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        cout << threads
+             << "\t" << run<locked_map>(keys, update, threads, ops)
+             << "\t\t" << run<sharded_map>(keys, update, threads, ops)
+             << "\t\t" << run<skiplist_map>(keys, update, threads, ops) << endl;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,183 @@
+//file: dijkstra_bench.cpp
+//Dijkstra from one corner of a generated road network: a jittered grid
+//of junctions with some streets missing, weights the street length over
+//its speed, and faster arterials every 16 streets. Every priority_queue
+//engine runs it, FIBHeap, PairingHeap and DaryHeap by decrease-key
+//through handles, DaryHeap, RadixHeap, DialQueue and std::priority_queue
+//by re-pushing and skipping stale entries.
+//build: g++ -std=c++11 -O2 -march=native -I.. dijkstra_bench.cpp -o dijkstra_bench
+//usage: ./dijkstra_bench [nodes ...]   (default 256K, 1M and 4M)
+#include<iostream>
+#include<chrono>
+#include<random>
+#include<vector>
+#include<queue>
+#include<cmath>
+#include<functional>
+#include<cstdlib>
+#include"../priority_queue.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+//adjacency arrays, each street both ways
+struct graph {
+    vector<unsigned> first;
+    vector<unsigned> to;
+    vector<unsigned> weight;
+    unsigned max_weight;
+};
+
+static graph make_roads(unsigned side, mt19937& gen) {
+    uniform_real_distribution<double> jitter(-30.0, 30.0), slow(1.0, 2.0);
+    unsigned n = side * side;
+    vector<double> x(n), y(n);
+    for (unsigned u = 0; u < n; ++u) {
+        x[u] = (u % side) * 100.0 + jitter(gen);
+        y[u] = (u / side) * 100.0 + jitter(gen);
+    }
+    //street from u to u + 1 (east) and to u + side (north)
+    vector<unsigned> east(n), north(n);
+    for (unsigned u = 0; u < n; ++u) {
+        east[u] = (u % side + 1 < side && gen() % 10 != 0) ? 1 : 0;
+        north[u] = (u / side + 1 < side && gen() % 10 != 0) ? 1 : 0;
+    }
+    graph g;
+    g.max_weight = 0;
+    g.first.push_back(0);
+    auto street = [&](unsigned u, unsigned v, bool arterial) {
+        double length = hypot(x[u] - x[v], y[u] - y[v]);
+        double factor = arterial ? 0.5 : slow(gen);
+        unsigned w = (unsigned)(length * factor) + 1;
+        g.to.push_back(v);
+        g.weight.push_back(w);
+        g.max_weight = w > g.max_weight ? w : g.max_weight;
+    };
+    for (unsigned u = 0; u < n; ++u) {
+        unsigned col = u % side, row = u / side;
+        if (col > 0 && east[u - 1]) street(u, u - 1, row % 16 == 0);
+        if (east[u]) street(u, u + 1, row % 16 == 0);
+        if (row > 0 && north[u - side]) street(u, u - side, col % 16 == 0);
+        if (north[u]) street(u, u + side, col % 16 == 0);
+        g.first.push_back((unsigned)g.to.size());
+    }
+    return g;
+}
+
+typedef TKF::pair<unsigned, unsigned> item;     //distance, node
+typedef TKF::less<unsigned> dist_less;
+static const unsigned infinity = static_cast<unsigned>(-1);
+
+static void report(char const* name, Clock::time_point t0, Clock::time_point t1) {
+    cout << "\t" << name << " " << chrono::duration<double, milli>(t1 - t0).count() << " ms";
+}
+
+template <typename QUEUE>
+void dijkstra_update(char const* name, graph const& g, vector<unsigned>& dist) {
+    size_t n = g.first.size() - 1;
+    dist.assign(n, infinity);
+    vector<typename QUEUE::handle> handles(n);
+    auto t0 = Clock::now();
+    QUEUE q;
+    dist[0] = 0;
+    handles[0] = q.push(TKF::make_pair(0u, 0u));
+    while (!q.empty()) {
+        item top = q.top();
+        q.pop();
+        for (unsigned e = g.first[top.second]; e < g.first[top.second + 1]; ++e) {
+            unsigned v = g.to[e], d = top.first + g.weight[e];
+            if (d < dist[v]) {
+                if (dist[v] == infinity) {
+                    handles[v] = q.push(TKF::make_pair(d, v));
+                }
+                else {
+                    q.update(handles[v], d);
+                }
+                dist[v] = d;
+            }
+        }
+    }
+    report(name, t0, Clock::now());
+}
+
+//QUEUE is built from proto, for the engines that take a range
+template <typename QUEUE>
+void dijkstra_lazy(char const* name, graph const& g, vector<unsigned>& dist, 
+    QUEUE const& proto = QUEUE()) {
+    size_t n = g.first.size() - 1;
+    dist.assign(n, infinity);
+    auto t0 = Clock::now();
+    QUEUE q(proto);
+    dist[0] = 0;
+    q.push(TKF::make_pair(0u, 0u));
+    while (!q.empty()) {
+        item top = q.top();
+        q.pop();
+        if (top.first > dist[top.second]) {
+            continue;
+        }
+        for (unsigned e = g.first[top.second]; e < g.first[top.second + 1]; ++e) {
+            unsigned v = g.to[e], d = top.first + g.weight[e];
+            if (d < dist[v]) {
+                q.push(TKF::make_pair(d, v));
+                dist[v] = d;
+            }
+        }
+    }
+    report(name, t0, Clock::now());
+}
+
+//std::priority_queue wants a max-heap order over std::pair
+struct std_queue {
+    typedef pair<unsigned, unsigned> value;
+    priority_queue<value, vector<value>, greater<value> > q;
+
+    bool empty() const { return q.empty(); }
+    item top() const { return TKF::make_pair(q.top().first, q.top().second); }
+    void pop() { q.pop(); }
+    void push(item const& x) { q.push(value(x.first, x.second)); }
+};
+
+template <typename HEAP>
+struct queue_of {
+    typedef TKF::priority_queue<item, dist_less, HEAP> type;
+};
+
+int main(int argc, char** argv) {
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        sizes.push_back(256 * 1024);
+        sizes.push_back(1024 * 1024);
+        sizes.push_back(4 * 1024 * 1024);
+    }
+
+    mt19937 gen(42);
+    for (size_t k = 0; k < sizes.size(); ++k) {
+        unsigned side = (unsigned)sqrt((double)sizes[k]);
+        graph g = make_roads(side, gen);
+        vector<unsigned> expect, dist;
+        bool same = true;
+        cout << "nodes = " << side * side << " edges = " << g.to.size();
+        dijkstra_lazy<std_queue>("std", g, expect);
+        dijkstra_update<queue_of<TKF::FIBHeap<item, dist_less> >::type>("fib", g, dist);
+        same &= dist == expect;
+        dijkstra_update<queue_of<TKF::PairingHeap<item, dist_less> >::type>("pairing", g, dist);
+        same &= dist == expect;
+        dijkstra_update<queue_of<TKF::DaryHeap<item, dist_less, 4, true> >::type>("dary4", g, dist);
+        same &= dist == expect;
+        dijkstra_lazy<queue_of<TKF::DaryHeap<item, dist_less, 4> >::type>("dary4_lazy", g, dist);
+        same &= dist == expect;
+        dijkstra_lazy<queue_of<TKF::monotone_heap<item>::type>::type>("radix", g, dist);
+        same &= dist == expect;
+        typedef TKF::DialQueue<item> dial;
+        dijkstra_lazy<queue_of<dial>::type>("dial", g, dist, 
+            queue_of<dial>::type(dist_less(), dial(g.max_weight + 1)));
+        same &= dist == expect;
+        cout << (same ? "" : " MISMATCH") << endl;
+    }
+    return 0;
+}
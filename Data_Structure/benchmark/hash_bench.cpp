@@ -0,0 +1,101 @@
+//file: hash_bench.cpp
+//TKF::unordered_map against the ordered TKF::map, for integer and string
+//keys: random insert, lookups that hit, lookups that miss, random erase,
+//and insert again into the table those erases left behind.
+//build: g++ -std=c++11 -O2 -march=native -I.. hash_bench.cpp -o hash_bench
+//usage: ./hash_bench [n ...]   (default 1K to 10M by powers of ten)
+#include<iostream>
+#include<string>
+#include<chrono>
+#include<random>
+#include<vector>
+#include<algorithm>
+#include<cstdlib>
+#include"../Map.h"
+#include"../Unordered_Map.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double ns_per_op(Clock::time_point t0, Clock::time_point t1, size_t n) {
+    return chrono::duration<double, nano>(t1 - t0).count() / (double)n;
+}
+
+//keys holds 2n distinct keys: the first n go in, the others only miss
+template <typename MAP, typename KEY>
+void run(string const& name, vector<KEY> const& keys, vector<size_t> const& probes) {
+    MAP* m = new MAP;
+    size_t n = keys.size() / 2;
+    long long sum = 0;
+
+    auto t0 = Clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        m->insert(TKF::make_pair(keys[i], (long long)i));
+    }
+    auto t1 = Clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        sum += (*m->find(keys[probes[i]])).second;
+    }
+    auto t2 = Clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        sum += m->find(keys[n + probes[i]]) == m->end();
+    }
+    auto t3 = Clock::now();
+    for (size_t i = 0; i < n; i += 2) {
+        m->erase(keys[i]);
+    }
+    auto t4 = Clock::now();
+    for (size_t i = 0; i < n; i += 2) {
+        m->insert(TKF::make_pair(keys[n + i], (long long)i));
+    }
+    auto t5 = Clock::now();
+    delete m;
+
+    size_t half = (n + 1) / 2;
+    cout << name
+         << "\tinsert " << ns_per_op(t0, t1, n) << " ns"
+         << "\tfind hit " << ns_per_op(t1, t2, probes.size()) << " ns"
+         << "\tfind miss " << ns_per_op(t2, t3, probes.size()) << " ns"
+         << "\terase " << ns_per_op(t3, t4, half) << " ns"
+         << "\treinsert " << ns_per_op(t4, t5, half) << " ns"
+         << "\t(" << (sum & 1) << ")" << endl;
+}
+
+int main(int argc, char** argv) {
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        for (size_t n = 1000; n <= 10000000; n *= 10) {
+            sizes.push_back(n);
+        }
+    }
+
+    mt19937_64 gen(42);
+    for (size_t k = 0; k < sizes.size(); ++k) {
+        size_t n = sizes[k];
+        //distinct by construction: i in the high bits
+        vector<long long> keys(2 * n);
+        for (size_t i = 0; i < 2 * n; ++i) {
+            keys[i] = (long long)((i << 24) | (gen() & 0xFFFFFF));
+        }
+        shuffle(keys.begin(), keys.end(), gen);
+        vector<string> names(2 * n);
+        for (size_t i = 0; i < 2 * n; ++i) {
+            names[i] = "key:" + to_string(keys[i]);
+        }
+        vector<size_t> probes(n < 1000000 ? 1000000 : n);
+        for (size_t i = 0; i < probes.size(); ++i) {
+            probes[i] = (size_t)(gen() % n);
+        }
+
+        cout << "n = " << n << endl;
+        run<TKF::map<long long, long long> >("map<int>", keys, probes);
+        run<TKF::unordered_map<long long, long long> >("unordered_map<int>", keys, probes);
+        run<TKF::map<string, long long> >("map<string>", names, probes);
+        run<TKF::unordered_map<string, long long> >("unordered_map<string>", names, probes);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,187 @@
+//file: heap_bench.cpp
+//priority_queue engines: FIBHeap against DaryHeap with 4 and 8 children,
+//PairingHeap and std::priority_queue, first on push/pop of random ints (n pushes, n
+//pop-push pairs, n pops), then on Dijkstra over a grid with random edge
+//weights, by decrease-key through handles and by lazy re-pushing.
+//build: g++ -std=c++11 -O2 -march=native -I.. heap_bench.cpp -o heap_bench
+//usage: ./heap_bench [n ...]   (default 1K to 1M by powers of four; the
+//       grid for Dijkstra has about n nodes)
+#include<iostream>
+#include<chrono>
+#include<random>
+#include<vector>
+#include<queue>
+#include<functional>
+#include<cstdlib>
+#include"../priority_queue.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double ns_per_op(Clock::time_point t0, Clock::time_point t1, size_t n) {
+    return chrono::duration<double, nano>(t1 - t0).count() / (double)n;
+}
+
+//ns per push or pop
+template <typename QUEUE>
+void push_pop(char const* name, vector<int> const& keys) {
+    size_t n = keys.size() / 2;
+    QUEUE q;
+    long long sum = 0;
+    auto t0 = Clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        q.push(keys[i]);
+    }
+    for (size_t i = n; i < 2 * n; ++i) {
+        sum += q.top();
+        q.pop();
+        q.push(keys[i]);
+    }
+    while (!q.empty()) {
+        sum += q.top();
+        q.pop();
+    }
+    auto t1 = Clock::now();
+    cout << "\t" << name << " " << ns_per_op(t0, t1, 4 * n) << " ns";
+    if (sum == 42) {
+        cout << "!";
+    }
+}
+
+//adjacency arrays of a side x side grid, each edge both ways
+struct graph {
+    vector<unsigned> first;
+    vector<unsigned> to;
+    vector<unsigned> weight;
+};
+
+static graph make_grid(unsigned side, mt19937& gen) {
+    graph g;
+    unsigned n = side * side;
+    g.first.push_back(0);
+    for (unsigned u = 0; u < n; ++u) {
+        unsigned x = u % side, y = u / side;
+        if (x > 0) g.to.push_back(u - 1);
+        if (x + 1 < side) g.to.push_back(u + 1);
+        if (y > 0) g.to.push_back(u - side);
+        if (y + 1 < side) g.to.push_back(u + side);
+        g.first.push_back((unsigned)g.to.size());
+    }
+    for (size_t e = 0; e < g.to.size(); ++e) {
+        g.weight.push_back(1 + gen() % 1000);
+    }
+    return g;
+}
+
+typedef TKF::pair<unsigned, unsigned> item;     //distance, node
+static const unsigned infinity = static_cast<unsigned>(-1);
+
+template <typename QUEUE>
+void dijkstra_update(char const* name, graph const& g, vector<unsigned>& dist) {
+    size_t n = g.first.size() - 1;
+    dist.assign(n, infinity);
+    vector<typename QUEUE::handle> handles(n);
+    auto t0 = Clock::now();
+    QUEUE q;
+    dist[0] = 0;
+    handles[0] = q.push(TKF::make_pair(0u, 0u));
+    while (!q.empty()) {
+        item top = q.top();
+        q.pop();
+        for (unsigned e = g.first[top.second]; e < g.first[top.second + 1]; ++e) {
+            unsigned v = g.to[e], d = top.first + g.weight[e];
+            if (d < dist[v]) {
+                if (dist[v] == infinity) {
+                    handles[v] = q.push(TKF::make_pair(d, v));
+                }
+                else {
+                    q.update(handles[v], d);
+                }
+                dist[v] = d;
+            }
+        }
+    }
+    auto t1 = Clock::now();
+    cout << "\t" << name << " " << chrono::duration<double, milli>(t1 - t0).count() << " ms";
+}
+
+template <typename QUEUE>
+void dijkstra_lazy(char const* name, graph const& g, vector<unsigned>& dist) {
+    size_t n = g.first.size() - 1;
+    dist.assign(n, infinity);
+    auto t0 = Clock::now();
+    QUEUE q;
+    dist[0] = 0;
+    q.push(TKF::make_pair(0u, 0u));
+    while (!q.empty()) {
+        item top = q.top();
+        q.pop();
+        if (top.first > dist[top.second]) {
+            continue;
+        }
+        for (unsigned e = g.first[top.second]; e < g.first[top.second + 1]; ++e) {
+            unsigned v = g.to[e], d = top.first + g.weight[e];
+            if (d < dist[v]) {
+                q.push(TKF::make_pair(d, v));
+                dist[v] = d;
+            }
+        }
+    }
+    auto t1 = Clock::now();
+    cout << "\t" << name << " " << chrono::duration<double, milli>(t1 - t0).count() << " ms";
+}
+
+template <typename HEAP>
+struct queue_of {
+    typedef TKF::priority_queue<typename HEAP::value_type, typename HEAP::key_compare, HEAP> type;
+};
+
+int main(int argc, char** argv) {
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        for (size_t n = 1024; n <= 1024 * 1024; n *= 4) {
+            sizes.push_back(n);
+        }
+    }
+
+    typedef TKF::less<int> int_less;
+    typedef TKF::less<unsigned> dist_less;
+    mt19937 gen(42);
+    for (size_t k = 0; k < sizes.size(); ++k) {
+        size_t n = sizes[k];
+        vector<int> keys(2 * n);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            keys[i] = (int)gen();
+        }
+        cout << "n = " << n << " push/pop";
+        push_pop<queue_of<TKF::FIBHeap<int, int_less> >::type>("fib", keys);
+        push_pop<queue_of<TKF::DaryHeap<int, int_less, 4> >::type>("dary4", keys);
+        push_pop<queue_of<TKF::DaryHeap<int, int_less, 8> >::type>("dary8", keys);
+        push_pop<queue_of<TKF::PairingHeap<int, int_less> >::type>("pairing", keys);
+        push_pop<priority_queue<int, vector<int>, greater<int> > >("std", keys);
+        cout << endl;
+
+        unsigned side = 1;
+        while ((size_t)(side + 1) * (side + 1) <= n) {
+            ++side;
+        }
+        graph g = make_grid(side, gen);
+        vector<unsigned> expect, dist;
+        cout << "n = " << side * side << " dijkstra";
+        dijkstra_update<queue_of<TKF::FIBHeap<item, dist_less> >::type>("fib", g, expect);
+        dijkstra_update<queue_of<TKF::DaryHeap<item, dist_less, 4, true> >::type>("dary4", g, dist);
+        bool same = dist == expect;
+        dijkstra_update<queue_of<TKF::DaryHeap<item, dist_less, 8, true> >::type>("dary8", g, dist);
+        same &= dist == expect;
+        dijkstra_update<queue_of<TKF::PairingHeap<item, dist_less> >::type>("pairing", g, dist);
+        same &= dist == expect;
+        dijkstra_lazy<queue_of<TKF::DaryHeap<item, dist_less, 4> >::type>("dary4_lazy", g, dist);
+        same &= dist == expect;
+        cout << (same ? "" : " MISMATCH") << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,407 @@
+//file: map_bench.cpp
+//regression suite of TKF::map and TKF::multimap against std::map and
+//std::multimap, with int and std::string keys. Workloads: insert in
+//random, sequential and Zipfian key order, find that hits and misses,
+//lower_bound, range scans, erase, operator[] upserts on Zipfian keys,
+//copy and clear. The results go to stdout as one JSON document:
+//ops/s, ns/op percentiles, peak RSS and the allocations of every run.
+//build: make map_bench   (or g++ -std=c++11 -O2 -march=native -I.. map_bench.cpp -o map_bench)
+//usage: ./map_bench [n ...] > map_bench.json   (default 1K to 1M by powers
+//       of ten; 100M string keys take about 40 GiB for both maps)
+//Percentiles are over batches of 64 operations timed together, so the
+//clock does not dominate the cheap ones; copy and clear are one sample.
+#include<iostream>
+#include<fstream>
+#include<string>
+#include<chrono>
+#include<random>
+#include<vector>
+#include<map>
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<cstdint>
+#include<algorithm>
+#include<new>
+#include"../Map.h"
+
+using namespace std;
+
+//every allocation of the process goes through here to be counted.
+//new and delete stay out of line so that the compiler always sees them
+//as a pair, never an inlined free() on what operator new returned
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+static uint64_t alloc_count = 0;
+static uint64_t alloc_bytes = 0;
+
+BENCH_NOINLINE void* operator new(size_t size) {
+    ++alloc_count;
+    alloc_bytes += size;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+BENCH_NOINLINE void operator delete(void* p) noexcept {
+    free(p);
+}
+
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+//peak resident set size in KiB since the last reset_peak_rss(), from
+///proc on Linux; 0 elsewhere
+static void reset_peak_rss() {
+    ofstream out("/proc/self/clear_refs");
+    out << "5";
+}
+
+static long peak_rss_kb() {
+    ifstream in("/proc/self/status");
+    string line;
+    while (getline(in, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+    return 0;
+}
+
+typedef chrono::steady_clock Clock;
+
+static double ns_between(Clock::time_point t0, Clock::time_point t1) {
+    return chrono::duration<double, nano>(t1 - t0).count();
+}
+
+//keys: id i maps to a distinct key through a bijection of 32-bit
+//integers, so ids [0, n) are the keys inserted and [n, 2n) never are
+static uint32_t scramble(uint64_t id) {
+    uint32_t x = (uint32_t)id * 2654435761u;
+    return x ^ (x >> 16);
+}
+
+template <typename KEY> struct keys;
+
+template <>
+struct keys<int> {
+    static const char* name() {
+        return "int";
+    }
+    static int random(uint64_t id) {
+        return (int)scramble(id);
+    }
+    static int sequential(uint64_t id) {
+        return (int)id;
+    }
+};
+
+//fixed width, so the order of the strings is the order of the numbers
+template <>
+struct keys<string> {
+    static const char* name() {
+        return "string";
+    }
+    static string format(uint32_t x) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "user%010u", x);
+        return buf;
+    }
+    static string random(uint64_t id) {
+        return format(scramble(id));
+    }
+    static string sequential(uint64_t id) {
+        return format((uint32_t)id);
+    }
+};
+
+//Zipfian ids in [0, n) with skew theta, as YCSB draws them (Gray et al.,
+//"Quickly generating billion-record synthetic databases"); id 0 is the
+//hottest, and the ids go through scramble() like the others
+class zipfian {
+    uint64_t _n;
+    double _theta, _alpha, _zetan, _eta;
+
+public:
+    zipfian(uint64_t n, double theta = 0.99) : _n(n), _theta(theta) {
+        double zeta2 = 1.0 + pow(0.5, theta);
+        _zetan = 0;
+        for (uint64_t i = 1; i <= n; ++i) {
+            _zetan += 1.0 / pow((double)i, theta);
+        }
+        _alpha = 1.0 / (1.0 - theta);
+        _eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / _zetan);
+    }
+
+    template <typename GEN>
+    uint64_t operator () (GEN& gen) {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(gen);
+        double uz = u * _zetan;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + pow(0.5, _theta)) {
+            return 1;
+        }
+        uint64_t id = (uint64_t)((double)_n * pow(_eta * u - _eta + 1.0, _alpha));
+        return id < _n ? id : _n - 1;
+    }
+};
+
+//the two libraries spell a pair differently
+template <typename MAP, typename KEY>
+void put(MAP& m, KEY const& key, long long value, TKF::true_type) {
+    m.insert(TKF::make_pair(key, value));
+}
+
+template <typename MAP, typename KEY>
+void put(MAP& m, KEY const& key, long long value, TKF::false_type) {
+    m.insert(std::make_pair(key, value));
+}
+
+struct result {
+    string      container;
+    string      key;
+    string      workload;
+    size_t      n;
+    size_t      ops;
+    double      seconds;
+    double      p50;
+    double      p90;
+    double      p99;
+    double      p999;
+    long        peak_rss_kb;
+    uint64_t    allocations;
+    uint64_t    allocated_bytes;
+};
+
+static vector<result> results;
+
+//times body(i) for i in [0, ops) in batches and records one result
+class timer {
+    static constexpr size_t _batch = 64;
+
+    result _res;
+    uint64_t _count, _bytes;
+
+public:
+    timer(string const& container, string const& key, string const& workload, size_t n) {
+        _res.container = container;
+        _res.key = key;
+        _res.workload = workload;
+        _res.n = n;
+    }
+
+    template <typename BODY>
+    void run(size_t ops, BODY body) {
+        vector<double> samples;
+        samples.reserve(ops / _batch + 1);
+        _start();
+        auto start = Clock::now();
+        auto t0 = start;
+        for (size_t i = 0; i < ops; i += _batch) {
+            size_t last = i + _batch < ops ? i + _batch : ops;
+            for (size_t j = i; j < last; ++j) {
+                body(j);
+            }
+            auto t1 = Clock::now();
+            samples.push_back(ns_between(t0, t1) / (double)(last - i));
+            t0 = t1;
+        }
+        _finish(ops, ns_between(start, t0) * 1e-9, samples);
+    }
+
+    //one operation, one sample
+    template <typename BODY>
+    void once(size_t ops, BODY body) {
+        vector<double> samples(1);
+        _start();
+        auto t0 = Clock::now();
+        body();
+        auto t1 = Clock::now();
+        samples[0] = ns_between(t0, t1) / (double)(ops == 0 ? 1 : ops);
+        _finish(ops, ns_between(t0, t1) * 1e-9, samples);
+    }
+
+private:
+    void _start() {
+        reset_peak_rss();
+        _count = alloc_count;
+        _bytes = alloc_bytes;
+    }
+
+    static double _percentile(vector<double>& samples, double q) {
+        size_t k = (size_t)(q * (double)(samples.size() - 1));
+        nth_element(samples.begin(), samples.begin() + k, samples.end());
+        return samples[k];
+    }
+
+    void _finish(size_t ops, double seconds, vector<double>& samples) {
+        _res.allocations = alloc_count - _count;
+        _res.allocated_bytes = alloc_bytes - _bytes;
+        _res.peak_rss_kb = peak_rss_kb();
+        _res.ops = ops;
+        _res.seconds = seconds;
+        _res.p50 = _percentile(samples, 0.5);
+        _res.p90 = _percentile(samples, 0.9);
+        _res.p99 = _percentile(samples, 0.99);
+        _res.p999 = _percentile(samples, 0.999);
+        results.push_back(_res);
+        cerr << _res.container << " " << _res.key << " n=" << _res.n << " "
+             << _res.workload << ": " << (double)ops / seconds << " ops/s" << endl;
+    }
+};
+
+static long long sink = 0;
+
+template <typename MAP>
+void subscript(MAP& m, typename MAP::key_type const& key, TKF::true_type) {
+    ++m[key];
+}
+
+template <typename MAP>
+void subscript(MAP&, typename MAP::key_type const&, TKF::false_type) {}
+
+//MULTI: the keys repeat and there is no operator[]
+template <typename MAP, typename TKF_PAIR, bool MULTI>
+void run(string const& name, size_t n) {
+    typedef typename MAP::key_type KEY;
+    typedef keys<KEY> K;
+    typedef TKF::int_constant<bool, TKF_PAIR::value> pair_tag;
+    string key_name = K::name();
+    size_t probes = 1000000;
+    size_t scans = 10000;
+    size_t range = 100;
+    //a multimap gets every key four times
+    size_t distinct = MULTI ? (n + 3) / 4 : n;
+
+    mt19937_64 gen(42);
+    vector<KEY> ins(n);
+    for (size_t i = 0; i < n; ++i) {
+        ins[i] = K::random(i % distinct);
+    }
+    shuffle(ins.begin(), ins.end(), gen);
+    vector<KEY> hits(probes), misses(probes);
+    for (size_t i = 0; i < probes; ++i) {
+        hits[i] = K::random(gen() % distinct);
+        misses[i] = K::random(distinct + gen() % distinct);
+    }
+    zipfian zipf(distinct);
+    vector<KEY> skewed(n);
+    for (size_t i = 0; i < n; ++i) {
+        skewed[i] = K::random(zipf(gen));
+    }
+
+    {
+        MAP m;
+        timer(name, key_name, "insert_sequential", n).run(n, [&](size_t i) {
+            put(m, K::sequential(i), (long long)i, pair_tag());
+        });
+    }
+    {
+        MAP m;
+        timer(name, key_name, "insert_zipfian", n).run(n, [&](size_t i) {
+            put(m, skewed[i], (long long)i, pair_tag());
+        });
+    }
+
+    MAP* m = new MAP;
+    timer(name, key_name, "insert_random", n).run(n, [&](size_t i) {
+        put(*m, ins[i], (long long)i, pair_tag());
+    });
+    timer(name, key_name, "find_hit", n).run(probes, [&](size_t i) {
+        sink += (*m->find(hits[i])).second;
+    });
+    timer(name, key_name, "find_miss", n).run(probes, [&](size_t i) {
+        sink += m->find(misses[i]) == m->end();
+    });
+    timer(name, key_name, "lower_bound", n).run(probes, [&](size_t i) {
+        auto iter = m->lower_bound(misses[i]);
+        if (iter != m->end()) {
+            sink += (*iter).second;
+        }
+    });
+    timer(name, key_name, "range_scan", n).run(scans, [&](size_t i) {
+        auto iter = m->lower_bound(misses[i]);
+        for (size_t k = 0; k < range && iter != m->end(); ++k, ++iter) {
+            sink += (*iter).second;
+        }
+    });
+    if (!MULTI) {
+        timer(name, key_name, "upsert_zipfian", n).run(n, [&](size_t i) {
+            subscript(*m, skewed[i], TKF::int_constant<bool, !MULTI>());
+        });
+    }
+    {
+        MAP* copy = nullptr;
+        timer(name, key_name, "copy", n).once(m->size(), [&]() {
+            copy = new MAP(*m);
+        });
+        timer(name, key_name, "clear", n).once(copy->size(), [&]() {
+            copy->clear();
+        });
+        delete copy;
+    }
+    size_t erases = distinct / 2;
+    timer(name, key_name, "erase", n).run(erases, [&](size_t i) {
+        sink += m->erase(K::random(i * 2));
+    });
+    delete m;
+}
+
+static void print_json() {
+    cout << "{\n  \"benchmark\": \"map_bench\",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        result const& r = results[i];
+        cout << (i == 0 ? "\n" : ",\n")
+             << "    {\"container\": \"" << r.container << "\""
+             << ", \"key\": \"" << r.key << "\""
+             << ", \"workload\": \"" << r.workload << "\""
+             << ", \"n\": " << r.n
+             << ", \"ops\": " << r.ops
+             << ", \"seconds\": " << r.seconds
+             << ", \"ops_per_sec\": " << (r.seconds > 0 ? (double)r.ops / r.seconds : 0.0)
+             << ", \"ns_per_op\": {\"p50\": " << r.p50 << ", \"p90\": " << r.p90
+             << ", \"p99\": " << r.p99 << ", \"p999\": " << r.p999 << "}"
+             << ", \"peak_rss_kb\": " << r.peak_rss_kb
+             << ", \"allocations\": " << r.allocations
+             << ", \"allocated_bytes\": " << r.allocated_bytes << "}";
+    }
+    cout << "\n  ]\n}" << endl;
+}
+
+int main(int argc, char** argv) {
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        for (size_t n = 1000; n <= 1000000; n *= 10) {
+            sizes.push_back(n);
+        }
+    }
+
+    typedef TKF::true_type tkf;
+    typedef TKF::false_type stl;
+    for (size_t k = 0; k < sizes.size(); ++k) {
+        size_t n = sizes[k];
+        run<TKF::map<int, long long>, tkf, false>("TKF::map", n);
+        run<std::map<int, long long>, stl, false>("std::map", n);
+        run<TKF::multimap<int, long long>, tkf, true>("TKF::multimap", n);
+        run<std::multimap<int, long long>, stl, true>("std::multimap", n);
+        run<TKF::map<string, long long>, tkf, false>("TKF::map", n);
+        run<std::map<string, long long>, stl, false>("std::map", n);
+        run<TKF::multimap<string, long long>, tkf, true>("TKF::multimap", n);
+        run<std::multimap<string, long long>, stl, true>("std::multimap", n);
+    }
+    print_json();
+    cerr << "(" << (sink & 1) << ")" << endl;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+//file: scan_bench.cpp
+//in-order scans of TKF::map with the plain node layout against the
+//threaded one (RBT_threaded_node), whose iterators step through the
+//in-order neighbour links instead of walking the tree: full forward and
+//backward scans, short range scans from lower_bound, and erase(first, last).
+//build: g++ -std=c++11 -O2 -I.. scan_bench.cpp -o scan_bench
+//usage: ./scan_bench [n = 1000000] [range = 64]
+#include<iostream>
+#include<string>
+#include<chrono>
+#include<random>
+#include<vector>
+#include<cstdlib>
+#include"../Map.h"
+
+using namespace std;
+
+typedef chrono::steady_clock bench_clock;
+
+static double seconds(bench_clock::time_point t0, bench_clock::time_point t1) {
+    return chrono::duration<double>(t1 - t0).count();
+}
+
+template <typename MAP>
+void run(string const& name, vector<int> const& keys, size_t range) {
+    MAP m;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        m.insert(TKF::make_pair(keys[i], (int)i));
+    }
+    double n = (double)m.size();
+    long long sum = 0;
+
+    auto t0 = bench_clock::now();
+    for (auto it = m.begin(); it != m.end(); ++it) {
+        sum += (*it).second;
+    }
+    auto t1 = bench_clock::now();
+    auto it = m.end();
+    while (it != m.begin()) {
+        --it;
+        sum += (*it).second;
+    }
+    auto t2 = bench_clock::now();
+    size_t queries = keys.size() / range + 1;
+    for (size_t q = 0; q < queries; ++q) {
+        auto first = m.lower_bound(keys[q]);
+        for (size_t i = 0; i < range && first != m.end(); ++i, ++first) {
+            sum += (*first).second;
+        }
+    }
+    auto t3 = bench_clock::now();
+    //erase the middle half of the keys in one call
+    auto first = m.begin(), last = m.begin();
+    for (size_t i = 0; i < m.size() / 4; ++i) {
+        ++first;
+    }
+    last = first;
+    for (size_t i = 0; i < m.size() / 2; ++i) {
+        ++last;
+    }
+    auto t4 = bench_clock::now();
+    m.erase(first, last);
+    auto t5 = bench_clock::now();
+
+    cout << name
+         << "\tforward " << seconds(t0, t1) / n * 1e9 << " ns"
+         << "\tbackward " << seconds(t1, t2) / n * 1e9 << " ns"
+         << "\trange(" << range << ") "
+         << seconds(t2, t3) / queries * 1e9 << " ns"
+         << "\terase range " << seconds(t4, t5) / (n / 2) * 1e9 << " ns"
+         << "\t(" << sum % 10 << ")" << endl;
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t range = argc > 2 ? strtoul(argv[2], nullptr, 10) : 64;
+    vector<int> keys(n);
+    mt19937 gen(42);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = (int)gen();
+    }
+
+    typedef TKF::pair<int, int> value_type;
+    cout << "n = " << n << ", per element unless noted" << endl;
+    run<TKF::map<int, int> >("plain", keys, range);
+    run<TKF::map<int, int, TKF::less<int>, TKF::pool_allocator<value_type>,
+        TKF::RBT_threaded_node> >("threaded", keys, range);
+    return 0;
+}
\ No newline at end of file
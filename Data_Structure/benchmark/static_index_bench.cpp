@@ -0,0 +1,78 @@
+//file: static_index_bench.cpp
+//lower_bound on random keys, mostly missing, against TKF::map (the
+//red-black tree), flat_map (binary search over a sorted array) and the
+//frozen static_index in the Eytzinger and van Emde Boas layouts.
+//build: g++ -std=c++11 -O2 -march=native -I.. static_index_bench.cpp -o static_index_bench
+//usage: ./static_index_bench [n ...]   (default 1K to 16M by powers of four)
+#include<iostream>
+#include<string>
+#include<chrono>
+#include<random>
+#include<vector>
+#include<cstdlib>
+#include"../Map.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double ns_per_op(Clock::time_point t0, Clock::time_point t1, size_t n) {
+    return chrono::duration<double, nano>(t1 - t0).count() / (double)n;
+}
+
+template <typename INDEX>
+void run(string const& name, INDEX& index, vector<int> const& probes) {
+    long long sum = 0;
+    auto t0 = Clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        auto iter = index.lower_bound(probes[i]);
+        if (iter != index.end()) {
+            sum += (*iter).second;
+        }
+    }
+    auto t1 = Clock::now();
+    cout << "\t" << name << " " << ns_per_op(t0, t1, probes.size()) << " ns";
+    if (sum == 42) {
+        cout << "!";
+    }
+}
+
+int main(int argc, char** argv) {
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        for (size_t n = 1024; n <= 16 * 1024 * 1024; n *= 4) {
+            sizes.push_back(n);
+        }
+    }
+
+    mt19937 gen(42);
+    for (size_t k = 0; k < sizes.size(); ++k) {
+        size_t n = sizes[k];
+        TKF::map<int, int> m;
+        while (m.size() < n) {
+            m.insert(TKF::make_pair((int)gen(), (int)m.size()));
+        }
+        vector<int> probes(1000000);
+        for (size_t i = 0; i < probes.size(); ++i) {
+            probes[i] = (int)gen();
+        }
+
+        cout << "n = " << n;
+        run("map", m, probes);
+        {
+            TKF::flat_map<int, int> flat(m);
+            run("flat_map", flat, probes);
+        }
+        {
+            auto eytzinger = m.freeze<TKF::static_eytzinger>();
+            run("eytzinger", eytzinger, probes);
+            auto veb = m.freeze<TKF::static_veb>();
+            run("veb", veb, probes);
+        }
+        cout << endl;
+    }
+    return 0;
+}
\ No newline at end of file
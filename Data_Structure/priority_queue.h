@@ -2,10 +2,20 @@
 #ifndef PRIORITY_QUEUE_H
 #define PRIORITY_QUEUE_H
 
+#include<type_traits>
 #include"Fibonacci_Heap.h"
+#include"Dary_Heap.h"
+#include"Pairing_Heap.h"
+#include"Radix_Heap.h"
 
 namespace TKF {
 
+//HEAP is the engine: FIBHeap, DaryHeap for an array heap that pushes
+//and pops faster and, with TRACK, still takes handles, PairingHeap for
+//smaller nodes where handles update keys often, or, when keys never go
+//below the last popped, RadixHeap or DialQueue (see monotone_heap).
+//RadixHeap and DialQueue have no handles: push returns whether the value
+//went in, and update, erase and contains do not compile.
 template <typename T, typename COMP = TKF::less<T>, 
     typename HEAP = TKF::FIBHeap<T, COMP> >
 class priority_queue {
@@ -15,6 +25,11 @@ protected:
 
 public:
     typedef typename HEAP::value_type      value_type;
+    typedef typename HEAP::key_type        key_type;
+    typedef typename HEAP::handle          handle;
+    static constexpr bool has_handles = !std::is_void<handle>::value;
+    //what push and emplace return: a handle, or a bool without them
+    typedef typename std::conditional<has_handles, handle, bool>::type push_type;
     typedef typename HEAP::reference       reference;
     typedef typename HEAP::const_reference const_reference;
     typedef typename HEAP::size_type       size_type;
@@ -41,24 +56,47 @@ public:
     }
 
     const_reference top() const {
-        return heap.top()->get_node_ptr()->value;
+        return heap.top_value();
     }
 
-    void push(value_type const& value) {
-        heap.insert(value);
+    //push and emplace return a handle that names the value until it is
+    //popped or erased, for update, erase and contains
+    push_type push(value_type const& value) {
+        return push_type(heap.insert(value));
     }
 
-    void push(value_type&& value) {
-        heap.insert(TKF::move(value));
+    push_type push(value_type&& value) {
+        return push_type(heap.insert(TKF::move(value)));
     }
 
     template <typename... Args>
-    void emplace(Args&&... args) {
-        heap.emplace(TKF::forward<Args>(args)...);
+    push_type emplace(Args&&... args) {
+        return push_type(heap.emplace(TKF::forward<Args>(args)...));
     }
 
     void pop() {
-        heap.extract();
+        heap.pop();
+    }
+
+    //gives the value of h a new key, smaller or larger; false if h was
+    //popped or erased. Templates only so that a HEAP without handles
+    //gets to the static_assert.
+    template <typename H = handle>
+    bool update(H h, key_type const& key) {
+        static_assert(has_handles, "priority_queue: this HEAP has no handles");
+        return heap.update(h, key);
+    }
+
+    template <typename H = handle>
+    bool erase(H h) {
+        static_assert(has_handles, "priority_queue: this HEAP has no handles");
+        return heap.erase(h);
+    }
+
+    template <typename H = handle>
+    bool contains(H h) const noexcept {
+        static_assert(has_handles, "priority_queue: this HEAP has no handles");
+        return heap.contains(h);
     }
 };
 
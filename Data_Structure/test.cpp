@@ -44,11 +44,11 @@ int main(){
     f.insert(3);
     f.insert(1);
     f.insert(6);
-    f.extract();
-    f.extract();
-    f.extract();
-    f.extract();
-    f.extract();
+    f.pop();
+    f.pop();
+    f.pop();
+    f.pop();
+    f.pop();
 
     cout << f.empty();
     return 0;
@@ -0,0 +1,17 @@
+//file: check.h
+//the one assertion the tests share: unlike assert it stays on under
+//NDEBUG, and it names the test that failed
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include<iostream>
+#include<cstdlib>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+        std::exit(1); \
+    } \
+} while (0)
+
+#endif //!TESTS_CHECK_H
@@ -0,0 +1,185 @@
+//file: heap_test.cpp
+//the heap engines of priority_queue, FIBHeap with and without recycling,
+//PairingHeap and DaryHeap with and without handles: random pushes and
+//pops against std::priority_queue, and copies that throw part way
+//through, which must leave no value alive and no memory behind. The
+//monotone engines, RadixHeap and DialQueue, must refuse a key below the
+//last popped and carry on.
+#include<queue>
+#include<random>
+#include<vector>
+#include<functional>
+#include<stdexcept>
+#include"../Fibonacci_Heap.h"
+#include"../Pairing_Heap.h"
+#include"../Dary_Heap.h"
+#include"../Radix_Heap.h"
+#include"../priority_queue.h"
+#include"check.h"
+
+using namespace std;
+
+//a key whose copies throw once the budget is spent
+struct fragile {
+    static int live;
+    static int budget;
+
+    int key;
+
+    fragile(int k = 0) : key(k) {
+        ++live;
+    }
+    fragile(fragile const& rhs) : key(rhs.key) {
+        if (budget == 0) {
+            throw runtime_error("fragile copy");
+        }
+        --budget;
+        ++live;
+    }
+    fragile(fragile&& rhs) noexcept : key(rhs.key) {
+        ++live;
+    }
+    fragile& operator = (fragile const& rhs) {
+        key = rhs.key;
+        return *this;
+    }
+    ~fragile() {
+        --live;
+    }
+
+    friend bool operator <= (fragile const& lhs, fragile const& rhs) {
+        return lhs.key <= rhs.key;
+    }
+    friend bool operator < (fragile const& lhs, fragile const& rhs) {
+        return lhs.key < rhs.key;
+    }
+    friend bool operator == (fragile const& lhs, fragile const& rhs) {
+        return lhs.key == rhs.key;
+    }
+};
+
+int fragile::live = 0;
+int fragile::budget = -1;
+
+template <typename HEAP>
+void random_ops(mt19937& gen) {
+    HEAP h;
+    priority_queue<int, vector<int>, greater<int> > ref;
+    for (int step = 0; step < 20000; ++step) {
+        if (ref.empty() || gen() % 3 != 0) {
+            int k = int(gen() % 100000);
+            h.insert(fragile(k));
+            ref.push(k);
+        }
+        else {
+            CHECK(h.top_value().key == ref.top());
+            h.pop();
+            ref.pop();
+        }
+        CHECK(h.size() == ref.size());
+    }
+    while (!ref.empty()) {
+        CHECK(h.top_value().key == ref.top());
+        h.pop();
+        ref.pop();
+    }
+    CHECK(h.empty());
+}
+
+template <typename HEAP>
+void throwing_copy() {
+    int before = fragile::live;
+    {
+        HEAP h;
+        for (int k = 0; k < 300; ++k) {
+            h.insert(fragile((k * 7919) % 1000));
+        }
+        //pops give the node based heaps trees to copy, not just lists
+        for (int k = 0; k < 40; ++k) {
+            h.pop();
+        }
+        int held = fragile::live;
+        bool done = false;
+        for (int budget = 0; !done; ++budget) {
+            fragile::budget = budget;
+            try {
+                HEAP copy(h);
+                fragile::budget = -1;
+                done = true;
+                CHECK(copy.size() == h.size());
+                HEAP other(h);
+                while (!copy.empty()) {
+                    CHECK(copy.top_value().key == other.top_value().key);
+                    copy.pop();
+                    other.pop();
+                }
+            }
+            catch (runtime_error const&) {
+                fragile::budget = -1;
+                CHECK(fragile::live == held);
+            }
+        }
+        //the source is unharmed
+        CHECK(h.size() == 260);
+        HEAP assigned;
+        assigned = h;
+        CHECK(assigned.size() == h.size());
+    }
+    CHECK(fragile::live == before);
+}
+
+//pushes keys at or above the last popped, and now and then one below
+template <typename HEAP>
+void monotone(mt19937& gen) {
+    typedef TKF::pair<unsigned, unsigned> item;
+    TKF::priority_queue<item, TKF::less<unsigned>, HEAP> q;
+    priority_queue<pair<unsigned, unsigned>, vector<pair<unsigned, unsigned> >,
+        greater<pair<unsigned, unsigned> > > ref;
+    unsigned last = 0;
+    for (unsigned step = 0; step < 50000; ++step) {
+        if (ref.empty() || gen() % 3 != 0) {
+            unsigned spread = step % 1000 == 0 ? 100000 : 300;
+            unsigned key = last + unsigned(gen() % spread);
+            CHECK(q.push(TKF::make_pair(key, step)));
+            ref.push(make_pair(key, step));
+        }
+        else {
+            CHECK(q.top().first == ref.top().first);
+            last = ref.top().first;
+            q.pop();
+            ref.pop();
+            if (last > 0 && step % 7 == 0) {
+                CHECK(!q.push(TKF::make_pair(last - 1, step)));
+            }
+        }
+        CHECK(q.size() == ref.size());
+    }
+    while (!ref.empty()) {
+        CHECK(q.top().first == ref.top().first);
+        q.pop();
+        ref.pop();
+    }
+}
+
+template <typename HEAP>
+void run(mt19937& gen) {
+    random_ops<HEAP>(gen);
+    throwing_copy<HEAP>();
+}
+
+int main() {
+    mt19937 gen(21);
+    typedef TKF::less<fragile> L;
+    run<TKF::FIBHeap<fragile, L, true> >(gen);
+    run<TKF::FIBHeap<fragile, L, false> >(gen);
+    run<TKF::PairingHeap<fragile, L> >(gen);
+    run<TKF::DaryHeap<fragile, L, 4> >(gen);
+    run<TKF::DaryHeap<fragile, L, 4, true> >(gen);
+    run<TKF::DaryHeap<fragile, L, 2> >(gen);
+    typedef TKF::pair<unsigned, unsigned> item;
+    monotone<TKF::monotone_heap<item>::type>(gen);
+    monotone<TKF::monotone_heap<item, TKF::less<unsigned>, true>::type>(gen);
+    CHECK(fragile::live == 0);
+    cout << "heap_test ok" << endl;
+    return 0;
+}
@@ -0,0 +1,155 @@
+//file: map_layout_test.cpp
+//map and multimap on every node policy and both node allocators: random
+//inserts and erases checked against std::map and std::multimap, walks in
+//both directions, copies and moves, and destroying or reassigning a map
+//that was moved from.
+#include<map>
+#include<random>
+#include<string>
+#include"../Map.h"
+#include"check.h"
+
+using namespace std;
+
+template <typename MAP, typename REF>
+void same(MAP const& m, REF const& ref) {
+    CHECK(m.size() == ref.size());
+    typename REF::const_iterator r = ref.begin();
+    for (auto i = m.begin(); i != m.end(); ++i, ++r) {
+        CHECK(i->first == r->first && i->second == r->second);
+    }
+    typename REF::const_reverse_iterator q = ref.rbegin();
+    auto i = m.end();
+    while (i != m.begin()) {
+        --i;
+        CHECK(i->first == q->first);
+        ++q;
+    }
+}
+
+template <typename M>
+void moved_from() {
+    {
+        M a;
+        a[1] = "one";
+        M b(TKF::move(a));
+        CHECK(b.size() == 1);
+    }
+    {
+        //a map moved out of and never filled
+        M a;
+        M b(TKF::move(a));
+    }
+    {
+        M a, b, c;
+        a[1] = "one";
+        b = TKF::move(a);
+        //assigning into a moved-from map
+        a = TKF::move(c);
+        CHECK(a.empty() && b.size() == 1);
+        a[2] = "two";
+        CHECK(a.size() == 1 && a.begin()->first == 2);
+        a = b;
+        CHECK(a.size() == 1 && a.begin()->first == 1);
+    }
+}
+
+template <typename M>
+void random_unique(mt19937& gen) {
+    M m;
+    std::map<int, string> ref;
+    uniform_int_distribution<int> key(0, 1000), op(0, 9);
+    for (int step = 0; step < 20000; ++step) {
+        int k = key(gen);
+        switch (op(gen)) {
+        case 0: case 1: case 2: case 3:
+            m.insert(TKF::make_pair(k, to_string(k)));
+            ref.insert(make_pair(k, to_string(k)));
+            break;
+        case 4:
+            m[k] = "set";
+            ref[k] = "set";
+            break;
+        case 5: case 6:
+            CHECK(m.erase(k) == ref.erase(k));
+            break;
+        case 7: {
+            auto i = m.lower_bound(k);
+            auto r = ref.lower_bound(k);
+            CHECK((i == m.end()) == (r == ref.end()));
+            if (r != ref.end()) {
+                CHECK(i->first == r->first);
+                m.erase(i);
+                ref.erase(r);
+            }
+            break;
+        }
+        case 8:
+            CHECK((m.find(k) == m.end()) == (ref.count(k) == 0));
+            break;
+        default:
+            if (step % 1000 == 0) {
+                M copy(m);
+                same(copy, ref);
+                M moved(TKF::move(copy));
+                m = TKF::move(moved);
+            }
+            break;
+        }
+    }
+    same(m, ref);
+    M copy;
+    copy = m;
+    m.clear();
+    same(copy, ref);
+    CHECK(m.empty() && m.begin() == m.end());
+}
+
+template <typename MM>
+void random_multi(mt19937& gen) {
+    MM m;
+    std::multimap<int, string> ref;
+    uniform_int_distribution<int> key(0, 100), op(0, 3);
+    for (int step = 0; step < 10000; ++step) {
+        int k = key(gen);
+        switch (op(gen)) {
+        case 0: case 1:
+            m.insert(TKF::make_pair(k, string("v")));
+            ref.insert(make_pair(k, string("v")));
+            break;
+        case 2:
+            CHECK(m.erase(k) == ref.erase(k));
+            break;
+        default:
+            CHECK(m.count(k) == ref.count(k));
+            break;
+        }
+    }
+    same(m, ref);
+}
+
+template <typename POLICY, typename ALLOC>
+void run(mt19937& gen) {
+    typedef TKF::map<int, string, TKF::less<int>, ALLOC, POLICY> M;
+    typedef TKF::multimap<int, string, TKF::less<int>, ALLOC, POLICY> MM;
+    moved_from<M>();
+    random_unique<M>(gen);
+    random_multi<MM>(gen);
+}
+
+template <typename POLICY>
+void run(mt19937& gen) {
+    run<POLICY, TKF::pool_allocator<TKF::pair<int, string> > >(gen);
+    run<POLICY, TKF::allocator<TKF::pair<int, string> > >(gen);
+}
+
+int main() {
+    mt19937 gen(6);
+    run<TKF::RBT_plain_node>(gen);
+    run<TKF::RBT_rank_node>(gen);
+    run<TKF::RBT_compact_node>(gen);
+    run<TKF::RBT_index_node>(gen);
+    run<TKF::RBT_threaded_node>(gen);
+    cout << "map_layout_test ok" << endl;
+    return 0;
+}
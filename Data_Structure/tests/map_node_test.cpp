@@ -0,0 +1,246 @@
+//file: map_node_test.cpp
+//node handles of map and multimap on every node policy: extract,
+//insert(node_type&&) with and without a hint, merge, and the arena
+//sharing that keeps a node valid whichever owner dies first. Random
+//operations are checked against std::map and std::multimap.
+#include<map>
+#include<random>
+#include<string>
+#include"../Map.h"
+#include"check.h"
+
+using namespace std;
+
+template <typename MAP, typename REF>
+void same(MAP const& m, REF const& ref) {
+    CHECK(m.size() == ref.size());
+    typename REF::const_iterator r = ref.begin();
+    for (auto i = m.begin(); i != m.end(); ++i, ++r) {
+        CHECK(i->first == r->first);
+    }
+}
+
+//merge leaves the colliding nodes behind in rhs; they must outlive the
+//map that took the others
+template <typename POLICY>
+void merge_keeps_collisions() {
+    typedef TKF::map<int, string, TKF::less<int>,
+        TKF::pool_allocator<TKF::pair<int, string> >, POLICY> M;
+    M m, m2;
+    for (int i = 0; i < 10; ++i) {
+        m[i] = to_string(i);
+    }
+    auto nh = m.extract(5);
+    nh.key() = 7;
+    m2.insert(TKF::move(nh));
+    m.merge(m2);
+    m = M();
+    CHECK(m2.size() == 1);
+    CHECK(m2.begin()->first == 7 && m2.begin()->second == "5");
+
+    M a, b;
+    for (int i = 0; i < 100; ++i) {
+        a[i] = to_string(i);
+        b[i * 2] = "b";
+    }
+    a.merge(b);
+    CHECK(a.size() == 150 && b.size() == 50);
+    { M dead(TKF::move(a)); }
+    for (auto i = b.begin(); i != b.end(); ++i) {
+        CHECK(i->first % 2 == 0 && i->first < 100 && i->second == "b");
+    }
+    b.clear();
+}
+
+template <typename POLICY>
+void random_unique(mt19937& gen) {
+    typedef TKF::map<int, string, TKF::less<int>,
+        TKF::pool_allocator<TKF::pair<int, string> >, POLICY> M;
+    M m[3];
+    std::map<int, string> ref[3];
+    uniform_int_distribution<int> key(0, 200), pick(0, 2), op(0, 5);
+    for (int step = 0; step < 20000; ++step) {
+        int a = pick(gen), b = pick(gen), k = key(gen);
+        switch (op(gen)) {
+        case 0:
+            if (m[a].insert(TKF::make_pair(k, to_string(k))).second) {
+                ref[a][k] = to_string(k);
+            }
+            break;
+        case 1: {
+            auto nh = m[a].extract(k);
+            CHECK(nh.empty() == (ref[a].count(k) == 0));
+            if (nh.empty()) {
+                break;
+            }
+            string v = ref[a][k];
+            ref[a].erase(k);
+            int nk = key(gen);
+            nh.key() = nk;
+            auto res = m[b].insert(TKF::move(nh));
+            CHECK(res.inserted == (ref[b].count(nk) == 0));
+            if (res.inserted) {
+                ref[b][nk] = v;
+            }
+            else {
+                //dropped with the handle
+                CHECK(!res.node.empty() && res.node.key() == nk);
+            }
+            break;
+        }
+        case 2: {
+            auto nh = m[a].extract(k);
+            if (!nh.empty()) {
+                string v = ref[a][k];
+                ref[a].erase(k);
+                if (ref[b].count(k) == 0) {
+                    ref[b][k] = v;
+                }
+                m[b].insert(m[b].lower_bound(k), TKF::move(nh));
+            }
+            break;
+        }
+        case 3:
+            if (a != b) {
+                m[a].merge(m[b]);
+                for (auto i = ref[b].begin(); i != ref[b].end(); ) {
+                    if (ref[a].insert(*i).second) {
+                        i = ref[b].erase(i);
+                    }
+                    else {
+                        ++i;
+                    }
+                }
+            }
+            break;
+        case 4:
+            if (step % 50 == 0) {
+                //the other owners keep their nodes when one goes away
+                m[a] = M();
+                ref[a].clear();
+            }
+            break;
+        default:
+            m[a].erase(k);
+            ref[a].erase(k);
+            break;
+        }
+        CHECK(m[a].size() == ref[a].size() && m[b].size() == ref[b].size());
+    }
+    for (int i = 0; i < 3; ++i) {
+        same(m[i], ref[i]);
+        for (auto j = m[i].begin(); j != m[i].end(); ++j) {
+            CHECK(j->second == ref[i][j->first]);
+        }
+    }
+}
+
+template <typename POLICY>
+void random_multi(mt19937& gen) {
+    typedef TKF::multimap<int, string, TKF::less<int>,
+        TKF::pool_allocator<TKF::pair<int, string> >, POLICY> MM;
+    MM m[2];
+    std::multimap<int, string> ref[2];
+    uniform_int_distribution<int> key(0, 50), op(0, 3);
+    for (int step = 0; step < 5000; ++step) {
+        int a = step & 1, b = a ^ 1, k = key(gen);
+        switch (op(gen)) {
+        case 0:
+            m[a].insert(TKF::make_pair(k, string("v")));
+            ref[a].insert(make_pair(k, string("v")));
+            break;
+        case 1: {
+            auto nh = m[a].extract(k);
+            if (!nh.empty()) {
+                ref[a].erase(ref[a].find(k));
+                nh.key() = k + 1;
+                m[b].insert(TKF::move(nh));
+                ref[b].insert(make_pair(k + 1, string("v")));
+            }
+            break;
+        }
+        case 2:
+            if (step % 100 == 0) {
+                m[a].merge(m[b]);
+                ref[a].insert(ref[b].begin(), ref[b].end());
+                ref[b].clear();
+            }
+            break;
+        default:
+            if (step % 200 == 0) {
+                m[a] = MM();
+                ref[a].clear();
+            }
+            break;
+        }
+    }
+    same(m[0], ref[0]);
+    same(m[1], ref[1]);
+}
+
+//extract(key) takes the first of the equal keys, as equal_range sees
+//them; equal keys inserted later come first in a multimap
+template <typename POLICY>
+void multi_extract_first() {
+    typedef TKF::multimap<int, int, TKF::less<int>,
+        TKF::pool_allocator<TKF::pair<int, int> >, POLICY> MM;
+    MM m;
+    for (int i = 0; i < 20; ++i) {
+        m.insert(TKF::make_pair(i % 3, i));
+    }
+    CHECK(m.equal_range(1).first->second == 19);
+    for (int round = 0; round < 32; ++round) {
+        int k = round % 4;
+        auto range = m.equal_range(k);
+        size_t n = m.count(k);
+        auto nh = m.extract(k);
+        CHECK(nh.empty() == (n == 0));
+        if (!nh.empty()) {
+            CHECK(nh.key() == k && nh.mapped() == range.first->second);
+            CHECK(m.count(k) == n - 1);
+        }
+    }
+    CHECK(m.empty());
+}
+
+//a handle that outlives the map its node came from
+template <typename POLICY>
+void handle_outlives_map() {
+    typedef TKF::map<int, string, TKF::less<int>,
+        TKF::pool_allocator<TKF::pair<int, string> >, POLICY> M;
+    typename M::node_type keep;
+    {
+        M c;
+        c[7] = string(50, 'y');
+        keep = c.extract(7);
+    }
+    CHECK(keep.key() == 7);
+    M a;
+    a.insert(TKF::move(keep));
+    CHECK(keep.empty() && a.find(7)->second == string(50, 'y'));
+    {
+        M c;
+        c[1] = "x";
+        auto nh = c.extract(c.begin());
+    }
+}
+
+template <typename POLICY>
+void run(mt19937& gen) {
+    merge_keeps_collisions<POLICY>();
+    random_unique<POLICY>(gen);
+    random_multi<POLICY>(gen);
+    multi_extract_first<POLICY>();
+    handle_outlives_map<POLICY>();
+}
+
+int main() {
+    mt19937 gen(14);
+    run<TKF::RBT_plain_node>(gen);
+    run<TKF::RBT_rank_node>(gen);
+    run<TKF::RBT_compact_node>(gen);
+    run<TKF::RBT_index_node>(gen);
+    run<TKF::RBT_threaded_node>(gen);
+    cout << "map_node_test ok" << endl;
+    return 0;
+}
@@ -0,0 +1,238 @@
+//file: map_setop_test.cpp
+//join, split and the set operations of map and multimap on every node
+//policy, checked against std::map and std::multimap: sizes, order in
+//both directions, which value an equal key keeps, and that the pieces
+//stay valid whichever of them is destroyed first
+#include<map>
+#include<random>
+#include<string>
+#include<vector>
+#include<thread>
+#include"../Map.h"
+#include"check.h"
+
+using namespace std;
+
+template <typename MAP, typename REF>
+void same(MAP const& m, REF const& ref) {
+    CHECK(m.size() == ref.size());
+    typename REF::const_iterator r = ref.begin();
+    for (auto i = m.begin(); i != m.end(); ++i, ++r) {
+        CHECK(i->first == r->first && i->second == r->second);
+    }
+    typename REF::const_reverse_iterator q = ref.rbegin();
+    auto i = m.end();
+    while (i != m.begin()) {
+        --i;
+        CHECK(i->first == q->first);
+        ++q;
+    }
+}
+
+template <typename M, typename REF>
+void random_fill(M& m, REF& ref, mt19937& gen, int n, int range, string const& tag) {
+    uniform_int_distribution<int> key(0, range);
+    for (int i = 0; i < n; ++i) {
+        int k = key(gen);
+        m.insert(TKF::make_pair(k, tag));
+        ref.insert(make_pair(k, tag));
+    }
+}
+
+template <typename M>
+void split_join(mt19937& gen) {
+    for (int round = 0; round < 40; ++round) {
+        int n = round < 20 ? round : int(gen() % 5000);
+        M m;
+        std::map<int, string> ref;
+        random_fill(m, ref, gen, n, 2 * n + 1, "m");
+        int key = int(gen() % (2 * n + 3)) - 1;
+        M left, right;
+        m.split(key, left, right);
+        CHECK(m.empty());
+        std::map<int, string> ref_left(ref.begin(), ref.lower_bound(key));
+        std::map<int, string> ref_right(ref.lower_bound(key), ref.end());
+        same(left, ref_left);
+        same(right, ref_right);
+        //the halves share an arena: drop one and use the other
+        if (round & 1) {
+            left = M();
+            right.insert(TKF::make_pair(-5, string("new")));
+            ref_right[-5] = "new";
+            same(right, ref_right);
+            continue;
+        }
+        //join them back around a key between the halves
+        if (!ref_right.empty() && ref_right.begin()->first > 
+            (ref_left.empty() ? -1 : ref_left.rbegin()->first) + 1) {
+            int mid = ref_right.begin()->first - 1;
+            m.join(TKF::move(left), TKF::make_pair(mid, string("mid")), TKF::move(right));
+            CHECK(left.empty() && right.empty());
+            ref[mid] = "mid";
+            same(m, ref);
+            m.erase(mid);
+            ref.erase(mid);
+            same(m, ref);
+        }
+    }
+}
+
+//erases and inserts back every key of [from, from + n) a few times over
+template <typename M>
+void churn(M& m, int from, int n) {
+    for (int round = 0; round < 3; ++round) {
+        for (int k = from; k < from + n; ++k) {
+            m.erase(k);
+        }
+        for (int k = from; k < from + n; ++k) {
+            m.insert(TKF::make_pair(k, to_string(k)));
+        }
+    }
+}
+
+//the halves of a split own their allocators and may go to two threads
+template <typename M>
+void split_threads() {
+    const int n = 20000;
+    M m;
+    for (int k = 0; k < 2 * n; ++k) {
+        m.insert(TKF::make_pair(k, to_string(k)));
+    }
+    M left, right;
+    m.split(n, left, right);
+    thread worker([&] { churn(left, 0, n); });
+    churn(right, n, n);
+    worker.join();
+    CHECK(left.size() == size_t(n) && right.size() == size_t(n));
+    int k = 0;
+    for (auto i = left.begin(); i != left.end(); ++i, ++k) {
+        CHECK(i->first == k && i->second == to_string(k));
+    }
+    for (auto i = right.begin(); i != right.end(); ++i, ++k) {
+        CHECK(i->first == k && i->second == to_string(k));
+    }
+    //and may die on different threads, in either order
+    thread killer([&] { left = M(); });
+    m = M();
+    killer.join();
+    CHECK(right.size() == size_t(n));
+}
+
+template <typename MM>
+void multi_split_join(mt19937& gen) {
+    for (int round = 0; round < 20; ++round) {
+        MM m;
+        std::multimap<int, string> ref;
+        random_fill(m, ref, gen, int(gen() % 3000), 100, "m");
+        int key = int(gen() % 102) - 1;
+        MM left, right;
+        m.split(key, left, right);
+        std::multimap<int, string> ref_left(ref.begin(), ref.lower_bound(key));
+        std::multimap<int, string> ref_right(ref.lower_bound(key), ref.end());
+        same(left, ref_left);
+        same(right, ref_right);
+        //equal keys on both sides of the joined value
+        MM joined;
+        joined.join(TKF::move(left), TKF::make_pair(key, string("mid")), TKF::move(right));
+        ref_left.insert(make_pair(key, string("mid")));
+        ref_left.insert(ref_right.begin(), ref_right.end());
+        CHECK(joined.size() == ref_left.size());
+        auto r = ref_left.begin();
+        for (auto i = joined.begin(); i != joined.end(); ++i, ++r) {
+            CHECK(i->first == r->first);
+        }
+    }
+}
+
+template <typename M>
+void set_operations(mt19937& gen) {
+    for (int round = 0; round < 30; ++round) {
+        int n = int(gen() % 4000), m = round % 3 == 0 ? int(gen() % 50) : int(gen() % 4000);
+        int range = 1 + int(gen() % 8000);
+        for (int op = 0; op < 3; ++op) {
+            M a, b;
+            std::map<int, string> ra, rb;
+            random_fill(a, ra, gen, n, range, "a");
+            random_fill(b, rb, gen, m, range, "b");
+            std::map<int, string> expect;
+            if (op == 0) {
+                a.unite(TKF::move(b));
+                expect = ra;
+                expect.insert(rb.begin(), rb.end());
+            }
+            else if (op == 1) {
+                a.intersect(TKF::move(b));
+                for (auto i = ra.begin(); i != ra.end(); ++i) {
+                    if (rb.count(i->first)) {
+                        expect.insert(*i);
+                    }
+                }
+            }
+            else {
+                a.subtract(TKF::move(b));
+                for (auto i = ra.begin(); i != ra.end(); ++i) {
+                    if (!rb.count(i->first)) {
+                        expect.insert(*i);
+                    }
+                }
+            }
+            CHECK(b.empty());
+            same(a, expect);
+            //b took over nothing: it must still work on its own
+            b.insert(TKF::make_pair(1, string("b")));
+            CHECK(b.size() == 1);
+            //and a owns every node it kept
+            b = M();
+            same(a, expect);
+        }
+    }
+    //with itself
+    M a;
+    std::map<int, string> ra;
+    random_fill(a, ra, gen, 1000, 2000, "a");
+    M copy(a);
+    a.unite(TKF::move(copy));
+    same(a, ra);
+}
+
+template <typename MM>
+void multi_merge(mt19937& gen) {
+    for (int round = 0; round < 20; ++round) {
+        MM a, b;
+        std::multimap<int, string> ra, rb;
+        random_fill(a, ra, gen, int(gen() % 3000), 200, "a");
+        random_fill(b, rb, gen, int(gen() % 3000), 200, "b");
+        a.merge(b);
+        ra.insert(rb.begin(), rb.end());
+        CHECK(b.empty());
+        //equal keys: a's come first, then b's
+        same(a, ra);
+    }
+}
+
+template <typename POLICY>
+void run(mt19937& gen) {
+    typedef TKF::pool_allocator<TKF::pair<int, string> > A;
+    typedef TKF::map<int, string, TKF::less<int>, A, POLICY> M;
+    typedef TKF::multimap<int, string, TKF::less<int>, A, POLICY> MM;
+    split_join<M>(gen);
+    split_threads<M>();
+    multi_split_join<MM>(gen);
+    set_operations<M>(gen);
+    multi_merge<MM>(gen);
+    //the other allocator has no arena to share
+    typedef TKF::allocator<TKF::pair<int, string> > B;
+    split_join<TKF::map<int, string, TKF::less<int>, B, POLICY> >(gen);
+    set_operations<TKF::map<int, string, TKF::less<int>, B, POLICY> >(gen);
+}
+
+int main() {
+    mt19937 gen(4);
+    run<TKF::RBT_plain_node>(gen);
+    run<TKF::RBT_rank_node>(gen);
+    run<TKF::RBT_compact_node>(gen);
+    run<TKF::RBT_index_node>(gen);
+    run<TKF::RBT_threaded_node>(gen);
+    cout << "map_setop_test ok" << endl;
+    return 0;
+}
@@ -0,0 +1,73 @@
+//file: map_stats_test.cpp
+//the counters of RBT_stats against a comparator that counts its own
+//calls: every comparison the tree makes, in lookups, building and the
+//set operations, must show up exactly once in stats().comparisons
+#include<atomic>
+#include<random>
+#include<vector>
+#include"../Map.h"
+#include"check.h"
+
+using namespace std;
+
+static atomic<uint64_t> calls(0);
+
+struct counting_less {
+    bool operator () (int lhs, int rhs) const {
+        ++calls;
+        return lhs <= rhs;
+    }
+};
+
+typedef TKF::map<int, int, counting_less, 
+    TKF::pool_allocator<TKF::pair<int, int> >, 
+    TKF::RBT_plain_node, TKF::RBT_stats> M;
+
+//big enough for the set operations and the build to fork without stats
+static const int n = 200000;
+
+static void fill(M& m, vector<TKF::pair<int, int> > const& values) {
+    M tmp(values.data(), values.data() + values.size());
+    m = TKF::move(tmp);
+}
+
+int main() {
+    mt19937 gen(18);
+    vector<TKF::pair<int, int> > a, b;
+    for (int i = 0; i < n; ++i) {
+        a.push_back(TKF::make_pair(int(gen() % (4 * n)), i));
+        b.push_back(TKF::make_pair(int(gen() % (4 * n)), i));
+    }
+
+    //building from an unsorted range sorts with the tree's comparator
+    calls = 0;
+    M m(a.data(), a.data() + a.size());
+    CHECK(m.stats().comparisons == calls);
+
+    for (int op = 0; op < 3; ++op) {
+        M rhs;
+        fill(m, a);
+        fill(rhs, b);
+        m.reset_stats();
+        calls = 0;
+        if (op == 0) {
+            m.unite(TKF::move(rhs));
+        }
+        else if (op == 1) {
+            m.intersect(TKF::move(rhs));
+        }
+        else {
+            m.subtract(TKF::move(rhs));
+        }
+        CHECK(m.stats().comparisons == calls);
+    }
+
+    m.reset_stats();
+    calls = 0;
+    for (int i = 0; i < 1000; ++i) {
+        m.find(int(gen() % (4 * n)));
+    }
+    CHECK(m.stats().comparisons == calls && m.stats().searches == 1000);
+    cout << "map_stats_test ok" << endl;
+    return 0;
+}